@@ -13,6 +13,7 @@
 #include <sys/stat.h>
 #include <sys/un.h>
 #include <termios.h>
+#include <fcntl.h>
 #include <errno.h>
 
 #include <libv/libv.h>
@@ -32,6 +33,9 @@
 #define E_OBJECT V_NUM_OBJECTS - 2
 #define I_OBJECT V_NUM_OBJECTS - 1
 
+/* the control socket of the daemon, next to the session sockets */
+#define V_DAEMON_SOCKNAME ".vtachd"
+
 struct v_prop {
   char
     *current_dir,
@@ -44,6 +48,7 @@ struct v_prop {
     always_connect;
 
   string_t
+    *ctlname,
     *data_dir,
     *as_sockname;
 
@@ -64,8 +69,16 @@ static const char usage[] =
   "    -s, --sockname=     set the socket name [required if --as= missing]\n"
   "        --as=           create the socket name in an inner environment [required if -s is missing]\n"
   "    -a, --attach        attach to the specified socket\n"
+  "        --read-only     attach as a viewer, that gets snapshots of the screen\n"
+  "        --rate=         the milliseconds between two snapshots of a viewer\n"
+  "        --daemon        host the session in the daemon of the socket directory\n"
+  "        --upgrade       take over the sessions of the running master (or daemon)\n"
   "    -f, --force         connect to socket, even when socket exists\n"
   "        --send          send data to the specified socket from standard input\n"
+  "        --file=         with --send, send this file instead\n"
+  "        --win=          with --send, the window (index or name) [default: the current]\n"
+  "        --frame=        with --send, the frame (index or command name) [default: the current]\n"
+  "        --stats         print the metrics of the session and exit\n"
   "        --exit          create the socket, fork and then exit\n"
   "        --remove-socket remove socket if exists and can not be connected\n"
   "        --loadfile=     load file for evaluation\n"
@@ -165,7 +178,7 @@ private int v_set_current_dir (v_t *this, char *dir, int is_malloced) {
   if (-1 is chdir (cwd)) return NOTOK;
 
   ifnot (NULL is $my(current_dir))
-    free ($my(current_dir));
+    Free ($my(current_dir));
 
   if (is_malloced)
     $my(current_dir) = cwd;
@@ -179,7 +192,7 @@ private void v_set_image_file (v_t *this, char *name) {
   if (NULL is name) return;
 
   ifnot (NULL is $my(image_file))
-    free ($my(image_file));
+    Free ($my(image_file));
 
   char *cwd = NULL;
 
@@ -213,7 +226,7 @@ private void v_set_image_name (v_t *this, char *name) {
   if (NULL is name) return;
 
   ifnot (NULL is $my(image_name))
-    free ($my(image_name));
+    Free ($my(image_name));
 
   $my(image_name) = Cstring.dup (name, bytelen (name));
 }
@@ -294,7 +307,7 @@ private int v_save_image (v_t *this, char *fname) {
     Vwm.get.num_wins (vwm),
     cur_win_idx);
 
-  free (cwd);
+  Free (cwd);
 
   int num_wins = Vwm.get.num_wins (vwm);
 
@@ -570,54 +583,73 @@ private int v_send (v_t *this, char *sockname, char *data) {
   int s = Vtach.sock.connect (vtach, sockname);
   if (s is NOTOK) return 1;
 
-  size_t max_size = Vtach.get.sock_max_data_size (vtach);
-  char buf[max_size];
   int retval = 0;
 
-  if (data isnot NULL) {
-    size_t len = bytelen (data);
-    int num = len;
-    char *sp = data;
-
-    while (num > 0) {
-      size_t n = 0;
-      for (;n < max_size and n < len; n++)
-        buf[n] = *sp++;
-
-      if (NOTOK is Vtach.sock.send_data (vtach, s, buf, n, MSG_PUSH)) {
-        retval = NOTOK;
-        goto theend;
-      }
+  if (NOTOK is Vtach.sock.hello (vtach, s)) {
+    fprintf (stderr, "%s: handshake failed\n", sockname);
+    retval = 1;
+    goto theend;
+  }
+
+  /* the input goes to this window and frame (by index or by name), or
+   * to the focused ones; it is sent as fast as the program takes it */
+  char *win = $my(opts)->send_win;
+  char *frame = $my(opts)->send_frame;
 
-      len -= n;
-      num -= n;
+  if (data isnot NULL) {
+    if (NOTOK is Vtach.sock.send_input (vtach, s, win, frame, data, bytelen (data))) {
+      fprintf (stderr, "%s: %s\n", sockname, strerror (errno));
+      retval = 1;
     }
 
     goto theend;
   }
 
-  if ($my(input_fd) is 0) { // read from the pipe
-    retval = 1;
-    goto theend;
-  }
+  int fd = $my(input_fd);
 
-  for (;;) {
-    ssize_t len = read ($my(input_fd), buf, max_size);
-    if (0 is len) goto theend;
-    if (len < 0) {
+  if ($my(opts)->send_file isnot NULL) {
+    if (-1 is (fd = open ($my(opts)->send_file, O_RDONLY))) {
+      fprintf (stderr, "%s: %s\n", $my(opts)->send_file, strerror (errno));
       retval = 1;
-      fprintf (stderr, "error while reading from stdin\n");
       goto theend;
     }
+  } else if (fd is 0) { // read from the pipe
+    retval = 1;
+    goto theend;
+  }
 
-    retval = Vtach.sock.send_data (vtach, s, buf, len, MSG_PUSH);
+  if (NOTOK is Vtach.sock.send_file (vtach, s, win, frame, fd)) {
+    fprintf (stderr, "%s: %s\n", sockname, strerror (errno));
+    retval = 1;
   }
 
+  if (fd isnot $my(input_fd))
+    close (fd);
+
 theend:
   close (s);
   return retval;
 }
 
+/* the metrics of the session and of the programs in its frames, in the
+ * text exposition format of prometheus */
+private int v_stats (v_t *this, char *sockname) {
+  vtach_t *vtach = $my(objects)[VTACH_OBJECT];
+  int s = Vtach.sock.connect (vtach, sockname);
+  if (s is NOTOK) return 1;
+
+  int retval = 0;
+
+  if (NOTOK is Vtach.sock.hello (vtach, s) or
+      NOTOK is Vtach.sock.stats (vtach, s, STDOUT_FILENO)) {
+    fprintf (stderr, "%s: can not get the metrics\n", sockname);
+    retval = 1;
+  }
+
+  close (s);
+  return retval;
+}
+
 private ival_t i_v_get (i_t *__i) {
   return (ival_t) I.get.object (__i);
 }
@@ -683,7 +715,7 @@ private ival_t i_v_set_size (i_t *__i, v_t *this) {
 private ival_t i_v_set_sockname (i_t *__i, v_t *this, char *sockname) {
   (void) __i;
   $my(as_sockname) = String.new_with (sockname);
-  free (sockname);
+  Free (sockname);
   return I_OK;
 }
 
@@ -691,7 +723,7 @@ private ival_t i_v_set_frame_command (i_t *__i, v_t *this, vwm_frame *frame, cha
   (void) __i;
   vwm_t *vwm = $my(objects)[VWM_OBJECT];
   Vframe.set.command (frame, command);
-  free (command);
+  Free (command);
   return I_OK;
 }
 
@@ -705,7 +737,7 @@ private ival_t i_v_set_frame_visibility (i_t *__i, v_t *this, vwm_frame *frame,
 private ival_t i_sys_set_current_dir (i_t* __i, char *dir) {
   (void) __i;
   int retval = chdir (dir);
-  free (dir);
+  Free (dir);
   return retval;
 }
 
@@ -713,21 +745,21 @@ private ival_t i_v_set_frame_log (i_t *__i, v_t *this, vwm_frame *frame, char *f
   (void) __i;
   vwm_t *vwm = $my(objects)[VWM_OBJECT];
   Vframe.set.log (frame, fname, val);
-  free (fname);
+  Free (fname);
   return I_OK;
 }
 
 private ival_t i_v_set_image_file (i_t *__i, v_t *this, char *fn) {
   (void) __i;
   self(set.image_file, fn);
-  free (fn);
+  Free (fn);
   return I_OK;
 }
 
 private ival_t i_v_set_image_name (i_t *__i, v_t *this, char *name) {
   (void) __i;
   self(set.image_name, name);
-  free (name);
+  Free (name);
   return I_OK;
 }
 
@@ -908,8 +940,16 @@ private int v_main (v_t *this) {
       OPT_STRING('s', "sockname", &sockname, "set the socket name [required if --as= missing]", NULL, 0, 0),
       OPT_STRING(0, "loadfile", &loadfile, "load file for evaluation", NULL, 0, 0), 
       OPT_BOOLEAN('a', "attach", &opts->attach, "attach to the specified socket", NULL, 0, 0),
+      OPT_BOOLEAN(0, "read-only", &opts->read_only, "attach as a viewer, that gets snapshots of the screen", NULL, 0, 0),
+      OPT_INTEGER(0, "rate", &opts->rate, "the milliseconds between two snapshots of a viewer", NULL, 0, 0),
+      OPT_BOOLEAN(0, "daemon", &opts->daemon, "host the session in the daemon of the socket directory", NULL, 0, 0),
+      OPT_BOOLEAN(0, "upgrade", &opts->upgrade, "take over the sessions of the running master (or daemon)", NULL, 0, 0),
       OPT_BOOLEAN(0, "force", &opts->force, "connect to socket, even when socket exists", NULL, 0, 0),
       OPT_BOOLEAN(0, "send", &opts->send_data, "send data to the specified socket", NULL, 0, 0),
+      OPT_STRING(0, "file", &opts->send_file, "with --send, send this file instead of the standard input", NULL, 0, 0),
+      OPT_STRING(0, "win", &opts->send_win, "with --send, the window (index or name) [default: the current]", NULL, 0, 0),
+      OPT_STRING(0, "frame", &opts->send_frame, "with --send, the frame (index or command name) [default: the current]", NULL, 0, 0),
+      OPT_BOOLEAN(0, "stats", &opts->stats, "print the metrics of the session and exit", NULL, 0, 0),
       OPT_BOOLEAN(0, "exit", &opts->exit, "create the socket, fork and then exit", NULL, 0, 0),
       OPT_BOOLEAN(0, "remove-socket", &opts->remove_socket, "remove socket if exists and can not be connected", NULL, 0, 0),
       OPT_END()
@@ -922,6 +962,10 @@ private int v_main (v_t *this) {
 
   if (argc is -1) return 0;
 
+  /* a viewer attaches, but it can not type */
+  if (opts->read_only)
+    opts->attach = 1;
+
   ifnot (NULL is loadfile)
     return v_loadfile (this, loadfile);
 
@@ -941,7 +985,7 @@ private int v_main (v_t *this) {
 
   if (opts->exit_on_no_command) {
     if (argc is 0 or argv is NULL) {
-      if ((0 is opts->attach and 0 is opts->send_data)) {
+      if ((0 is opts->attach and 0 is opts->send_data and 0 is opts->upgrade and 0 is opts->stats)) {
         fprintf (stderr, "command hasn't been set\n");
         fprintf (stderr, "%s", usage);
         return 1;
@@ -950,7 +994,7 @@ private int v_main (v_t *this) {
   }
 
   if (File.exists (sockname)) {
-    if (0 is opts->attach and 0 is opts->send_data) {
+    if (0 is opts->attach and 0 is opts->send_data and 0 is opts->upgrade and 0 is opts->stats) {
       ifnot (opts->force) {
         ifnot (opts->remove_socket) {
           fprintf (stderr, "%s: exists in the filesystem\n", sockname);
@@ -965,12 +1009,12 @@ private int v_main (v_t *this) {
     }
 
     int fd = Vtach.sock.connect (vtach, sockname);
-    if (0 is opts->attach and 0 is opts->send_data)
+    if (0 is opts->attach and 0 is opts->send_data and 0 is opts->upgrade and 0 is opts->stats)
       if (opts->remove_socket)
         unlink (sockname);
 
     if (NOTOK is fd) {
-      if (opts->attach or opts->send_data) {
+      if (opts->attach or opts->send_data or opts->upgrade or opts->stats) {
         if (opts->remove_socket)
           unlink (sockname);
         fprintf (stderr, "can not connect/attach to the socket\n");
@@ -980,7 +1024,11 @@ private int v_main (v_t *this) {
       close (fd);
   }
 
-  if (0 is opts->send_data or (opts->send_data and data isnot NULL)) {
+  if (opts->stats)
+    return v_stats (this, sockname);
+
+  if (0 is opts->upgrade and
+     (0 is opts->send_data or (opts->send_data and data isnot NULL))) {
     if (0 is isatty (fileno (stdin))) {
       fprintf (stderr, "Not a controlled terminal\n");
       return 1;
@@ -993,6 +1041,20 @@ private int v_main (v_t *this) {
   if (NOTOK is Vtach.init.pty (vtach, sockname))
     return 1;
 
+  /* one process hosts the sessions of the directory; the socket of each
+   * session still works as before */
+  if (opts->daemon) {
+    char *sp = strrchr (sockname, '/');
+    $my(ctlname) = String.new (64);
+    if (sp) String.append_with_len ($my(ctlname), sockname, sp - sockname + 1);
+    String.append ($my(ctlname), V_DAEMON_SOCKNAME);
+    Vtach.set.daemon (vtach, $my(ctlname)->bytes);
+  }
+
+  /* this build takes over the running sessions, which go on without a restart */
+  if (opts->upgrade)
+    return (OK is Vtach.pty.upgrade (vtach) ? 0 : 1);
+
   ifnot (opts->attach) {
     vwmed_t *vwmed = $my(objects)[VWMED_OBJECT];
     Vwmed.init.ved (vwmed);
@@ -1007,6 +1069,9 @@ private int v_main (v_t *this) {
   if (opts->exit)
     return 0;
 
+  if (opts->read_only)
+    Vtach.set.view (vtach, opts->rate);
+
   return Vtach.tty.main (vtach);
 }
 
@@ -1046,6 +1111,7 @@ public v_t *__init_v__ (vwm_t *vwm, v_opts *opts) {
   $my(image_file) = NULL;
   $my(image_name) = NULL;
   $my(as_sockname) = NULL;
+  $my(ctlname) = NULL;
   $my(current_dir) = NULL;
   $my(data_dir) = NULL;
   $my(save_image) = 0;
@@ -1114,11 +1180,12 @@ public void __deinit_v__ (v_t **thisp) {
   v_t *this = *thisp;
 
   String.free ($my(as_sockname));
+  String.free ($my(ctlname));
   self(unset.data_dir);
 
-  ifnot (NULL is $my(image_file)) free ($my(image_file));
-  ifnot (NULL is $my(image_name)) free ($my(image_name));
-  ifnot (NULL is $my(current_dir)) free ($my(current_dir));
+  ifnot (NULL is $my(image_file)) Free ($my(image_file));
+  ifnot (NULL is $my(image_name)) Free ($my(image_name));
+  ifnot (NULL is $my(current_dir)) Free ($my(current_dir));
 
   vtach_t *vtach = $my(objects)[VTACH_OBJECT];
   vwmed_t *vwmed = $my(objects)[VWMED_OBJECT];
@@ -1130,7 +1197,7 @@ public void __deinit_v__ (v_t **thisp) {
 
   tcsetattr ($my(input_fd), TCSAFLUSH, &$my(orig_mode));
 
-  free (this->prop);
-  free (this);
+  Free (this->prop);
+  Free (this);
   *thisp = NULL;
 }
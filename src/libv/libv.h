@@ -14,14 +14,22 @@ typedef struct v_init_opts {
     *data,
     *loadfile,
     *sockname,
+    *send_win,
+    *send_file,
+    *send_frame,
     **argv;
 
   int
     argc,
     exit,
+    rate,
     force,
     attach,
+    daemon,
+    upgrade,
     send_data,
+    read_only,
+    stats,
     parse_argv,
     remove_socket,
     exit_on_no_command;
@@ -36,12 +44,20 @@ typedef struct v_init_opts {
   .data = NULL,            \
   .loadfile = NULL,        \
   .sockname = NULL,        \
+  .send_win = NULL,        \
+  .send_file = NULL,       \
+  .send_frame = NULL,      \
   .argv = NULL,            \
   .argc = 0,               \
   .exit = 0,               \
+  .rate = 0,               \
   .force = 0,              \
   .attach = 0,             \
+  .daemon = 0,             \
+  .upgrade = 0,            \
   .send_data = 0,          \
+  .read_only = 0,          \
+  .stats = 0,              \
   .parse_argv = 1,         \
   .remove_socket = 0,      \
   .at_pty_main = NULL,     \
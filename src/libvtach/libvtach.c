@@ -1,8 +1,8 @@
-#define _POSIX_C_SOURCE 200809L
-#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/types.h>
@@ -12,13 +12,18 @@
 #include <string.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <sched.h>
 #include <time.h>
 #include <pty.h>
 #include <termios.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
 #include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
+#include <sys/wait.h>
 
 #include <libv/libvwm.h>
 #include <libv/libvtach.h>
@@ -32,7 +37,7 @@
 #define Vframe ((vwm_t *) $my(objects)[VWM_OBJECT])->frame
 #define Vterm  ((vwm_t *) $my(objects)[VWM_OBJECT])->term
 
-#define SOCKET_MAX_DATA_SIZE (sizeof (struct winsize))
+#define SOCKET_MAX_DATA_SIZE VTACH_MAX_DATA_SIZE
 
 enum
 {
@@ -42,29 +47,213 @@ enum
   REDRAW_WINCH  = 3,
 };
 
-struct packet {
-  unsigned char type;
-  unsigned char len;
-  union {
-    unsigned char buf[SOCKET_MAX_DATA_SIZE];
-    struct winsize ws;
-  } u;
-};
-
+/* the message header, in host byte order, as both ends live on the same host */
+typedef struct msg_hdr {
+  uint32_t len;
+  uint8_t  type;
+  uint8_t  flags;
+  uint16_t arg;
+} msg_hdr;
+
+#define MSG_HDR_SIZE     sizeof (msg_hdr)
+#define MSG_READER_SIZE  (MSG_HDR_SIZE + SOCKET_MAX_DATA_SIZE)
+
+/* the most descriptors that come with a message: the socket and the pty of
+ * a session, the memory where its program publishes its metrics, and the
+ * eventfd that wakes the program for them */
+#define MSG_MAX_FDS 4
+
+/* buffers the stream of a socket, until it holds complete messages */
+typedef struct msg_reader {
+  unsigned char *buf;
+  size_t
+    pos,
+    len;
+} msg_reader;
+
+/* metrics is shared with the program, that writes its metrics there (see
+ * Vwm.set.metrics()); metrics_fd is a memfd, so it can be handed over;
+ * the program polls metrics_wake, an eventfd, so a reader does not wait
+ * for a turn of an idle program */
 struct pty {
   int fd;
   pid_t pid;
   struct termios term;
   struct winsize ws;
+
+  int
+    metrics_fd,
+    metrics_wake;
+
+  vwm_metrics *metrics;
+};
+
+/* A complete message, shared by the queues of all the clients it goes to. */
+struct chunk {
+  int refs;
+  size_t len;
+  unsigned char data[];
+};
+
+/* is_rest: the rest of a message whose start went through the pipe */
+struct qentry {
+  struct chunk *chunk;
+  struct qentry *next;
+  int is_rest;
+};
+
+#define CLIENT_QUEUE_MAX_SIZE (1 << 20)
+
+/* Input for the program is queued, and written as the pty takes it, so the
+ * program holds back only the client that sends it. With ack, the client
+ * (of MSG_SEND) is told once it has been written. */
+struct input {
+  struct input *next;
+  struct client *client;
+  int ack;
+  size_t
+    len,
+    off;
+  unsigned char data[];
 };
 
+/* the MSG_SEND messages that a sender has on their way */
+#define SEND_WINDOW 4
+
+/* the milliseconds between the snapshots of a viewer */
+#define VIEW_DEFAULT_MS 200
+#define VIEW_MIN_MS     20
+
+/* the recent output, that a client that resumes might miss */
+#define REPLAY_RING_SIZE (1 << 20)
+
+/* reconnections in a row, without output in between */
+#define MAX_RECONNECTS 3
+
+struct session;
+
+/* The server side of a connection. Its output is queued and written as the
+ * socket accepts it, so a client that does not read, never blocks the pty.
+ * qoff is how much of the head chunk has been written.
+ *
+ * With zero copy, the output goes first to the pipe of the client, with
+ * tee(2) from the pipe that the pty is spliced into, and from there to
+ * the socket with splice(2). The pipe is drained before the queue.
+ *
+ * A client is not read while its input is queued (in_pending), and the
+ * messages that it had already sent, wait in the reader (in_held).
+ *
+ * A viewer (view_ms) is not attached; it gets a snapshot of the screen
+ * once view_next has come, if there was output since the last (view_seq)
+ * and it took that. */
 struct client {
   struct client *next;
   struct client **pprev;
+  struct session *ss;
   int fd;
   int attached;
+  int said_hello;
+  int needs_repaint;
+  int in_pending;
+  int in_held;
+  int view_ms;
+  long view_next;
+  uint64_t view_seq;
+  msg_reader rd;
+
+  int pipe[2];
+  size_t
+    pipe_len,
+    pipe_size;
+  ssize_t tee_len;
+
+  int
+    fds[MSG_MAX_FDS],
+    num_fds;
+
+  struct qentry
+    *qhead,
+    *qtail;
+
+  size_t
+    qoff,
+    qsize;
+};
+
+/* A session: the pty of a program, the clients that connected to its
+ * socket, and what repaints and resumes them. The master of a session
+ * serves just that; a daemon serves every session that is handed to it,
+ * behind one select() loop, and its sockets remain the way to them. */
+struct session {
+  struct session *next;
+  char *name;
+  int s;
+  int waitattach;
+  int has_attached_client;
+  int render_signals;
+  struct pty pty;
+  struct client *clients;
+
+  struct input
+    *in_head,
+    *in_tail;
+
+  vwm_win *win;
+  vwm_frame *screen;
+
+  unsigned char *ring;
+  size_t ring_size;
+  uint64_t out_seq;
+
+  int fan[2];
+};
+
+/* the payload of MSG_ADD, followed by the path of the socket; the socket
+ * and the pty come as descriptors */
+typedef struct vtach_session_msg {
+  pid_t pid;
+  struct winsize ws;
+  int render_signals;
+} vtach_session_msg;
+
+/* An upgrade is a series of MSG_UPGRADE messages from the old master to the
+ * new one, that its argument tells apart: the control socket (with its path),
+ * then each session (vtach_handover_session and its path, with its socket
+ * and its pty) followed by its screen as MSG_REDRAW, its ring as MSG_OUTPUT,
+ * and its clients (vtach_handover_client and the bytes of the message that
+ * it was in the middle of, with its socket). The new master replies to
+ * HANDOVER_DONE, and the old one exits. */
+enum {
+  HANDOVER_DONE    = 0,
+  HANDOVER_CTL     = 1,
+  HANDOVER_SESSION = 2,
+  HANDOVER_CLIENT  = 3
 };
 
+typedef struct vtach_handover_session {
+  pid_t pid;
+  struct winsize ws;
+  int waitattach;
+  int render_signals;
+  uint64_t out_seq;
+  uint64_t ring_len;
+} vtach_handover_session;
+
+typedef struct vtach_handover_client {
+  int attached;
+  int said_hello;
+  int needs_repaint;
+} vtach_handover_client;
+
+/* how long the old master waits for its clients to take what it has queued */
+#define HANDOVER_FLUSH_MS 250
+
+/* how long a reader of the metrics waits for the program to publish them */
+#define PROGRAM_METRICS_WAIT_MS 200
+
+/* the seconds a daemon without sessions waits, before it goes */
+#define DAEMON_IDLE_TIMEOUT 10
+
 struct vtach_prop {
   vwm_term *term;
 
@@ -78,10 +267,18 @@ struct vtach_prop {
 
   int
     waitattach,
-    dont_have_tty;
+    dont_have_tty,
+    overflow_policy,
+    view_ms,
+    render_signals,
+    zero_copy;
 
-  struct client *clients;
   struct pty pty;
+  struct session *sessions;
+
+  char *ctlname;
+  int ctl_s;
+  struct client *ctl_clients;
 
   void *objects[NUM_OBJECTS];
 
@@ -173,23 +370,403 @@ private int vtach_sock_connect (vtach_t *this, char *sockname) {
   return s;
 }
 
-private int vtach_sock_send_data (vtach_t *this, int s, char *data, size_t len, int type) {
+/* writes all the vectors; the server sockets are non-blocking, so wait
+ * when they are full, as a message can not be left half written */
+private int sock_writev (int fd, struct iovec *iov, int iovcnt) {
+  while (iovcnt) {
+    ssize_t n = writev (fd, iov, iovcnt);
+
+    if (n < 0) {
+      if (errno is EINTR) continue;
+      if (errno isnot EAGAIN) return NOTOK;
+
+      fd_set writefds;
+      FD_ZERO(&writefds);
+      FD_SET(fd, &writefds);
+      if (select (fd + 1, NULL, &writefds, NULL, NULL) < 0 and errno isnot EINTR)
+        return NOTOK;
+
+      continue;
+    }
+
+    while (iovcnt and (size_t) n >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+
+    if (iovcnt) {
+      iov->iov_base = (char *) iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+
+  return OK;
+}
+
+private int fd_write_all (int fd, void *buf, size_t len) {
+  struct iovec iov = {.iov_base = buf, .iov_len = len};
+  return sock_writev (fd, &iov, 1);
+}
+
+private int vtach_sock_send_msg (vtach_t *this, int s, int type, int arg, char *data, size_t len) {
   (void) this;
+  if (len > SOCKET_MAX_DATA_SIZE or (len and NULL is data)) return NOTOK;
+
+  msg_hdr hdr = {.len = len, .type = type, .flags = 0, .arg = arg};
+
+  struct iovec iov[2] = {
+    {.iov_base = &hdr, .iov_len = MSG_HDR_SIZE},
+    {.iov_base = data, .iov_len = len}
+  };
+
+  return sock_writev (s, iov, (len ? 2 : 1));
+}
+
+/* data of any size, in messages of at most SOCKET_MAX_DATA_SIZE */
+private int vtach_sock_send_data (vtach_t *this, int s, char *data, size_t len, int type) {
+  if (NULL is data) return NOTOK;
+
+  do {
+    size_t n = (len > SOCKET_MAX_DATA_SIZE ? SOCKET_MAX_DATA_SIZE : len);
+    if (NOTOK is self(sock.send_msg, s, type, 0, data, n))
+      return NOTOK;
+
+    data += n;
+    len -= n;
+  } while (len);
+
+  return OK;
+}
+
+/* a message with descriptors, on a blocking socket */
+private int sock_send_fds (int s, int type, int arg, char *data, size_t len, int *fds, int num_fds) {
+  msg_hdr hdr = {.len = len, .type = type, .flags = 0, .arg = arg};
+
+  struct iovec iov[2] = {
+    {.iov_base = &hdr, .iov_len = MSG_HDR_SIZE},
+    {.iov_base = data, .iov_len = len}
+  };
+
+  char cbuf[CMSG_SPACE (sizeof (int) * MSG_MAX_FDS)];
+  memset (cbuf, 0, sizeof (cbuf));
+
+  struct msghdr mh = {
+    .msg_iov = iov, .msg_iovlen = 2,
+    .msg_control = cbuf, .msg_controllen = CMSG_SPACE (sizeof (int) * num_fds)};
+
+  struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+  cm->cmsg_level = SOL_SOCKET;
+  cm->cmsg_type = SCM_RIGHTS;
+  cm->cmsg_len = CMSG_LEN (sizeof (int) * num_fds);
+  memcpy (CMSG_DATA(cm), fds, sizeof (int) * num_fds);
+
+  ssize_t n;
+  while (-1 is (n = sendmsg (s, &mh, 0)))
+    if (errno isnot EINTR) return NOTOK;
+
+  /* the descriptors went with the first byte; the rest is plain data */
+  if ((size_t) n < MSG_HDR_SIZE + len) {
+    char *all = Alloc (MSG_HDR_SIZE + len);
+    memcpy (all, &hdr, MSG_HDR_SIZE);
+    memcpy (all + MSG_HDR_SIZE, data, len);
+    int r = fd_write_all (s, all + n, MSG_HDR_SIZE + len - n);
+    Free (all);
+    return r;
+  }
+
+  return OK;
+}
+
+private int sock_read_all (int fd, void *buf, size_t len) {
+  size_t nread = 0;
+
+  while (nread < len) {
+    ssize_t n = read (fd, (char *) buf + nread, len - nread);
+    if (n < 0 and errno is EINTR) continue;
+    if (n <= 0) return NOTOK;
+    nread += n;
+  }
+
+  return OK;
+}
+
+/* a message on a blocking socket, with the descriptors that came with it
+ * (they come with the first byte, so with the header); data has room for
+ * SOCKET_MAX_DATA_SIZE */
+private int sock_recv_msg (int s, msg_hdr *hdr, unsigned char *data, int *fds, int *num_fds) {
+  struct iovec iov = {.iov_base = hdr, .iov_len = MSG_HDR_SIZE};
+  char cbuf[CMSG_SPACE (sizeof (int) * MSG_MAX_FDS)];
+  struct msghdr mh = {
+    .msg_iov = &iov, .msg_iovlen = 1,
+    .msg_control = cbuf, .msg_controllen = sizeof (cbuf)};
+
+  *num_fds = 0;
+
+  ssize_t n;
+  while (-1 is (n = recvmsg (s, &mh, MSG_CMSG_CLOEXEC)))
+    if (errno isnot EINTR) return NOTOK;
+
+  if (n is 0) return NOTOK;
+
+  for (struct cmsghdr *cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm)) {
+    if (cm->cmsg_level isnot SOL_SOCKET or cm->cmsg_type isnot SCM_RIGHTS)
+      continue;
+
+    int num = (cm->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+    int *cfds = (int *) CMSG_DATA(cm);
+
+    for (int i = 0; i < num; i++)
+      if (*num_fds < MSG_MAX_FDS)
+        fds[(*num_fds)++] = cfds[i];
+      else
+        close (cfds[i]);
+  }
+
+  if ((size_t) n < MSG_HDR_SIZE and
+      NOTOK is sock_read_all (s, (char *) hdr + n, MSG_HDR_SIZE - n))
+    return NOTOK;
+
+  if (hdr->len > SOCKET_MAX_DATA_SIZE)
+    return NOTOK;
+
+  return sock_read_all (s, data, hdr->len);
+}
+
+/* the reply to a MSG_SEND; what else comes meanwhile is skipped */
+private int sock_send_reply (int s) {
+  unsigned char buf[256];
+  msg_hdr hdr;
+
+  for (;;) {
+    if (NOTOK is sock_read_all (s, &hdr, MSG_HDR_SIZE))
+      return NOTOK;
+
+    for (size_t len = hdr.len; len;) {
+      size_t n = (len > sizeof (buf) ? sizeof (buf) : len);
+      if (NOTOK is sock_read_all (s, buf, n))
+        return NOTOK;
+      len -= n;
+    }
+
+    if (hdr.type isnot MSG_SEND)
+      continue;
+
+    if (hdr.arg) {
+      errno = hdr.arg;
+      return NOTOK;
+    }
+
+    return OK;
+  }
+}
+
+/* Input for a window and a frame, from fd (when it isn't -1) or from data,
+ * in messages of the maximum size; a message is sent once there are less
+ * than SEND_WINDOW unanswered, so the sender goes as fast as the program
+ * takes it. */
+private int sock_send_input (vtach_t *this, int s, char *win, char *frame, int fd, char *data, size_t len) {
+  if (NULL is win) win = "";
+  if (NULL is frame) frame = "";
+
+  size_t winlen = bytelen (win) + 1;
+  size_t namelen = winlen + bytelen (frame) + 1;
+  if (namelen >= SOCKET_MAX_DATA_SIZE) {
+    errno = EINVAL;
+    return NOTOK;
+  }
+
+  size_t max_len = SOCKET_MAX_DATA_SIZE - namelen;
+  char *buf = Alloc (SOCKET_MAX_DATA_SIZE);
+  memcpy (buf, win, winlen);
+  memcpy (buf + winlen, frame, namelen - winlen);
+
+  int in_flight = 0;
+  int retval = NOTOK;
+
+  for (;;) {
+    ssize_t n;
+
+    if (fd is -1) {
+      n = (len > max_len ? max_len : len);
+      memcpy (buf + namelen, data, n);
+      data += n;
+      len -= n;
+    } else if (0 > (n = read (fd, buf + namelen, max_len))) {
+      if (errno is EINTR) continue;
+      goto theend;
+    }
+
+    if (0 is n) break;
+
+    if (in_flight is SEND_WINDOW) {
+      if (NOTOK is sock_send_reply (s)) goto theend;
+      in_flight--;
+    }
+
+    if (NOTOK is self(sock.send_msg, s, MSG_SEND, 0, buf, namelen + n))
+      goto theend;
+
+    in_flight++;
+  }
+
+  for (; in_flight; in_flight--)
+    if (NOTOK is sock_send_reply (s)) goto theend;
+
+  retval = OK;
+
+theend:
+  Free (buf);
+  return retval;
+}
+
+private int vtach_sock_send_input (vtach_t *this, int s, char *win, char *frame, char *data, size_t len) {
   if (NULL is data) return NOTOK;
+  return sock_send_input (this, s, win, frame, -1, data, len);
+}
+
+/* streams fd, till its end */
+private int vtach_sock_send_file (vtach_t *this, int s, char *win, char *frame, int fd) {
+  return sock_send_input (this, s, win, frame, fd, NULL, 0);
+}
 
-  if (len > SOCKET_MAX_DATA_SIZE) return NOTOK;
+/* the handshake, which should be the first thing a client does */
+private int vtach_sock_hello (vtach_t *this, int s) {
+  if (NOTOK is self(sock.send_msg, s, MSG_HELLO, VTACH_PROTO_VERSION, NULL, 0))
+    return NOTOK;
+
+  msg_hdr hdr;
+  if (NOTOK is sock_read_all (s, &hdr, MSG_HDR_SIZE) or
+      hdr.type isnot MSG_HELLO or hdr.len isnot 0)
+    return NOTOK;
+
+  if (hdr.arg isnot VTACH_PROTO_VERSION) {
+    errno = EPROTO;
+    return NOTOK;
+  }
+
+  return OK;
+}
+
+/* asks for the metrics of the session and writes them to fd, as they come;
+ * what else comes meanwhile is skipped */
+private int vtach_sock_stats (vtach_t *this, int s, int fd) {
+  if (NOTOK is self(sock.send_msg, s, MSG_STATS, 0, NULL, 0))
+    return NOTOK;
+
+  unsigned char *buf = Alloc (SOCKET_MAX_DATA_SIZE);
+  int retval = NOTOK;
+  msg_hdr hdr;
+
+  for (;;) {
+    if (NOTOK is sock_read_all (s, &hdr, MSG_HDR_SIZE) or
+        hdr.len > SOCKET_MAX_DATA_SIZE or
+        NOTOK is sock_read_all (s, buf, hdr.len))
+      break;
+
+    if (hdr.type isnot MSG_STATS)
+      continue;
 
-  struct packet pkt;
-  pkt.type = type;
-  pkt.len = len;
-  for (int i = 0; i < pkt.len; i++) pkt.u.buf[i] = data[i];
+    retval = fd_write_all (fd, buf, hdr.len);
+    break;
+  }
+
+  Free (buf);
+  return retval;
+}
+
+/* on the control socket of a daemon, after the hello; from then on, the
+ * connection is to the session */
+private int vtach_sock_open (vtach_t *this, int s, char *name) {
+  if (NOTOK is self(sock.send_msg, s, MSG_OPEN, 0, name, bytelen (name) + 1))
+    return NOTOK;
+
+  msg_hdr hdr;
+  if (NOTOK is sock_read_all (s, &hdr, MSG_HDR_SIZE) or
+      hdr.type isnot MSG_OPEN or hdr.len isnot 0)
+    return NOTOK;
 
-  if (-1 is write (s, &pkt, sizeof(struct packet)))
+  if (hdr.arg isnot 0) {
+    errno = hdr.arg;
     return NOTOK;
+  }
 
   return OK;
 }
 
+private void msg_reader_init (msg_reader *rd) {
+  rd->buf = Alloc (MSG_READER_SIZE);
+  rd->pos = rd->len = 0;
+}
+
+private void msg_reader_release (msg_reader *rd) {
+  Free (rd->buf);
+  rd->buf = NULL;
+}
+
+/* returns what read() returned */
+private ssize_t msg_reader_fill (msg_reader *rd, int fd) {
+  if (rd->pos) {
+    memmove (rd->buf, rd->buf + rd->pos, rd->len - rd->pos);
+    rd->len -= rd->pos;
+    rd->pos = 0;
+  }
+
+  ssize_t n = read (fd, rd->buf + rd->len, MSG_READER_SIZE - rd->len);
+  if (n > 0) rd->len += n;
+  return n;
+}
+
+/* as msg_reader_fill(), and the descriptors that came with the data */
+private ssize_t msg_reader_fill_fds (msg_reader *rd, int fd, int *fds, int *num_fds) {
+  if (rd->pos) {
+    memmove (rd->buf, rd->buf + rd->pos, rd->len - rd->pos);
+    rd->len -= rd->pos;
+    rd->pos = 0;
+  }
+
+  struct iovec iov = {.iov_base = rd->buf + rd->len, .iov_len = MSG_READER_SIZE - rd->len};
+  char cbuf[CMSG_SPACE (sizeof (int) * MSG_MAX_FDS)];
+  struct msghdr mh = {
+    .msg_iov = &iov, .msg_iovlen = 1,
+    .msg_control = cbuf, .msg_controllen = sizeof (cbuf)};
+
+  ssize_t n = recvmsg (fd, &mh, MSG_CMSG_CLOEXEC);
+  if (n <= 0) return n;
+
+  rd->len += n;
+
+  for (struct cmsghdr *cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm)) {
+    if (cm->cmsg_level isnot SOL_SOCKET or cm->cmsg_type isnot SCM_RIGHTS)
+      continue;
+
+    int num = (cm->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+    int *cfds = (int *) CMSG_DATA(cm);
+
+    for (int i = 0; i < num; i++)
+      if (*num_fds < MSG_MAX_FDS)
+        fds[(*num_fds)++] = cfds[i];
+      else
+        close (cfds[i]);
+  }
+
+  return n;
+}
+
+/* 1 for a complete message, 0 if more is needed, NOTOK on a bad header */
+private int msg_reader_next (msg_reader *rd, msg_hdr *hdr, unsigned char **data) {
+  size_t avail = rd->len - rd->pos;
+  if (avail < MSG_HDR_SIZE) return 0;
+
+  memcpy (hdr, rd->buf + rd->pos, MSG_HDR_SIZE);
+  if (hdr->len > SOCKET_MAX_DATA_SIZE) return NOTOK;
+  if (avail < MSG_HDR_SIZE + hdr->len) return 0;
+
+  *data = rd->buf + rd->pos + MSG_HDR_SIZE;
+  rd->pos += MSG_HDR_SIZE + hdr->len;
+  return 1;
+}
+
 private void update_socket_modes (char *sockname, int exec) {
   struct stat st;
   mode_t newmode;
@@ -255,57 +832,146 @@ static char *ustring_character (utf8 c, char *buf, int *len) {
   return buf;
 }
 
-private int tty_process_kbd (vtach_t *this, int s, struct packet *pkt) {
-  /* Suspend? */
-  if (0 is $my(no_suspend) and (pkt->u.buf[0] is $my(term)->raw_mode.c_cc[VSUSP])) {
-    pkt->type = MSG_DETACH;
-    write (s, pkt, sizeof (struct packet));
+private void tty_send_redraw (vtach_t *this, int s) {
+  struct winsize ws;
+  ioctl (0, TIOCGWINSZ, &ws);
+  self(sock.send_msg, s, MSG_REDRAW, $my(redraw_method), (char *) &ws, sizeof (ws));
+}
+
+/* A whole read() goes as one message; only the suspend character, and
+ * the mode key followed by the detach character, are handled here. */
+private int tty_process_kbd (vtach_t *this, int s, unsigned char *buf, ssize_t len) {
+  ssize_t beg = 0;
+
+  for (ssize_t i = 0; i < len; i++) {
+    /* Suspend? */
+    if (0 is $my(no_suspend) and (buf[i] is $my(term)->raw_mode.c_cc[VSUSP])) {
+      if (i > beg) self(sock.send_data, s, (char *) buf + beg, i - beg, MSG_PUSH);
+      beg = i + 1;
+
+      self(sock.send_msg, s, MSG_DETACH, 0, NULL, 0);
+
+      tcsetattr (0, TCSADRAIN, &$my(term)->orig_mode);
+      fprintf (stdout, EOS "\r\n");
+      kill (getpid(), SIGTSTP);
+      tcsetattr (0, TCSADRAIN, &$my(term)->raw_mode);
+
+      /* Tell the master that we are returning. */
+      self(sock.send_msg, s, MSG_ATTACH, 0, NULL, 0);
+
+      /* We would like a redraw, too. */
+      tty_send_redraw (this, s);
+    } else if (buf[i] is $my(mode_key)) {
+      /* the next key might be already in the buffer */
+      if (i + 1 < len) {
+        if (buf[i + 1] is $my(detach_char)) {
+          if (i > beg) self(sock.send_data, s, (char *) buf + beg, i - beg, MSG_PUSH);
+          fprintf (stdout, EOS "\r\n[detached]\r\n");
+          return 1;
+        }
+
+        i++;
+        continue;
+      }
+
+      utf8 c = Vwm.getkey ($my(objects)[VWM_OBJECT], 0);
 
-    tcsetattr (0, TCSADRAIN, &$my(term)->orig_mode);
-    fprintf (stdout, EOS "\r\n");
-    kill (getpid(), SIGTSTP);
-    tcsetattr (0, TCSADRAIN, &$my(term)->raw_mode);
+      if (c is $my(detach_char)) {
+        if (i > beg) self(sock.send_data, s, (char *) buf + beg, i - beg, MSG_PUSH);
+        fprintf (stdout, EOS "\r\n[detached]\r\n");
+        return 1;
+      }
 
-    /* Tell the master that we are returning. */
-    pkt->type = MSG_ATTACH;
-    write (s, pkt, sizeof (struct packet));
+      self(sock.send_data, s, (char *) buf + beg, i + 1 - beg, MSG_PUSH);
+      beg = len;
 
-    /* We would like a redraw, too. */
-    pkt->type = MSG_REDRAW;
-    pkt->len = $my(redraw_method);
-    ioctl (0, TIOCGWINSZ, &pkt->u.ws);
-    write (s, pkt, sizeof (struct packet));
-    return 0;
-  } else if (pkt->u.buf[0] is $my(mode_key)) {
-    utf8 c = Vwm.getkey ($my(objects)[VWM_OBJECT], 0);
+      int clen;
+      char cbuf[8];
+      ustring_character (c, cbuf, &clen);
+      self(sock.send_data, s, cbuf, clen, MSG_PUSH);
+    }
+    /* Just in case something pukes out. */
+    else if (buf[i] is '\f')
+      win_changed = 1;
+  }
+
+  if (len > beg)
+    self(sock.send_data, s, (char *) buf + beg, len - beg, MSG_PUSH);
+
+  return 0;
+}
+
+/* a viewer sends nothing, and only detaches */
+private int tty_view_kbd (vtach_t *this, unsigned char *buf, ssize_t len) {
+  for (ssize_t i = 0; i < len; i++) {
+    if (buf[i] isnot $my(mode_key))
+      continue;
+
+    utf8 c = (i + 1 < len ? buf[++i] : Vwm.getkey ($my(objects)[VWM_OBJECT], 0));
 
     if (c is $my(detach_char)) {
       fprintf (stdout, EOS "\r\n[detached]\r\n");
       return 1;
     }
+  }
+
+  return 0;
+}
+
+/* to the socket of the session, or in daemon mode, to the session by
+ * its name (the last component of the socket path), through the daemon */
+private int tty_connect (vtach_t *this) {
+  char *sockname = ($my(ctlname) ? $my(ctlname) : $my(sockname));
 
-    pkt->len = 1;
-    write (s, pkt, sizeof (struct packet));
+  int s = self(sock.connect, sockname);
+  if (s is NOTOK) return NOTOK;
 
-    int len;
-    char buf[8];
-    ustring_character (c, buf, &len);
-    pkt->len = len;
-    for (int i = 0; i < len; i++) pkt->u.buf[i] = buf[i];
+  if (NOTOK is self(sock.hello, s))
+    goto theerror;
+
+  if ($my(ctlname)) {
+    char *sp = strrchr ($my(sockname), '/');
+    if (NOTOK is self(sock.open, s, (sp ? sp + 1 : $my(sockname))))
+      goto theerror;
   }
-  /* Just in case something pukes out. */
-  else if (pkt->u.buf[0] is '\f')
-    win_changed = 1;
 
-  write (s, pkt, sizeof (struct packet));
-  return 0;
+  return s;
+
+theerror:;
+  int err = errno;
+  close (s);
+  errno = err;
+  return NOTOK;
+}
+
+/* When the connection breaks while the server still listens, connect
+ * again and ask for the output after seq. */
+private int tty_reconnect (vtach_t *this, int *s, uint64_t seq) {
+  close (*s);
+
+  if (NOTOK is (*s = tty_connect (this)))
+    return NOTOK;
+
+  int r = ($my(view_ms)
+    ? self(sock.send_msg, *s, MSG_VIEW, $my(view_ms), NULL, 0)
+    : self(sock.send_msg, *s, MSG_ATTACH, 0, (char *) &seq, sizeof (seq)));
+
+  if (NOTOK is r) {
+    close (*s);
+    *s = -1;
+    return NOTOK;
+  }
+
+  win_changed = 1;
+  return OK;
 }
 
 private int vtach_tty_main (vtach_t *this) {
-  int s = self(sock.connect, $my(sockname));
+  int s = tty_connect (this);
 
   if (s is NOTOK) {
-    fprintf (stderr, "%s: %s\n", $my(sockname), strerror (errno));
+    fprintf (stderr, "%s: %s\n", $my(sockname), (errno is EPROTO ?
+        "the server speaks another protocol version" : strerror (errno)));
     return 1;
   }
 
@@ -321,22 +987,26 @@ private int vtach_tty_main (vtach_t *this) {
   Vterm.screen.save ($my(term));
   Vterm.screen.clear ($my(term));
 
-  struct packet pkt;
-
-  memset (&pkt, 0, sizeof (struct packet));
-  pkt.type = MSG_ATTACH;
-  write (s, &pkt, sizeof (struct packet));
+  if ($my(view_ms))
+    self(sock.send_msg, s, MSG_VIEW, $my(view_ms), NULL, 0);
+  else {
+    self(sock.send_msg, s, MSG_ATTACH, 0, NULL, 0);
+    tty_send_redraw (this, s);
+  }
 
-  pkt.type = MSG_REDRAW;
-  pkt.len = $my(redraw_method);
-  ioctl (0, TIOCGWINSZ, &pkt.u.ws);
-  write (s, &pkt, sizeof (struct packet));
+  int
+    retval = 0,
+    synced = 0,
+    reconnects = 0;
 
-  int retval = 0;
+  uint64_t seq = 0;
 
   unsigned char buf[BUFSIZE];
   fd_set readfds;
 
+  msg_reader rd;
+  msg_reader_init (&rd);
+
   while (1) {
 
     FD_ZERO(&readfds);
@@ -352,7 +1022,14 @@ private int vtach_tty_main (vtach_t *this) {
     }
 
     if (n > 0 and FD_ISSET(s, &readfds)) {
-      ssize_t len = read (s, buf, sizeof (buf));
+      ssize_t len = msg_reader_fill (&rd, s);
+
+      if (len <= 0 and synced and reconnects++ < MAX_RECONNECTS and
+          OK is tty_reconnect (this, &s, seq)) {
+        msg_reader_release (&rd);
+        msg_reader_init (&rd);
+        continue;
+      }
 
       if (len is 0) {
         fprintf (stderr, EOS "\r\n[EOF - terminating]\r\n");
@@ -363,38 +1040,58 @@ private int vtach_tty_main (vtach_t *this) {
         break;
       }
 
-      write (STDOUT_FILENO, buf, len);
+      msg_hdr hdr;
+      unsigned char *data;
+      int r;
+      while (0 < (r = msg_reader_next (&rd, &hdr, &data)))
+        if (hdr.type is MSG_OUTPUT) {
+          fd_write_all (STDOUT_FILENO, data, hdr.len);
+          seq += hdr.len;
+          reconnects = 0;
+        } else if (hdr.type is MSG_SYNC and hdr.len is sizeof (seq)) {
+          memcpy (&seq, data, sizeof (seq));
+          synced = 1;
+        }
+
+      if (r is NOTOK) {
+        fprintf (stderr, EOS "\r\n[protocol error]\r\n");
+        retval = -1;
+        break;
+      }
+
       n--;
     }
 
     if (n > 0 and FD_ISSET(STDIN_FILENO, &readfds)) {
-      ssize_t len;
-
-      pkt.type = MSG_PUSH;
-      memset (pkt.u.buf, 0, sizeof (pkt.u.buf));
-      len = read (STDIN_FILENO, pkt.u.buf, sizeof (pkt.u.buf));
+      ssize_t len = read (STDIN_FILENO, buf, sizeof (buf));
 
       if (len <= 0) {
         retval = -1;
         break;
       }
 
-      pkt.len = len;
-      if (1 is (retval = tty_process_kbd (this, s, &pkt)))
+      if ($my(view_ms))
+        retval = tty_view_kbd (this, buf, len);
+      else
+        retval = tty_process_kbd (this, s, buf, len);
+
+      if (1 is retval)
         break;
 
       n--;
     }
 
-    if (win_changed) {
+    if (win_changed and 0 is $my(view_ms)) {
       win_changed = 0;
 
-      pkt.type = MSG_WINCH;
-      ioctl (0, TIOCGWINSZ, &pkt.u.ws);
-      write (s, &pkt, sizeof (pkt));
+      struct winsize ws;
+      ioctl (0, TIOCGWINSZ, &ws);
+      self(sock.send_msg, s, MSG_WINCH, 0, (char *) &ws, sizeof (ws));
     }
   }
 
+  msg_reader_release (&rd);
+
   Vterm.orig_mode ($my(term));
   Vterm.screen.restore ($my(term));
 
@@ -404,15 +1101,66 @@ private int vtach_tty_main (vtach_t *this) {
   return (retval is -1 ? 1 : 0);
 }
 
+private void pty_metrics_map (struct pty *pty) {
+  pty->metrics = NULL;
+  if (-1 is pty->metrics_fd) return;
+
+  void *m = mmap (NULL, VWM_METRICS_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, pty->metrics_fd, 0);
+  if (m is MAP_FAILED) {
+    close (pty->metrics_fd);
+    pty->metrics_fd = -1;
+    if (-1 isnot pty->metrics_wake) close (pty->metrics_wake);
+    pty->metrics_wake = -1;
+    return;
+  }
+
+  pty->metrics = m;
+}
+
+/* the memory is created before the fork, so both ends have it mapped */
+private void pty_metrics_open (struct pty *pty) {
+  pty->metrics_fd = memfd_create ("vtach-metrics", MFD_CLOEXEC);
+  if (-1 isnot pty->metrics_fd and -1 is ftruncate (pty->metrics_fd, VWM_METRICS_SIZE)) {
+    close (pty->metrics_fd);
+    pty->metrics_fd = -1;
+  }
+
+  /* without it, the program publishes on a turn that comes anyway */
+  pty->metrics_wake = (-1 is pty->metrics_fd ? -1 :
+      eventfd (0, EFD_CLOEXEC|EFD_NONBLOCK));
+
+  pty_metrics_map (pty);
+}
+
+/* the descriptors of a session that go with a message; the eventfd goes
+ * only with the memory, so a receiver knows either by their number */
+private int pty_metrics_num_fds (struct pty *pty) {
+  if (-1 is pty->metrics_fd) return 2;
+  return (-1 is pty->metrics_wake ? 3 : 4);
+}
+
+private void pty_metrics_close (struct pty *pty) {
+  if (pty->metrics) munmap (pty->metrics, VWM_METRICS_SIZE);
+  if (-1 isnot pty->metrics_fd) close (pty->metrics_fd);
+  if (-1 isnot pty->metrics_wake) close (pty->metrics_wake);
+  pty->metrics = NULL;
+  pty->metrics_fd = -1;
+  pty->metrics_wake = -1;
+}
+
 private int pty_child (vtach_t *this, int argc, char **argv) {
+  pty_metrics_open (&$my(pty));
+
   $my(pty).term = $my(term)->orig_mode;
   memset (&$my(pty).ws, 0, sizeof (struct winsize));
 
   char name[1024];
   $my(pty).pid = forkpty (&$my(pty).fd, name, &$my(pty).term, NULL);
 
-  if ($my(pty).pid < 0)
+  if ($my(pty).pid < 0) {
+    pty_metrics_close (&$my(pty));
     return -1;
+  }
 
   if ($my(pty).pid is 0) {
     setsid ();
@@ -443,6 +1191,19 @@ private int pty_child (vtach_t *this, int argc, char **argv) {
 
     close (fd);
 
+    /* until the program handles them */
+    if ($my(render_signals)) {
+      signal (SIGUSR1, SIG_IGN);
+      signal (SIGUSR2, SIG_IGN);
+    }
+
+    /* the mapping and the eventfd stay */
+    if ($my(pty).metrics) {
+      Vwm.set.metrics (vwm, $my(pty).metrics, VWM_METRICS_SIZE, $my(pty).metrics_wake);
+      close ($my(pty).metrics_fd);
+      $my(pty).metrics_fd = -1;
+    }
+
     int retval = $my(exec_child_cb) (this, argc, argv);
     __deinit_vwm__ (&vwm);
     __deinit_vtach__ (&this);
@@ -476,147 +1237,1375 @@ private void killpty (struct pty *pty, int sig) {
   kill (-pty->pid, sig);
 }
 
-private void pty_activity (vtach_t *this, int s) {
-  unsigned char buf[BUFSIZE];
-  ssize_t len;
-  struct client *p;
-  fd_set readfds, writefds;
-  int max_fd, nclients;
+private struct chunk *chunk_new (int type, int arg, char *data, size_t len) {
+  struct chunk *c = Alloc (sizeof (struct chunk) + MSG_HDR_SIZE + len);
+  c->refs = 1;
+  c->len = MSG_HDR_SIZE + len;
 
-  len = read ($my(pty).fd, buf, sizeof (buf));
-  if (len <= 0)
-    exit (1);
+  msg_hdr hdr = {.len = len, .type = type, .flags = 0, .arg = arg};
+  memcpy (c->data, &hdr, MSG_HDR_SIZE);
+  if (len) memcpy (c->data + MSG_HDR_SIZE, data, len);
+  return c;
+}
 
-  if (tcgetattr ($my(pty).fd, &$my(pty).term) < 0)
-    exit (1);
+private void chunk_unref (struct chunk *c) {
+  if (--c->refs) return;
+  Free (c);
+}
+
+private void client_queue_push (struct client *p, struct chunk *c) {
+  struct qentry *q = Alloc (sizeof (struct qentry));
+  q->chunk = c;
+  q->next = NULL;
+  q->is_rest = 0;
+  c->refs++;
+
+  if (p->qtail)
+    p->qtail->next = q;
+  else
+    p->qhead = q;
+
+  p->qtail = q;
+  p->qsize += c->len;
+}
+
+private void client_queue_pop (struct client *p) {
+  struct qentry *q = p->qhead;
+  p->qhead = q->next;
+  if (NULL is p->qhead) p->qtail = NULL;
+
+  p->qsize -= q->chunk->len;
+  chunk_unref (q->chunk);
+  Free (q);
+}
+
+/* drops what has not been written yet; a message that is half written
+ * (or that its start is in the pipe) is kept, as the stream would be
+ * broken otherwise */
+private void client_queue_discard (struct client *p) {
+  struct qentry *keep = NULL;
+
+  if (p->qoff or (p->qhead and p->qhead->is_rest)) {
+    keep = p->qhead;
+    p->qhead = keep->next;
+    p->qsize -= keep->chunk->len;
+  }
+
+  while (p->qhead)
+    client_queue_pop (p);
+
+  if (keep) {
+    keep->next = NULL;
+    p->qhead = p->qtail = keep;
+    p->qsize = keep->chunk->len;
+  }
+}
+
+private int client_queue_msg (struct client *p, int type, int arg, char *data, size_t len) {
+  do {
+    size_t n = (len > SOCKET_MAX_DATA_SIZE ? SOCKET_MAX_DATA_SIZE : len);
+    struct chunk *c = chunk_new (type, arg, data, n);
+    client_queue_push (p, c);
+    chunk_unref (c);
+
+    data += n;
+    len -= n;
+  } while (len);
+
+  return OK;
+}
+
+/* len is at most a pty read, far less than the ring */
+private void session_ring_append (struct session *ss, unsigned char *buf, size_t len) {
+  size_t pos = ss->out_seq % ss->ring_size;
+  size_t n = ss->ring_size - pos;
+  if (n > len) n = len;
+
+  memcpy (ss->ring + pos, buf, n);
+  memcpy (ss->ring, buf + n, len - n);
+  ss->out_seq += len;
+}
+
+private long clock_ms (void) {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+private void client_queue_sync (struct client *p, uint64_t seq) {
+  client_queue_msg (p, MSG_SYNC, 0, (char *) &seq, sizeof (seq));
+}
+
+/* the repaint supersedes any output that is still queued */
+private int pty_client_repaint (vtach_t *this, struct client *p) {
+  struct session *ss = p->ss;
+
+  p->needs_repaint = 0;
+  client_queue_discard (p);
+
+  size_t len;
+  char *buf = Vframe.repaint (ss->screen, &len);
+  client_queue_msg (p, MSG_OUTPUT, 0, buf, len);
+  client_queue_sync (p, ss->out_seq);
+  return OK;
+}
+
+/* the output after seq from the ring, or a repaint when it is not there */
+private void pty_client_resume (vtach_t *this, struct client *p, uint64_t seq) {
+  struct session *ss = p->ss;
+  uint64_t avail = (ss->out_seq < ss->ring_size ? ss->out_seq : ss->ring_size);
+
+  if (seq > ss->out_seq or ss->out_seq - seq > avail) {
+    if (ss->screen)
+      pty_client_repaint (this, p);
+    else
+      client_queue_sync (p, ss->out_seq);
+    return;
+  }
+
+  while (seq < ss->out_seq) {
+    size_t pos = seq % ss->ring_size;
+    size_t n = ss->ring_size - pos;
+    if (n > ss->out_seq - seq) n = ss->out_seq - seq;
+    if (n > SOCKET_MAX_DATA_SIZE) n = SOCKET_MAX_DATA_SIZE;
+
+    client_queue_msg (p, MSG_OUTPUT, 0, (char *) ss->ring + pos, n);
+    seq += n;
+  }
+}
+
+/* writes as much of the pipe and the queue as the socket takes, without blocking */
+private int pty_client_flush (vtach_t *this, struct client *p) {
+#ifdef SPLICE_F_NONBLOCK
+  while (p->pipe_len) {
+    ssize_t n = splice (p->pipe[0], NULL, p->fd, NULL, p->pipe_len, SPLICE_F_NONBLOCK);
+
+    if (n < 0) {
+      if (errno is EINTR) continue;
+      return (errno is EAGAIN ? OK : NOTOK);
+    }
+
+    p->pipe_len -= n;
+  }
+#endif
+
+  if (p->needs_repaint and NULL is p->qhead)
+    pty_client_repaint (this, p);
+
+  while (p->qhead) {
+    struct iovec iov[16];
+    int iovcnt = 0;
+
+    for (struct qentry *q = p->qhead; q and iovcnt < 16; q = q->next, iovcnt++) {
+      iov[iovcnt].iov_base = q->chunk->data;
+      iov[iovcnt].iov_len = q->chunk->len;
+    }
+
+    iov[0].iov_base = (char *) iov[0].iov_base + p->qoff;
+    iov[0].iov_len -= p->qoff;
+
+    ssize_t n = writev (p->fd, iov, iovcnt);
+
+    if (n < 0) {
+      if (errno is EINTR) continue;
+      return (errno is EAGAIN ? OK : NOTOK);
+    }
+
+    n += p->qoff;
+    p->qoff = 0;
+
+    while (p->qhead and (size_t) n >= p->qhead->chunk->len) {
+      n -= p->qhead->chunk->len;
+      client_queue_pop (p);
+    }
+
+    if (p->qhead)
+      p->qoff = n;
+  }
+
+  return OK;
+}
+
+#ifdef SPLICE_F_NONBLOCK
+private int pipe_open (int fd[2], size_t *size) {
+  if (-1 is pipe2 (fd, O_NONBLOCK|O_CLOEXEC)) {
+    fd[0] = fd[1] = -1;
+    return NOTOK;
+  }
+
+  fcntl (fd[0], F_SETPIPE_SZ, CLIENT_QUEUE_MAX_SIZE);
+  int sz = fcntl (fd[0], F_GETPIPE_SZ);
+  *size = (sz > 0 ? (size_t) sz : 0);
+  return OK;
+}
+
+/* Duplicates the len bytes of the fan pipe into the pipe of the client,
+ * after a header. Returns 1 when the message went (at least its start)
+ * that way; tee_len is then the part of the payload that did, and the
+ * rest is queued once the data is read. Returns 0 for the copy path, that
+ * a client takes when it has queued output or it waits for a repaint. */
+private int pty_client_tee (struct client *p, size_t len) {
+  p->tee_len = -1;
+
+  if (p->needs_repaint or p->qhead) return 0;
+
+  if (-1 is p->pipe[0] and NOTOK is pipe_open (p->pipe, &p->pipe_size))
+    return 0;
+
+  if (p->pipe_len + MSG_HDR_SIZE + len > p->pipe_size) return 0;
+
+  msg_hdr hdr = {.len = len, .type = MSG_OUTPUT, .flags = 0, .arg = 0};
+
+  /* a header is less than PIPE_BUF, so it is written whole or not at all */
+  if (MSG_HDR_SIZE isnot write (p->pipe[1], &hdr, MSG_HDR_SIZE))
+    return 0;
+
+  p->pipe_len += MSG_HDR_SIZE;
+
+  ssize_t n = tee (p->ss->fan[0], p->pipe[1], len, SPLICE_F_NONBLOCK);
+  if (n < 0) n = 0;
+
+  p->pipe_len += n;
+  p->tee_len = n;
+  return 1;
+}
+
+/* what the pipe of the client could not take */
+private void pty_client_tee_rest (struct client *p, unsigned char *buf, size_t len) {
+  if (p->tee_len < 0 or (size_t) p->tee_len is len) return;
+
+  struct chunk *c = Alloc (sizeof (struct chunk) + len - p->tee_len);
+  c->refs = 1;
+  c->len = len - p->tee_len;
+  memcpy (c->data, buf + p->tee_len, c->len);
+
+  client_queue_push (p, c);
+  p->qtail->is_rest = 1;
+  chunk_unref (c);
+}
+
+/* moves the pty output into the fan pipe; returns 0 when zero copy
+ * is not available, so the caller reads it */
+private ssize_t session_fan_splice (struct session *ss, size_t len) {
+  if (-1 is ss->fan[0]) return 0;
+
+  ssize_t n;
+  while (-1 is (n = splice (ss->pty.fd, NULL, ss->fan[1], NULL, len, SPLICE_F_NONBLOCK)))
+    if (errno isnot EINTR) break;
+
+  if (n < 0 and errno isnot EAGAIN) {
+    close (ss->fan[0]);
+    close (ss->fan[1]);
+    ss->fan[0] = ss->fan[1] = -1;
+    return 0;
+  }
+
+  return n;
+}
+#endif
+
+/* returns NOTOK, when the client has to be dropped */
+private int pty_client_send (vtach_t *this, struct client *p, struct chunk *c) {
+  if (p->needs_repaint) return OK;
+
+  if (p->qsize + c->len > CLIENT_QUEUE_MAX_SIZE) {
+    if ($my(overflow_policy) is VTACH_OVERFLOW_DROP or NULL is p->ss->screen)
+      return NOTOK;
+
+    /* it will get the screen, once it catches up */
+    client_queue_discard (p);
+    p->needs_repaint = 1;
+    return OK;
+  }
+
+  client_queue_push (p, c);
+  return pty_client_flush (this, p);
+}
+
+private void pty_client_release (struct client *p) {
+  /* its input is still written, but nobody is told */
+  if (p->ss)
+    for (struct input *in = p->ss->in_head; in; in = in->next)
+      if (in->client is p)
+        in->client = NULL;
+
+  close (p->fd);
+
+  if (p->pipe[0] isnot -1) {
+    close (p->pipe[0]);
+    close (p->pipe[1]);
+  }
+
+  for (int i = 0; i < p->num_fds; i++)
+    close (p->fds[i]);
+
+  p->qoff = 0;
+  client_queue_discard (p);
+
+  if (p->next)
+    p->next->pprev = p->pprev;
+  *(p->pprev) = p->next;
+
+  msg_reader_release (&p->rd);
+  Free (p);
+}
+
+/* the screen for a viewer, when it is due, it changed, and the viewer took
+ * the previous; returns the milliseconds until it is due, or -1 */
+private long pty_client_snapshot (vtach_t *this, struct client *p, long now) {
+  struct session *ss = p->ss;
+
+  if (NULL is ss->screen or p->view_seq is ss->out_seq or p->qhead)
+    return -1;
+
+  if (now < p->view_next)
+    return p->view_next - now;
+
+  size_t len;
+  char *buf = Vframe.repaint (ss->screen, &len);
+  client_queue_msg (p, MSG_OUTPUT, 0, buf, len);
+  client_queue_sync (p, ss->out_seq);
+
+  p->view_seq = ss->out_seq;
+  p->view_next = now + p->view_ms;
+
+  if (NOTOK is pty_client_flush (this, p))
+    pty_client_release (p);
+
+  return -1;
+}
+
+private void client_link (struct client **list, struct client *p) {
+  p->pprev = list;
+  p->next = *list;
+  if (p->next)
+    p->next->pprev = &p->next;
+  *list = p;
+}
+
+private void client_unlink (struct client *p) {
+  if (p->next)
+    p->next->pprev = p->pprev;
+  *(p->pprev) = p->next;
+}
+
+/* The master keeps a model of the screen of the program, by parsing its
+ * output, so an attaching client gets repainted without asking the program. */
+private void session_screen_init (vtach_t *this, struct session *ss) {
+  vwm_t *vwm = $my(objects)[VWM_OBJECT];
+
+  int rows = ss->pty.ws.ws_row;
+  int cols = ss->pty.ws.ws_col;
+
+  win_opts w_opts = WinOpts (
+      .num_rows = rows,
+      .num_cols = cols,
+      .num_frames = 1,
+      .max_frames = 1);
+
+  w_opts.frame_opts[0].fork = 0;
+
+  ss->win = Vwm.new.win (vwm, "vtach", w_opts);
+  if (NULL is ss->win) return;
+
+  ss->screen = Vwin.get.frame_at (ss->win, 0);
+  Vframe.set.size (ss->screen, rows, cols);
+}
+
+private void session_set_size (vtach_t *this, struct session *ss, struct winsize *ws) {
+  memcpy (&ss->pty.ws, ws, sizeof (struct winsize));
+  ioctl (ss->pty.fd, TIOCSWINSZ, &ss->pty.ws);
+
+  if (ss->screen)
+    Vframe.set.size (ss->screen, ws->ws_row, ws->ws_col);
+}
+
+/* name is the path of the socket of the session */
+private struct session *session_new (vtach_t *this, char *name, int s, struct pty *pty) {
+  struct session *ss = Alloc (sizeof (struct session));
+
+  ss->name = Alloc (bytelen (name) + 1);
+  strcpy (ss->name, name);
+  ss->s = s;
+  ss->pty = *pty;
+  ss->waitattach = $my(waitattach);
+  ss->has_attached_client = 0;
+  ss->render_signals = $my(render_signals);
+  ss->clients = NULL;
+  ss->in_head = ss->in_tail = NULL;
+  ss->win = NULL;
+  ss->screen = NULL;
+  ss->fan[0] = ss->fan[1] = -1;
+
+  /* the input is written as the pty takes it */
+  fd_set_nonblocking (ss->pty.fd);
+
+  if (0 is ss->pty.ws.ws_row or 0 is ss->pty.ws.ws_col) {
+    vwm_t *vwm = $my(objects)[VWM_OBJECT];
+    ss->pty.ws.ws_row = Vwm.get.lines (vwm);
+    ss->pty.ws.ws_col = Vwm.get.columns (vwm);
+  }
+
+  session_screen_init (this, ss);
+
+  ss->ring_size = REPLAY_RING_SIZE;
+  ss->ring = Alloc (ss->ring_size);
+  ss->out_seq = 0;
+
+#ifdef SPLICE_F_NONBLOCK
+  size_t fan_size;
+  if ($my(zero_copy))
+    pipe_open (ss->fan, &fan_size);
+#endif
+
+  ss->next = $my(sessions);
+  $my(sessions) = ss;
+  return ss;
+}
+
+/* the program has gone; so do its clients and its socket */
+private void session_release (vtach_t *this, struct session *ss) {
+  struct session **sp = &$my(sessions);
+  while (*sp isnot ss) sp = &(*sp)->next;
+  *sp = ss->next;
+
+  while (ss->clients)
+    pty_client_release (ss->clients);
+
+  while (ss->in_head) {
+    struct input *in = ss->in_head;
+    ss->in_head = in->next;
+    Free (in);
+  }
+
+  close (ss->pty.fd);
+  close (ss->s);
+  unlink (ss->name);
+  pty_metrics_close (&ss->pty);
+
+  if (ss->fan[0] isnot -1) {
+    close (ss->fan[0]);
+    close (ss->fan[1]);
+  }
+
+  if (ss->win)
+    Vwm.release_win ($my(objects)[VWM_OBJECT], ss->win);
+
+  Free (ss->ring);
+  Free (ss->name);
+  Free (ss);
+}
+
+private void session_input_push (struct session *ss, struct client *p, int ack,
+                                char *hdr, size_t hdrlen, unsigned char *data, size_t len) {
+  struct input *in = Alloc (sizeof (struct input) + hdrlen + len);
+  in->next = NULL;
+  in->client = p;
+  in->ack = ack;
+  in->len = hdrlen + len;
+  in->off = 0;
+  if (hdrlen) memcpy (in->data, hdr, hdrlen);
+  if (len) memcpy (in->data + hdrlen, data, len);
+
+  if (ss->in_tail)
+    ss->in_tail->next = in;
+  else
+    ss->in_head = in;
+
+  ss->in_tail = in;
+  p->in_pending++;
+}
+
+/* the head of the input is done with; err goes to a client that waits */
+private void session_input_pop (vtach_t *this, struct session *ss, int err) {
+  struct input *in = ss->in_head;
+  ss->in_head = in->next;
+  if (NULL is ss->in_head)
+    ss->in_tail = NULL;
+
+  struct client *p = in->client;
+  int ack = in->ack;
+  Free (in);
+
+  if (NULL is p) return;
+
+  p->in_pending--;
+
+  ifnot (ack) return;
+
+  client_queue_msg (p, MSG_SEND, err, NULL, 0);
+  if (NOTOK is pty_client_flush (this, p))
+    pty_client_release (p);
+}
+
+/* writes the input, as much as the pty takes now */
+private void session_write_input (vtach_t *this, struct session *ss) {
+  struct input *in;
+
+  while (NULL isnot (in = ss->in_head)) {
+    ssize_t n = write (ss->pty.fd, in->data + in->off, in->len - in->off);
+    if (n < 0) {
+      if (errno is EAGAIN or errno is EINTR)
+        return;
+
+      /* the program has gone, and the read side closes the session */
+      int err = errno;
+      while (ss->in_head)
+        session_input_pop (this, ss, err);
+      return;
+    }
+
+    in->off += n;
+    if (in->off < in->len)
+      return;
+
+    session_input_pop (this, ss, 0);
+  }
+}
+
+/* MSG_SEND: the data goes to the program (a vwm), in what it takes as input
+ * for a frame: MODE_KEY ESC _ vwm-send;window;frame;length ESC \ data */
+private int session_input_send (vtach_t *this, struct session *ss, struct client *p,
+                                unsigned char *data, size_t len) {
+  char *win = (char *) data;
+  size_t winlen = strnlen (win, len);
+  if (winlen is len) return EINVAL;
+
+  char *frame = win + winlen + 1;
+  size_t framelen = strnlen (frame, len - winlen - 1);
+  if (framelen is len - winlen - 1) return EINVAL;
+
+  for (char *sp = win; sp < frame + framelen; sp++)
+    if (*sp is ';' or (*sp and (unsigned char) *sp < ' ') or *sp is 0x7f)
+      return EINVAL;
+
+  size_t off = winlen + framelen + 2;
+  char hdr[256];
+  int n = snprintf (hdr, sizeof (hdr), "%c\033_vwm-send;%s;%s;%zu\033\\",
+      $my(mode_key), win, frame, len - off);
+
+  if (n < 0 or n >= (int) sizeof (hdr))
+    return EINVAL;
+
+  session_input_push (ss, p, 1, hdr, n, data + off, len - off);
+  return 0;
+}
+
+private struct session *session_by_name (vtach_t *this, char *name) {
+  for (struct session *ss = $my(sessions); ss; ss = ss->next) {
+    char *sp = strrchr (ss->name, '/');
+    if (0 is strcmp ((sp ? sp + 1 : ss->name), name))
+      return ss;
+  }
+
+  return NULL;
+}
+
+/* returns NOTOK, when the pty has been closed */
+private int pty_activity (vtach_t *this, struct session *ss) {
+  unsigned char buf[SOCKET_MAX_DATA_SIZE];
+  ssize_t len = 0;
+  struct client *p, *next;
+  int spliced = 0;
+
+#ifdef SPLICE_F_NONBLOCK
+  /* with zero copy, the clients take it from the fan pipe, before it is
+   * read from there, once, for the model and for the copy path */
+  if (0 < (len = session_fan_splice (ss, sizeof (buf)))) {
+    spliced = 1;
+
+    for (p = ss->clients; p; p = p->next)
+      if (p->attached)
+        pty_client_tee (p, len);
+
+    ssize_t n = 0;
+    while (n < len) {
+      ssize_t r = read (ss->fan[0], buf + n, len - n);
+      if (r <= 0) {
+        if (r < 0 and errno is EINTR) continue;
+        return NOTOK;
+      }
+      n += r;
+    }
+  } else if (len < 0)
+    return OK;
+#endif
+
+  ifnot (spliced) {
+    len = read (ss->pty.fd, buf, sizeof (buf));
+    if (len <= 0)
+      return ((len < 0 and (errno is EINTR or errno is EAGAIN)) ? OK : NOTOK);
+  }
+
+  if (tcgetattr (ss->pty.fd, &ss->pty.term) < 0)
+    return NOTOK;
+
+  if (ss->screen)
+    Vframe.feed (ss->screen, (char *) buf, len);
+
+  session_ring_append (ss, buf, len);
+
+  struct chunk *c = NULL;
+
+  for (p = ss->clients; p; p = next) {
+    next = p->next;
+
+    ifnot (p->attached)
+      continue;
+
+    int r;
+
+    if (spliced and p->tee_len >= 0) {
+      pty_client_tee_rest (p, buf, len);
+      r = pty_client_flush (this, p);
+    } else {
+      if (NULL is c)
+        c = chunk_new (MSG_OUTPUT, 0, (char *) buf, len);
+
+      r = pty_client_send (this, p, c);
+    }
+
+    if (NOTOK is r)
+      pty_client_release (p);
+  }
+
+  if (c) chunk_unref (c);
+  return OK;
+}
+
+private struct client *client_new (struct session *ss, int fd, struct client **list) {
+  struct client *p = Alloc (sizeof (struct client));
+
+  p->fd = fd;
+  p->ss = ss;
+  p->attached = 0;
+  p->said_hello = 0;
+  p->needs_repaint = 0;
+  p->in_pending = p->in_held = 0;
+  p->view_ms = 0;
+  p->num_fds = 0;
+  p->qhead = p->qtail = NULL;
+  p->qoff = p->qsize = 0;
+  p->pipe[0] = p->pipe[1] = -1;
+  p->pipe_len = p->pipe_size = 0;
+  p->tee_len = -1;
+  msg_reader_init (&p->rd);
+  client_link (list, p);
+  return p;
+}
+
+/* ss is NULL for the control socket of the daemon */
+private void pty_socket_activity (struct session *ss, int s, struct client **list) {
+  int fd = accept (s, NULL, NULL);
+  if (fd < 0)
+    return;
+
+  if (fd_set_nonblocking (fd) < 0) {
+    close (fd);
+    return;
+  }
+
+  client_new (ss, fd, list);
+}
+
+private void fd_watch (int fd, fd_set *fds, int *max_fd) {
+  FD_SET(fd, fds);
+  if (fd > *max_fd)
+    *max_fd = fd;
+}
+
+/* Gives the clients a little time to take what is queued for them, before
+ * the handover. */
+private void pty_handover_flush (vtach_t *this, struct client *except) {
+  struct session *ss;
+  struct client *p;
+
+  for (int ms = 0; ms < HANDOVER_FLUSH_MS; ms += 10) {
+    fd_set writefds;
+    FD_ZERO(&writefds);
+    int max_fd = -1;
+
+    for (ss = $my(sessions); ss; ss = ss->next)
+      for (p = ss->clients; p; p = p->next)
+        if (p isnot except and (p->qhead or p->pipe_len))
+          fd_watch (p->fd, &writefds, &max_fd);
+
+    if (-1 is max_fd) return;
+
+    struct timeval tv = {.tv_sec = 0, .tv_usec = 10000};
+    if (select (max_fd + 1, NULL, &writefds, NULL, &tv) <= 0)
+      continue;
+
+    for (ss = $my(sessions); ss; ss = ss->next)
+      for (p = ss->clients; p; p = p->next)
+        if (p isnot except and FD_ISSET(p->fd, &writefds))
+          pty_client_flush (this, p);
+  }
+}
+
+/* The input can not be handed over, so it is written first; when a program
+ * does not take it in HANDOVER_FLUSH_MS, there is no upgrade. */
+private int pty_handover_input (vtach_t *this) {
+  struct session *ss;
+
+  for (int ms = 0; ms < HANDOVER_FLUSH_MS; ms += 10) {
+    fd_set writefds;
+    FD_ZERO(&writefds);
+    int max_fd = -1;
+
+    for (ss = $my(sessions); ss; ss = ss->next)
+      if (ss->in_head)
+        fd_watch (ss->pty.fd, &writefds, &max_fd);
+
+    if (-1 is max_fd) return OK;
+
+    struct timeval tv = {.tv_sec = 0, .tv_usec = 10000};
+    if (select (max_fd + 1, NULL, &writefds, NULL, &tv) <= 0)
+      continue;
+
+    for (ss = $my(sessions); ss; ss = ss->next)
+      if (ss->in_head and FD_ISSET(ss->pty.fd, &writefds))
+        session_write_input (this, ss);
+  }
+
+  for (ss = $my(sessions); ss; ss = ss->next)
+    if (ss->in_head) return NOTOK;
+
+  return OK;
+}
+
+/* A client that is left in the middle of a message stays behind, and it
+ * resumes from the new master once it reconnects; an attached one with whole
+ * messages queued, gets a repaint from there instead. A viewer stays behind
+ * as well, and asks the new master for its snapshots. */
+private int pty_handover_client (int s, struct client *p) {
+  if (p->view_ms or p->pipe_len or p->qoff or (p->qhead and (p->qhead->is_rest or
+      NULL is p->ss->screen or 0 is p->attached)))
+    return OK;
+
+  size_t rdlen = p->rd.len - p->rd.pos;
+  size_t len = sizeof (vtach_handover_client) + rdlen;
+  if (len > SOCKET_MAX_DATA_SIZE)
+    return OK;
+
+  vtach_handover_client st = {
+    .attached = p->attached,
+    .said_hello = p->said_hello,
+    .needs_repaint = (p->needs_repaint or NULL isnot p->qhead)};
+
+  char *data = Alloc (len);
+  memcpy (data, &st, sizeof (st));
+  memcpy (data + sizeof (st), p->rd.buf + p->rd.pos, rdlen);
+
+  int r = sock_send_fds (s, MSG_UPGRADE, HANDOVER_CLIENT, data, len, &p->fd, 1);
+  Free (data);
+  return r;
+}
+
+private int pty_handover_session (vtach_t *this, int s, struct session *ss, struct client *except) {
+  size_t namelen = bytelen (ss->name) + 1;
+  size_t len = sizeof (vtach_handover_session) + namelen;
+
+  vtach_handover_session st = {
+    .pid = ss->pty.pid,
+    .ws = ss->pty.ws,
+    .waitattach = ss->waitattach,
+    .render_signals = ss->render_signals,
+    .out_seq = ss->out_seq,
+    .ring_len = (ss->out_seq < ss->ring_size ? ss->out_seq : ss->ring_size)};
+
+  char *data = Alloc (len);
+  memcpy (data, &st, sizeof (st));
+  memcpy (data + sizeof (st), ss->name, namelen);
+
+  int fds[MSG_MAX_FDS] = {ss->s, ss->pty.fd, ss->pty.metrics_fd, ss->pty.metrics_wake};
+  int r = sock_send_fds (s, MSG_UPGRADE, HANDOVER_SESSION, data, len, fds,
+      pty_metrics_num_fds (&ss->pty));
+  Free (data);
+
+  if (NOTOK is r) return NOTOK;
+
+  if (ss->screen) {
+    char *buf = Vframe.repaint (ss->screen, &len);
+    if (NOTOK is self(sock.send_data, s, buf, len, MSG_REDRAW))
+      return NOTOK;
+  }
+
+  for (uint64_t seq = ss->out_seq - st.ring_len; seq < ss->out_seq;) {
+    size_t pos = seq % ss->ring_size;
+    size_t n = ss->ring_size - pos;
+    if (n > ss->out_seq - seq) n = ss->out_seq - seq;
+    if (n > SOCKET_MAX_DATA_SIZE) n = SOCKET_MAX_DATA_SIZE;
+
+    if (NOTOK is self(sock.send_msg, s, MSG_OUTPUT, 0, (char *) ss->ring + pos, n))
+      return NOTOK;
+
+    seq += n;
+  }
+
+  for (struct client *p = ss->clients; p; p = p->next)
+    if (p isnot except and NOTOK is pty_handover_client (s, p))
+      return NOTOK;
+
+  return OK;
+}
+
+/* MSG_UPGRADE: hands everything to the process on the other end of p, and
+ * exits once it took it; returns NOTOK (so p is dropped) if it did not */
+private int pty_handover (vtach_t *this, struct client *p) {
+  int s = p->fd;
+  int flags = fcntl (s, F_GETFL);
+  if (-1 is flags or -1 is fcntl (s, F_SETFL, flags & ~O_NONBLOCK))
+    return NOTOK;
+
+  if (NOTOK is pty_handover_input (this))
+    return NOTOK;
+
+  pty_handover_flush (this, p);
+
+  if (-1 isnot $my(ctl_s) and NOTOK is sock_send_fds (s, MSG_UPGRADE, HANDOVER_CTL,
+      $my(ctlname), bytelen ($my(ctlname)) + 1, &$my(ctl_s), 1))
+    return NOTOK;
+
+  for (struct session *ss = $my(sessions); ss; ss = ss->next)
+    if (NOTOK is pty_handover_session (this, s, ss, p))
+      return NOTOK;
+
+  msg_hdr hdr = {.len = 0, .type = MSG_PUSH, .flags = 0, .arg = 0};
+
+  if (NOTOK is self(sock.send_msg, s, MSG_UPGRADE, HANDOVER_DONE, NULL, 0) or
+      NOTOK is sock_read_all (s, &hdr, MSG_HDR_SIZE) or
+      hdr.type isnot MSG_UPGRADE or hdr.arg isnot 0)
+    return NOTOK;
+
+  /* the sockets stay, as they are served from there now */
+  _exit (0);
+}
+
+/* MSG_ADD: a session that a process started, is handed to the daemon */
+private int daemon_add_session (vtach_t *this, struct client *p, unsigned char *data, size_t len) {
+  vtach_session_msg msg;
+  if (len <= sizeof (msg) or data[len - 1] isnot '\0' or p->num_fds < 2)
+    return EINVAL;
+
+  memcpy (&msg, data, sizeof (msg));
+  char *name = (char *) data + sizeof (msg);
+
+  char *sp = strrchr (name, '/');
+  if (session_by_name (this, (sp ? sp + 1 : name)))
+    return EEXIST;
+
+  if (fd_set_nonblocking (p->fds[0]) < 0)
+    return errno;
+
+  for (int i = 0; i < p->num_fds; i++)
+    fcntl (p->fds[i], F_SETFD, FD_CLOEXEC);
+
+  struct pty pty;
+  memset (&pty, 0, sizeof (struct pty));
+  pty.fd = p->fds[1];
+  pty.pid = msg.pid;
+  pty.ws = msg.ws;
+  pty.metrics_fd = (p->num_fds > 2 ? p->fds[2] : -1);
+  pty.metrics_wake = (p->num_fds > 3 ? p->fds[3] : -1);
+  pty_metrics_map (&pty);
+  tcgetattr (pty.fd, &pty.term);
+
+  struct session *ss = session_new (this, name, p->fds[0], &pty);
+  ss->render_signals = msg.render_signals;
+  p->num_fds = 0;
+  return 0;
+}
+
+/* the messages on the control socket of the daemon, that come before a
+ * connection opens a session; returns NOTOK when it should be dropped */
+private int daemon_client_message (vtach_t *this, struct client *p, msg_hdr *hdr, unsigned char *data) {
+  if (hdr->type is MSG_ADD) {
+    int err = daemon_add_session (this, p, data, hdr->len);
+    client_queue_msg (p, MSG_ADD, err, NULL, 0);
+    return pty_client_flush (this, p);
+  }
+
+  if (hdr->type is MSG_UPGRADE)
+    return pty_handover (this, p);
+
+  if (hdr->type isnot MSG_OPEN)
+    return NOTOK;
+
+  struct session *ss = NULL;
+  if (hdr->len and data[hdr->len - 1] is '\0')
+    ss = session_by_name (this, (char *) data);
+
+  client_queue_msg (p, MSG_OPEN, (ss ? 0 : ENOENT), NULL, 0);
+  if (NOTOK is pty_client_flush (this, p) or NULL is ss)
+    return NOTOK;
+
+  /* from now on, it is a client of the session */
+  client_unlink (p);
+  client_link (&ss->clients, p);
+  p->ss = ss;
+  return OK;
+}
+
+typedef struct stats_buf {
+  char *buf;
+  size_t
+    size,
+    len;
+} stats_buf;
+
+/* a line that does not fit is left out */
+private void stats_printf (stats_buf *b, const char *fmt, ...) __attribute__((format (printf, 2, 3)));
+private void stats_printf (stats_buf *b, const char *fmt, ...) {
+  if (b->len >= b->size) return;
+
+  va_list ap;
+  va_start (ap, fmt);
+  int n = vsnprintf (b->buf + b->len, b->size - b->len, fmt, ap);
+  va_end (ap);
+
+  if (n >= 0 and (size_t) n < b->size - b->len)
+    b->len += n;
+  else
+    b->size = b->len;
+}
+
+private void stats_gauge (stats_buf *b, const char *name, const char *type, const char *help,
+                          const char *labels, double v) {
+  stats_printf (b, "# HELP %s %s\n# TYPE %s %s\n%s{%s} %.15g\n", name, help, name, type,
+      name, labels, v);
+}
+
+/* the metrics of the program; it is asked for new ones and woken, and they
+ * are waited for a little, so an idle program costs nothing between the
+ * readers; a program that does not answer in time (one that published
+ * less than VWM_METRICS_MS ago, or one that never did) gives the last
+ * ones, and their age tells. They are copied while seq stays the same and
+ * even, so the program never waits for a reader. */
+private size_t session_program_metrics (struct session *ss, char *buf, size_t size, long *ms) {
+  vwm_metrics *m = ss->pty.metrics;
+  if (NULL is m) return 0;
+
+  uint last = __atomic_load_n (&m->seq, __ATOMIC_ACQUIRE);
+  __atomic_add_fetch (&m->req, 1, __ATOMIC_RELEASE);
+
+  uint64_t one = 1;
+  if (last and -1 isnot ss->pty.metrics_wake and
+      sizeof (one) is write (ss->pty.metrics_wake, &one, sizeof (one))) {
+    long end = clock_ms () + PROGRAM_METRICS_WAIT_MS;
+    while (last is __atomic_load_n (&m->seq, __ATOMIC_ACQUIRE) and clock_ms () < end)
+      usleep (1000);
+  }
+
+  for (int try = 0; try < 100; try++) {
+    uint seq = __atomic_load_n (&m->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1) {
+      sched_yield ();
+      continue;
+    }
+
+    size_t len = m->len;
+    if (len > size) len = size;
+    memcpy (buf, m->doc, len);
+    *ms = m->ms;
+
+    __atomic_thread_fence (__ATOMIC_ACQUIRE);
+    if (seq is __atomic_load_n (&m->seq, __ATOMIC_RELAXED))
+      return (seq ? len : 0);
+  }
+
+  return 0;
+}
+
+/* MSG_STATS: the metrics of the master for the session, followed by those
+ * of the program */
+private size_t session_stats (struct session *ss, char *buf, size_t size) {
+  stats_buf b = {.buf = buf, .size = size, .len = 0};
+
+  char labels[256];
+  size_t len = 0;
+  for (char *sp = ss->name; *sp and len < sizeof (labels) - 32; sp++) {
+    if (*sp is '"' or *sp is '\\') labels[len++] = '\\';
+    labels[len++] = *sp;
+  }
+  labels[len] = '\0';
+
+  char session[288];
+  snprintf (session, sizeof (session), "session=\"%s\"", labels);
+
+  int num_clients = 0, num_attached = 0, num_viewers = 0;
+  size_t queued = 0, input = 0;
+
+  for (struct client *p = ss->clients; p; p = p->next) {
+    num_clients++;
+    num_attached += (p->attached isnot 0);
+    num_viewers += (p->view_ms isnot 0);
+    queued += p->qsize;
+  }
+
+  for (struct input *in = ss->in_head; in; in = in->next)
+    input += in->len - in->off;
+
+  char info[320];
+  snprintf (info, sizeof (info), "%s,pid=\"%d\"", session, ss->pty.pid);
+
+  stats_gauge (&b, "vtach_session_info", "gauge", "The session and the pid of its program.", info, 1);
+  stats_gauge (&b, "vtach_clients", "gauge", "Connected clients.", session, num_clients);
+  stats_gauge (&b, "vtach_attached_clients", "gauge", "Attached clients.", session, num_attached);
+  stats_gauge (&b, "vtach_viewers", "gauge", "Read only clients.", session, num_viewers);
+  stats_gauge (&b, "vtach_output_bytes_total", "counter", "Output of the program.", session, ss->out_seq);
+  stats_gauge (&b, "vtach_client_queued_bytes", "gauge", "Output queued for the clients.", session, queued);
+  stats_gauge (&b, "vtach_input_queued_bytes", "gauge", "Input queued for the program.", session, input);
+
+  long ms = 0;
+  size_t n = session_program_metrics (ss, b.buf + b.len, b.size - b.len, &ms);
+
+  /* the age goes first; the document of the program follows as it is */
+  if (n) {
+    char *doc = Alloc (n);
+    memcpy (doc, b.buf + b.len, n);
+
+    stats_gauge (&b, "vtach_program_metrics_age_seconds", "gauge",
+        "Since the program published its metrics.", session, (clock_ms () - ms) / 1000.0);
+
+    /* whole lines only */
+    if (n > b.size - b.len)
+      n = b.size - b.len;
+    while (n and doc[n - 1] isnot '\n') n--;
+
+    memcpy (b.buf + b.len, doc, n);
+    b.len += n;
+    Free (doc);
+  }
+
+  return b.len;
+}
+
+/* returns NOTOK, when the client should be dropped */
+private int pty_client_message (vtach_t *this, struct client *p, msg_hdr *hdr, unsigned char *data) {
+  if (0 is p->said_hello) {
+    if (hdr->type isnot MSG_HELLO)
+      return NOTOK;
+
+    p->said_hello = 1;
+    client_queue_msg (p, MSG_HELLO, VTACH_PROTO_VERSION, NULL, 0);
+    if (NOTOK is pty_client_flush (this, p))
+      return NOTOK;
+
+    return (hdr->arg is VTACH_PROTO_VERSION ? OK : NOTOK);
+  }
+
+  if (NULL is p->ss)
+    return daemon_client_message (this, p, hdr, data);
+
+  struct session *ss = p->ss;
+
+  if (hdr->type is MSG_STATS) {
+    char *buf = Alloc (SOCKET_MAX_DATA_SIZE);
+    size_t len = session_stats (ss, buf, SOCKET_MAX_DATA_SIZE);
+    client_queue_msg (p, MSG_STATS, 0, buf, len);
+    Free (buf);
+    return pty_client_flush (this, p);
+  }
+
+  if (hdr->type is MSG_VIEW) {
+    p->view_ms = (hdr->arg ? hdr->arg : VIEW_DEFAULT_MS);
+    if (p->view_ms < VIEW_MIN_MS)
+      p->view_ms = VIEW_MIN_MS;
+
+    p->attached = 0;
+    p->view_next = 0;
+    p->view_seq = ss->out_seq - 1;
+    return OK;
+  }
+
+  /* a viewer is read only */
+  if (p->view_ms) {
+    if (hdr->type isnot MSG_SEND)
+      return OK;
+
+    client_queue_msg (p, MSG_SEND, EPERM, NULL, 0);
+    return pty_client_flush (this, p);
+  }
+
+  /* Push out data to the program. */
+  if (hdr->type is MSG_PUSH) {
+    if (hdr->len) session_input_push (ss, p, 0, NULL, 0, data, hdr->len);
+  } else if (hdr->type is MSG_SEND) {
+    int err = session_input_send (this, ss, p, data, hdr->len);
+    if (err) {
+      client_queue_msg (p, MSG_SEND, err, NULL, 0);
+      return pty_client_flush (this, p);
+    }
+  } else if (hdr->type is MSG_ATTACH) {
+    p->attached = 1;
+
+    if (hdr->len is sizeof (uint64_t)) {
+      uint64_t seq;
+      memcpy (&seq, data, sizeof (seq));
+      pty_client_resume (this, p, seq);
+    } else
+      client_queue_sync (p, ss->out_seq);
+
+    return pty_client_flush (this, p);
+  } else if (hdr->type is MSG_DETACH)
+    p->attached = 0;
+  else if (hdr->type is MSG_UPGRADE)
+    return pty_handover (this, p);
+  else if (hdr->type is MSG_WINCH) {
+    if (hdr->len isnot sizeof (struct winsize)) return OK;
+    session_set_size (this, ss, (struct winsize *) data);
+  } else if (hdr->type == MSG_REDRAW) {
+    int method = hdr->arg;
+
+    /* If the client didn't specify a particular method, use
+    ** whatever we had on startup. */
+    if (method is REDRAW_UNSPEC)
+      method = $my(redraw_method);
+    if (method is REDRAW_NONE)
+      return OK;
+
+    if (hdr->len is sizeof (struct winsize))
+      session_set_size (this, ss, (struct winsize *) data);
+
+    /* Repaint from the model; a change of size, signals the program anyway. */
+    if (ss->screen) {
+      pty_client_repaint (this, p);
+      return pty_client_flush (this, p);
+    }
+
+    /* Send a ^L character if the terminal is in no-echo and
+    ** character-at-a-time mode. */
+    if (method is REDRAW_CTRL_L) {
+      char c = '\f';
+
+      if (((ss->pty.term.c_lflag & (ECHO|ICANON)) is 0) and
+           (ss->pty.term.c_cc[VMIN] is 0))
+           //(ss->pty.term.c_cc[VMIN] is 1)) {
+        write (ss->pty.fd, &c, 1);
+    } else if (method is REDRAW_WINCH)
+      killpty (&ss->pty, SIGWINCH);
+  }
+
+  return OK;
+}
 
-top:
-  FD_ZERO(&readfds);
-  FD_ZERO(&writefds);
-  FD_SET(s, &readfds);
-  max_fd = s;
+/* the messages that have been read, till the first that is input */
+private void pty_client_messages (vtach_t *this, struct client *p) {
+  msg_hdr hdr;
+  unsigned char *data;
+  int r;
 
-  for (p = $my(clients), nclients = 0; p; p = p->next) {
-    if (!p->attached)
-      continue;
+  p->in_held = 0;
 
-    FD_SET(p->fd, &writefds);
-    if (p->fd > max_fd)
-      max_fd = p->fd;
+  while (0 < (r = msg_reader_next (&p->rd, &hdr, &data))) {
+    if (NOTOK is pty_client_message (this, p, &hdr, data)) {
+      r = NOTOK;
+      break;
+    }
 
-    nclients++;
+    if (p->in_pending) {
+      p->in_held = 1;
+      break;
+    }
   }
 
-  ifnot (nclients) return;
+  if (r is NOTOK)
+    pty_client_release (p);
+}
+
+private void pty_client_activity (vtach_t *this, struct client *p) {
+  ssize_t len;
+
+  if (NULL is p->ss) /* the daemon gets the sessions as descriptors */
+    len = msg_reader_fill_fds (&p->rd, p->fd, p->fds, &p->num_fds);
+  else
+    len = msg_reader_fill (&p->rd, p->fd);
 
-  if (select (max_fd + 1, &readfds, &writefds, NULL, NULL) < 0)
+  if (len < 0 and (errno is EAGAIN or errno is EINTR))
     return;
 
-  for (p = $my(clients), nclients = 0; p; p = p->next) {
-    ssize_t written;
+  if (len <= 0) {
+    pty_client_release (p);
+    return;
+  }
 
-    ifnot (FD_ISSET(p->fd, &writefds))
-      continue;
+  pty_client_messages (this, p);
+}
 
-    written = 0;
-    while (written < len) {
-      ssize_t n = write (p->fd, buf + written, len - written);
+private void pty_clients_watch (struct client *list, fd_set *readfds, fd_set *writefds, int *max_fd) {
+  for (struct client *p = list; p; p = p->next) {
+    ifnot (p->in_pending)
+      fd_watch (p->fd, readfds, max_fd);
 
-      if (n > 0) {
-        written += n;
-        continue;
-      } else if (n < 0 and errno is EINTR)
-        continue;
-      else if (n < 0 and errno isnot EAGAIN)
-        nclients = -1;
-      break;
+    if (p->qhead or p->pipe_len or p->needs_repaint)
+      fd_watch (p->fd, writefds, max_fd);
+  }
+}
+
+private void pty_clients_activity (vtach_t *this, struct client *list, fd_set *readfds, fd_set *writefds) {
+  struct client *p, *next;
+
+  for (p = list; p; p = next) {
+    next = p->next;
+    if (FD_ISSET(p->fd, writefds) and NOTOK is pty_client_flush (this, p)) {
+      pty_client_release (p);
+      continue;
     }
 
-    if (nclients isnot -1 and written is len)
-      nclients++;
+    if (FD_ISSET(p->fd, readfds))
+      pty_client_activity (this, p);
   }
-
-  /* Try again if nothing happened. */
-  if (!FD_ISSET(s, &readfds) and nclients is 0)
-    goto top;
 }
 
-private void pty_socket_activity (vtach_t *this, int s) {
-  int fd = accept (s, NULL, NULL);
-  if (fd < 0)
-    return;
+/* One select() loop for every session, and the control socket of the
+ * daemon. It returns when the last session is gone, or when the daemon
+ * had none for DAEMON_IDLE_TIMEOUT seconds. */
+private void pty_serve (vtach_t *this) {
+  struct session *ss, *ss_next;
+  fd_set readfds, writefds;
+  int max_fd;
 
-  if (fd_set_nonblocking (fd) < 0) {
-    close (fd);
-    return;
-  }
+  while ($my(sessions) or -1 isnot $my(ctl_s)) {
+    FD_ZERO(&readfds);
+    FD_ZERO(&writefds);
+    max_fd = -1;
 
-  struct client *p = Alloc (sizeof (struct client));
+    if (-1 isnot $my(ctl_s)) {
+      fd_watch ($my(ctl_s), &readfds, &max_fd);
+      pty_clients_watch ($my(ctl_clients), &readfds, &writefds, &max_fd);
+    }
 
-  p->fd = fd;
-  p->attached = 0;
-  p->pprev = &$my(clients);
-  p->next = *(p->pprev);
-  if (p->next)
-    p->next->pprev = &p->next;
-  *(p->pprev) = p;
-}
+    long now = clock_ms ();
+    long wait = -1;
 
-private void pty_client_activity (vtach_t *this, struct client *p) {
-  struct packet pkt;
+    for (ss = $my(sessions); ss; ss = ss->next) {
+      int has_attached_client = 0;
 
-  ssize_t len = read (p->fd, &pkt, sizeof (struct packet));
-  if (len < 0 and (errno is EAGAIN or errno is EINTR))
-    return;
+      for (struct client *p = ss->clients, *next; p; p = next) {
+        next = p->next;
+        ifnot (p->view_ms) continue;
 
-  if (len <= 0) {
-    close (p->fd);
+        long ms = pty_client_snapshot (this, p, now);
+        if (ms >= 0 and (wait < 0 or ms < wait))
+          wait = ms;
+      }
 
-    if (p->next)
-      p->next->pprev = p->pprev;
-    *(p->pprev) = p->next;
-    free(p);
-    return;
-  }
+      fd_watch (ss->s, &readfds, &max_fd);
 
-  /* Push out data to the program. */
-  if (pkt.type is MSG_PUSH) {
-    if (pkt.len <= sizeof (pkt.u.buf))
-      write ($my(pty).fd, pkt.u.buf, pkt.len);
-  } else if (pkt.type is MSG_ATTACH)
-    p->attached = 1;
-  else if (pkt.type is MSG_DETACH)
-    p->attached = 0;
-  else if (pkt.type is MSG_WINCH) {
-    $my(pty).ws = pkt.u.ws;
-    ioctl ($my(pty).fd, TIOCSWINSZ, &$my(pty).ws);
-  } else if (pkt.type == MSG_REDRAW) {
-    int method = pkt.len;
+      /* When waitattach is set, wait until the client attaches
+       * before trying to read from the pty. */
+      if (ss->waitattach) {
+        if (ss->clients and (ss->clients->attached or ss->clients->view_ms))
+          ss->waitattach = 0;
+      } else
+        fd_watch (ss->pty.fd, &readfds, &max_fd);
+
+      if (ss->in_head)
+        fd_watch (ss->pty.fd, &writefds, &max_fd);
+
+      pty_clients_watch (ss->clients, &readfds, &writefds, &max_fd);
+
+      for (struct client *p = ss->clients; p; p = p->next)
+        if (p->attached or p->view_ms)
+          has_attached_client = 1;
+
+      /* chmod the socket if necessary, and tell the program whether its
+       * output is seen */
+      if (ss->has_attached_client isnot has_attached_client) {
+        update_socket_modes (ss->name, has_attached_client);
+        ss->has_attached_client = has_attached_client;
+
+        if (ss->render_signals)
+          kill (ss->pty.pid, (has_attached_client ? SIGUSR2 : SIGUSR1));
+      }
+    }
+
+    struct timeval tv = {.tv_sec = DAEMON_IDLE_TIMEOUT, .tv_usec = 0};
+
+    /* the next snapshot that is due */
+    if (wait >= 0) {
+      tv.tv_sec = wait / 1000;
+      tv.tv_usec = (wait % 1000) * 1000;
+    }
+
+    int n = select (max_fd + 1, &readfds, &writefds, NULL,
+        ((NULL is $my(sessions) or wait >= 0) ? &tv : NULL));
+
+    if (n < 0) {
+      if (errno is EINTR or errno isnot EAGAIN)
+        continue;
 
-    /* If the client didn't specify a particular method, use
-    ** whatever we had on startup. */
-    if (method is REDRAW_UNSPEC)
-      method = $my(redraw_method);
-    if (method is REDRAW_NONE)
       return;
+    }
 
-    $my(pty).ws = pkt.u.ws;
-    ioctl ($my(pty).fd, TIOCSWINSZ, &$my(pty).ws);
+    if (n is 0) {
+      if (NULL is $my(sessions)) /* an idle daemon */
+        return;
 
-    /* Send a ^L character if the terminal is in no-echo and
-    ** character-at-a-time mode. */
-    if (method is REDRAW_CTRL_L) {
-      char c = '\f';
+      continue;
+    }
 
-      if ((($my(pty).term.c_lflag & (ECHO|ICANON)) is 0) and
-           ($my(pty).term.c_cc[VMIN] is 0))
-           //($my(pty).term.c_cc[VMIN] is 1)) {
-        write ($my(pty).fd, &c, 1);
-    } else if (method is REDRAW_WINCH)
-      killpty (&$my(pty), SIGWINCH);
+    if (-1 isnot $my(ctl_s)) {
+      if (FD_ISSET($my(ctl_s), &readfds))
+        pty_socket_activity (NULL, $my(ctl_s), &$my(ctl_clients));
+
+      pty_clients_activity (this, $my(ctl_clients), &readfds, &writefds);
+    }
+
+    for (ss = $my(sessions); ss; ss = ss_next) {
+      ss_next = ss->next;
+
+      /* New client? */
+      if (FD_ISSET(ss->s, &readfds))
+        pty_socket_activity (ss, ss->s, &ss->clients);
+
+      if (ss->in_head and FD_ISSET(ss->pty.fd, &writefds))
+        session_write_input (this, ss);
+
+      /* the clients whose input has been written, go on */
+      for (struct client *p = ss->clients, *next; p; p = next) {
+        next = p->next;
+        if (p->in_held and 0 is p->in_pending)
+          pty_client_messages (this, p);
+      }
+
+      pty_clients_activity (this, ss->clients, &readfds, &writefds);
+
+      if (FD_ISSET(ss->pty.fd, &readfds) and NOTOK is pty_activity (this, ss)) {
+        session_release (this, ss);
+
+        /* the daemon goes with its last session */
+        if (NULL is $my(sessions) and -1 isnot $my(ctl_s)) {
+          close ($my(ctl_s));
+          unlink ($my(ctlname));
+          $my(ctl_s) = -1;
+        }
+      }
+    }
   }
 }
 
+private void pty_daemonize (void) {
+  signal (SIGPIPE, SIG_IGN);
+  signal (SIGXFSZ, SIG_IGN);
+  signal (SIGHUP, SIG_IGN);
+  signal (SIGTTIN, SIG_IGN);
+  signal (SIGTTOU, SIG_IGN);
+  signal (SIGINT, pty_die);
+  signal (SIGTERM, pty_die);
+
+  /* Make sure stdin/stdout/stderr point to /dev/null. We are now a
+  ** daemon. */
+  int nullfd = open ("/dev/null", O_RDWR);
+  dup2 (nullfd, 0);
+  dup2 (nullfd, 1);
+  dup2 (nullfd, 2);
+
+  if (nullfd > 2)
+    close (nullfd);
+}
+
 private void pty_process (vtach_t *this, int s, int argc, char **argv, int statusfd) {
   setsid ();
 
@@ -635,87 +2624,313 @@ private void pty_process (vtach_t *this, int s, int argc, char **argv, int statu
     exit (1);
   }
 
-  signal (SIGPIPE, SIG_IGN);
-  signal (SIGXFSZ, SIG_IGN);
-  signal (SIGHUP, SIG_IGN);
-  signal (SIGTTIN, SIG_IGN);
-  signal (SIGTTOU, SIG_IGN);
-  signal (SIGINT, pty_die);
-  signal (SIGTERM, pty_die);
+  session_new (this, $my(sockname), s, &$my(pty));
 
   /* Close statusfd, since we don't need it anymore. */
   if (statusfd isnot -1) close (statusfd);
 
-  /* Make sure stdin/stdout/stderr point to /dev/null. We are now a
-  ** daemon. */
-  int nullfd = open ("/dev/null", O_RDWR);
-  dup2 (nullfd, 0);
-  dup2 (nullfd, 1);
-  dup2 (nullfd, 2);
+  pty_daemonize ();
 
-  if (nullfd > 2)
-    close (nullfd);
+  pty_serve (this);
+  exit (1);
+}
 
-  struct client *p, *next;
-  fd_set readfds;
-  int
-    max_fd,
-    has_attached_client = 0;
+/* the messages of a handover, on the side of the new master; ss is the
+ * session that the ones that follow are about */
+private int pty_handover_message (vtach_t *this, struct session **ssp, msg_hdr *hdr,
+                                  unsigned char *data, int *fds, int num_fds) {
+  struct session *ss = *ssp;
 
-  while (1) {
-    int new_has_attached_client = 0;
+  if (hdr->type is MSG_REDRAW or hdr->type is MSG_OUTPUT) {
+    if (NULL is ss or num_fds) return NOTOK;
 
-    FD_ZERO(&readfds);
-    FD_SET(s, &readfds);
-    max_fd = s;
+    if (hdr->type is MSG_OUTPUT)
+      session_ring_append (ss, data, hdr->len);
+    else if (ss->screen)
+      Vframe.feed (ss->screen, (char *) data, hdr->len);
 
-    /* When waitattach is set, wait until the client attaches
-     * before trying to read from the pty. */
-    if ($my(waitattach)) {
-      if ($my(clients) and $my(clients)->attached)
-        $my(waitattach) = 0;
-    } else {
-      FD_SET($my(pty).fd, &readfds);
-      if ($my(pty).fd > max_fd)
-        max_fd = $my(pty).fd;
-    }
+    return OK;
+  }
+
+  if (hdr->type isnot MSG_UPGRADE)
+    return NOTOK;
 
-    for (p = $my(clients); p; p = p->next) {
-      FD_SET(p->fd, &readfds);
-      if (p->fd > max_fd)
-        max_fd = p->fd;
+  if (hdr->arg is HANDOVER_CTL) {
+    if (num_fds isnot 1 or 0 is hdr->len or data[hdr->len - 1] isnot '\0')
+      return NOTOK;
 
-      if (p->attached)
-        new_has_attached_client = 1;
+    /* it lives as long as the daemon */
+    $my(ctlname) = Alloc (hdr->len);
+    memcpy ($my(ctlname), data, hdr->len);
+    $my(ctl_s) = fds[0];
+    return OK;
+  }
+
+  if (hdr->arg is HANDOVER_SESSION) {
+    vtach_handover_session st;
+    if (num_fds < 2 or hdr->len <= sizeof (st) or data[hdr->len - 1] isnot '\0')
+      return NOTOK;
+
+    memcpy (&st, data, sizeof (st));
+
+    struct pty pty;
+    memset (&pty, 0, sizeof (struct pty));
+    pty.fd = fds[1];
+    pty.pid = st.pid;
+    pty.ws = st.ws;
+    pty.metrics_fd = (num_fds > 2 ? fds[2] : -1);
+    pty.metrics_wake = (num_fds > 3 ? fds[3] : -1);
+    pty_metrics_map (&pty);
+    tcgetattr (pty.fd, &pty.term);
+
+    ss = session_new (this, (char *) data + sizeof (st), fds[0], &pty);
+    ss->waitattach = st.waitattach;
+    ss->render_signals = st.render_signals;
+
+    /* the ring that follows, ends at out_seq */
+    ss->out_seq = st.out_seq - st.ring_len;
+
+    *ssp = ss;
+    return OK;
+  }
+
+  if (hdr->arg is HANDOVER_CLIENT) {
+    vtach_handover_client st;
+    if (NULL is ss or num_fds isnot 1 or hdr->len < sizeof (st))
+      return NOTOK;
+
+    memcpy (&st, data, sizeof (st));
+
+    struct client *p = client_new (ss, fds[0], &ss->clients);
+    p->attached = st.attached;
+    p->said_hello = st.said_hello;
+    p->needs_repaint = st.needs_repaint;
+
+    p->rd.len = hdr->len - sizeof (st);
+    memcpy (p->rd.buf, data + sizeof (st), p->rd.len);
+    p->in_held = (p->rd.len > 0);
+    return OK;
+  }
+
+  return NOTOK;
+}
+
+/* returns OK, once the old master said that it is done */
+private int pty_handover_recv (vtach_t *this, int s) {
+  unsigned char *data = Alloc (SOCKET_MAX_DATA_SIZE);
+  struct session *ss = NULL;
+  msg_hdr hdr;
+  int fds[MSG_MAX_FDS];
+  int num_fds;
+  int retval = NOTOK;
+
+  while (OK is sock_recv_msg (s, &hdr, data, fds, &num_fds)) {
+    if (hdr.type is MSG_UPGRADE and hdr.arg is HANDOVER_DONE) {
+      retval = OK;
+      break;
     }
 
-    /* chmod the socket if necessary. */
-    if (has_attached_client isnot new_has_attached_client) {
-      update_socket_modes ($my(sockname), new_has_attached_client);
-      has_attached_client = new_has_attached_client;
+    if (NOTOK is pty_handover_message (this, &ss, &hdr, data, fds, num_fds)) {
+      for (int i = 0; i < num_fds; i++)
+        close (fds[i]);
+      break;
     }
+  }
 
-    if (select (max_fd + 1, &readfds, NULL, NULL, NULL) < 0) {
-      if (errno is EINTR or errno isnot EAGAIN)
-        continue;
+  Free (data);
+  return retval;
+}
 
-      unlink ($my(sockname));
-      exit (1);
+/* Takes over the sessions of a running master (or of the daemon, if one is
+ * set): they come as descriptors with their state, and the old master exits,
+ * while this process goes to the background and serves them. So a newer
+ * build replaces a running one, and the programs and their clients do not
+ * notice, but for a short pause. */
+private int vtach_pty_upgrade (vtach_t *this) {
+  char *sockname = ($my(ctlname) ? $my(ctlname) : $my(sockname));
+
+  int s = self(sock.connect, sockname);
+  if (NOTOK is s) {
+    fprintf (stderr, "%s: %s\n", sockname, strerror (errno));
+    return NOTOK;
+  }
+
+  int fd[2];
+  if (NOTOK is self(sock.hello, s) or
+      NOTOK is self(sock.send_msg, s, MSG_UPGRADE, 0, NULL, 0) or
+      -1 is pipe (fd)) {
+    fprintf (stderr, "%s: %s\n", sockname, strerror (errno));
+    close (s);
+    return NOTOK;
+  }
+
+  pid_t pid = fork ();
+
+  if (pid < 0) {
+    fprintf (stderr, "fork: %s\n", strerror (errno));
+    close (fd[0]);
+    close (fd[1]);
+    close (s);
+    return NOTOK;
+  }
+
+  if (pid is 0) {
+    close (fd[0]);
+    setsid ();
+
+    if (NOTOK is pty_handover_recv (this, s) or
+        NOTOK is self(sock.send_msg, s, MSG_UPGRADE, 0, NULL, 0)) {
+      dup2 (fd[1], 2);
+      fprintf (stderr, "%s: the handover failed\n", sockname);
+      _exit (1);
     }
 
-    /* New client? */
-    if (FD_ISSET(s, &readfds))
-      pty_socket_activity (this, s);
+    close (s);
+    close (fd[1]);
+
+    pty_daemonize ();
+    pty_serve (this);
+    _exit (0);
+  }
+
+  close (s);
+  close (fd[1]);
+
+  /* empty, unless the handover failed */
+  char buf[256];
+  ssize_t n;
+  while (-1 is (n = read (fd[0], buf, sizeof (buf))) and errno is EINTR);
+  close (fd[0]);
+
+  if (n > 0) {
+    fd_write_all (2, buf, n);
+    return NOTOK;
+  }
+
+  return OK;
+}
+
+/* the daemon, when there is none yet; a second one that races it, fails to
+ * bind its socket and goes */
+private void daemon_spawn (vtach_t *this, int s) {
+  pid_t pid = fork ();
+  if (pid isnot 0) {
+    if (pid > 0) waitpid (pid, NULL, 0);
+    return;
+  }
+
+  /* detach from the waiting parent */
+  if (fork () isnot 0) _exit (0);
+
+  /* the session that is about to be handed, comes back as descriptors */
+  close (s);
+  close ($my(pty).fd);
+  pty_metrics_close (&$my(pty));
+
+  setsid ();
+  signal (SIGCHLD, SIG_IGN);
 
-    for (p = $my(clients); p; p = next) {
-      next = p->next;
-      if (FD_ISSET(p->fd, &readfds))
-        pty_client_activity (this, p);
+  struct stat st;
+  if (0 is stat ($my(ctlname), &st) and S_ISSOCK(st.st_mode)) {
+    int fd = self(sock.connect, $my(ctlname));
+    if (NOTOK isnot fd) { /* somebody else serves */
+      close (fd);
+      _exit (0);
     }
 
-    if (FD_ISSET($my(pty).fd, &readfds))
-      pty_activity (this, s);
+    unlink ($my(ctlname));
+  }
+
+  if (NOTOK is ($my(ctl_s) = self(sock.create, $my(ctlname))))
+    _exit (1);
+
+  fcntl ($my(ctl_s), F_SETFD, FD_CLOEXEC);
+
+  pty_daemonize ();
+  pty_serve (this);
+  _exit (0);
+}
+
+private int daemon_connect (vtach_t *this, int session_s) {
+  int s = NOTOK;
+
+  for (int i = 0; i < 50; i++) {
+    if (NOTOK isnot (s = self(sock.connect, $my(ctlname))))
+      break;
+
+    if (0 is i)
+      daemon_spawn (this, session_s);
+
+    usleep (20000);
+  }
+
+  if (NOTOK is s)
+    return NOTOK;
+
+  if (NOTOK is self(sock.hello, s)) {
+    close (s);
+    return NOTOK;
+  }
+
+  return s;
+}
+
+/* In daemon mode, the program is started here and its pty, with the socket
+ * of the session, is handed to the daemon. This is done by a process that
+ * exits right after, so the program is not a child of the caller. */
+private int pty_daemon_add (vtach_t *this, int s, int argc, char **argv) {
+  pid_t pid = fork ();
+
+  if (pid < 0) {
+    fprintf (stderr, "fork: %s\n", strerror (errno));
+    return NOTOK;
+  }
+
+  if (pid > 0) {
+    int status;
+    close (s);
+    if (-1 is waitpid (pid, &status, 0) or 0 is WIFEXITED(status) or WEXITSTATUS(status))
+      return NOTOK;
+
+    return OK;
   }
+
+  if (pty_child (this, argc, argv) < 0) {
+    fprintf (stderr, "init_pty: %s\n", strerror (errno));
+    _exit (1);
+  }
+
+  int c = daemon_connect (this, s);
+  if (NOTOK is c) {
+    fprintf (stderr, "%s: can not connect to the daemon\n", $my(ctlname));
+    kill ($my(pty).pid, SIGHUP);
+    _exit (1);
+  }
+
+  size_t namelen = bytelen ($my(sockname)) + 1;
+  size_t len = sizeof (vtach_session_msg) + namelen;
+  char *data = Alloc (len);
+
+  vtach_session_msg msg = {.pid = $my(pty).pid, .render_signals = $my(render_signals)};
+  msg.ws.ws_row = Vwm.get.lines ($my(objects)[VWM_OBJECT]);
+  msg.ws.ws_col = Vwm.get.columns ($my(objects)[VWM_OBJECT]);
+  memcpy (data, &msg, sizeof (msg));
+  memcpy (data + sizeof (msg), $my(sockname), namelen);
+
+  int fds[MSG_MAX_FDS] = {s, $my(pty).fd, $my(pty).metrics_fd, $my(pty).metrics_wake};
+  msg_hdr hdr = {.len = 0, .type = MSG_PUSH, .flags = 0, .arg = 0};
+
+  if (NOTOK is sock_send_fds (c, MSG_ADD, 0, data, len, fds,
+        pty_metrics_num_fds (&$my(pty))) or
+      NOTOK is sock_read_all (c, &hdr, MSG_HDR_SIZE) or
+      hdr.type isnot MSG_ADD or hdr.arg isnot 0) {
+    fprintf (stderr, "%s: the daemon refused the session: %s\n", $my(sockname),
+        (hdr.type is MSG_ADD ? strerror (hdr.arg) : "protocol error"));
+    kill ($my(pty).pid, SIGHUP);
+    _exit (1);
+  }
+
+  _exit (0);
 }
 
 private int vtach_pty_main (vtach_t *this, int argc, char **argv) {
@@ -732,7 +2947,7 @@ private int vtach_pty_main (vtach_t *this, int argc, char **argv) {
 
   /* If FD_CLOEXEC works, create a pipe and use it to report any errors
   ** that occur while trying to execute the program. */
-  if (pipe (fd) >= 0) {
+  if (NULL is $my(ctlname) and pipe (fd) >= 0) {
     if (fcntl (fd[0], F_SETFD, FD_CLOEXEC) < 0 or
         fcntl (fd[1], F_SETFD, FD_CLOEXEC) < 0) {
       close (fd[0]);
@@ -751,6 +2966,15 @@ private int vtach_pty_main (vtach_t *this, int argc, char **argv) {
     return retval;
   }
 
+  if ($my(ctlname)) {
+    if (NOTOK is pty_daemon_add (this, s, argc, argv)) {
+      unlink ($my(sockname));
+      return NOTOK;
+    }
+
+    return 0;
+  }
+
   pid_t pid = fork ();
 
   if (pid < 0) {
@@ -833,6 +3057,14 @@ private int vtach_init_pty (vtach_t *this, char *sockname) {
   $my(no_suspend) = 0;
   $my(detach_char) = 04;
   $my(waitattach) = 1;
+  $my(overflow_policy) = VTACH_OVERFLOW_REPAINT;
+  $my(zero_copy) = 0;
+  $my(render_signals) = 1;
+  $my(view_ms) = 0;
+  $my(sessions) = NULL;
+  $my(ctlname) = NULL;
+  $my(ctl_s) = -1;
+  $my(ctl_clients) = NULL;
 
   $my(pty_main_cb) = vtach_pty_main_default;
   $my(exec_child_cb) = vtach_exec_child_default;
@@ -849,6 +3081,34 @@ private void vtach_set_exec_child_cb (vtach_t *this, PtyOnExecChild_cb cb) {
   $my(exec_child_cb) = cb;
 }
 
+/* sessions are hosted by the daemon that listens on ctlname, which is
+ * started when there is none */
+private void vtach_set_daemon (vtach_t *this, char *ctlname) {
+  $my(ctlname) = ctlname;
+}
+
+/* The program is told with SIGUSR1 that no client is attached, and with
+ * SIGUSR2 that one is, so it can skip the rendering meanwhile (vwm does).
+ * Turn it off for a program that does not expect them. */
+private void vtach_set_render_signals (vtach_t *this, int render_signals) {
+  $my(render_signals) = render_signals;
+}
+
+private void vtach_set_zero_copy (vtach_t *this, int zero_copy) {
+  $my(zero_copy) = zero_copy;
+}
+
+/* makes the tty a viewer, with a snapshot every ms milliseconds at most
+ * (0 for the default) */
+private void vtach_set_view (vtach_t *this, int ms) {
+  if (ms <= 0) ms = VIEW_DEFAULT_MS;
+  $my(view_ms) = (ms > 0xffff ? 0xffff : ms);
+}
+
+private void vtach_set_overflow_policy (vtach_t *this, int policy) {
+  $my(overflow_policy) = policy;
+}
+
 private void vtach_set_pty_main_cb (vtach_t *this, PtyMain_cb cb) {
   $my(pty_main_cb) = cb;
 }
@@ -894,6 +3154,11 @@ public vtach_t *__init_vtach__ (vwm_t *vwm) {
       .object = vtach_set_object,
       .at_exit_cb = vtach_set_at_exit_cb,
       .pty_main_cb = vtach_set_pty_main_cb,
+      .daemon = vtach_set_daemon,
+      .zero_copy = vtach_set_zero_copy,
+      .render_signals = vtach_set_render_signals,
+      .view = vtach_set_view,
+      .overflow_policy = vtach_set_overflow_policy,
       .exec_child_cb = vtach_set_exec_child_cb
     },
     .get = (vtach_get_self) {
@@ -909,10 +3174,17 @@ public vtach_t *__init_vtach__ (vwm_t *vwm) {
     .sock = (vtach_sock_self) {
       .create = vtach_sock_create,
       .connect = vtach_sock_connect,
-      .send_data = vtach_sock_send_data
+      .open = vtach_sock_open,
+      .hello = vtach_sock_hello,
+      .send_msg = vtach_sock_send_msg,
+      .send_data = vtach_sock_send_data,
+      .send_file = vtach_sock_send_file,
+      .send_input = vtach_sock_send_input,
+      .stats = vtach_sock_stats
     },
     .pty = (vtach_pty_self) {
-      .main = vtach_pty_main
+      .main = vtach_pty_main,
+      .upgrade = vtach_pty_upgrade
     },
     .tty = (vtach_tty_self) {
       .main = vtach_tty_main
@@ -942,9 +3214,9 @@ public void __deinit_vtach__ (vtach_t **thisp) {
     $my(at_exit_cbs)[i] (this);
 
   if ($my(num_at_exit_cbs))
-    free ($my(at_exit_cbs));
+    Free ($my(at_exit_cbs));
 
-  free (this->prop);
-  free (this);
+  Free (this->prop);
+  Free (this);
   *thisp = NULL;
 }
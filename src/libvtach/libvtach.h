@@ -1,12 +1,62 @@
 #ifndef VTACH_H
 #define VTACH_H
 
+/* Every message is a header (the payload length, the type and an
+ * argument) followed by the payload. A client starts with MSG_HELLO,
+ * carrying VTACH_PROTO_VERSION, and the server replies with its own.
+ *
+ * The output is numbered by its offset in the stream of the pty. MSG_SYNC
+ * tells a client the offset (a uint64_t) of the output that follows, and
+ * a MSG_ATTACH that carries the offset of a client, resumes from there.
+ *
+ * The control socket of a daemon takes MSG_ADD, that hands it a session
+ * (its socket and its pty as descriptors), and MSG_OPEN with the name of a
+ * session, after which the connection is to that session. Both replies
+ * carry an errno value as argument, 0 on success.
+ *
+ * MSG_UPGRADE, from a process of a newer build, asks a master (or a daemon)
+ * to hand it everything it serves and exit; see Vtach.pty.upgrade().
+ *
+ * MSG_SEND is input for a window and a frame of the program (a vwm), by
+ * index or by name: their names, each terminated with a '\0', and the data.
+ * The reply (0 or an errno value) comes once the data has been written to
+ * the pty, and until then nothing else is read from the client.
+ *
+ * MSG_VIEW makes the client a viewer, with the milliseconds between two
+ * snapshots as argument (0 for the default): it gets the screen, as the
+ * master keeps it, at most that often and only when it changed, and what
+ * it sends (but a change of that rate) is dropped.
+ *
+ * MSG_STATS asks for the metrics of the session, and the reply carries them
+ * in the text exposition format (as Prometheus reads it): those of the
+ * master, and those that the program (a vwm) last published, which are
+ * taken from a memory that both share, so the program is not disturbed;
+ * see Vtach.sock.stats(). */
+
+#define VTACH_PROTO_VERSION 1
+#define VTACH_MAX_DATA_SIZE (1 << 16)
+
 enum {
   MSG_PUSH    = 0,
   MSG_ATTACH  = 1,
   MSG_DETACH  = 2,
   MSG_WINCH   = 3,
   MSG_REDRAW  = 4,
+  MSG_HELLO   = 5,
+  MSG_OUTPUT  = 6,
+  MSG_SYNC    = 7,
+  MSG_OPEN    = 8,
+  MSG_ADD     = 9,
+  MSG_UPGRADE = 10,
+  MSG_SEND    = 11,
+  MSG_VIEW    = 12,
+  MSG_STATS   = 13,
+};
+
+/* what happens to a client that does not keep up with the output */
+enum {
+  VTACH_OVERFLOW_REPAINT = 0, /* skip the output, then repaint it */
+  VTACH_OVERFLOW_DROP    = 1  /* disconnect it */
 };
 
 typedef struct vtach_t vtach_t;
@@ -19,7 +69,12 @@ typedef void (*PtyAtExit_cb) (vtach_t *);
 typedef struct vtach_set_self {
   void
     (*object) (vtach_t *, void *, int),
+    (*daemon) (vtach_t *, char *),
     (*at_exit_cb) (vtach_t *, PtyAtExit_cb),
+    (*zero_copy) (vtach_t *, int),
+    (*render_signals) (vtach_t *, int),
+    (*overflow_policy) (vtach_t *, int),
+    (*view) (vtach_t *, int),
     (*pty_main_cb) (vtach_t *, PtyMain_cb),
     (*exec_child_cb) (vtach_t *, PtyOnExecChild_cb);
 } vtach_set_self;
@@ -45,11 +100,19 @@ typedef struct vtach_sock_self {
   int
     (*create) (vtach_t *, char *),
     (*connect) (vtach_t *, char *),
-    (*send_data) (vtach_t *, int, char *, size_t, int);
+    (*open) (vtach_t *, int, char *),
+    (*hello) (vtach_t *, int),
+    (*send_msg) (vtach_t *, int, int, int, char *, size_t),
+    (*send_data) (vtach_t *, int, char *, size_t, int),
+    (*send_file) (vtach_t *, int, char *, char *, int),
+    (*send_input) (vtach_t *, int, char *, char *, char *, size_t),
+    (*stats) (vtach_t *, int, int);
 } vtach_sock_self;
 
 typedef struct vtach_pty_self {
-  int (*main) (vtach_t *this, int, char **);
+  int
+    (*main) (vtach_t *this, int, char **),
+    (*upgrade) (vtach_t *this);
 } vtach_pty_self;
 
 typedef struct vtach_tty_self {
@@ -6,8 +6,10 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <termios.h>
@@ -23,9 +25,15 @@ static const char usage[] =
   "\n"
   "Options:\n"
   "    -s, --sockname=     set the socket name [required]\n"
-  "    -a, --attach        attach to the specified socket\n";
-
-private char **set_argv (int *argc, char **argv, char **sockname, int *attach) {
+  "    -a, --attach        attach to the specified socket\n"
+  "    -r, --read-only     attach as a viewer, that gets snapshots of the screen\n"
+  "        --rate=         the milliseconds between two snapshots of a viewer\n"
+  "    -z, --zero-copy     pass the output to the clients with splice(2)\n"
+  "    -d, --daemon=       host the session in the daemon of this control socket\n"
+  "    -U, --upgrade       take over the sessions of the running master (or daemon)\n"
+  "        --stats         print the metrics of the session and exit\n";
+
+private char **set_argv (int *argc, char **argv, char **sockname, int *attach, int *zero_copy, char **ctlname, int *upgrade, int *read_only, int *rate, int *stats) {
   argv++; *argc -= 1;
 
   char **largv = argv;
@@ -65,6 +73,26 @@ private char **set_argv (int *argc, char **argv, char **sockname, int *attach) {
       continue;
     }
 
+    if (0 == strncmp (argv[i], "--daemon=", 9)) {
+      char *sp = strchr (argv[i], '=') + 1;
+      ifnot (*sp)
+        continue;
+
+      *ctlname = sp;
+      largv++;
+      continue;
+    }
+
+    if (0 == strcmp (argv[i], "-d")) {
+      if (i + 1 == *argc)
+        continue;
+
+      *ctlname = argv[i+1];
+      skip = 1;
+      largv += 2;
+      continue;
+    }
+
     if (0 == strcmp (argv[i], "-a") or
         0 == strcmp (argv[i], "--attach")) {
       *attach = 1;
@@ -72,6 +100,41 @@ private char **set_argv (int *argc, char **argv, char **sockname, int *attach) {
       continue;
     }
 
+    if (0 == strcmp (argv[i], "-r") or
+        0 == strcmp (argv[i], "--read-only")) {
+      *attach = 1;
+      *read_only = 1;
+      largv++;
+      continue;
+    }
+
+    if (0 == strncmp (argv[i], "--rate=", 7)) {
+      *rate = atoi (strchr (argv[i], '=') + 1);
+      if (*rate < 0) *rate = 0;
+      largv++;
+      continue;
+    }
+
+    if (0 == strcmp (argv[i], "-U") or
+        0 == strcmp (argv[i], "--upgrade")) {
+      *upgrade = 1;
+      largv++;
+      continue;
+    }
+
+    if (0 == strcmp (argv[i], "--stats")) {
+      *stats = 1;
+      largv++;
+      continue;
+    }
+
+    if (0 == strcmp (argv[i], "-z") or
+        0 == strcmp (argv[i], "--zero-copy")) {
+      *zero_copy = 1;
+      largv++;
+      continue;
+    }
+
     n++;
   }
 
@@ -85,10 +148,16 @@ int main (int argc, char **argv) {
 
   int
     retval = 1,
-    attach = 0;
+    attach = 0,
+    zero_copy = 0,
+    upgrade = 0,
+    stats = 0,
+    rate = 0,
+    read_only = 0;
   char *sockname = NULL;
+  char *ctlname = NULL;
 
-  argv = set_argv (&argc, argv, &sockname, &attach);
+  argv = set_argv (&argc, argv, &sockname, &attach, &zero_copy, &ctlname, &upgrade, &read_only, &rate, &stats);
 
   if (argc < 0) goto theend;
 
@@ -101,6 +170,37 @@ int main (int argc, char **argv) {
   if (NOTOK is Vtach.init.pty (vtach, sockname))
     goto theend;
 
+  Vtach.set.zero_copy (vtach, zero_copy);
+
+  if (ctlname)
+    Vtach.set.daemon (vtach, ctlname);
+
+  /* a rate alone does not make a viewer */
+  if (read_only)
+    Vtach.set.view (vtach, rate);
+
+  if (upgrade) {
+    retval = (OK is Vtach.pty.upgrade (vtach) ? 0 : 1);
+    goto theend;
+  }
+
+  if (stats) {
+    int s = Vtach.sock.connect (vtach, sockname);
+    if (NOTOK is s) {
+      fprintf (stderr, "%s: %s\n", sockname, strerror (errno));
+      goto theend;
+    }
+
+    if (NOTOK is Vtach.sock.hello (vtach, s) or
+        NOTOK is Vtach.sock.stats (vtach, s, STDOUT_FILENO))
+      fprintf (stderr, "%s: can not get the metrics\n", sockname);
+    else
+      retval = 0;
+
+    close (s);
+    goto theend;
+  }
+
   ifnot (attach)
     retval = Vtach.pty.main (vtach, argc, argv);
 
@@ -41,6 +41,14 @@ typedef void (*AllocErrorHandlerF) (int, size_t, char *, const char *, int);
 
 AllocErrorHandlerF AllocErrorHandler;
 
+/* when it is set, it is called with every allocation (new, 0, size),
+ * reallocation (new, old, size) and Free() (NULL, old, 0), and the name
+ * of the function; old is the address that has been released, as an
+ * integer, since it is not a pointer to anything anymore */
+typedef void (*AllocAccountF) (void *, uintptr_t, size_t, const char *);
+
+extern AllocAccountF AllocAccount;
+
 #define __REALLOC__ realloc
 #define __CALLOC__  calloc
 
@@ -62,21 +70,36 @@ AllocErrorHandlerF AllocErrorHandler;
   } else {                                                            \
     if (NULL == (ptr__ = __CALLOC__ (1, (size))))                     \
       AllocErrorHandler (errno, (size), __FILE__, __func__, __LINE__);\
+    else if (AllocAccount)                                            \
+      AllocAccount (ptr__, 0, (size), __func__);                      \
     }                                                                 \
   ptr__;                                                              \
   })
 
+/* the old address is taken into a volatile, as otherwise gcc reads it after
+ * realloc() (and warns of a use after free) */
 #define Realloc(ptr, size) ({                                         \
   void *ptr__ = NULL;                                                 \
   if (MEM_IS_INT_OVERFLOW (1, (size))) {                              \
     errno = INTEGEROVERFLOW_ERROR;                                    \
     AllocErrorHandler (errno, (size),  __FILE__, __func__, __LINE__); \
   } else {                                                            \
-    if (NULL == (ptr__ = __REALLOC__ ((ptr), (size))))                \
+    void *old__ = (ptr);                                              \
+    volatile uintptr_t addr__ = (uintptr_t) old__;                    \
+    if (NULL == (ptr__ = __REALLOC__ (old__, (size))))                \
       AllocErrorHandler (errno, (size), __FILE__, __func__, __LINE__);\
+    else if (AllocAccount)                                            \
+      AllocAccount (ptr__, addr__, (size), __func__);                 \
     }                                                                 \
   ptr__;                                                              \
   })
+
+#define Free(ptr) ({                                                  \
+  void *ptr__ = (ptr);                                                \
+  if (AllocAccount && ptr__)                                          \
+    AllocAccount (NULL, (uintptr_t) ptr__, 0, __func__);              \
+  free (ptr__);                                                       \
+  })
 #endif /* Alloc */
 
 #ifdef $my
@@ -1,6 +1,7 @@
 #define _XOPEN_SOURCE 700
 #define _DEFAULT_SOURCE
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,6 +10,7 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/select.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
@@ -19,6 +21,7 @@
 #include <time.h>
 #include <dirent.h>
 #include <signal.h>
+#include <pthread.h>
 
 #include <errno.h>
 
@@ -62,6 +65,45 @@ static vwm_t *VWM;
 
 #define TABWIDTH    8
 
+/* the pause between the reads of a vwm that is not drawn, so the output
+ * gathers and is taken in fewer, bigger reads */
+#define UNDRAWN_READ_DELAY_US 250
+
+#define VWM_SEARCH_MAX_HITS      1000
+#define VWM_SEARCH_MAX_THREADS   32
+#define VWM_SEARCH_MAX_LINE_LEN  1024
+#define VWM_SEARCH_CHUNK_SIZE    (1 << 16)
+
+#define LOGTS_BLOCK_SIZE  4096
+#define LOGTS_FMT_LEN     23
+
+#define LOG_MIN_SEGMENT_SIZE  (1 << 16)
+#define LOG_LZ_BLOCK_SIZE     (1 << 16)
+#define LOG_LZ_HASH_BITS      13
+#define LOG_LZ_MAGIC          "VLZ1"
+#define LOG_LZ_MAGIC_LEN      4
+#define LOG_LZ_EXT            ".lz"
+
+#define REC_MAGIC           "VWMREC\001\n"
+#define REC_IDX_MAGIC       "VWMIDX\001\n"
+#define REC_MAGIC_LEN       8
+#define REC_IDX_EXT         ".idx"
+#define REC_IDX_ENTRY_LEN   24
+#define REC_OUTPUT          1
+#define REC_FRAME           2
+#define REC_KEYFRAME        3
+#define REC_KEYFRAME_MS     10000
+#define REC_KEYFRAME_BYTES  (1 << 18)
+#define REC_MAX_PENDING     (1 << 25)
+
+#define UNIMPLEMENTED_SLOTS    128
+#define UNIMPLEMENTED_MAX      96
+#define UNIMPLEMENTED_DUMP_MS  1000
+
+#define LOG_WORKER_NONE     0
+#define LOG_WORKER_RUNNING  1
+#define LOG_WORKER_QUIT     2
+
 #define ISDIGIT(c_)     ('0' <= (c_) && (c_) <= '9')
 #define IS_UTF8(c_)     (((c_) & 0xC0) == 0x80)
 #define isnotutf8(c_)   (IS_UTF8 (c_) == 0)
@@ -155,6 +197,164 @@ struct tmpname_t {
   string_t *fname;
  };
 
+/* Per line timestamps of the log file. Each block keeps the monotonic time
+ * (in milliseconds) of its first line and a LEB128 varint with the delta to
+ * the previous line, for every line that follows (the first one is 0). */
+typedef struct logts_block logts_block;
+
+struct logts_block {
+  long base_ms;
+
+  int
+    num_lines,
+    num_bytes;
+
+  uchar bytes[LOGTS_BLOCK_SIZE];
+
+  logts_block
+    *next,
+    *prev;
+};
+
+typedef struct logts_t {
+  long
+    last_ms,
+    num_lines;
+
+  logts_block
+    *head,
+    *tail;
+} logts_t;
+
+/* A sealed part of a frame log; it lives in "logfile.seq" and once it has
+ * been compressed by the log worker, in "logfile.seq.lz". */
+typedef struct log_segment log_segment;
+
+struct log_segment {
+  long
+    seq,
+    num_lines;
+
+  string_t *fname;
+
+  log_segment *next;
+};
+
+/* A histogram of latencies in microseconds, as HdrHistogram keeps them:
+ * the values below HIST_SUB have a bucket each, and every power of two
+ * above is split in HIST_SUB buckets, so a bucket is within 1/HIST_SUB of
+ * its values; the last one takes everything above a minute. */
+#define HIST_SUB     8
+#define HIST_BUCKETS 200
+
+/* output that comes later than that after a keystroke, is not its echo */
+#define LATENCY_MAX_US 5000000
+
+typedef struct vwm_hist {
+  long
+    count,
+    min,
+    max,
+    sum;
+
+  uint32_t buckets[HIST_BUCKETS];
+} vwm_hist;
+
+typedef struct log_job log_job;
+
+struct log_job {
+  char *fname;
+  log_job *next;
+};
+
+/* The session recorder; the main loop appends the records to buf (and
+ * the keyframe index entries to idx_buf), and the writer thread swaps
+ * them out and writes them to disk, so the main loop never waits for
+ * the disk. offset is the offset in the file of the next record. */
+typedef struct vwm_recorder {
+  int
+    fd,
+    gen,
+    quit,
+    idx_fd;
+
+  long
+    dropped,
+    start_ms;
+
+  off_t offset;
+
+  string_t
+    *buf,
+    *idx_buf;
+
+  pthread_t thread;
+  pthread_cond_t cond;
+  pthread_mutex_t mutex;
+} vwm_recorder;
+
+typedef struct rec_idx_entry {
+  long
+    ts,
+    offset;
+
+  int frame_id;
+} rec_idx_entry;
+
+struct vwm_replay {
+  uchar *map;
+  size_t size;
+
+  long num_idx;
+  rec_idx_entry *idx;
+
+  size_t pos;
+  int frame_id;
+
+  vwm_replay_info info;
+};
+
+typedef struct search_job {
+  char
+    **rows,
+    *win_name;
+
+  int
+    win_idx,
+    frame_idx,
+    num_rows,
+    num_hits,
+    hits_idx,
+    max_hits,
+    log_lines,
+    num_logs,
+    *log_fds,
+    *log_compressed;
+
+  off_t *log_sizes;
+
+  vwm_search_hit *hits;
+} search_job;
+
+typedef struct search_ctx {
+  char *pattern;
+  size_t pattern_len;
+
+  int
+    max_hits,
+    num_jobs,
+    next_job,
+    jobs_done,
+    is_cancelled,
+    num_threads,
+    notify[2];
+
+  struct timespec ts_beg;
+  pthread_t threads[VWM_SEARCH_MAX_THREADS];
+
+  search_job *jobs;
+} search_ctx;
+
 typedef string_t *(*FrameProcessChar_cb) (vwm_frame *, string_t *, int);
 
 struct vwm_frame {
@@ -166,7 +366,8 @@ struct vwm_frame {
   uchar
     charset[2],
     textattr,
-    saved_textattr;
+    saved_textattr,
+    *wrapped;
 
   int
     fd,
@@ -188,7 +389,10 @@ struct vwm_frame {
     param_idx,
     at_frame,
     is_visible,
+    alt_screen,
     remove_log,
+    pending_rows,
+    pending_cols,
     saved_row_pos,
     saved_col_pos,
     old_attribute,
@@ -204,6 +408,37 @@ struct vwm_frame {
 
   pid_t pid;
 
+  int
+    id,
+    rec_gen,
+    log_compress;
+
+  size_t rec_bytes;
+
+  long
+    batch_ms,
+    rec_keyframe_ms,
+    log_seq,
+    log_lines,
+    log_max_size,
+    log_segment_size;
+
+  off_t log_size;
+
+  vframe_stats stats;
+
+  /* the keystroke that waits for its output, the parse of that output, and
+   * the histograms of them, allocated with the first */
+  long
+    lat_input_ns,
+    lat_parsed_ns;
+
+  vwm_hist *latency;
+
+  logts_t logts;
+
+  log_segment *log_segments;
+
   string_t
     *logfile,
     *render;
@@ -281,9 +516,17 @@ struct vwm_prop {
     *sequences_fname,
     *unimplemented_fname;
 
-  FILE
-    *unimplemented_fp,
-    *sequences_fp;
+  FILE *unimplemented_fp;
+
+  /* the unimplemented sequences, in an open addressing table (see
+   * vt_unimplemented()) */
+  vwm_unimplemented unimplemented[UNIMPLEMENTED_SLOTS];
+  int
+    num_unimplemented,
+    unimplemented_dirty;
+  long
+    unimplemented_dropped,
+    unimplemented_dump_ms;
 
   int
     state,
@@ -293,6 +536,24 @@ struct vwm_prop {
     need_resize,
     first_column;
 
+  /* 0 while nobody looks (see vwm_sigrender_handler()) */
+  int
+    render,
+    need_draw;
+
+  /* bytes of the standard input that were read ahead, and put back; at
+   * most the ESC _ and the header of vwm_input_send() */
+  char unread[16];
+  int num_unread;
+
+  /* an input that is sent to a frame (see vwm_input_send()) */
+  vwm_frame *send_frame;
+  size_t
+    send_left,
+    send_len,
+    send_off;
+  char send_buf[BUFSIZE];
+
   uint modes;
 
   vwm_win
@@ -310,15 +571,55 @@ struct vwm_prop {
   VwmOnTab_cb on_tab_cb;
   VwmRLine_cb rline_cb;
   VwmEditFile_cb edit_file_cb;
+  VwmSearch_cb search_cb;
+
+  /* a search that runs in the background (see vwm_search_run()) */
+  search_ctx *search;
 
   int num_at_exit_cbs;
   VwmAtExit_cb *at_exit_cbs;
 
   int num_process_input_cbs;
   ProcessInput_cb *process_input_cbs;
+
+  int
+    rec_gen,
+    frame_id_gen;
+
+  vwm_recorder *recorder;
+
+  /* where the metrics are published (see vwm_publish_metrics()) */
+  vwm_metrics *metrics;
+  size_t metrics_size;
+  long metrics_ms;
+  uint metrics_req;
+  int metrics_wake;
+
+  /* what a loop of the host waits on (see vwm_prepare()) */
+  vwm_poll poll_set;
+  int
+    poll_size,
+    is_started;
+
+  /* where the output goes without a terminal (see vt_write()) */
+  VwmOutput_cb output_cb;
+  void *output_object;
+  int output_fd;
+
+  int log_worker_state;
+  log_job *log_jobs;
+  pthread_t log_worker;
+  pthread_cond_t log_cond;
+  pthread_mutex_t log_mutex;
 };
 
 static void vwm_sigwinch_handler (int sig);
+static void vwm_sigrender_handler (int sig);
+static void vwm_handle_sigwinch (vwm_t *);
+static void frame_record_output (vwm_frame *, vwm_recorder *, char *, int);
+static void frame_feed_output (vwm_frame *, const uchar *, size_t);
+static void frame_record_keyframe (vwm_frame *, vwm_recorder *);
+static long logts_real_offset (void);
 
 static const utf8 offsetsFromUTF8[6] = {
   0x00000000UL, 0x00003080UL, 0x000E2080UL,
@@ -439,6 +740,312 @@ static int fd_write (int fd, char *buf, size_t len) {
   return retval;
 }
 
+static long vt_clock_ms (void) {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static long vt_clock_ns (void) {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (long) ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* Every thread that traces, gets a ring that only it writes; the rings
+ * are linked, so they can be dumped. They are shared by the instances of
+ * the process, and are released with the last one; TRACE_ON counts the
+ * instances that trace, and TRACE_GEN tells a thread that its ring has
+ * been released. */
+#define TRACE_RING_EVENTS (1 << 16)
+
+typedef struct trace_ring trace_ring;
+
+struct trace_ring {
+  uint thread;
+  long long head;
+
+  vwm_trace_event *events;
+  trace_ring *next;
+};
+
+static volatile int TRACE_ON = 0;
+static volatile int TRACE_DUMPED = 0;
+static int TRACE_USERS = 0;
+static uint TRACE_GEN = 0;
+static uint TRACE_NUM_RINGS = 0;
+static trace_ring *TRACE_RINGS = NULL;
+static pthread_mutex_t TRACE_MUTEX = PTHREAD_MUTEX_INITIALIZER;
+static __thread trace_ring *TRACE_RING = NULL;
+static __thread uint TRACE_RING_GEN = 0;
+
+#define TRACE_EVENT(...) do { if (TRACE_ON) trace_event (__VA_ARGS__); } while (0)
+
+static void trace_event (int type, int frame, uint a, uint b, uint c) {
+  trace_ring *r = TRACE_RING;
+
+  if (NULL is r or TRACE_RING_GEN isnot __atomic_load_n (&TRACE_GEN, __ATOMIC_ACQUIRE)) {
+    r = Alloc (sizeof (trace_ring));
+    r->events = Alloc (sizeof (vwm_trace_event) * TRACE_RING_EVENTS);
+
+    pthread_mutex_lock (&TRACE_MUTEX);
+    r->thread = TRACE_NUM_RINGS++;
+    r->next = TRACE_RINGS;
+    TRACE_RINGS = r;
+    TRACE_RING_GEN = TRACE_GEN;
+    pthread_mutex_unlock (&TRACE_MUTEX);
+
+    TRACE_RING = r;
+  }
+
+  vwm_trace_event *ev = &r->events[r->head & (TRACE_RING_EVENTS - 1)];
+  ev->ns = vt_clock_ns ();
+  ev->type = type;
+  ev->frame = frame;
+  ev->a = a;
+  ev->b = b;
+  ev->c = c;
+
+  __atomic_store_n (&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+/* it only writes, so it is safe in a signal handler */
+static int trace_write (int fd) {
+  vwm_trace_header hdr = {
+    .version = VWM_TRACE_VERSION,
+    .event_size = sizeof (vwm_trace_event),
+    .num_rings = TRACE_NUM_RINGS};
+
+  memcpy (hdr.magic, VWM_TRACE_MAGIC, sizeof (hdr.magic));
+
+  if (NOTOK is fd_write (fd, (char *) &hdr, sizeof (hdr))) return NOTOK;
+
+  for (trace_ring *r = TRACE_RINGS; r; r = r->next) {
+    long long head = __atomic_load_n (&r->head, __ATOMIC_ACQUIRE);
+    long long num = (head < TRACE_RING_EVENTS ? head : TRACE_RING_EVENTS);
+
+    vwm_trace_ring_header rhdr = {
+      .thread = r->thread, .num_events = num, .total = head};
+
+    if (NOTOK is fd_write (fd, (char *) &rhdr, sizeof (rhdr))) return NOTOK;
+
+    long long start = (head - num) & (TRACE_RING_EVENTS - 1);
+    long long first = (start + num > TRACE_RING_EVENTS ? TRACE_RING_EVENTS - start : num);
+
+    if (NOTOK is fd_write (fd, (char *) (r->events + start), sizeof (vwm_trace_event) * first))
+      return NOTOK;
+
+    if (num > first and NOTOK is fd_write (fd, (char *) r->events,
+        sizeof (vwm_trace_event) * (num - first)))
+      return NOTOK;
+  }
+
+  return OK;
+}
+
+static void trace_acquire (void) {
+  pthread_mutex_lock (&TRACE_MUTEX);
+  TRACE_USERS++;
+  pthread_mutex_unlock (&TRACE_MUTEX);
+}
+
+static void trace_release (void) {
+  pthread_mutex_lock (&TRACE_MUTEX);
+  if (--TRACE_USERS > 0) {
+    pthread_mutex_unlock (&TRACE_MUTEX);
+    return;
+  }
+
+  trace_ring *r = TRACE_RINGS;
+  while (r) {
+    trace_ring *tmp = r->next;
+    Free (r->events);
+    Free (r);
+    r = tmp;
+  }
+
+  TRACE_RINGS = NULL;
+  TRACE_NUM_RINGS = 0;
+  TRACE_RING = NULL;
+  TRACE_USERS = 0;
+  __atomic_add_fetch (&TRACE_GEN, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock (&TRACE_MUTEX);
+}
+
+/* The allocation accounting, that is the AllocAccount hook. The live
+ * pointers are kept in an open addressing table with linear probing, that
+ * grows at half full, and their sizes are summed by the function that
+ * allocated them, in a table of a fixed size. The tables are allocated
+ * with calloc(), so they are not counted. A pointer that is freed and
+ * not in the table, was allocated before the accounting was on, or by
+ * something else, and it is ignored. */
+/* one hook for the process: the libraries on top of this one (libvci.h)
+ * call it too */
+public AllocAccountF AllocAccount = NULL;
+
+#define ALLOC_SITES       512
+#define ALLOC_MIN_ENTRIES (1 << 12)
+
+typedef struct alloc_entry {
+  void *ptr;
+  size_t size;
+  int site;
+} alloc_entry;
+
+static alloc_entry *ALLOC_ENTRIES = NULL;
+static size_t ALLOC_CAP = 0;
+static size_t ALLOC_LEN = 0;
+static vwm_alloc_site *ALLOC_SITE = NULL;
+static vwm_alloc_stats ALLOC_TOTAL;
+static pthread_mutex_t ALLOC_MUTEX = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t alloc_hash (void *ptr) {
+  return (size_t) (((ulong) ptr >> 4) * 0x9E3779B97F4A7C15UL);
+}
+
+/* the last slot collects the sites that do not fit */
+static int alloc_site (const char *site) {
+  size_t h = alloc_hash ((void *) site);
+
+  for (int i = 0; i < ALLOC_SITES - 1; i++) {
+    int idx = (int) ((h + i) % (ALLOC_SITES - 1));
+    if (ALLOC_SITE[idx].site is site) return idx;
+
+    if (NULL is ALLOC_SITE[idx].site) {
+      ALLOC_SITE[idx].site = site;
+      return idx;
+    }
+  }
+
+  return ALLOC_SITES - 1;
+}
+
+static alloc_entry *alloc_find (void *ptr) {
+  size_t mask = ALLOC_CAP - 1;
+  for (size_t i = alloc_hash (ptr) & mask; ALLOC_ENTRIES[i].ptr; i = (i + 1) & mask)
+    if (ALLOC_ENTRIES[i].ptr is ptr) return &ALLOC_ENTRIES[i];
+
+  return NULL;
+}
+
+static void alloc_insert (alloc_entry *entries, size_t cap, alloc_entry *e) {
+  size_t mask = cap - 1;
+  size_t i = alloc_hash (e->ptr) & mask;
+  while (entries[i].ptr) i = (i + 1) & mask;
+  entries[i] = *e;
+}
+
+/* the entries that follow are shifted back, so there are no tombstones */
+static void alloc_remove (alloc_entry *e) {
+  size_t mask = ALLOC_CAP - 1;
+  size_t i = (size_t) (e - ALLOC_ENTRIES);
+  size_t j = i;
+
+  for (;;) {
+    j = (j + 1) & mask;
+    if (NULL is ALLOC_ENTRIES[j].ptr) break;
+
+    size_t k = alloc_hash (ALLOC_ENTRIES[j].ptr) & mask;
+    if ((i <= j) ? (i < k and k <= j) : (i < k or k <= j)) continue;
+
+    ALLOC_ENTRIES[i] = ALLOC_ENTRIES[j];
+    i = j;
+  }
+
+  ALLOC_ENTRIES[i].ptr = NULL;
+  ALLOC_LEN--;
+}
+
+static void alloc_forget (void *ptr) {
+  alloc_entry *e = alloc_find (ptr);
+  if (NULL is e) return;
+
+  vwm_alloc_site *s = &ALLOC_SITE[e->site];
+  s->live_bytes -= e->size;
+  s->live_allocs--;
+  ALLOC_TOTAL.live_bytes -= e->size;
+  ALLOC_TOTAL.live_allocs--;
+
+  alloc_remove (e);
+}
+
+static void alloc_account (void *ptr, uintptr_t old, size_t size, const char *site) {
+  pthread_mutex_lock (&ALLOC_MUTEX);
+  if (NULL is ALLOC_ENTRIES) goto theend;
+
+  if (old) alloc_forget ((void *) old);
+  if (NULL is ptr) goto theend;
+
+  /* a pointer that has been released with free() */
+  alloc_forget (ptr);
+
+  if (ALLOC_LEN + 1 > ALLOC_CAP / 2) {
+    alloc_entry *entries = calloc (ALLOC_CAP * 2, sizeof (alloc_entry));
+    if (NULL is entries) goto theend;
+
+    for (size_t i = 0; i < ALLOC_CAP; i++)
+      if (ALLOC_ENTRIES[i].ptr)
+        alloc_insert (entries, ALLOC_CAP * 2, &ALLOC_ENTRIES[i]);
+
+    free (ALLOC_ENTRIES);
+    ALLOC_ENTRIES = entries;
+    ALLOC_CAP *= 2;
+  }
+
+  alloc_entry e = {.ptr = ptr, .size = size, .site = alloc_site (site)};
+  alloc_insert (ALLOC_ENTRIES, ALLOC_CAP, &e);
+  ALLOC_LEN++;
+
+  vwm_alloc_site *s = &ALLOC_SITE[e.site];
+  s->live_bytes += size;
+  s->live_allocs++;
+  s->allocs++;
+  if (s->live_bytes > s->peak_bytes) s->peak_bytes = s->live_bytes;
+
+  ALLOC_TOTAL.live_bytes += size;
+  ALLOC_TOTAL.live_allocs++;
+  ALLOC_TOTAL.allocs++;
+  if (ALLOC_TOTAL.live_bytes > ALLOC_TOTAL.peak_bytes)
+    ALLOC_TOTAL.peak_bytes = ALLOC_TOTAL.live_bytes;
+
+theend:
+  pthread_mutex_unlock (&ALLOC_MUTEX);
+}
+
+static int alloc_site_cmp (const void *a, const void *b) {
+  const vwm_alloc_site *x = a, *y = b;
+  return (y->live_bytes > x->live_bytes) - (y->live_bytes < x->live_bytes);
+}
+
+static vwm_alloc_stats *alloc_get_stats (void) {
+  pthread_mutex_lock (&ALLOC_MUTEX);
+  vwm_alloc_stats *stats = NULL;
+  if (NULL is ALLOC_ENTRIES) goto theend;
+
+  stats = calloc (1, sizeof (vwm_alloc_stats));
+  if (NULL is stats) goto theend;
+
+  *stats = ALLOC_TOTAL;
+  stats->sites = calloc (ALLOC_SITES, sizeof (vwm_alloc_site));
+  if (NULL is stats->sites) goto theend;
+
+  for (int i = 0; i < ALLOC_SITES; i++)
+    if (ALLOC_SITE[i].allocs)
+      stats->sites[stats->num_sites++] = ALLOC_SITE[i];
+
+  qsort (stats->sites, stats->num_sites, sizeof (vwm_alloc_site), alloc_site_cmp);
+
+theend:
+  pthread_mutex_unlock (&ALLOC_MUTEX);
+  return stats;
+}
+
+static void alloc_release_stats (vwm_alloc_stats *stats) {
+  if (NULL is stats) return;
+  free (stats->sites);
+  free (stats);
+}
+
 static void fd_set_size (int fd, int rows, int cols) {
   struct winsize wsiz;
   wsiz.ws_row = rows;
@@ -508,8 +1115,8 @@ static string_t *string_reallocate (string_t *this, size_t size) {
 
 static void string_free (string_t *this) {
   if (this is NULL) return;
-  if (this->mem_size) free (this->bytes);
-  free (this);
+  if (this->mem_size) Free (this->bytes);
+  Free (this);
 }
 
 static string_t *string_new (size_t size) {
@@ -540,8 +1147,8 @@ static string_t *string_new_with (const char *bytes) {
 }
 
 static void string_release (string_t *this) {
-  free (this->bytes);
-  free (this);
+  Free (this->bytes);
+  Free (this);
 }
 
 static string_t *string_clear (string_t *this) {
@@ -570,6 +1177,18 @@ static string_t *string_append_with_len (string_t *this, char *bytes, size_t len
   return this;
 }
 
+/* like the above, but for binary data, that might contain '\0' */
+static string_t *string_append_data (string_t *this, const char *bytes, size_t len) {
+  size_t bts = this->num_bytes + len;
+  if (bts >= this->mem_size)
+    this = string_reallocate (this, bts - this->mem_size + 1);
+
+  memcpy (this->bytes + this->num_bytes, bytes, len);
+  this->num_bytes += len;
+  this->bytes[this->num_bytes] = '\0';
+  return this;
+}
+
 static string_t *string_append (string_t *this, char *bytes) {
   return string_append_with_len (this, bytes, bytelen (bytes));
 }
@@ -587,9 +1206,9 @@ static void dirlist_free (dirlist_t *dlist) {
     return;
 
   for (int i = 0; i < dlist->len; i++)
-    free (dlist->list[i]);
+    Free (dlist->list[i]);
 
-  free (dlist->list);
+  Free (dlist->list);
 
   dlist->list = NULL;
 }
@@ -748,6 +1367,7 @@ static vwm_term *vwm_new_term (vwm_t *this) {
   term->columns = 78;
   term->in_fd = STDIN_FILENO;
   term->out_fd = STDOUT_FILENO;
+  term->headless = 0;
   term->mode = 'o';
 
   char *term_name = getenv ("TERM");
@@ -772,12 +1392,13 @@ static vwm_term *vwm_new_term (vwm_t *this) {
 
 static void term_release (vwm_term **thisp) {
   if (NULL is *thisp) return;
-  free ((*thisp)->name);
-  free (*thisp);
+  Free ((*thisp)->name);
+  Free (*thisp);
   *thisp = NULL;
 }
 
 static int term_sane_mode (vwm_term *this) {
+  if (this->headless) return OK;
   if (this->mode == 's') return OK;
   if (isnotatty (this->in_fd)) return NOTOK;
 
@@ -802,6 +1423,7 @@ static int term_sane_mode (vwm_term *this) {
 }
 
 static int term_orig_mode (vwm_term *this) {
+  if (this->headless) return OK;
   if (this->mode == 'o') return OK;
   if (isnotatty (this->in_fd)) return NOTOK;
 
@@ -814,6 +1436,7 @@ static int term_orig_mode (vwm_term *this) {
 }
 
 static int term_raw_mode (vwm_term *this) {
+  if (this->headless) return OK;
   if (this->mode == 'r') return OK;
   if (isnotatty (this->in_fd)) return NOTOK;
 
@@ -838,6 +1461,8 @@ static int term_raw_mode (vwm_term *this) {
 }
 
 static int term_cursor_get_ptr_pos (vwm_term *this, int *row, int *col) {
+  if (this->headless) return NOTOK;
+
   if (NOTOK == TERM_SEND_ESC_SEQ (TERM_GET_PTR_POS))
     return NOTOK;
 
@@ -863,25 +1488,36 @@ static int term_cursor_get_ptr_pos (vwm_term *this, int *row, int *col) {
 }
 
 static void term_cursor_set_ptr_pos (vwm_term *this, int row, int col) {
+  if (this->headless) return;
+
   char ptr[32];
   snprintf (ptr, 32, TERM_GOTO_PTR_POS_FMT, row, col);
   fd_write (this->out_fd, ptr, bytelen (ptr));
 }
 
 static void term_screen_clear (vwm_term *this) {
+  if (this->headless) return;
   TERM_SEND_ESC_SEQ (TERM_SCREEN_CLEAR);
 }
 
 static void term_screen_save (vwm_term *this) {
+  if (this->headless) return;
   TERM_SEND_ESC_SEQ (TERM_SCREEN_SAVE);
 }
 
 static void term_screen_restore (vwm_term *this) {
+  if (this->headless) return;
   TERM_SEND_ESC_SEQ (TERM_SCROLL_RESET);
   TERM_SEND_ESC_SEQ (TERM_SCREEN_RESTORE);
 }
 
 static void term_init_size (vwm_term *this, int *rows, int *cols) {
+  /* the virtual size (see vwm_set_headless()) */
+  if (this->headless) {
+    *rows = this->lines; *cols = this->columns;
+    return;
+  }
+
   struct winsize wsiz;
 
   do {
@@ -937,6 +1573,46 @@ static void vwm_set_term  (vwm_t *this, vwm_term *term) {
   $my(term) = term;
 }
 
+/* without a controlling terminal: the size is fixed (calling it again
+ * resizes), nothing is read from the standard input, and the output goes
+ * to the output callback or descriptor (see vt_write()); without both,
+ * the frames are only parsed, as when the session is detached */
+static void vwm_set_headless (vwm_t *this, int rows, int cols) {
+  vwm_term *term = $my(term);
+
+  term->headless = 1;
+  term->in_fd = term->out_fd = -1;
+  term->lines = rows;
+  term->columns = cols;
+  term->mode = 'o';
+
+  $my(render) = (NULL isnot $my(output_cb) or -1 isnot $my(output_fd));
+
+  ifnot ($my(length)) {
+    self(set.size, rows, cols, 1);
+    return;
+  }
+
+  if (rows is $my(num_rows) and cols is $my(num_cols)) return;
+
+  vwm_handle_sigwinch (this);
+}
+
+static void vwm_set_output_cb (vwm_t *this, VwmOutput_cb cb, void *object) {
+  $my(output_cb) = cb;
+  $my(output_object) = object;
+
+  if ($my(term)->headless)
+    $my(render) = (NULL isnot cb or -1 isnot $my(output_fd));
+}
+
+static void vwm_set_output_fd (vwm_t *this, int fd) {
+  $my(output_fd) = fd;
+
+  if ($my(term)->headless)
+    $my(render) = (NULL isnot $my(output_cb) or -1 isnot fd);
+}
+
 static void vwm_set_state (vwm_t *this, int state) {
   $my(state) = state;
 }
@@ -974,6 +1650,10 @@ static void vwm_set_edit_file_cb (vwm_t *this, VwmEditFile_cb cb) {
   $my(edit_file_cb) = cb;
 }
 
+static void vwm_set_search_cb (vwm_t *this, VwmSearch_cb cb) {
+  $my(search_cb) = cb;
+}
+
 static void vwm_set_shell (vwm_t *this, char *shell) {
   if (NULL is shell) return;
   size_t len = bytelen (shell);
@@ -982,6 +1662,60 @@ static void vwm_set_shell (vwm_t *this, char *shell) {
   string_append_with_len ($my(shell), shell, len);
 }
 
+static int unimplemented_cmp (const void *a, const void *b) {
+  const vwm_unimplemented *x = a, *y = b;
+  return (y->count > x->count) - (y->count < x->count);
+}
+
+/* the counted sequences, the most frequent first, with the times since the
+ * epoch */
+static vwm_unimplemented *vwm_get_unimplemented (vwm_t *this, int *num) {
+  *num = $my(num_unimplemented);
+  ifnot (*num) return NULL;
+
+  vwm_unimplemented *u = Alloc (sizeof (vwm_unimplemented) * *num);
+  long offset = logts_real_offset ();
+  int idx = 0;
+
+  for (int i = 0; i < UNIMPLEMENTED_SLOTS; i++) {
+    if (NULL is $my(unimplemented)[i].fun) continue;
+    u[idx] = $my(unimplemented)[i];
+    u[idx].first_seen += offset;
+    u[idx].last_seen += offset;
+    idx++;
+  }
+
+  qsort (u, *num, sizeof (vwm_unimplemented), unimplemented_cmp);
+  return u;
+}
+
+/* rewrites the file of the unimplemented sequences with their counts */
+static void vwm_write_unimplemented (vwm_t *this) {
+  FILE *fp = $my(unimplemented_fp);
+  if (NULL is fp) return;
+
+  int num;
+  vwm_unimplemented *u = vwm_get_unimplemented (this, &num);
+
+  rewind (fp);
+  if (-1 is ftruncate (fileno (fp), 0)) {}
+
+  fprintf (fp, "%10s  %-24s %-5s %6s  %s\n", "count", "handler", "char", "param", "frames");
+  for (int i = 0; i < num; i++)
+    fprintf (fp, "%10ld  %-24s %c %3d %6d  %d..%d\n", u[i].count, u[i].fun,
+        (u[i].c >= ' ' and u[i].c < 0x7f ? u[i].c : '?'), u[i].c, u[i].param,
+        u[i].first_frame, u[i].last_frame);
+
+  if ($my(unimplemented_dropped))
+    fprintf (fp, "%10ld  not counted, as the table is full\n", $my(unimplemented_dropped));
+
+  fflush (fp);
+  Free (u);
+
+  $my(unimplemented_dirty) = 0;
+  $my(unimplemented_dump_ms) = vt_clock_ms ();
+}
+
 static void vwm_set_debug_unimplemented (vwm_t *this, char *fname) {
   self(unset.debug.unimplemented);
 
@@ -1001,13 +1735,78 @@ static void vwm_set_debug_unimplemented (vwm_t *this, char *fname) {
   $my(unimplemented_fp) = fopen (fname, "w");
 }
 
+/* Counts the allocations from now on, of the whole process (see the
+ * AllocAccount hook). If they are already counted, the peaks start over
+ * from the live bytes. */
+static void vwm_set_debug_allocations (vwm_t *this) {
+  (void) this;
+  pthread_mutex_lock (&ALLOC_MUTEX);
+  if (NULL isnot ALLOC_ENTRIES) {
+    ALLOC_TOTAL.peak_bytes = ALLOC_TOTAL.live_bytes;
+    for (int i = 0; i < ALLOC_SITES; i++)
+      ALLOC_SITE[i].peak_bytes = ALLOC_SITE[i].live_bytes;
+    goto theend;
+  }
+
+  ALLOC_ENTRIES = calloc (ALLOC_MIN_ENTRIES, sizeof (alloc_entry));
+  ALLOC_SITE = calloc (ALLOC_SITES, sizeof (vwm_alloc_site));
+
+  if (NULL is ALLOC_ENTRIES or NULL is ALLOC_SITE) {
+    free (ALLOC_ENTRIES);
+    free (ALLOC_SITE);
+    ALLOC_ENTRIES = NULL;
+    ALLOC_SITE = NULL;
+    goto theend;
+  }
+
+  ALLOC_CAP = ALLOC_MIN_ENTRIES;
+  ALLOC_LEN = 0;
+  ALLOC_TOTAL = (vwm_alloc_stats) {0};
+  AllocAccount = alloc_account;
+
+theend:
+  pthread_mutex_unlock (&ALLOC_MUTEX);
+}
+
+static void vwm_unset_debug_allocations (vwm_t *this) {
+  (void) this;
+  pthread_mutex_lock (&ALLOC_MUTEX);
+  AllocAccount = NULL;
+  free (ALLOC_ENTRIES);
+  free (ALLOC_SITE);
+  ALLOC_ENTRIES = NULL;
+  ALLOC_SITE = NULL;
+  ALLOC_CAP = ALLOC_LEN = 0;
+  pthread_mutex_unlock (&ALLOC_MUTEX);
+}
+
 static void vwm_unset_debug_unimplemented (vwm_t *this) {
   if (NULL is $my(unimplemented_fp)) return;
+  vwm_write_unimplemented (this);
   fclose ($my(unimplemented_fp));
   $my(unimplemented_fp) = NULL;
   string_free ($my(unimplemented_fname));
 }
 
+/* Writes the trace rings to fname, or to the file of the trace. */
+static int vwm_dump_trace (vwm_t *this, char *fname) {
+  if (NULL is fname) {
+    if (NULL is $my(sequences_fname)) return NOTOK;
+    fname = $my(sequences_fname)->bytes;
+  }
+
+  int fd = open (fname, O_CREAT|O_WRONLY|O_TRUNC|O_CLOEXEC, S_IRUSR|S_IWUSR);
+  if (-1 is fd) return NOTOK;
+
+  int retval = trace_write (fd);
+  if (close (fd)) retval = NOTOK;
+  return retval;
+}
+
+/* Starts the trace (the parsed sequences, the reads, writes, renders and
+ * resizes of the frames, and the work of the threads), that is written to
+ * fname (or to a temporary file) when it stops, on a crash, or when it is
+ * dumped. */
 static void vwm_set_debug_sequences (vwm_t *this, char *fname) {
   self(unset.debug.sequences);
 
@@ -1017,21 +1816,25 @@ static void vwm_set_debug_sequences (vwm_t *this, char *fname) {
 
     if (-1 is t.fd) return;
 
-    $my(sequences_fp) = fdopen (t.fd, "w+");
+    close (t.fd);
     $my(sequences_fname) = t.fname;
+  } else
+    $my(sequences_fname) = string_new_with (fname);
 
-    return;
-  }
-
-  $my(sequences_fname) = string_new_with (fname);
-  $my(sequences_fp) = fopen (fname, "w");
+  __atomic_add_fetch (&TRACE_ON, 1, __ATOMIC_RELEASE);
 }
 
 static void vwm_unset_debug_sequences (vwm_t *this) {
-  if (NULL is $my(sequences_fp)) return;
-  fclose ($my(sequences_fp));
-  $my(sequences_fp) = NULL;
+  if (NULL is $my(sequences_fname)) return;
+
+  __atomic_sub_fetch (&TRACE_ON, 1, __ATOMIC_RELEASE);
+
+  /* after a crash it has been written already */
+  ifnot (TRACE_DUMPED)
+    vwm_dump_trace (this, NULL);
+
   string_free ($my(sequences_fname));
+  $my(sequences_fname) = NULL;
 }
 
 static void vwm_unset_tmpdir (vwm_t *this) {
@@ -1079,21 +1882,33 @@ theerror:
  * of such sequence
  */
 
+/* a byte, after what has been put back on the standard input */
+static int vwm_getbyte (vwm_t *this, int infd, char *c) {
+  if (infd is STDIN_FILENO and $my(num_unread)) {
+    *c = $my(unread)[--$my(num_unread)];
+    return 1;
+  }
+
+  char buf[2];
+  int n = fd_read (infd, buf, 1);
+  if (0 < n) *c = buf[0];
+  return n;
+}
+
 static utf8 vwm_getkey (vwm_t *this, int infd) {
-  (void) this;
   char c;
   int n;
   char buf[5];
 
-  while (0 == (n = fd_read (infd, buf, 1)));
+  while (0 == (n = vwm_getbyte (this, infd, buf)));
 
-  if (n == -1) return -1;
+  if (n < 0) return -1;
 
   c = buf[0];
 
   switch (c) {
     case ESCAPE_KEY:
-      if (0 == fd_read (infd, buf, 1))
+      if (0 >= vwm_getbyte (this, infd, buf))
         return ESCAPE_KEY;
 
       /* recent (revailed through CTRL-[other than CTRL sequence]) and unused */
@@ -1101,18 +1916,18 @@ static utf8 vwm_getkey (vwm_t *this, int infd) {
         return 0;
 
       if (buf[0] == ESCAPE_KEY /* probably alt->arrow-key */)
-        if (0 == fd_read (infd, buf, 1))
+        if (0 >= vwm_getbyte (this, infd, buf))
           return 0;
 
       if (buf[0] != '[' && buf[0] != 'O')
         return 0;
 
-      if (0 == fd_read (infd, buf + 1, 1))
+      if (0 >= vwm_getbyte (this, infd, buf + 1))
         return ESCAPE_KEY;
 
       if (buf[0] == '[') {
         if ('0' <= buf[1] && buf[1] <= '9') {
-          if (0 == fd_read (infd, buf + 2, 1))
+          if (0 >= vwm_getbyte (this, infd, buf + 2))
             return ESCAPE_KEY;
 
           if (buf[2] == '~') {
@@ -1128,7 +1943,7 @@ static utf8 vwm_getkey (vwm_t *this, int infd) {
               default: return 0;
             }
           } else if (buf[1] == '1') {
-            if (fd_read (infd, buf, 1) == 0)
+            if (vwm_getbyte (this, infd, buf) <= 0)
               return ESCAPE_KEY;
 
             switch (buf[2]) {
@@ -1143,7 +1958,7 @@ static utf8 vwm_getkey (vwm_t *this, int infd) {
               default: return 0;
             }
           } else if (buf[1] == '2') {
-            if (fd_read (infd, buf, 1) == 0)
+            if (vwm_getbyte (this, infd, buf) <= 0)
               return ESCAPE_KEY;
 
             switch (buf[2]) {
@@ -1161,7 +1976,7 @@ static utf8 vwm_getkey (vwm_t *this, int infd) {
               return 0;
           }
         } else if (buf[1] == '[') {
-          if (fd_read (infd, buf, 1) == 0)
+          if (vwm_getbyte (this, infd, buf) <= 0)
             return ESCAPE_KEY;
 
           switch (buf[0]) {
@@ -1215,7 +2030,7 @@ static utf8 vwm_getkey (vwm_t *this, int infd) {
       char cc;
 
       for (idx = 0; idx < len - 1; idx++) {
-        if (0 >= fd_read (infd, &cc, 1))
+        if (0 >= vwm_getbyte (this, infd, &cc))
           return -1;
 
         if (isnotutf8 ((uchar) cc)) {
@@ -1266,6 +2081,10 @@ static int vwm_get_columns (vwm_t *this) {
   return $my(term)->columns;
 }
 
+static int vwm_get_headless (vwm_t *this) {
+  return $my(term)->headless;
+}
+
 static void *vwm_get_object (vwm_t *this, int idx) {
   if (idx >= NUM_OBJECTS or idx < 0) return NULL;
   return $my(objects)[idx];
@@ -1328,7 +2147,7 @@ static char *vwm_get_default_app (vwm_t *this) {
 
 static void frame_release_info (vframe_info *finfo) {
   if (NULL is finfo) return;
-  free (finfo);
+  Free (finfo);
   finfo = NULL;
 }
 
@@ -1338,8 +2157,8 @@ static void win_release_info (vwin_info *winfo) {
   for (int fidx = 0; fidx < winfo->num_frames; fidx++)
     frame_release_info (winfo->frames[fidx++]);
 
-  free (winfo->frames);
-  free (winfo);
+  Free (winfo->frames);
+  Free (winfo);
   winfo = NULL;
 }
 
@@ -1352,14 +2171,120 @@ static void vwm_release_info (vwm_t *this, vwm_info **vinfop) {
   for (int widx = 0; widx < vinfo->num_win; widx++)
     win_release_info (vinfo->wins[widx++]);
 
-  free (vinfo->wins);
-  free (vinfo);
+  Free (vinfo->wins);
+  Free (vinfo->unimplemented);
+  alloc_release_stats (vinfo->allocations);
+  Free (vinfo);
   *vinfop = NULL;
 }
 
+static int hist_idx (long v) {
+  if (v < HIST_SUB) return (v < 0 ? 0 : (int) v);
+
+  int shift = (63 - __builtin_clzl ((unsigned long) v)) - 3;
+  int idx = (shift + 1) * HIST_SUB + (int) ((v >> shift) - HIST_SUB);
+  return (idx < HIST_BUCKETS ? idx : HIST_BUCKETS - 1);
+}
+
+/* the lowest and the highest value of a bucket */
+static long hist_bucket_low (int idx) {
+  if (idx < HIST_SUB) return idx;
+  int shift = idx / HIST_SUB - 1;
+  return (long) (HIST_SUB + idx % HIST_SUB) << shift;
+}
+
+static long hist_bucket_high (int idx) {
+  if (idx < HIST_SUB) return idx;
+  return hist_bucket_low (idx) + (1L << (idx / HIST_SUB - 1)) - 1;
+}
+
+static void hist_record (vwm_hist *h, long v) {
+  if (0 is h->count or v < h->min) h->min = v;
+  if (v > h->max) h->max = v;
+  h->count++;
+  h->sum += v;
+  h->buckets[hist_idx (v)]++;
+}
+
+/* the highest value of the bucket where the percentile falls, but no
+ * more than the maximum */
+static long hist_percentile (vwm_hist *h, double p) {
+  ifnot (h->count) return 0;
+
+  long rank = (long) (p * h->count + 0.5);
+  if (rank < 1) rank = 1;
+
+  long seen = 0;
+  for (int i = 0; i < HIST_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen >= rank) {
+      long high = hist_bucket_high (i);
+      return (high < h->max ? high : h->max);
+    }
+  }
+
+  return h->max;
+}
+
+static void frame_latency_record (vwm_frame *this, long read_ns, long present_ns) {
+  if (NULL is this->latency)
+    this->latency = Alloc (sizeof (vwm_hist) * NUM_LATENCIES);
+
+  long parsed_ns = (this->lat_parsed_ns ? this->lat_parsed_ns : present_ns);
+
+  if ((read_ns - this->lat_input_ns) / 1000 > LATENCY_MAX_US) {
+    this->lat_input_ns = this->lat_parsed_ns = 0;
+    return;
+  }
+
+  hist_record (&this->latency[LATENCY_INPUT_PTY], (read_ns - this->lat_input_ns) / 1000);
+  hist_record (&this->latency[LATENCY_PTY_PARSE], (parsed_ns - read_ns) / 1000);
+  hist_record (&this->latency[LATENCY_PARSE_PRESENT], (present_ns - parsed_ns) / 1000);
+
+  this->lat_input_ns = this->lat_parsed_ns = 0;
+}
+
+static void frame_get_latency (vwm_frame *this, vframe_latency *lat) {
+  for (int i = 0; i < NUM_LATENCIES; i++) {
+    lat[i] = (vframe_latency) {0};
+    if (NULL is this->latency) continue;
+
+    vwm_hist *h = &this->latency[i];
+    lat[i].count = h->count;
+    lat[i].min = h->min;
+    lat[i].max = h->max;
+    lat[i].p50 = hist_percentile (h, 0.50);
+    lat[i].p90 = hist_percentile (h, 0.90);
+    lat[i].p99 = hist_percentile (h, 0.99);
+  }
+}
+
+static void frame_get_stats (vwm_frame *this, vframe_stats *stats) {
+  *stats = this->stats;
+
+  /* it is kept in the monotonic clock */
+  if (this->stats.last_activity) {
+    struct timespec rt, mt;
+    clock_gettime (CLOCK_REALTIME, &rt);
+    clock_gettime (CLOCK_MONOTONIC, &mt);
+    long ago = ((long) mt.tv_sec * 1000 + mt.tv_nsec / 1000000) - this->stats.last_activity;
+    stats->last_activity = ((long) rt.tv_sec * 1000 + rt.tv_nsec / 1000000) - ago;
+  }
+
+  int pending = 0;
+  if (this->fd isnot -1 and 0 is ioctl (this->fd, FIONREAD, &pending))
+    stats->read_backlog = pending;
+
+  vwm_t *vwm = this->root;
+  if (NULL isnot vwm and vwm->prop->send_frame is this)
+    stats->write_backlog = (long) (vwm->prop->send_len - vwm->prop->send_off) +
+        (long) vwm->prop->send_left;
+}
+
 static vframe_info *frame_get_info (vwm_frame *this) {
   vframe_info *finfo = Alloc (sizeof (vframe_info));
   finfo->pid = this->pid;
+  finfo->id = this->id;
   finfo->first_row = this->first_row;
   finfo->num_rows = this->num_rows;
   finfo->last_row = this->first_row + this->num_rows - 1;
@@ -1367,6 +2292,15 @@ static vframe_info *frame_get_info (vwm_frame *this) {
   finfo->is_current = this->parent->current is this;
   finfo->at_frame = (this->is_visible ? this->at_frame : -1);
   finfo->logfile = (NULL is this->logfile ? "" : this->logfile->bytes);
+  finfo->log_compress = this->log_compress;
+  finfo->log_max_size = this->log_max_size;
+  finfo->log_segment_size = this->log_segment_size;
+  finfo->num_log_segments = 0;
+  for (log_segment *seg = this->log_segments; seg; seg = seg->next)
+    finfo->num_log_segments++;
+
+  frame_get_stats (this, &finfo->stats);
+  frame_get_latency (this, finfo->latency);
 
   int arg = 0;
   for (; arg < this->argc; arg++)
@@ -1393,7 +2327,21 @@ static vwin_info *win_get_info (vwm_win *this) {
   int fidx = 0;
 
   while (frame and fidx < this->length) {
-    winfo->frames[fidx++] = frame_get_info (frame);
+    vframe_info *finfo = frame_get_info (frame);
+    winfo->frames[fidx++] = finfo;
+
+    vframe_stats *ws = &winfo->stats;
+    ws->bytes_read     += finfo->stats.bytes_read;
+    ws->bytes_rendered += finfo->stats.bytes_rendered;
+    ws->sequences      += finfo->stats.sequences;
+    ws->unimplemented  += finfo->stats.unimplemented;
+    ws->scrolls        += finfo->stats.scrolls;
+    ws->render_ns      += finfo->stats.render_ns;
+    ws->write_backlog  += finfo->stats.write_backlog;
+    ws->read_backlog   += finfo->stats.read_backlog;
+    if (finfo->stats.last_activity > ws->last_activity)
+      ws->last_activity = finfo->stats.last_activity;
+
     frame = frame->next;
   }
 
@@ -1409,6 +2357,9 @@ static vwm_info *vwm_get_info (vwm_t *this) {
       $my(sequences_fname)->bytes);
   vinfo->unimplemented_fname = (NULL is $my(unimplemented_fname) ? "" :
       $my(unimplemented_fname)->bytes);
+  vinfo->unimplemented = vwm_get_unimplemented (this, &vinfo->num_unimplemented);
+  vinfo->unimplemented_dropped = $my(unimplemented_dropped);
+  vinfo->allocations = alloc_get_stats ();
 
   vinfo->wins = Alloc (sizeof (vwin_info *) * $my(length));
   vwm_win *win = $my(head);
@@ -1421,6 +2372,269 @@ static vwm_info *vwm_get_info (vwm_t *this) {
   return vinfo;
 }
 
+/* Writes the latency histograms of every frame to fname: a line for each
+ * histogram, and then the buckets that have values as "low high count". */
+static int vwm_dump_latency (vwm_t *this, char *fname) {
+  static const char *names[NUM_LATENCIES] = {"input-pty", "pty-parse", "parse-present"};
+
+  FILE *fp = fopen (fname, "w");
+  if (NULL is fp) return NOTOK;
+
+  int widx = 0;
+  for (vwm_win *win = $my(head); win; win = win->next, widx++) {
+    int fidx = 0;
+    for (vwm_frame *frame = win->head; frame; frame = frame->next, fidx++) {
+      if (NULL is frame->latency) continue;
+
+      for (int i = 0; i < NUM_LATENCIES; i++) {
+        vwm_hist *h = &frame->latency[i];
+
+        fprintf (fp, "window %d (%s) frame %d pid %d %s: count %ld min %ld "
+            "p50 %ld p90 %ld p99 %ld max %ld mean %ld (us)\n",
+            widx, (NULL is win->name ? "" : win->name), fidx, frame->pid,
+            names[i], h->count, h->min, hist_percentile (h, 0.50),
+            hist_percentile (h, 0.90), hist_percentile (h, 0.99), h->max,
+            (h->count ? h->sum / h->count : 0));
+
+        for (int b = 0; b < HIST_BUCKETS; b++)
+          if (h->buckets[b])
+            fprintf (fp, "  %ld %ld %u\n", hist_bucket_low (b),
+                (b is HIST_BUCKETS - 1 ? h->max : hist_bucket_high (b)), h->buckets[b]);
+      }
+    }
+  }
+
+  int retval = (ferror (fp) ? NOTOK : OK);
+  if (fclose (fp)) retval = NOTOK;
+  return retval;
+}
+
+/* Writes the allocations, as "live peak live-allocs allocs site" lines, the
+ * first for the whole process. */
+static int vwm_dump_allocations (vwm_t *this, char *fname) {
+  (void) this;
+  vwm_alloc_stats *stats = alloc_get_stats ();
+  if (NULL is stats) return NOTOK;
+
+  FILE *fp = fopen (fname, "w");
+  if (NULL is fp) {
+    alloc_release_stats (stats);
+    return NOTOK;
+  }
+
+  fprintf (fp, "%ld %ld %ld %ld total\n", stats->live_bytes, stats->peak_bytes,
+      stats->live_allocs, stats->allocs);
+
+  for (int i = 0; i < stats->num_sites; i++) {
+    vwm_alloc_site *site = &stats->sites[i];
+    fprintf (fp, "%ld %ld %ld %ld %s\n", site->live_bytes, site->peak_bytes,
+        site->live_allocs, site->allocs, (NULL is site->site ? "other" : site->site));
+  }
+
+  alloc_release_stats (stats);
+
+  int retval = (ferror (fp) ? NOTOK : OK);
+  if (fclose (fp)) retval = NOTOK;
+  return retval;
+}
+
+typedef struct metrics_buf {
+  char *buf;
+  size_t
+    size,
+    len;
+} metrics_buf;
+
+/* a line that does not fit is left out, so the document stays whole */
+static void metrics_printf (metrics_buf *m, const char *fmt, ...) __attribute__((format (printf, 2, 3)));
+static void metrics_printf (metrics_buf *m, const char *fmt, ...) {
+  if (m->len >= m->size) return;
+
+  va_list ap;
+  va_start (ap, fmt);
+  int n = vsnprintf (m->buf + m->len, m->size - m->len, fmt, ap);
+  va_end (ap);
+
+  if (n >= 0 and (size_t) n < m->size - m->len)
+    m->len += n;
+  else
+    m->size = m->len;
+}
+
+static void metrics_family (metrics_buf *m, const char *name, const char *type, const char *help) {
+  metrics_printf (m, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/* the labels of a frame; the quotes, the backslashes and the newlines of
+ * the name of its window are escaped */
+static void metrics_frame_labels (char *buf, size_t size, vwin_info *w, int fidx, vframe_info *f) {
+  char name[128];
+  size_t len = 0;
+
+  for (char *sp = (w->name ? w->name : ""); *sp and len < sizeof (name) - 3; sp++) {
+    if (*sp is '"' or *sp is '\\' or *sp is '\n') {
+      name[len++] = '\\';
+      name[len++] = (*sp is '\n' ? 'n' : *sp);
+    } else
+      name[len++] = *sp;
+  }
+
+  name[len] = '\0';
+  snprintf (buf, size, "win=\"%s\",frame=\"%d\",pid=\"%d\"", name, fidx, f->pid);
+}
+
+static long metrics_resident_bytes (void) {
+  long pages = 0, resident = 0;
+  FILE *fp = fopen ("/proc/self/statm", "r");
+  if (NULL is fp) return 0;
+
+  if (2 isnot fscanf (fp, "%ld %ld", &pages, &resident)) resident = 0;
+  fclose (fp);
+  return resident * sysconf (_SC_PAGESIZE);
+}
+
+/* Writes the metrics of the vwm, its windows and their frames into buf,
+ * and returns their length. */
+static int vwm_get_metrics (vwm_t *this, char *buf, size_t size) {
+  static const struct {
+    const char *name, *type, *help;
+    size_t off;
+    double scale;
+  } frame_stats[] = {
+    {"vwm_frame_read_bytes_total", "counter", "Bytes read from the pty of the frame.",
+     offsetof (vframe_stats, bytes_read), 1},
+    {"vwm_frame_rendered_bytes_total", "counter", "Bytes written to the terminal for the frame.",
+     offsetof (vframe_stats, bytes_rendered), 1},
+    {"vwm_frame_sequences_total", "counter", "Escape sequences parsed.",
+     offsetof (vframe_stats, sequences), 1},
+    {"vwm_frame_unimplemented_total", "counter", "Escape sequences that are not implemented.",
+     offsetof (vframe_stats, unimplemented), 1},
+    {"vwm_frame_scrolls_total", "counter", "Lines scrolled.",
+     offsetof (vframe_stats, scrolls), 1},
+    {"vwm_frame_render_seconds_total", "counter", "Time spent parsing and rendering the output.",
+     offsetof (vframe_stats, render_ns), 1e-9},
+    {"vwm_frame_write_backlog_bytes", "gauge", "Input that waits for the program.",
+     offsetof (vframe_stats, write_backlog), 1},
+    {"vwm_frame_read_backlog_bytes", "gauge", "Output that waits for the frame.",
+     offsetof (vframe_stats, read_backlog), 1}};
+
+  static const char *stages[NUM_LATENCIES] = {"input_pty", "pty_parse", "parse_present"};
+
+  metrics_buf m = {.buf = buf, .size = size, .len = 0};
+  vwm_info *vinfo = self(get.info);
+
+  int num_frames = 0;
+  for (int w = 0; w < vinfo->num_win; w++)
+    num_frames += vinfo->wins[w]->num_frames;
+
+  metrics_family (&m, "vwm_windows", "gauge", "Windows.");
+  metrics_printf (&m, "vwm_windows %d\n", vinfo->num_win);
+  metrics_family (&m, "vwm_frames", "gauge", "Frames of all the windows.");
+  metrics_printf (&m, "vwm_frames %d\n", num_frames);
+  metrics_family (&m, "vwm_resident_bytes", "gauge", "Resident memory of the vwm.");
+  metrics_printf (&m, "vwm_resident_bytes %ld\n", metrics_resident_bytes ());
+
+  if (vinfo->allocations) {
+    metrics_family (&m, "vwm_alloc_live_bytes", "gauge", "Bytes allocated and not released.");
+    metrics_printf (&m, "vwm_alloc_live_bytes %ld\n", vinfo->allocations->live_bytes);
+    metrics_family (&m, "vwm_alloc_peak_bytes", "gauge", "The peak of the allocated bytes.");
+    metrics_printf (&m, "vwm_alloc_peak_bytes %ld\n", vinfo->allocations->peak_bytes);
+  }
+
+  char labels[256];
+
+  for (size_t i = 0; i < sizeof (frame_stats) / sizeof (frame_stats[0]); i++) {
+    metrics_family (&m, frame_stats[i].name, frame_stats[i].type, frame_stats[i].help);
+
+    for (int w = 0; w < vinfo->num_win; w++) {
+      vwin_info *winfo = vinfo->wins[w];
+      for (int fidx = 0; fidx < winfo->num_frames; fidx++) {
+        vframe_info *f = winfo->frames[fidx];
+        long v = *(long *) ((char *) &f->stats + frame_stats[i].off);
+        metrics_frame_labels (labels, sizeof (labels), winfo, fidx, f);
+
+        if (frame_stats[i].scale is 1)
+          metrics_printf (&m, "%s{%s} %ld\n", frame_stats[i].name, labels, v);
+        else
+          metrics_printf (&m, "%s{%s} %.6f\n", frame_stats[i].name, labels, v * frame_stats[i].scale);
+      }
+    }
+  }
+
+  metrics_family (&m, "vwm_frame_latency_seconds", "summary",
+      "Latency of the input, from a keystroke to its echo.");
+
+  for (int w = 0; w < vinfo->num_win; w++) {
+    vwin_info *winfo = vinfo->wins[w];
+    for (int fidx = 0; fidx < winfo->num_frames; fidx++) {
+      vframe_info *f = winfo->frames[fidx];
+      metrics_frame_labels (labels, sizeof (labels), winfo, fidx, f);
+
+      for (int i = 0; i < NUM_LATENCIES; i++) {
+        vframe_latency *lat = &f->latency[i];
+        ifnot (lat->count) continue;
+
+        metrics_printf (&m,
+            "vwm_frame_latency_seconds{%s,stage=\"%s\",quantile=\"0.5\"} %.6f\n"
+            "vwm_frame_latency_seconds{%s,stage=\"%s\",quantile=\"0.9\"} %.6f\n"
+            "vwm_frame_latency_seconds{%s,stage=\"%s\",quantile=\"0.99\"} %.6f\n"
+            "vwm_frame_latency_seconds_count{%s,stage=\"%s\"} %ld\n",
+            labels, stages[i], lat->p50 / 1e6, labels, stages[i], lat->p90 / 1e6,
+            labels, stages[i], lat->p99 / 1e6, labels, stages[i], lat->count);
+      }
+    }
+  }
+
+  self(release_info, &vinfo);
+  return (int) m.len;
+}
+
+/* When the reader has asked for them, and at most once in VWM_METRICS_MS,
+ * the metrics are taken into a buffer, and copied to the shared memory
+ * between the two changes of seq, so a reader (that retries while it is
+ * odd, or if it changed while it was copying) waits only for the copy.
+ * It returns the milliseconds until an asked document can be published,
+ * or -1 when there is none to publish. */
+static int vwm_publish_metrics (vwm_t *this) {
+  vwm_metrics *shm = $my(metrics);
+  if (NULL is shm) return -1;
+
+  uint req = __atomic_load_n (&shm->req, __ATOMIC_ACQUIRE);
+  if (req is $my(metrics_req)) return -1;
+
+  long now = vt_clock_ms ();
+  if ($my(metrics_ms) and now - $my(metrics_ms) < VWM_METRICS_MS)
+    return (int) (VWM_METRICS_MS - (now - $my(metrics_ms)));
+
+  $my(metrics_req) = req;
+  $my(metrics_ms) = now;
+
+  size_t size = $my(metrics_size) - sizeof (vwm_metrics);
+  char *buf = Alloc (size);
+  int len = self(get.metrics, buf, size);
+
+  __atomic_add_fetch (&shm->seq, 1, __ATOMIC_ACQ_REL);
+  memcpy (shm->doc, buf, len);
+  shm->len = len;
+  shm->ms = now;
+  __atomic_add_fetch (&shm->seq, 1, __ATOMIC_RELEASE);
+
+  Free (buf);
+  return -1;
+}
+
+/* the first document is published on the first turn; wake_fd is polled,
+ * and it is not closed here */
+static void vwm_set_metrics (vwm_t *this, vwm_metrics *shm, size_t size, int wake_fd) {
+  $my(metrics) = (size > sizeof (vwm_metrics) ? shm : NULL);
+  $my(metrics_size) = size;
+  $my(metrics_ms) = 0;
+  $my(metrics_wake) = (NULL is $my(metrics) ? -1 : wake_fd);
+
+  if ($my(metrics))
+    $my(metrics_req) = __atomic_load_n (&shm->req, __ATOMIC_ACQUIRE) - 1;
+}
+
 static vwm_win *vwm_pop_win_at (vwm_t *this, int idx) {
   return DListPopAt ($myprop, vwm_win, idx);
 }
@@ -1438,2091 +2652,4154 @@ static int **vwm_alloc_ints (int rows, int cols, int val) {
  return obj;
 }
 
-static int vt_video_line_to_str (int *line, char *buf, int len) {
-  int idx = 0;
-  utf8 c;
+static void logts_release (logts_t *lt) {
+  logts_block *b = lt->head;
+  while (b) {
+    logts_block *tmp = b->next;
+    Free (b);
+    b = tmp;
+  }
 
-  for (int i = 0; i < len; i++) {
-    c = line[i];
+  lt->head = lt->tail = NULL;
+  lt->num_lines = lt->last_ms = 0;
+}
 
-    ifnot (c) continue;
+static void logts_push (logts_t *lt, long ms) {
+  if (ms < lt->last_ms) ms = lt->last_ms;
 
-    if ((c & 0xFF) < 0x80)
-      buf[idx++] = c & 0xFF;
-    else if (c < 0x800) {
-      buf[idx++] = (c >> 6) | 0xC0;
-      buf[idx++] = (c & 0x3F) | 0x80;
-    } else if (c < 0x10000) {
-      buf[idx++] = (c >> 12) | 0xE0;
-      buf[idx++] = ((c >> 6) & 0x3F) | 0x80;
-      buf[idx++] = (c & 0x3F) | 0x80;
-    } else if (c < 0x110000) {
-      buf[idx++] = (c >> 18) | 0xF0;
-      buf[idx++] = ((c >> 12) & 0x3F) | 0x80;
-      buf[idx++] = ((c >> 6) & 0x3F) | 0x80;
-      buf[idx++] = (c & 0x3F) | 0x80;
-    } else {
-      continue;
-    }
-  }
+  ulong delta = (ulong) (ms - lt->last_ms);
 
-  buf[idx++] = '\n';
+  logts_block *b = lt->tail;
 
-  buf[idx] = '\0';
+  /* room for the longest varint */
+  if (NULL is b or b->num_bytes + 10 > LOGTS_BLOCK_SIZE) {
+    b = Alloc (sizeof (logts_block));
+    b->base_ms = ms;
+    b->prev = lt->tail;
+    if (NULL is lt->tail)
+      lt->head = b;
+    else
+      lt->tail->next = b;
+    lt->tail = b;
+    delta = 0;
+  }
 
-  return idx;
-}
+  do {
+    uchar c = delta & 0x7F;
+    delta >>= 7;
+    if (delta) c |= 0x80;
+    b->bytes[b->num_bytes++] = c;
+  } while (delta);
 
-static void vt_write (char *buf, FILE *fp) {
-  fprintf (fp, "%s", buf);
-  fflush (fp);
+  b->num_lines++;
+  lt->num_lines++;
+  lt->last_ms = ms;
 }
 
-static string_t *vt_insline (string_t *buf, int num) {
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dL", num));
-}
+static int logts_block_next (logts_block *b, int *idx, long *ms) {
+  ulong delta = 0;
+  int shift = 0;
+  uchar c;
 
-static string_t *vt_insertchar (string_t *buf, int numcols) {
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%d@", numcols));
-}
+  do {
+    if (*idx >= b->num_bytes) return NOTOK;
+    c = b->bytes[(*idx)++];
+    delta |= (ulong) (c & 0x7F) << shift;
+    shift += 7;
+  } while (c & 0x80);
 
-static string_t *vt_savecursor (string_t *buf) {
-  return string_append_with_len (buf, "\0337", 2);
+  *ms += (long) delta;
+  return OK;
 }
 
-static string_t *vt_restcursor (string_t *buf) {
-  return string_append_with_len (buf, "\0338", 2);
-}
+/* drop the timestamps of the last num lines, the ones that were truncated
+ * from the end of the log */
+static void logts_pop (logts_t *lt, long num) {
+  while (num > 0 and lt->tail isnot NULL) {
+    logts_block *b = lt->tail;
 
-static string_t *vt_clreol (string_t *buf) {
-  return string_append_with_len (buf, "\033[K", 3);
-}
+    int idx = b->num_bytes - 1;
+    while (idx > 0 and (b->bytes[idx - 1] & 0x80)) idx--;
 
-static string_t *vt_clrbgl (string_t *buf) {
-  return string_append_with_len (buf, "\033[1K", 4);
-}
+    b->num_bytes = idx;
+    b->num_lines--;
+    lt->num_lines--;
+    num--;
 
-static string_t *vt_clrline (string_t *buf) {
-  return string_append_with_len (buf, "\033[2K", 4);
-}
+    if (b->num_lines) continue;
 
-static string_t *vt_delunder (string_t *buf, int num) {
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dP", num));
-}
+    lt->tail = b->prev;
+    if (NULL is lt->tail)
+      lt->head = NULL;
+    else
+      lt->tail->next = NULL;
 
-static string_t *vt_delline (string_t *buf, int num) {
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dM", num));
-}
+    Free (b);
+  }
 
-static string_t *vt_attr_reset (string_t *buf) {
-  return string_append_with_len (buf, "\033[m", 3);
-}
+  lt->last_ms = 0;
+  if (NULL is lt->tail) return;
 
-static string_t *vt_reverse (string_t *buf, int on) {
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%sm", (on ? "7" : "27")));
-}
+  int idx = 0;
+  lt->last_ms = lt->tail->base_ms;
+  while (OK is logts_block_next (lt->tail, &idx, &lt->last_ms));
+}
+
+/* fmt: "%Y-%m-%d %H:%M:%S.mmm", LOGTS_FMT_LEN bytes */
+static void logts_fmt (long ms, long real_offset, char *buf) {
+  long wall = ms + real_offset;
+  time_t secs = (time_t) (wall / 1000);
+  struct tm tm;
+  localtime_r (&secs, &tm);
+  size_t len = strftime (buf, LOGTS_FMT_LEN + 1, "%Y-%m-%d %H:%M:%S", &tm);
+  snprintf (buf + len, LOGTS_FMT_LEN + 1 - len, ".%03ld", wall % 1000);
+}
+
+static long logts_real_offset (void) {
+  struct timespec ts;
+  clock_gettime (CLOCK_REALTIME, &ts);
+  return ((long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000) - vt_clock_ms ();
+}
+
+/* drop the timestamps of the first num lines, when the oldest log segment
+ * is removed */
+static void logts_shift (logts_t *lt, long num) {
+  while (num > 0 and lt->head isnot NULL) {
+    logts_block *b = lt->head;
+
+    if (num >= b->num_lines) {
+      num -= b->num_lines;
+      lt->num_lines -= b->num_lines;
+      lt->head = b->next;
+      if (NULL is lt->head)
+        lt->tail = NULL;
+      else
+        lt->head->prev = NULL;
 
-static string_t *vt_underline (string_t *buf, int on) {
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%sm", (on ? "4" : "24")));
-}
+      Free (b);
+      continue;
+    }
 
-static string_t *vt_bold (string_t *buf, int on) {
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%sm", (on ? "1" : "22")));
-}
+    int idx = 0;
+    long ms = b->base_ms;
+    for (long i = 0; i < num; i++)
+      logts_block_next (b, &idx, &ms);
+
+    /* the first kept line becomes the base of the block */
+    logts_block_next (b, &idx, &ms);
+    b->base_ms = ms;
+    b->bytes[0] = 0;
+    memmove (b->bytes + 1, b->bytes + idx, b->num_bytes - idx);
+    b->num_bytes = 1 + b->num_bytes - idx;
+    b->num_lines -= num;
+    lt->num_lines -= num;
+    num = 0;
+  }
 
-static string_t *vt_italic (string_t *buf, int on) {
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%sm", (on ? "3" : "23")));
+  if (NULL is lt->head) lt->last_ms = 0;
 }
 
-static string_t *vt_blink (string_t *buf, int on) {
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%sm", (on ? "5" : "25")));
-}
+/* A tiny LZ77 codec for the sealed log segments. The stream is a
+ * sequence of blocks of at most LOG_LZ_BLOCK_SIZE bytes, each prefixed
+ * by its raw and its compressed length (32bit little endian). A block
+ * is a sequence of [token][literals][offset][match] records, where the
+ * token holds the literal length in the high and the match length - 4
+ * in the low nibble (15 means that more length bytes follow, 255 each
+ * but the last). The last record has no match. */
 
-static string_t *vt_bell (string_t *buf) {
-  return string_append_with_len (buf, "\007", 1);
-}
+static void lz_put_len (uchar *dst, size_t *op, size_t len) {
+  while (len >= 255) {
+    dst[(*op)++] = 255;
+    len -= 255;
+  }
 
-static string_t *vt_setfg (string_t *buf, int color) {
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%d;1m", color));
+  dst[(*op)++] = (uchar) len;
 }
 
-static string_t *vt_setbg (string_t *buf, int color) {
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%d;1m", color));
-}
+static int lz_get_len (const uchar *src, size_t slen, size_t *ip, size_t *len) {
+  uchar c;
+  do {
+    if (*ip >= slen) return NOTOK;
+    c = src[(*ip)++];
+    *len += c;
+  } while (c is 255);
 
-static string_t *vt_left (string_t *buf, int count) {
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dD", count));
+  return OK;
 }
 
-static string_t *vt_right (string_t *buf, int count) {
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dC", count));
-}
+static void lz_put_record (uchar *dst, size_t *op, const uchar *lit, size_t lit_len,
+                                                        size_t offset, size_t match_len) {
+  size_t m = (match_len ? match_len - 4 : 0);
+  dst[(*op)++] = (uchar) (((lit_len < 15 ? lit_len : 15) << 4) | (m < 15 ? m : 15));
 
-static string_t *vt_up (string_t *buf, int numrows) {
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dA", numrows));
-}
+  if (lit_len >= 15) lz_put_len (dst, op, lit_len - 15);
 
-static string_t *vt_down (string_t *buf, int numrows) {
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dB", numrows));
-}
+  memcpy (dst + *op, lit, lit_len);
+  *op += lit_len;
 
-static string_t *vt_irm (string_t *buf) {
-  return string_append_with_len (buf, "\033[4l", 4);
-}
+  ifnot (match_len) return;
 
-static string_t *vt_revscroll (string_t *buf) {
-  return string_append_with_len (buf, "\033M", 2);
-}
+  dst[(*op)++] = offset & 0xFF;
+  dst[(*op)++] = (offset >> 8) & 0xFF;
 
-static string_t *vt_setscroll (string_t *buf, int first, int last) {
-  if (0 is first and 0 is last)
-    return string_append_with_len (buf, "\033[r", 3);
-  else
-    return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%d;%dr", first, last));
+  if (m >= 15) lz_put_len (dst, op, m - 15);
 }
 
-static string_t *vt_goto (string_t *buf, int row, int col) {
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%d;%dH", row, col));
+/* dst should hold at least len + len / 255 + 16 bytes */
+static size_t lz_compress (const uchar *src, size_t len, uchar *dst) {
+  int table[1 << LOG_LZ_HASH_BITS];
+  memset (table, 0xff, sizeof (table));
+
+  size_t ip = 0, anchor = 0, op = 0;
+
+  while (ip + 8 <= len) {
+    uint32_t seq;
+    memcpy (&seq, src + ip, 4);
+    uint h = (seq * 2654435761U) >> (32 - LOG_LZ_HASH_BITS);
+    int ref = table[h];
+    table[h] = (int) ip;
+
+    if (ref < 0 or ip - ref > 0xFFFF or memcmp (src + ref, src + ip, 4)) {
+      ip++;
+      continue;
+    }
+
+    size_t mlen = 4;
+    while (ip + mlen < len and src[ref + mlen] is src[ip + mlen])
+      mlen++;
+
+    lz_put_record (dst, &op, src + anchor, ip - anchor, ip - ref, mlen);
+    ip += mlen;
+    anchor = ip;
+  }
+
+  lz_put_record (dst, &op, src + anchor, len - anchor, 0, 0);
+  return op;
 }
 
-static string_t *vt_attr_check (string_t *buf, int pixel, int lastattr, uchar *currattr) {
-  uchar
-    simplepixel,
-    lastpixel,
-    change,
-    selected,
-    reversed;
+static long lz_decompress (const uchar *src, size_t slen, uchar *dst, size_t dlen) {
+  size_t ip = 0, op = 0;
 
- /* Set the simplepixel REVERSE bit if SELECTED ^ REVERSE */
-  simplepixel = ((pixel  >> 8) & (~SELECTED)  & (~REVERSE));
-  selected    = (((pixel >> 8) & (~SELECTED)) ? 1 : 0);
-  reversed    = (((pixel >> 8) & (~REVERSE))  ? 1 : 0);
+  while (ip < slen) {
+    uchar token = src[ip++];
 
-  if (selected ^ reversed)
-    simplepixel |= REVERSE;
+    size_t lit = token >> 4;
+    if (lit is 15 and NOTOK is lz_get_len (src, slen, &ip, &lit))
+      return NOTOK;
 
-  /* Set the lastpixel REVERSE bit if SELECTED ^ REVERSE */
-  lastpixel = ((lastattr  >> 8) & (~SELECTED)  & (~REVERSE));
-  selected  = (((lastattr >> 8) & (~SELECTED)) ? 1 : 0);
-  reversed  = (((lastattr >> 8) & (~REVERSE))  ? 1 : 0);
+    if (ip + lit > slen or op + lit > dlen) return NOTOK;
 
-  if (selected ^ reversed)
-    lastpixel |= REVERSE;
+    memcpy (dst + op, src + ip, lit);
+    ip += lit;
+    op += lit;
 
- /* Thanks to Dan Dorough for the XOR code */
-checkchange:
-  change = (lastpixel ^ simplepixel);
-  if (change) {
-    if (change & REVERSE) {
-      if ((*currattr) & REVERSE) {
-#define GOTO_HACK          /* vt_reverse (0) doesn't work on xterms? */
-#ifdef  GOTO_HACK          /* This goto hack resets all current attributes */
-        vt_attr_reset (buf);
-        *currattr &= ~REVERSE;
-        simplepixel = 0;
-        lastpixel &= (~REVERSE);
-        goto checkchange;
-#else
-        vt_reverse (buf, 0);
-        *currattr &= ~REVERSE;
-#endif
-      } else {
-        vt_reverse (buf, 1);
-        *currattr |= REVERSE;
-      }
-    }
+    if (ip is slen) break;
 
-    if (change & BOLD) {
-      if ((*currattr) & BOLD) {
-        vt_bold (buf, 0);
-        *currattr &= ~BOLD;
-      } else {
-        vt_bold (buf, 1);
-        *currattr |= BOLD;
-      }
-    }
+    if (ip + 2 > slen) return NOTOK;
 
-    if (change & ITALIC) {
-      if ((*currattr) & ITALIC) {
-        vt_italic (buf, 0);
-        *currattr &= ~ITALIC;
-      } else {
-        vt_italic (buf, 1);
-        *currattr |= ITALIC;
-      }
-    }
+    size_t offset = src[ip] | (src[ip + 1] << 8);
+    ip += 2;
 
-    if (change & UNDERLINE) {
-      if ((*currattr) & UNDERLINE) {
-        vt_underline (buf, 0);
-        *currattr &= ~UNDERLINE;
-      } else {
-        vt_underline (buf, 1);
-        *currattr |= UNDERLINE;
-      }
-    }
+    size_t mlen = token & 0x0F;
+    if (mlen is 15 and NOTOK is lz_get_len (src, slen, &ip, &mlen))
+      return NOTOK;
 
-    if (change & BLINK) {
-      if ((*currattr) & BLINK) {
-        vt_blink (buf, 0);
-        *currattr &= ~BLINK;
-      } else {
-        vt_blink (buf, 1);
-        *currattr |= BLINK;
-      }
-    }
+    mlen += 4;
+
+    if (0 is offset or offset > op or op + mlen > dlen) return NOTOK;
+
+    for (size_t i = 0; i < mlen; i++, op++)
+      dst[op] = dst[op - offset];
   }
 
-  return buf;
+  return (long) op;
 }
 
-static string_t *vt_attr_set (string_t *buf, int textattr) {
-  vt_attr_reset (buf);
+static void lz_put_u32 (uchar *buf, uint32_t v) {
+  buf[0] = v & 0xFF;
+  buf[1] = (v >> 8) & 0xFF;
+  buf[2] = (v >> 16) & 0xFF;
+  buf[3] = (v >> 24) & 0xFF;
+}
 
-  if (textattr & BOLD)
-    vt_bold (buf, 1);
+static uint32_t lz_get_u32 (const uchar *buf) {
+  return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t) buf[3] << 24);
+}
 
-  if (textattr & UNDERLINE)
-    vt_underline (buf, 1);
+static int lz_compress_file (int in_fd, int out_fd) {
+  uchar *src = Alloc (LOG_LZ_BLOCK_SIZE);
+  uchar *dst = Alloc (LOG_LZ_BLOCK_SIZE + LOG_LZ_BLOCK_SIZE / 255 + 16 + 8);
+  int retval = NOTOK;
 
-  if (textattr & BLINK)
-    vt_blink (buf, 1);
+  if (LOG_LZ_MAGIC_LEN isnot fd_write (out_fd, LOG_LZ_MAGIC, LOG_LZ_MAGIC_LEN))
+    goto theend;
 
-  if (textattr & REVERSE)
-    vt_reverse (buf, 1);
+  off_t offset = 0;
+  ssize_t bts;
 
-  if (textattr & ITALIC)
-    vt_italic (buf, 1);
+  while (0 < (bts = pread (in_fd, src, LOG_LZ_BLOCK_SIZE, offset))) {
+    offset += bts;
 
-  return buf;
-}
+    size_t len = lz_compress (src, bts, dst + 8);
+    lz_put_u32 (dst, (uint32_t) bts);
+    lz_put_u32 (dst + 4, (uint32_t) len);
 
-static void vt_video_add (vwm_frame *frame, utf8 c) {
-  frame->videomem[frame->row_pos - 1][frame->col_pos - 1] = c;
-  frame->videomem[frame->row_pos - 1][frame->col_pos - 1] |=
-      (((int) frame->textattr) << 8);
-}
+    if ((int) len + 8 isnot fd_write (out_fd, (char *) dst, len + 8))
+      goto theend;
+  }
 
-static void vt_video_erase (vwm_frame *frame, int x1, int x2, int y1, int y2) {
-  int i, j;
+  if (0 is bts) retval = OK;
 
-  for (i = x1 - 1; i < x2; ++i)
-    for (j = y1 - 1; j < y2; ++j) {
-      frame->videomem[i][j] = 0;
-      frame->colors  [i][j] = COLOR_FG_NORM;
-    }
+theend:
+  Free (src);
+  Free (dst);
+  return retval;
 }
 
-static void vt_frame_video_rshift (vwm_frame *frame, int numcols) {
-  for (int i = frame->num_cols - 1; i > frame->col_pos - 1; --i) {
-    if (i - numcols >= 0) {
-      frame->videomem[frame->row_pos-1][i] = frame->videomem[frame->row_pos-1][i-numcols];
-      frame->colors[frame->row_pos-1][i] = frame->colors[frame->row_pos-1][i-numcols];
-    } else {
-      frame->videomem[frame->row_pos-1][i] = 0;
-      frame->colors [frame->row_pos-1][i] = COLOR_FG_NORM;
-    }
-  }
-}
+/* appends to out, src compressed as a block stream */
+static void lz_blocks_compress (const uchar *src, size_t len, string_t *out) {
+  uchar *dst = Alloc (LOG_LZ_BLOCK_SIZE + LOG_LZ_BLOCK_SIZE / 255 + 16 + 8);
 
-static string_t *vt_frame_ech (vwm_frame *frame, string_t *buf, int num_cols) {
-  for (int i = 0; i + frame->col_pos <= frame->num_cols and i < num_cols; i++) {
-    frame->videomem[frame->row_pos-1][frame->col_pos - i - 1] = 0;
-    frame->colors[frame->row_pos-1][frame->col_pos - i - 1] = COLOR_FG_NORM;
+  while (len) {
+    size_t blen = (len > LOG_LZ_BLOCK_SIZE ? LOG_LZ_BLOCK_SIZE : len);
+    size_t clen = lz_compress (src, blen, dst + 8);
+    lz_put_u32 (dst, (uint32_t) blen);
+    lz_put_u32 (dst + 4, (uint32_t) clen);
+    string_append_data (out, (char *) dst, clen + 8);
+    src += blen;
+    len -= blen;
   }
 
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dX", num_cols));
+  Free (dst);
 }
 
-/*
-static string_t *vt_frame_cha (vwm_frame *frame, string_t *buf, int param) {
-  if (param < 2)
-    frame->col_pos = 1;
-  else {
-    if (param > frame->num_cols)
-      param = frame->num_cols;
-    frame->col_pos = param;
+/* returns the contents of a block stream, or NULL if it is corrupted */
+static char *lz_blocks_decompress (const uchar *src, size_t size, size_t *len) {
+  size_t raw_len = 0;
+  size_t ip = 0;
+  while (ip + 8 <= size) {
+    raw_len += lz_get_u32 (src + ip);
+    ip += 8 + lz_get_u32 (src + ip + 4);
   }
 
-  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dG", param));
-}
-*/
+  if (ip isnot size) return NULL;
 
-static void vt_frame_video_scroll (vwm_frame *frame, int numlines) {
-  int *tmpvideo;
-  int *tmpcolors;
-  int n;
+  char *dst = Alloc (raw_len + 1);
+  *len = 0;
 
-  for (int i = 0; i < numlines; i++) {
-    tmpvideo = frame->videomem[frame->scroll_first_row - 1];
-    tmpcolors = frame->colors[frame->scroll_first_row - 1];
+  ip = 0;
+  while (ip < size) {
+    size_t blen = lz_get_u32 (src + ip);
+    size_t clen = lz_get_u32 (src + ip + 4);
+    ip += 8;
 
-    ifnot (NULL is frame->logfile) {
-      char buf[(frame->num_cols * 3) + 2];
-      int len = vt_video_line_to_str (tmpvideo, buf, frame->num_cols);
-      fd_write (frame->logfd, buf, len);
+    if ((long) blen isnot lz_decompress (src + ip, clen, (uchar *) dst + *len, blen)) {
+      Free (dst);
+      return NULL;
     }
 
-    for (int j = 0; j < frame->num_cols; j++) {
-      tmpvideo[j] = 0;
-      tmpcolors[j] = COLOR_FG_NORM;
-    }
+    ip += clen;
+    *len += blen;
+  }
 
-    for (n = frame->scroll_first_row - 1; n < frame->last_row - 1; n++) {
-      frame->videomem[n] = frame->videomem[n + 1];
-      frame->colors[n] = frame->colors[n + 1];
-    }
+  return dst;
+}
 
-    frame->videomem[n] = tmpvideo;
-    frame->colors[n] = tmpcolors;
+/* returns the contents of a compressed log, or NULL */
+static char *lz_decompress_file (int fd, size_t *len) {
+  struct stat st;
+  if (-1 is fstat (fd, &st) or st.st_size < LOG_LZ_MAGIC_LEN)
+    return NULL;
+
+  size_t size = st.st_size;
+  uchar *src = Alloc (size);
+  char *dst = NULL;
+
+  size_t nread = 0;
+  while (nread < size) {
+    ssize_t bts = pread (fd, src + nread, size - nread, nread);
+    if (0 >= bts) {
+      if (-1 is bts and errno is EINTR) continue;
+      goto theend;
+    }
+    nread += bts;
   }
+
+  if (memcmp (src, LOG_LZ_MAGIC, LOG_LZ_MAGIC_LEN))
+    goto theend;
+
+  dst = lz_blocks_decompress (src + LOG_LZ_MAGIC_LEN, size - LOG_LZ_MAGIC_LEN, len);
+
+theend:
+  Free (src);
+  return dst;
 }
 
-static void vt_frame_video_scroll_back (vwm_frame *frame, int numlines) {
-  if (frame->row_pos < frame->scroll_first_row)
-    return;
+/* The log worker compresses the sealed segments. The segment is replaced
+ * by its compressed copy under the log mutex, so it never races with
+ * frame_log_delete_segment(); readers open the segment or the .lz copy,
+ * and since the latter is renamed in place before the unlink, one of
+ * them always exists. */
+static void *vwm_log_worker (void *arg) {
+  vwm_t *this = (vwm_t *) arg;
 
-  int n;
-  int *tmpvideo;
-  int *tmpcolors;
+  pthread_mutex_lock (&$my(log_mutex));
 
-  for (int i = 0; i < numlines; i++) {
-    tmpvideo = frame->videomem[frame->last_row - 1];
-    tmpcolors = frame->colors[frame->last_row - 1];
+  for (;;) {
+    while (NULL is $my(log_jobs) and $my(log_worker_state) isnot LOG_WORKER_QUIT)
+      pthread_cond_wait (&$my(log_cond), &$my(log_mutex));
 
-    for (int j = 0; j < frame->num_cols; j++) {
-      tmpvideo[j] = 0;
-      tmpcolors[j] = COLOR_FG_NORM;
+    if ($my(log_worker_state) is LOG_WORKER_QUIT) break;
+
+    log_job *job = $my(log_jobs);
+    $my(log_jobs) = job->next;
+
+    pthread_mutex_unlock (&$my(log_mutex));
+
+    size_t len = bytelen (job->fname);
+    char lz_fname[len + sizeof (LOG_LZ_EXT) + 4];
+    char tmp_fname[len + sizeof (LOG_LZ_EXT) + 4];
+    snprintf (lz_fname, sizeof (lz_fname), "%s" LOG_LZ_EXT, job->fname);
+    snprintf (tmp_fname, sizeof (tmp_fname), "%s" LOG_LZ_EXT ".tmp", job->fname);
+
+    int retval = NOTOK;
+    int in_fd = open (job->fname, O_RDONLY|O_CLOEXEC);
+    int out_fd = -1;
+    if (-1 isnot in_fd) {
+      out_fd = open (tmp_fname, O_CREAT|O_WRONLY|O_TRUNC|O_CLOEXEC, S_IRUSR|S_IWUSR);
+      if (-1 isnot out_fd)
+        retval = lz_compress_file (in_fd, out_fd);
     }
 
-   for (n = frame->last_row - 1; n > frame->scroll_first_row - 1; --n) {
-      frame->videomem[n] = frame->videomem[n - 1];
-      frame->colors[n] = frame->colors[n - 1];
+    if (-1 isnot in_fd) close (in_fd);
+    if (-1 isnot out_fd) close (out_fd);
+
+    TRACE_EVENT (VWM_TRACE_LOG_COMPRESS, 0, OK is retval, 0, 0);
+
+    pthread_mutex_lock (&$my(log_mutex));
+
+    if (-1 isnot out_fd) {
+      if (OK is retval and 0 is access (job->fname, F_OK) and
+          0 is rename (tmp_fname, lz_fname))
+        unlink (job->fname);
+      else
+        unlink (tmp_fname);
     }
 
-    frame->videomem[n] = tmpvideo;
-    frame->colors[n] = tmpcolors;
+    Free (job->fname);
+    Free (job);
   }
-}
 
-static string_t *vt_frame_attr_set (vwm_frame *frame, string_t *buf) {
-  uchar on = NORMAL;
-  vt_attr_reset (buf);
-  return vt_attr_check (buf, 0, frame->textattr, &on);
+  pthread_mutex_unlock (&$my(log_mutex));
+  return NULL;
 }
 
-static string_t *vt_append (vwm_frame *frame, string_t *buf, utf8 c) {
-  if (frame->col_pos > frame->num_cols) {
-    if (frame->row_pos < frame->last_row)
-      frame->row_pos++;
-    else
-      vt_frame_video_scroll (frame, 1);
-
-    string_append (buf, "\r\n");
-    frame->col_pos = 1;
-  }
+static void vwm_log_worker_add_job (vwm_t *this, char *fname) {
+  log_job *job = Alloc (sizeof (log_job));
+  size_t len = bytelen (fname);
+  job->fname = Alloc (len + 1);
+  memcpy (job->fname, fname, len + 1);
 
-  vt_video_add (frame, c);
+  pthread_mutex_lock (&$my(log_mutex));
 
-  if (frame->mb_len)
-    string_append_with_len (buf, frame->mb_buf, frame->mb_len);
-  else
-    string_append_byte (buf, c);
+  if ($my(log_worker_state) is LOG_WORKER_NONE) {
+    if (0 isnot pthread_create (&$my(log_worker), NULL, vwm_log_worker, this)) {
+      /* the segment stays uncompressed */
+      pthread_mutex_unlock (&$my(log_mutex));
+      Free (job->fname);
+      Free (job);
+      return;
+    }
 
-  frame->col_pos++;
-  return buf;
-}
+    $my(log_worker_state) = LOG_WORKER_RUNNING;
+  }
 
-static string_t *vt_keystate_print (string_t *buf, int application) {
-  if (application)
-    return string_append (buf, "\033=\033[?1h");
+  log_job **it = &$my(log_jobs);
+  while (*it) it = &(*it)->next;
+  *it = job;
 
-  return string_append (buf, "\033>\033[?1l");
+  pthread_cond_signal (&$my(log_cond));
+  pthread_mutex_unlock (&$my(log_mutex));
 }
 
-static string_t *vt_altcharset (string_t *buf, int charset, int type) {
-  switch (type) {
-    case UK_CHARSET:
-      string_append_with_len (buf, V_STR_FMT_LEN (4, "\033%cA", (charset is G0 ? '(' : ')')), 3);
-      break;
+static void vwm_log_worker_stop (vwm_t *this) {
+  pthread_mutex_lock (&$my(log_mutex));
 
-    case US_CHARSET:
-      string_append_with_len (buf, V_STR_FMT_LEN (4, "\033%cB", (charset is G0 ? '(' : ')')), 3);
-      break;
+  int state = $my(log_worker_state);
+  $my(log_worker_state) = LOG_WORKER_QUIT;
+  pthread_cond_signal (&$my(log_cond));
 
-    case GRAPHICS:
-      string_append_with_len (buf, V_STR_FMT_LEN (4, "\033%c0", (charset is G0 ? '(' : ')')), 3);
-      break;
+  pthread_mutex_unlock (&$my(log_mutex));
 
-    default:  break;
+  if (state is LOG_WORKER_RUNNING)
+    pthread_join ($my(log_worker), NULL);
+
+  while ($my(log_jobs)) {
+    log_job *job = $my(log_jobs);
+    $my(log_jobs) = job->next;
+    Free (job->fname);
+    Free (job);
   }
-  return buf;
 }
 
-static string_t *vt_esc_scan (vwm_frame *, string_t *, int);
+static int log_segment_open (log_segment *seg, int *compressed) {
+  *compressed = 0;
+  int fd = open (seg->fname->bytes, O_RDONLY|O_CLOEXEC);
+  if (-1 isnot fd) return fd;
 
-static void vt_frame_esc_set (vwm_frame *frame) {
-  frame->process_char_cb = vt_esc_scan;
+  char fname[seg->fname->num_bytes + sizeof (LOG_LZ_EXT)];
+  snprintf (fname, sizeof (fname), "%s" LOG_LZ_EXT, seg->fname->bytes);
+  fd = open (fname, O_RDONLY|O_CLOEXEC);
+  if (-1 isnot fd) *compressed = 1;
+  return fd;
+}
 
-  for (int i = 0; i < MAX_PARAMS; i++)
-    frame->esc_param[i] = 0;
+static off_t log_segment_disk_size (log_segment *seg) {
+  struct stat st;
+  if (0 is stat (seg->fname->bytes, &st)) return st.st_size;
 
-  frame->param_idx = 0;
-  frame->cur_param = &frame->esc_param[frame->param_idx];
+  char fname[seg->fname->num_bytes + sizeof (LOG_LZ_EXT)];
+  snprintf (fname, sizeof (fname), "%s" LOG_LZ_EXT, seg->fname->bytes);
+  if (0 is stat (fname, &st)) return st.st_size;
+  return 0;
 }
 
-static void frame_reset (vwm_frame *frame) {
-  frame->row_pos = 1;
-  frame->col_pos = 1;
-  frame->saved_row_pos = 1;
-  frame->saved_col_pos = 1;
-  frame->scroll_first_row = 1;
-  frame->last_row = frame->num_rows;
-  frame->key_state = norm;
-  frame->textattr = NORMAL;
-  frame->saved_textattr = NORMAL;
-  frame->charset[G0] = US_CHARSET;
-  frame->charset[G1] = US_CHARSET;
-  vt_frame_esc_set (frame);
+static void frame_log_delete_segment (vwm_frame *this, log_segment *seg) {
+  char fname[seg->fname->num_bytes + sizeof (LOG_LZ_EXT)];
+  snprintf (fname, sizeof (fname), "%s" LOG_LZ_EXT, seg->fname->bytes);
+
+  pthread_mutex_lock (&this->root->prop->log_mutex);
+  unlink (seg->fname->bytes);
+  unlink (fname);
+  pthread_mutex_unlock (&this->root->prop->log_mutex);
 }
 
-static string_t *vt_esc_brace_q (vwm_frame *frame, string_t *buf, int c) {
-  if (ISDIGIT (c)) {
-    *frame->cur_param *= 10;
-    *frame->cur_param += (c - '0');
-    return buf;
+static void frame_log_release_segments (vwm_frame *this, int remove) {
+  log_segment *seg = this->log_segments;
+  while (seg) {
+    log_segment *tmp = seg->next;
+    if (remove) frame_log_delete_segment (this, seg);
+    string_free (seg->fname);
+    Free (seg);
+    seg = tmp;
   }
 
-  /* Return inside the switch to prevent reset_esc() */
-  switch (c) {
-    case '\030': /* Processed as escape cancel */
-    case '\032': vt_frame_esc_set (frame);
-    return buf;
+  this->log_segments = NULL;
+  this->log_seq = 0;
+}
 
-    case 'h': /* Set modes */
-      switch (frame->esc_param[0]) {
-        case 1: /* Cursorkeys in application mode */
-          frame->key_state = appl;
-          vt_keystate_print (buf, frame->key_state);
-          break;
+/* remove the oldest segments, until the log fits in log_max_size; the
+ * active log counts as a full segment, as this is what it will grow to */
+static void frame_log_trim (vwm_frame *this) {
+  if (0 >= this->log_max_size) return;
 
-        case 7:
-          string_append_with_len (buf, TERM_AUTOWRAP_ON, TERM_AUTOWRAP_ON_LEN);
-          break;
+  off_t total = (this->log_size > this->log_segment_size ?
+      this->log_size : this->log_segment_size);
+  for (log_segment *seg = this->log_segments; seg; seg = seg->next)
+    total += log_segment_disk_size (seg);
 
-        case 25:
-          string_append_with_len (buf, TERM_CURSOR_SHOW, TERM_CURSOR_SHOW_LEN);
-          break;
+  while (total > this->log_max_size and NULL isnot this->log_segments) {
+    log_segment *seg = this->log_segments;
+    total -= log_segment_disk_size (seg);
+    frame_log_delete_segment (this, seg);
+    logts_shift (&this->logts, seg->num_lines);
+    this->log_segments = seg->next;
+    string_free (seg->fname);
+    Free (seg);
+  }
+}
 
-        case 47:
-          string_append_with_len (buf, TERM_SCREEN_SAVE, TERM_SCREEN_SAVE_LEN);
-          break;
+/* seal the active log to "logfile.seq" and start a new one */
+static void frame_log_rotate (vwm_frame *this) {
+  char fname[this->logfile->num_bytes + 32];
+  snprintf (fname, sizeof (fname), "%s.%ld", this->logfile->bytes, this->log_seq + 1);
 
-        case 2: /* Set ansi mode */
-        case 3: /* 132 char/row */
-        case 4: /* Set jump scroll */
-        case 5: /* Set reverse screen */
-        case 6: /* Set relative coordinates */
-        case 8: /* Set auto repeat on */
-        default:
-          frame->unimplemented_cb (frame, __func__, c, frame->esc_param[0]);
-          break;
-      }
-      break;
+  ftruncate (this->logfd, this->log_size);
 
-  case 'l': /* Reset modes */
-    switch (frame->esc_param[0]) {
-      case 1: /* Cursorkeys in normal mode */
-        frame->key_state = norm;
-        vt_keystate_print (buf, frame->key_state);
-        break;
+  if (-1 is rename (this->logfile->bytes, fname)) return;
 
-        case 7:
-          string_append_with_len (buf, TERM_AUTOWRAP_OFF, TERM_AUTOWRAP_OFF_LEN);
-          break;
+  int fd = open (this->logfile->bytes, O_CREAT|O_RDWR|O_TRUNC, S_IRUSR|S_IWUSR);
+  if (-1 is fd) {
+    rename (fname, this->logfile->bytes);
+    return;
+  }
 
-      case 25:
-        string_append_with_len (buf, TERM_CURSOR_HIDE, TERM_CURSOR_HIDE_LEN);
-        break;
+  close (this->logfd);
+  this->logfd = fd;
 
-      case 47:
-        string_append_with_len (buf, TERM_SCREEN_RESTORE, TERM_SCREEN_RESTORE_LEN);
-        break;
+  log_segment *seg = Alloc (sizeof (log_segment));
+  seg->seq = ++this->log_seq;
+  seg->num_lines = this->log_lines;
+  seg->fname = string_new_with (fname);
 
-      case 2: /* Set VT52 mode */
-      case 3:
-      case 4: /* Set smooth scroll */
-      case 5: /* Set non-reversed (normal) screen */
-      case 6: /* Set absolute coordinates */
-      case 8: /* Set auto repeat off */
-      default:
-        frame->unimplemented_cb (frame, __func__, c, frame->esc_param[0]);
-        break;
-    }
-    break;
+  log_segment **it = &this->log_segments;
+  while (*it) it = &(*it)->next;
+  *it = seg;
 
-    default:
-      break;
-   }
+  this->log_size = 0;
+  this->log_lines = 0;
 
-  vt_frame_esc_set (frame);
-  return buf;
-}
+  if (this->log_compress)
+    vwm_log_worker_add_job (this->root, fname);
 
-static string_t *vt_esc_lparen (vwm_frame *frame, string_t *buf, int c) {
-  /* Return inside the switch to prevent reset_esc() */
-  switch (c) {
-    case '\030': /* Processed as escape cancel */
-    case '\032':
-      vt_frame_esc_set (frame);
-      break;
+  frame_log_trim (this);
+}
 
-    /* Select character sets */
-    case 'A': /* UK as G0 */
-      frame->charset[G0] = UK_CHARSET;
-      vt_altcharset (buf, G0, UK_CHARSET);
-      break;
+static int vt_video_line_to_str (int *line, char *buf, int len) {
+  int idx = 0;
+  utf8 c;
 
-    case 'B': /* US as G0 */
-      frame->charset[G0] = US_CHARSET;
-      vt_altcharset (buf, G0, US_CHARSET);
-      break;
+  for (int i = 0; i < len; i++) {
+    c = line[i];
 
-    case '0': /* Special character set as G0 */
-      frame->charset[G0] = GRAPHICS;
-      vt_altcharset (buf, G0, GRAPHICS);
-      break;
+    ifnot (c) continue;
 
-    case '1': /* Alternate ROM as G0 */
-    case '2': /* Alternate ROM special character set as G0 */
-    default:
-      frame->unimplemented_cb (frame, __func__, c, frame->esc_param[0]);
-      break;
+    if ((c & 0xFF) < 0x80)
+      buf[idx++] = c & 0xFF;
+    else if (c < 0x800) {
+      buf[idx++] = (c >> 6) | 0xC0;
+      buf[idx++] = (c & 0x3F) | 0x80;
+    } else if (c < 0x10000) {
+      buf[idx++] = (c >> 12) | 0xE0;
+      buf[idx++] = ((c >> 6) & 0x3F) | 0x80;
+      buf[idx++] = (c & 0x3F) | 0x80;
+    } else if (c < 0x110000) {
+      buf[idx++] = (c >> 18) | 0xF0;
+      buf[idx++] = ((c >> 12) & 0x3F) | 0x80;
+      buf[idx++] = ((c >> 6) & 0x3F) | 0x80;
+      buf[idx++] = (c & 0x3F) | 0x80;
+    } else {
+      continue;
+    }
   }
 
-  vt_frame_esc_set (frame);
-  return buf;
+  buf[idx++] = '\n';
+
+  buf[idx] = '\0';
+
+  return idx;
 }
 
-static string_t *vt_esc_rparen (vwm_frame *frame, string_t *buf, int c) {
-  switch (c) {
-    case '\030': /* Processed as escape cancel */
-    case '\032':
-      break;
+/* to the terminal, or without one (see vwm_set_headless()), to the output
+ * callback, or to the output descriptor, or nowhere */
+static void vt_write (vwm_t *root, string_t *buf) {
+  if (NULL is root or 0 is root->prop->term->headless) {
+    fprintf (stdout, "%s", buf->bytes);
+    fflush (stdout);
+    return;
+  }
 
-    /* Select character sets */
-    case 'A':
-      frame->charset[G1] = UK_CHARSET;
-      vt_altcharset (buf, G1, UK_CHARSET);
-      break;
+  ifnot (buf->num_bytes) return;
 
-    case 'B':
-      frame->charset[G1] = US_CHARSET;
-      vt_altcharset (buf, G1, US_CHARSET);
-      break;
+  vwm_prop *prop = root->prop;
 
-    case '0':
-      frame->charset[G1] = GRAPHICS;
-      vt_altcharset (buf, G1, GRAPHICS);
-      break;
+  if (NULL isnot prop->output_cb)
+    prop->output_cb (root, buf->bytes, buf->num_bytes, prop->output_object);
+  else if (-1 isnot prop->output_fd)
+    fd_write (prop->output_fd, buf->bytes, buf->num_bytes);
+}
 
-    case '1': /* Alternate ROM as G1 */
-    case '2': /* Alternate ROM special character set as G1 */
-    default:
-      frame->unimplemented_cb (frame, __func__, c, frame->esc_param[0]);
-      break;
-  }
+static string_t *vt_insline (string_t *buf, int num) {
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dL", num));
+}
 
-  vt_frame_esc_set (frame);
-  return buf;
+static string_t *vt_insertchar (string_t *buf, int numcols) {
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%d@", numcols));
 }
 
-static string_t *vt_esc_pound (vwm_frame *frame, string_t *buf, int c) {
-  switch (c)   /* Line attributes not supported */ {
-    case '3':  /* Double height (top half) */
-    case '4':  /* Double height (bottom half) */
-    case '5':  /* Single width, single height */
-    case '6':  /* Double width */
-    default:
-      frame->unimplemented_cb (frame, __func__, c, frame->esc_param[0]);
-      vt_frame_esc_set (frame);
-      break;
-  }
+static string_t *vt_savecursor (string_t *buf) {
+  return string_append_with_len (buf, "\0337", 2);
+}
 
-  return buf;
+static string_t *vt_restcursor (string_t *buf) {
+  return string_append_with_len (buf, "\0338", 2);
 }
 
-static string_t *vt_process_m (vwm_frame *frame, string_t *buf, int c) {
-  int idx;
+static string_t *vt_clreol (string_t *buf) {
+  return string_append_with_len (buf, "\033[K", 3);
+}
 
-  switch (c) {
-    case 0: /* Turn all attributes off */
-      frame->textattr = NORMAL;
-      vt_attr_reset (buf);
-      idx = frame->num_cols - frame->col_pos - 1;
-      if (0 <= idx)
-        for (int i = 0; i < idx; i++)
-          frame->colors[frame->row_pos -1][frame->col_pos - 1 + i] = COLOR_FG_NORM;
-      break;
+static string_t *vt_clrbgl (string_t *buf) {
+  return string_append_with_len (buf, "\033[1K", 4);
+}
 
-    case 1:
-      frame->textattr |= BOLD;
-      vt_bold (buf, 1);
-      break;
+static string_t *vt_clrline (string_t *buf) {
+  return string_append_with_len (buf, "\033[2K", 4);
+}
 
-    case 2: /* Half brightness */
-      frame->unimplemented_cb (frame, __func__, c, frame->esc_param[0]);
-      break;
+static string_t *vt_delunder (string_t *buf, int num) {
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dP", num));
+}
 
-    case 3:
-      frame->textattr |= ITALIC;
-      vt_italic (buf, 1);
-      break;
+static string_t *vt_delline (string_t *buf, int num) {
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dM", num));
+}
 
-    case 4:
-      frame->textattr |= UNDERLINE;
-      vt_underline (buf, 1);
-      break;
+static string_t *vt_attr_reset (string_t *buf) {
+  return string_append_with_len (buf, "\033[m", 3);
+}
 
-    case 5:
-      frame->textattr |= BLINK;
-      vt_blink (buf, 1);
-      break;
+static string_t *vt_reverse (string_t *buf, int on) {
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%sm", (on ? "7" : "27")));
+}
 
-    case 7:
-      frame->textattr |= REVERSE;
-      vt_reverse (buf, 1);
-      break;
+static string_t *vt_underline (string_t *buf, int on) {
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%sm", (on ? "4" : "24")));
+}
 
-    case 21: /* Normal brightness */
-      frame->unimplemented_cb (frame, __func__, c, frame->esc_param[0]);
-      break;
+static string_t *vt_bold (string_t *buf, int on) {
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%sm", (on ? "1" : "22")));
+}
 
-    case 22:
-      frame->textattr &= ~BOLD;
-      vt_bold (buf, 0);
-      break;
+static string_t *vt_italic (string_t *buf, int on) {
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%sm", (on ? "3" : "23")));
+}
 
-    case 23:
-      frame->textattr &= ~ITALIC;
-      vt_italic (buf, 0);
-      break;
+static string_t *vt_blink (string_t *buf, int on) {
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%sm", (on ? "5" : "25")));
+}
 
-    case 24:
-      frame->textattr &= ~UNDERLINE;
-      vt_underline (buf, 0);
-      break;
+static string_t *vt_bell (string_t *buf) {
+  return string_append_with_len (buf, "\007", 1);
+}
 
-    case 25:
-      frame->textattr &= ~BLINK;
-      vt_blink (buf, 0);
-      break;
+static string_t *vt_setfg (string_t *buf, int color) {
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%d;1m", color));
+}
 
-    case 27:
-      frame->textattr &= ~REVERSE;
-      vt_reverse (buf, 0);
-      break;
+static string_t *vt_setbg (string_t *buf, int color) {
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%d;1m", color));
+}
 
-    case 39:
-      c = 30;
-    case 30 ... 37:
-      vt_setfg (buf, c);
-      idx = frame->num_cols - frame->col_pos + 1;
-      if (0 < idx)
-        for (int i = 0; i < idx; i++)
-          frame->colors[frame->row_pos - 1][frame->col_pos - 1 + i] = c;
+static string_t *vt_left (string_t *buf, int count) {
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dD", count));
+}
 
-      break;
+static string_t *vt_right (string_t *buf, int count) {
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dC", count));
+}
 
-    case 49:
-      c = 47;
-    case 40 ... 47:
-      vt_setbg (buf, c);
-      break;
+static string_t *vt_up (string_t *buf, int numrows) {
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dA", numrows));
+}
 
-    default:
-      frame->unimplemented_cb (frame, __func__, c, frame->esc_param[0]);
-      break;
-  }
+static string_t *vt_down (string_t *buf, int numrows) {
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dB", numrows));
+}
 
-  return buf;
+static string_t *vt_irm (string_t *buf) {
+  return string_append_with_len (buf, "\033[4l", 4);
 }
 
-static string_t *vt_esc_brace (vwm_frame *frame, string_t *buf, int c) {
-  int
-    i,
-    newx,
-    newy;
+static string_t *vt_revscroll (string_t *buf) {
+  return string_append_with_len (buf, "\033M", 2);
+}
 
-  char reply[128];
+static string_t *vt_setscroll (string_t *buf, int first, int last) {
+  if (0 is first and 0 is last)
+    return string_append_with_len (buf, "\033[r", 3);
+  else
+    return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%d;%dr", first, last));
+}
 
-  if (ISDIGIT (c)) {
-    *frame->cur_param *= 10;
-    *frame->cur_param += (c - '0');
-    return buf;
-  }
+static string_t *vt_goto (string_t *buf, int row, int col) {
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%d;%dH", row, col));
+}
 
-   /* Return inside the switch to prevent reset_esc() */
-  switch (c) {
-    case '\030': /* Processed as escape cancel */
-    case '\032':
-      break;
+static string_t *vt_attr_check (string_t *buf, int pixel, int lastattr, uchar *currattr) {
+  uchar
+    simplepixel,
+    lastpixel,
+    change,
+    selected,
+    reversed;
 
-    case '?': /* Format should be \E[?<n> */
-      if (*frame->cur_param) {
+ /* Set the simplepixel REVERSE bit if SELECTED ^ REVERSE */
+  simplepixel = ((pixel  >> 8) & (~SELECTED)  & (~REVERSE));
+  selected    = (((pixel >> 8) & (~SELECTED)) ? 1 : 0);
+  reversed    = (((pixel >> 8) & (~REVERSE))  ? 1 : 0);
 
-frame->unimplemented_cb (frame, "brace why", c, frame->esc_param[0]);
-        vt_frame_esc_set (frame);
-      } else {
-        frame->process_char_cb = vt_esc_brace_q;
-      }
+  if (selected ^ reversed)
+    simplepixel |= REVERSE;
 
-      return buf;
+  /* Set the lastpixel REVERSE bit if SELECTED ^ REVERSE */
+  lastpixel = ((lastattr  >> 8) & (~SELECTED)  & (~REVERSE));
+  selected  = (((lastattr >> 8) & (~SELECTED)) ? 1 : 0);
+  reversed  = (((lastattr >> 8) & (~REVERSE))  ? 1 : 0);
 
-    case ';':
-      if (frame->param_idx + 1 < MAX_PARAMS)
-        frame->cur_param = &frame->esc_param[++frame->param_idx];
-      return buf;
+  if (selected ^ reversed)
+    lastpixel |= REVERSE;
 
-    case 'h': /* Set modes */
-      switch (frame->esc_param[0]) {
-        case 2:  /* Lock keyboard */
-        case 4:  /* Character insert mode */
-        case 12: /* Local echo on */
-        case 20: /* <Return> = CR */
-        default:
-          frame->unimplemented_cb (frame, __func__, c, frame->esc_param[0]);
-          break;
+ /* Thanks to Dan Dorough for the XOR code */
+checkchange:
+  change = (lastpixel ^ simplepixel);
+  if (change) {
+    if (change & REVERSE) {
+      if ((*currattr) & REVERSE) {
+#define GOTO_HACK          /* vt_reverse (0) doesn't work on xterms? */
+#ifdef  GOTO_HACK          /* This goto hack resets all current attributes */
+        vt_attr_reset (buf);
+        *currattr &= ~REVERSE;
+        simplepixel = 0;
+        lastpixel &= (~REVERSE);
+        goto checkchange;
+#else
+        vt_reverse (buf, 0);
+        *currattr &= ~REVERSE;
+#endif
+      } else {
+        vt_reverse (buf, 1);
+        *currattr |= REVERSE;
       }
-      break;
+    }
 
-    case 'l': /* Reset modes */
-      switch (frame->esc_param[0]) {
-        case 4:  /* Character overstrike mode */
-          vt_irm (buf); /* (ADDITION - unverified) */
-          break;
+    if (change & BOLD) {
+      if ((*currattr) & BOLD) {
+        vt_bold (buf, 0);
+        *currattr &= ~BOLD;
+      } else {
+        vt_bold (buf, 1);
+        *currattr |= BOLD;
+      }
+    }
 
-        case 2:  /* Unlock keyboard */
-        case 12: /* Local echo off */
-        case 20: /* <Return> = CR-LF */
-        default:
-          frame->unimplemented_cb (frame, __func__, c, frame->esc_param[0]);
-          break;
+    if (change & ITALIC) {
+      if ((*currattr) & ITALIC) {
+        vt_italic (buf, 0);
+        *currattr &= ~ITALIC;
+      } else {
+        vt_italic (buf, 1);
+        *currattr |= ITALIC;
       }
-      break;
+    }
 
-    case 'r': /* Set scroll region */
-      if (!frame->esc_param[0] and !frame->esc_param[1]) {
-        frame->scroll_first_row = 1;
-        frame->last_row = frame->num_rows;
+    if (change & UNDERLINE) {
+      if ((*currattr) & UNDERLINE) {
+        vt_underline (buf, 0);
+        *currattr &= ~UNDERLINE;
       } else {
-        /* Check parameters: VERY important. :) */
-        if (frame->esc_param[0] < 1) /* Not needed */
-          frame->scroll_first_row = 1;
-        else
-          frame->scroll_first_row = frame->esc_param[0];
+        vt_underline (buf, 1);
+        *currattr |= UNDERLINE;
+      }
+    }
+
+    if (change & BLINK) {
+      if ((*currattr) & BLINK) {
+        vt_blink (buf, 0);
+        *currattr &= ~BLINK;
+      } else {
+        vt_blink (buf, 1);
+        *currattr |= BLINK;
+      }
+    }
+  }
+
+  return buf;
+}
+
+static string_t *vt_attr_set (string_t *buf, int textattr) {
+  vt_attr_reset (buf);
+
+  if (textattr & BOLD)
+    vt_bold (buf, 1);
+
+  if (textattr & UNDERLINE)
+    vt_underline (buf, 1);
+
+  if (textattr & BLINK)
+    vt_blink (buf, 1);
+
+  if (textattr & REVERSE)
+    vt_reverse (buf, 1);
+
+  if (textattr & ITALIC)
+    vt_italic (buf, 1);
+
+  return buf;
+}
+
+static void vt_video_add (vwm_frame *frame, utf8 c) {
+  frame->videomem[frame->row_pos - 1][frame->col_pos - 1] = c;
+  frame->videomem[frame->row_pos - 1][frame->col_pos - 1] |=
+      (((int) frame->textattr) << 8);
+}
+
+static void vt_video_erase (vwm_frame *frame, int x1, int x2, int y1, int y2) {
+  int i, j;
+
+  for (i = x1 - 1; i < x2; ++i) {
+    for (j = y1 - 1; j < y2; ++j) {
+      frame->videomem[i][j] = 0;
+      frame->colors  [i][j] = COLOR_FG_NORM;
+    }
+
+    if (y2 >= frame->num_cols)
+      frame->wrapped[i] = 0;
+  }
+}
+
+static void vt_frame_video_rshift (vwm_frame *frame, int numcols) {
+  for (int i = frame->num_cols - 1; i > frame->col_pos - 1; --i) {
+    if (i - numcols >= 0) {
+      frame->videomem[frame->row_pos-1][i] = frame->videomem[frame->row_pos-1][i-numcols];
+      frame->colors[frame->row_pos-1][i] = frame->colors[frame->row_pos-1][i-numcols];
+    } else {
+      frame->videomem[frame->row_pos-1][i] = 0;
+      frame->colors [frame->row_pos-1][i] = COLOR_FG_NORM;
+    }
+  }
+}
+
+static string_t *vt_frame_ech (vwm_frame *frame, string_t *buf, int num_cols) {
+  for (int i = 0; i + frame->col_pos <= frame->num_cols and i < num_cols; i++) {
+    frame->videomem[frame->row_pos-1][frame->col_pos - i - 1] = 0;
+    frame->colors[frame->row_pos-1][frame->col_pos - i - 1] = COLOR_FG_NORM;
+  }
+
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dX", num_cols));
+}
+
+/*
+static string_t *vt_frame_cha (vwm_frame *frame, string_t *buf, int param) {
+  if (param < 2)
+    frame->col_pos = 1;
+  else {
+    if (param > frame->num_cols)
+      param = frame->num_cols;
+    frame->col_pos = param;
+  }
+
+  return string_append (buf, V_STR_FMT_LEN (MAX_SEQ_LEN, "\033[%dG", param));
+}
+*/
+
+/* A soft-wrapped row is a part of a logical line, so it goes to the log
+ * without the newline; the line is timestamped and counted when it ends,
+ * and a segment never ends in the middle of a line. */
+static void frame_log_row (vwm_frame *frame, int *row, int num_cols, int wrapped) {
+  char buf[(num_cols * 4) + 2];
+  int len = vt_video_line_to_str (row, buf, num_cols);
+  if (wrapped) len--;
+
+  fd_write (frame->logfd, buf, len);
+  frame->log_size += len;
+
+  if (wrapped) return;
+
+  logts_push (&frame->logts, (frame->batch_ms ? frame->batch_ms : vt_clock_ms ()));
+  frame->log_lines++;
+
+  if (frame->log_segment_size and frame->log_size >= frame->log_segment_size)
+    frame_log_rotate (frame);
+}
+
+static void vt_frame_video_scroll (vwm_frame *frame, int numlines) {
+  int *tmpvideo;
+  int *tmpcolors;
+  int n;
+
+  frame->stats.scrolls += numlines;
+
+  for (int i = 0; i < numlines; i++) {
+    tmpvideo = frame->videomem[frame->scroll_first_row - 1];
+    tmpcolors = frame->colors[frame->scroll_first_row - 1];
+
+    ifnot (NULL is frame->logfile)
+      frame_log_row (frame, tmpvideo, frame->num_cols, frame->wrapped[frame->scroll_first_row - 1]);
+
+    for (int j = 0; j < frame->num_cols; j++) {
+      tmpvideo[j] = 0;
+      tmpcolors[j] = COLOR_FG_NORM;
+    }
+
+    for (n = frame->scroll_first_row - 1; n < frame->last_row - 1; n++) {
+      frame->videomem[n] = frame->videomem[n + 1];
+      frame->colors[n] = frame->colors[n + 1];
+      frame->wrapped[n] = frame->wrapped[n + 1];
+    }
+
+    frame->videomem[n] = tmpvideo;
+    frame->colors[n] = tmpcolors;
+    frame->wrapped[n] = 0;
+  }
+}
+
+static void vt_frame_video_scroll_back (vwm_frame *frame, int numlines) {
+  if (frame->row_pos < frame->scroll_first_row)
+    return;
+
+  int n;
+  int *tmpvideo;
+  int *tmpcolors;
+
+  frame->stats.scrolls += numlines;
+
+  for (int i = 0; i < numlines; i++) {
+    tmpvideo = frame->videomem[frame->last_row - 1];
+    tmpcolors = frame->colors[frame->last_row - 1];
+
+    for (int j = 0; j < frame->num_cols; j++) {
+      tmpvideo[j] = 0;
+      tmpcolors[j] = COLOR_FG_NORM;
+    }
+
+   for (n = frame->last_row - 1; n > frame->scroll_first_row - 1; --n) {
+      frame->videomem[n] = frame->videomem[n - 1];
+      frame->colors[n] = frame->colors[n - 1];
+      frame->wrapped[n] = frame->wrapped[n - 1];
+    }
+
+    frame->videomem[n] = tmpvideo;
+    frame->colors[n] = tmpcolors;
+    frame->wrapped[n] = 0;
+  }
+}
+
+static string_t *vt_frame_attr_set (vwm_frame *frame, string_t *buf) {
+  uchar on = NORMAL;
+  vt_attr_reset (buf);
+  return vt_attr_check (buf, 0, frame->textattr, &on);
+}
+
+static string_t *vt_append (vwm_frame *frame, string_t *buf, utf8 c) {
+  if (frame->col_pos > frame->num_cols) {
+    /* the line continues to the next row */
+    frame->wrapped[frame->row_pos - 1] = 1;
+
+    if (frame->row_pos < frame->last_row)
+      frame->row_pos++;
+    else
+      vt_frame_video_scroll (frame, 1);
+
+    string_append (buf, "\r\n");
+    frame->col_pos = 1;
+  }
+
+  vt_video_add (frame, c);
+
+  if (frame->mb_len)
+    string_append_with_len (buf, frame->mb_buf, frame->mb_len);
+  else
+    string_append_byte (buf, c);
+
+  frame->col_pos++;
+  return buf;
+}
+
+static string_t *vt_keystate_print (string_t *buf, int application) {
+  if (application)
+    return string_append (buf, "\033=\033[?1h");
+
+  return string_append (buf, "\033>\033[?1l");
+}
+
+static string_t *vt_altcharset (string_t *buf, int charset, int type) {
+  switch (type) {
+    case UK_CHARSET:
+      string_append_with_len (buf, V_STR_FMT_LEN (4, "\033%cA", (charset is G0 ? '(' : ')')), 3);
+      break;
+
+    case US_CHARSET:
+      string_append_with_len (buf, V_STR_FMT_LEN (4, "\033%cB", (charset is G0 ? '(' : ')')), 3);
+      break;
+
+    case GRAPHICS:
+      string_append_with_len (buf, V_STR_FMT_LEN (4, "\033%c0", (charset is G0 ? '(' : ')')), 3);
+      break;
+
+    default:  break;
+  }
+  return buf;
+}
+
+static string_t *vt_esc_scan (vwm_frame *, string_t *, int);
+
+static int vt_trace_state (FrameProcessChar_cb);
+
+/* Counts the sequence by its handler, its final byte and its first
+ * parameter, in a table of a fixed size, so a program that repeats one
+ * costs nothing more than a lookup. The handlers are keyed by their
+ * address, as they are __func__ or literals. */
+static void vt_unimplemented_count (vwm_frame *frame, const char *fun, int c, int param) {
+  vwm_prop *prop = frame->root->prop;
+  ulong h = ((ulong) fun >> 3) * 31 + (uint) c;
+  h = h * 31 + (uint) param;
+
+  for (int i = 0; i < UNIMPLEMENTED_SLOTS; i++) {
+    vwm_unimplemented *u = &prop->unimplemented[(h + i) % UNIMPLEMENTED_SLOTS];
+
+    if (NULL is u->fun) {
+      if (prop->num_unimplemented is UNIMPLEMENTED_MAX) break;
+
+      u->fun = fun;
+      u->c = c;
+      u->param = param;
+      u->first_frame = frame->id;
+      u->first_seen = vt_clock_ms ();
+      prop->num_unimplemented++;
+    } else if (u->fun isnot fun or u->c isnot c or u->param isnot param)
+      continue;
+
+    u->count++;
+    u->last_frame = frame->id;
+    u->last_seen = (u->count is 1 ? u->first_seen : vt_clock_ms ());
+    prop->unimplemented_dirty = 1;
+    return;
+  }
+
+  prop->unimplemented_dropped++;
+}
+
+static void vt_unimplemented (vwm_frame *frame, const char *fun, int c, int param) {
+  frame->stats.unimplemented++;
+  vt_unimplemented_count (frame, fun, c, param);
+  TRACE_EVENT (VWM_TRACE_UNIMPLEMENTED, frame->id, c, param,
+      vt_trace_state (frame->process_char_cb));
+  frame->unimplemented_cb (frame, fun, c, param);
+}
+
+static void vt_frame_esc_set (vwm_frame *frame) {
+  frame->process_char_cb = vt_esc_scan;
+
+  for (int i = 0; i < MAX_PARAMS; i++)
+    frame->esc_param[i] = 0;
+
+  frame->param_idx = 0;
+  frame->cur_param = &frame->esc_param[frame->param_idx];
+}
+
+static void frame_reset (vwm_frame *frame) {
+  frame->row_pos = 1;
+  frame->col_pos = 1;
+  frame->saved_row_pos = 1;
+  frame->saved_col_pos = 1;
+  frame->scroll_first_row = 1;
+  frame->last_row = frame->num_rows;
+  frame->key_state = norm;
+  frame->textattr = NORMAL;
+  frame->saved_textattr = NORMAL;
+  frame->charset[G0] = US_CHARSET;
+  frame->charset[G1] = US_CHARSET;
+  vt_frame_esc_set (frame);
+}
+
+static string_t *vt_esc_brace_q (vwm_frame *frame, string_t *buf, int c) {
+  if (ISDIGIT (c)) {
+    *frame->cur_param *= 10;
+    *frame->cur_param += (c - '0');
+    return buf;
+  }
+
+  /* Return inside the switch to prevent reset_esc() */
+  switch (c) {
+    case '\030': /* Processed as escape cancel */
+    case '\032': vt_frame_esc_set (frame);
+    return buf;
+
+    case 'h': /* Set modes */
+      switch (frame->esc_param[0]) {
+        case 1: /* Cursorkeys in application mode */
+          frame->key_state = appl;
+          vt_keystate_print (buf, frame->key_state);
+          break;
+
+        case 7:
+          string_append_with_len (buf, TERM_AUTOWRAP_ON, TERM_AUTOWRAP_ON_LEN);
+          break;
+
+        case 25:
+          string_append_with_len (buf, TERM_CURSOR_SHOW, TERM_CURSOR_SHOW_LEN);
+          break;
+
+        case 47:
+          frame->alt_screen = 1;
+          string_append_with_len (buf, TERM_SCREEN_SAVE, TERM_SCREEN_SAVE_LEN);
+          break;
+
+        case 2: /* Set ansi mode */
+        case 3: /* 132 char/row */
+        case 4: /* Set jump scroll */
+        case 5: /* Set reverse screen */
+        case 6: /* Set relative coordinates */
+        case 8: /* Set auto repeat on */
+        default:
+          vt_unimplemented (frame, __func__, c, frame->esc_param[0]);
+          break;
+      }
+      break;
+
+  case 'l': /* Reset modes */
+    switch (frame->esc_param[0]) {
+      case 1: /* Cursorkeys in normal mode */
+        frame->key_state = norm;
+        vt_keystate_print (buf, frame->key_state);
+        break;
+
+        case 7:
+          string_append_with_len (buf, TERM_AUTOWRAP_OFF, TERM_AUTOWRAP_OFF_LEN);
+          break;
+
+      case 25:
+        string_append_with_len (buf, TERM_CURSOR_HIDE, TERM_CURSOR_HIDE_LEN);
+        break;
+
+      case 47:
+        frame->alt_screen = 0;
+        string_append_with_len (buf, TERM_SCREEN_RESTORE, TERM_SCREEN_RESTORE_LEN);
+        break;
+
+      case 2: /* Set VT52 mode */
+      case 3:
+      case 4: /* Set smooth scroll */
+      case 5: /* Set non-reversed (normal) screen */
+      case 6: /* Set absolute coordinates */
+      case 8: /* Set auto repeat off */
+      default:
+        vt_unimplemented (frame, __func__, c, frame->esc_param[0]);
+        break;
+    }
+    break;
+
+    default:
+      break;
+   }
+
+  vt_frame_esc_set (frame);
+  return buf;
+}
+
+static string_t *vt_esc_lparen (vwm_frame *frame, string_t *buf, int c) {
+  /* Return inside the switch to prevent reset_esc() */
+  switch (c) {
+    case '\030': /* Processed as escape cancel */
+    case '\032':
+      vt_frame_esc_set (frame);
+      break;
+
+    /* Select character sets */
+    case 'A': /* UK as G0 */
+      frame->charset[G0] = UK_CHARSET;
+      vt_altcharset (buf, G0, UK_CHARSET);
+      break;
+
+    case 'B': /* US as G0 */
+      frame->charset[G0] = US_CHARSET;
+      vt_altcharset (buf, G0, US_CHARSET);
+      break;
+
+    case '0': /* Special character set as G0 */
+      frame->charset[G0] = GRAPHICS;
+      vt_altcharset (buf, G0, GRAPHICS);
+      break;
+
+    case '1': /* Alternate ROM as G0 */
+    case '2': /* Alternate ROM special character set as G0 */
+    default:
+      vt_unimplemented (frame, __func__, c, frame->esc_param[0]);
+      break;
+  }
+
+  vt_frame_esc_set (frame);
+  return buf;
+}
+
+static string_t *vt_esc_rparen (vwm_frame *frame, string_t *buf, int c) {
+  switch (c) {
+    case '\030': /* Processed as escape cancel */
+    case '\032':
+      break;
+
+    /* Select character sets */
+    case 'A':
+      frame->charset[G1] = UK_CHARSET;
+      vt_altcharset (buf, G1, UK_CHARSET);
+      break;
+
+    case 'B':
+      frame->charset[G1] = US_CHARSET;
+      vt_altcharset (buf, G1, US_CHARSET);
+      break;
+
+    case '0':
+      frame->charset[G1] = GRAPHICS;
+      vt_altcharset (buf, G1, GRAPHICS);
+      break;
+
+    case '1': /* Alternate ROM as G1 */
+    case '2': /* Alternate ROM special character set as G1 */
+    default:
+      vt_unimplemented (frame, __func__, c, frame->esc_param[0]);
+      break;
+  }
+
+  vt_frame_esc_set (frame);
+  return buf;
+}
+
+static string_t *vt_esc_pound (vwm_frame *frame, string_t *buf, int c) {
+  switch (c)   /* Line attributes not supported */ {
+    case '3':  /* Double height (top half) */
+    case '4':  /* Double height (bottom half) */
+    case '5':  /* Single width, single height */
+    case '6':  /* Double width */
+    default:
+      vt_unimplemented (frame, __func__, c, frame->esc_param[0]);
+      vt_frame_esc_set (frame);
+      break;
+  }
+
+  return buf;
+}
+
+static string_t *vt_process_m (vwm_frame *frame, string_t *buf, int c) {
+  int idx;
+
+  switch (c) {
+    case 0: /* Turn all attributes off */
+      frame->textattr = NORMAL;
+      vt_attr_reset (buf);
+      idx = frame->num_cols - frame->col_pos - 1;
+      if (0 <= idx)
+        for (int i = 0; i < idx; i++)
+          frame->colors[frame->row_pos -1][frame->col_pos - 1 + i] = COLOR_FG_NORM;
+      break;
+
+    case 1:
+      frame->textattr |= BOLD;
+      vt_bold (buf, 1);
+      break;
+
+    case 2: /* Half brightness */
+      vt_unimplemented (frame, __func__, c, frame->esc_param[0]);
+      break;
+
+    case 3:
+      frame->textattr |= ITALIC;
+      vt_italic (buf, 1);
+      break;
+
+    case 4:
+      frame->textattr |= UNDERLINE;
+      vt_underline (buf, 1);
+      break;
+
+    case 5:
+      frame->textattr |= BLINK;
+      vt_blink (buf, 1);
+      break;
+
+    case 7:
+      frame->textattr |= REVERSE;
+      vt_reverse (buf, 1);
+      break;
+
+    case 21: /* Normal brightness */
+      vt_unimplemented (frame, __func__, c, frame->esc_param[0]);
+      break;
+
+    case 22:
+      frame->textattr &= ~BOLD;
+      vt_bold (buf, 0);
+      break;
+
+    case 23:
+      frame->textattr &= ~ITALIC;
+      vt_italic (buf, 0);
+      break;
+
+    case 24:
+      frame->textattr &= ~UNDERLINE;
+      vt_underline (buf, 0);
+      break;
+
+    case 25:
+      frame->textattr &= ~BLINK;
+      vt_blink (buf, 0);
+      break;
+
+    case 27:
+      frame->textattr &= ~REVERSE;
+      vt_reverse (buf, 0);
+      break;
+
+    case 39:
+      c = 30;
+    case 30 ... 37:
+      vt_setfg (buf, c);
+      idx = frame->num_cols - frame->col_pos + 1;
+      if (0 < idx)
+        for (int i = 0; i < idx; i++)
+          frame->colors[frame->row_pos - 1][frame->col_pos - 1 + i] = c;
+
+      break;
+
+    case 49:
+      c = 47;
+    case 40 ... 47:
+      vt_setbg (buf, c);
+      break;
+
+    default:
+      vt_unimplemented (frame, __func__, c, frame->esc_param[0]);
+      break;
+  }
+
+  return buf;
+}
+
+static string_t *vt_esc_brace (vwm_frame *frame, string_t *buf, int c) {
+  int
+    i,
+    newx,
+    newy;
+
+  char reply[128];
+
+  if (ISDIGIT (c)) {
+    *frame->cur_param *= 10;
+    *frame->cur_param += (c - '0');
+    return buf;
+  }
+
+   /* Return inside the switch to prevent reset_esc() */
+  switch (c) {
+    case '\030': /* Processed as escape cancel */
+    case '\032':
+      break;
+
+    case '?': /* Format should be \E[?<n> */
+      if (*frame->cur_param) {
+
+vt_unimplemented (frame, "brace why", c, frame->esc_param[0]);
+        vt_frame_esc_set (frame);
+      } else {
+        frame->process_char_cb = vt_esc_brace_q;
+      }
+
+      return buf;
+
+    case ';':
+      if (frame->param_idx + 1 < MAX_PARAMS)
+        frame->cur_param = &frame->esc_param[++frame->param_idx];
+      return buf;
+
+    case 'h': /* Set modes */
+      switch (frame->esc_param[0]) {
+        case 2:  /* Lock keyboard */
+        case 4:  /* Character insert mode */
+        case 12: /* Local echo on */
+        case 20: /* <Return> = CR */
+        default:
+          vt_unimplemented (frame, __func__, c, frame->esc_param[0]);
+          break;
+      }
+      break;
+
+    case 'l': /* Reset modes */
+      switch (frame->esc_param[0]) {
+        case 4:  /* Character overstrike mode */
+          vt_irm (buf); /* (ADDITION - unverified) */
+          break;
+
+        case 2:  /* Unlock keyboard */
+        case 12: /* Local echo off */
+        case 20: /* <Return> = CR-LF */
+        default:
+          vt_unimplemented (frame, __func__, c, frame->esc_param[0]);
+          break;
+      }
+      break;
+
+    case 'r': /* Set scroll region */
+      if (!frame->esc_param[0] and !frame->esc_param[1]) {
+        frame->scroll_first_row = 1;
+        frame->last_row = frame->num_rows;
+      } else {
+        /* Check parameters: VERY important. :) */
+        if (frame->esc_param[0] < 1) /* Not needed */
+          frame->scroll_first_row = 1;
+        else
+          frame->scroll_first_row = frame->esc_param[0];
+
+        if (frame->esc_param[1] > frame->num_rows)
+          frame->last_row = frame->num_rows;
+        else
+           frame->last_row = frame->esc_param[1];
+
+        if (frame->scroll_first_row > frame->last_row) {
+          /* Reset scroll region */
+          frame->scroll_first_row = 1;
+          frame->last_row = frame->num_rows;
+        }
+      }
+
+      frame->row_pos = 1;
+      frame->col_pos = 1;
+
+      vt_setscroll (buf, frame->scroll_first_row + frame->first_row - 1,
+        frame->last_row + frame->first_row - 1);
+      vt_goto (buf, frame->row_pos + frame->first_row - 1, 1);
+      break;
+
+    case 'A': /* Cursor UP */
+      if (frame->row_pos is frame->first_row)
+        break;
+
+      ifnot (frame->esc_param[0])
+        frame->esc_param[0] = 1;
+
+      newx = (frame->row_pos - frame->esc_param[0]);
+
+      if (newx > frame->scroll_first_row) {
+        frame->row_pos = newx;
+        vt_up (buf, frame->esc_param[0]);
+      } else {
+        frame->row_pos = frame->scroll_first_row;
+        vt_goto (buf, frame->row_pos + frame->first_row - 1,
+          frame->col_pos);
+      }
+      break;
+
+    case 'B': /* Cursor DOWN */
+      if (frame->row_pos is frame->last_row)
+        break;
+
+      ifnot (frame->esc_param[0])
+        frame->esc_param[0] = 1;
+
+      newx = frame->row_pos + frame->esc_param[0];
+
+      if (newx <= frame->last_row) {
+        frame->row_pos = newx;
+        vt_down (buf, frame->esc_param[0]);
+      } else {
+        frame->row_pos = frame->last_row;
+        vt_goto (buf, frame->row_pos + frame->first_row - 1,
+          frame->col_pos);
+      }
+      break;
+
+    case 'C': /* Cursor RIGHT */
+      if (frame->col_pos is frame->num_cols)
+        break;
+
+      ifnot (frame->esc_param[0])
+        frame->esc_param[0] = 1;
+
+      newy = (frame->col_pos + frame->esc_param[0]);
+
+      if (newy < frame->num_cols) {
+        frame->col_pos = newy;
+
+        vt_right (buf, frame->esc_param[0]);
+      } else {
+        frame->col_pos = frame->num_cols;
+        vt_goto (buf, frame->row_pos + frame->first_row - 1,
+          frame->col_pos);
+      }
+      break;
+
+    case 'D': /* Cursor LEFT */
+      if (frame->col_pos is 1)
+        break;
+
+      ifnot (frame->esc_param[0])
+        frame->esc_param[0] = 1;
+
+      newy = (frame->col_pos - frame->esc_param[0]);
+
+      if (newy > 1) {
+        frame->col_pos = newy;
+        vt_left (buf, frame->esc_param[0]);
+      } else {
+        frame->col_pos = 1;
+        string_append (buf, "\r");
+      }
+
+      break;
+
+    case 'G': { /* (hpa - horizontal) (ADDITION) */
+      int col = frame->esc_param[0];
+      int row = frame->esc_param[1];
+      if (row <= 1) row = frame->row_pos;
+      frame->esc_param[0] = row;
+      frame->esc_param[1] = col;
+    }
+
+    case 'd': /* (vpa - HVP) (ADDITION) */
+      frame->unimplemented_cb (frame, "ADDI param[0]", c, frame->esc_param[0]);
+      frame->unimplemented_cb (frame, "ADDI param[1]", c, frame->esc_param[1]);
+      frame->unimplemented_cb (frame, "ADDI row_pos", c, frame->row_pos);
+      frame->unimplemented_cb (frame, "ADDI col_pos", c, frame->col_pos);
+
+    case 'f':
+    case 'H': /* Move cursor to coordinates */
+      ifnot (frame->esc_param[0])
+        frame->esc_param[0] = 1;
+
+      ifnot (frame->esc_param[1])
+        frame->esc_param[1] = 1;
+
+      if ((frame->row_pos = frame->esc_param[0]) >
+          frame->num_rows)
+        frame->row_pos = frame->num_rows;
+
+      if ((frame->col_pos = frame->esc_param[1]) >
+          frame->num_cols)
+        frame->col_pos = frame->num_cols;
+
+      vt_goto (buf, frame->row_pos + frame->first_row - 1,
+        frame->col_pos);
+      break;
+
+    case 'g': /* Clear tabstops */
+      switch (frame->esc_param[0]) {
+        case 0: /* Clear a tabstop */
+          frame->tabstops[frame->col_pos-1] = 0;
+          break;
+
+        case 3: /* Clear all tabstops */
+          for (newy = 0; newy < frame->num_cols; ++newy)
+            frame->tabstops[newy] = 0;
+          break;
+
+        default:
+          vt_unimplemented (frame, __func__, c, frame->esc_param[0]);
+          break;
+      }
+      break;
+
+    case 'm': /* Set terminal attributes */
+      vt_process_m (frame, buf, frame->esc_param[0]);
+      for (i = 1; frame->esc_param[i] and i < MAX_PARAMS; i++)
+        vt_process_m (frame, buf, frame->esc_param[i]);
+      break;
+
+    case 'J': /* Clear screen */
+      switch (frame->esc_param[0]) {
+        case 0: /* Clear from cursor down */
+          vt_video_erase (frame, frame->row_pos,
+            frame->num_rows, 1, frame->num_cols);
+
+          newx = frame->row_pos;
+          vt_savecursor (buf);
+          string_append (buf, "\r");
+
+          while (newx++ < frame->num_rows) {
+            vt_clreol (buf);
+            string_append (buf, "\n");
+          }
+
+          vt_clreol (buf);
+          vt_restcursor (buf);
+          break;
+
+        case 1: /* Clear from cursor up */
+          vt_video_erase (frame, 1, frame->row_pos,
+            1, frame->num_cols);
+
+          newx = frame->row_pos;
+          vt_savecursor (buf);
+          string_append (buf, "\r");
+
+          while (--newx > 0) {
+            vt_clreol (buf);
+            vt_up (buf, 1);
+          }
+
+          vt_clreol (buf);
+          vt_restcursor (buf);
+          break;
+
+        case 2: /* Clear whole screen */
+          vt_video_erase (frame, 1, frame->num_rows,
+            1, frame->num_cols);
+
+          vt_goto (buf, frame->first_row + 1 - 1, 1);
+          frame->row_pos = 1;
+          frame->col_pos = 1;
+          newx = frame->row_pos;
+          vt_savecursor (buf);
+          string_append (buf, "\r");
+
+          while (newx++ < frame->num_rows) {
+            vt_clreol (buf);
+            string_append (buf, "\n");
+          }
+
+          vt_clreol (buf);
+          vt_restcursor (buf);
+          break;
+
+        default:
+          vt_unimplemented (frame, __func__, c, frame->esc_param[0]);
+          break;
+      }
+      break;
+
+    case 'K': /* Clear line */
+      switch (frame->esc_param[0]) {
+        case 0: /* Clear to end of line */
+          vt_video_erase (frame, frame->row_pos,
+            frame->row_pos, frame->col_pos, frame->num_cols);
+
+          vt_clreol (buf);
+        break;
+
+        case 1: /* Clear to beginning of line */
+          vt_video_erase (frame, frame->row_pos,
+            frame->row_pos, 1, frame->col_pos);
+
+          vt_clrbgl (buf);
+          break;
+
+        case 2: /* Clear whole line */
+          vt_video_erase (frame, frame->row_pos,
+            frame->row_pos, 1, frame->num_cols);
+
+          vt_clrline (buf);
+          break;
+        }
+      break;
+
+    case 'P': /* Delete under cursor */
+      vt_video_erase (frame, frame->row_pos,
+        frame->row_pos, frame->col_pos, frame->col_pos);
+
+      vt_delunder (buf, frame->esc_param[0]);
+      break;
+
+    case 'M': /* Delete lines */
+      vt_frame_video_scroll_back (frame, 1);
+      vt_delline (buf, frame->esc_param[0]);
+      break;
+
+    case 'L': /* Insert lines */
+      vt_insline (buf, frame->esc_param[0]);
+      break;
+
+    case '@': /* Insert characters */
+      ifnot (frame->esc_param[0])
+        frame->esc_param[0] = 1;
+
+      vt_insertchar (buf, frame->esc_param[0]);
+      vt_frame_video_rshift (frame, frame->esc_param[0]);
+      break;
+
+    case 'i': /* Printing */
+      vt_unimplemented (frame, __func__, c, frame->esc_param[0]);
+      break;
+
+    case 'n': /* Device status request */
+      switch (frame->esc_param[0]) {
+        case 5: /* Status report request */
+          /* Say we're just fine. */
+          write (frame->fd, "\033[0n", 4);
+          break;
+
+        case 6: /* Cursor position request */
+          sprintf (reply, "\033[%d;%dR", frame->row_pos,
+              frame->col_pos);
+
+          write (frame->fd, reply, bytelen (reply));
+          break;
+        }
+        break;
+
+    case 'c': /* Request terminal identification string_t */
+      /* Respond with "I am a vt102" */
+      write (frame->fd, "\033[?6c", 5);
+      break;
+
+    case 'X': /* (ECH) Erase param chars (ADDITION) */
+      vt_frame_ech (frame, buf, frame->esc_param[0]);
+      break;
+
+    //case 'G':
+       /* (CHA) Cursor to column param (ADDITION) */
+     // vt_frame_cha (frame, buf, frame->esc_param[0]);
+     // break;
+
+    default:
+      vt_unimplemented (frame, __func__, c, frame->esc_param[0]);
+      break;
+  }
+
+  vt_frame_esc_set (frame);
+  return buf;
+}
+
+static string_t *vt_esc_e (vwm_frame *frame, string_t *buf, int c) {
+  /* Return inside the switch to prevent reset_esc() */
+  switch (c) {
+    case '\030': /* Processed as escape cancel */
+    case '\032':
+      break;
+
+    case '[':
+      frame->process_char_cb = vt_esc_brace;
+      return buf;
+
+    case '(':
+      frame->process_char_cb = vt_esc_lparen;
+      return buf;
+
+    case ')':
+      frame->process_char_cb = vt_esc_rparen;
+      return buf;
+
+    case '#':
+      frame->process_char_cb = vt_esc_pound;
+      return buf;
+
+    case 'D': /* Cursor down with scroll up at margin */
+      if (frame->row_pos < frame->last_row)
+        frame->row_pos++;
+      else
+        vt_frame_video_scroll (frame, 1);
+
+      string_append (buf, "\n");
+      break;
+
+    case 'M': /* Reverse scroll (move up; scroll at top) */
+      if (frame->row_pos > frame->scroll_first_row)
+        --frame->row_pos;
+      else
+        vt_frame_video_scroll_back (frame, 1);
+
+      vt_revscroll (buf);
+      break;
+
+    case 'E': /* Next line (CR-LF) */
+      if (frame->row_pos < frame->last_row)
+        frame->row_pos++;
+      else
+        vt_frame_video_scroll (frame, 1);
+
+      frame->col_pos = 1;
+      string_append (buf, "\r\n");
+      break;
+
+    case '7': /* Save cursor and attribute */
+      frame->saved_row_pos = frame->row_pos;
+      frame->saved_col_pos = frame->col_pos;
+      frame->saved_textattr = frame->textattr;
+      break;
+
+    case '8': /* Restore saved cursor and attribute */
+      frame->row_pos = frame->saved_row_pos;
+      frame->col_pos = frame->col_pos;
+      if (frame->row_pos > frame->num_rows)
+        frame->row_pos = frame->num_rows;
+
+      if (frame->col_pos > frame->num_cols)
+        frame->col_pos = frame->num_cols;
+
+      vt_goto (buf, frame->row_pos + frame->first_row - 1,
+        frame->col_pos);
+
+      frame->textattr = frame->saved_textattr;
+      vt_frame_attr_set (frame, buf);
+      break;
+
+    case '=': /* Set application keypad mode */
+      frame->key_state = appl;
+      vt_keystate_print (buf, frame->key_state);
+      break;
+
+    case '>': /* Set numeric keypad mode */
+      frame->key_state = norm;
+      vt_keystate_print (buf, frame->key_state);
+      break;
+
+    case 'N': /* Select charset G2 for one character */
+    case 'O': /* Select charset G3 for one character */
+      vt_unimplemented (frame, __func__, c, frame->esc_param[0]);
+      break;
+
+    case 'H': /* Set horizontal tab */
+      frame->tabstops[frame->col_pos - 1] = 1;
+      break;
+
+    case 'Z': /* Request terminal identification string_t */
+      /* Respond with "I am a vt102" */
+      write (frame->fd, "\033[?6c", 5);
+      break;
+
+    case 'c': /* Terminal reset */
+      frame_reset (frame);
+      break;
+
+    default:
+      vt_unimplemented (frame, __func__, c, frame->esc_param[0]);
+      break;
+  }
+
+  vt_frame_esc_set (frame);
+  return buf;
+}
+
+static string_t *vt_esc_scan (vwm_frame *frame, string_t *buf, int c) {
+  switch (c) {
+    case '\000': /* NULL (fill character) */
+      break;
+
+    case '\003': /* EXT  (half duplex turnaround) */
+    case '\004': /* EOT  (can be disconnect char) */
+    case '\005': /* ENQ  (generate answerback) */
+      string_append_byte (buf, c);
+      break;
+
+    case '\007': /* BEL  (sound terminal bell) */
+      vt_bell (buf);
+      break;
+
+    case '\b': /* Backspace; move left one character */
+      ifnot (1 is frame->col_pos) {
+        --frame->col_pos;
+        vt_left (buf, frame->esc_param[0]);
+      }
+      break;
+
+    case '\t': /* Tab.  Handle with direct motion (Buggy) */
+      {
+        int i = frame->col_pos;
+        do {
+          ++frame->col_pos;
+        } while (0 is frame->tabstops[frame->col_pos - 1]
+            and (frame->col_pos < frame->num_cols));
+
+        vt_right (buf, frame->col_pos - i);
+      }
+      break;
+
+    case '\013': /* Processed as linefeeds */
+    case '\014': /* Don't let the cursor move below winow or scrolling region */
+    case '\n':
+      if (frame->row_pos < frame->last_row)
+        frame->row_pos++;
+      else
+        vt_frame_video_scroll (frame, 1);
+
+      string_append (buf, "\n");
+      break;
+
+    case '\r': /* Move cursor to left margin */
+      frame->col_pos = 1;
+      string_append (buf, "\r");
+      break;
+
+    case '\016': /* S0 (selects G1 charset) */
+    case '\017': /* S1 (selects G0 charset) */
+    case '\021': /* XON (continue transmission) */
+    case '\022': /* XOFF (stop transmission) */
+      string_append_byte (buf, c);
+      break;
+
+    case '\030': /* Processed as escape cancel */
+    case '\032':
+      vt_frame_esc_set (frame);
+      break;
+
+    case '\033':
+      frame->stats.sequences++;
+      frame->process_char_cb = vt_esc_e;
+      return buf;
+
+    default:
+      if (c >= 0x80 or frame->mb_len) {
+        if (frame->mb_len > 0) {
+          frame->mb_buf[frame->mb_curlen++] = c;
+          frame->mb_code <<= 6;
+          frame->mb_code += c;
+
+          if (frame->mb_curlen isnot frame->mb_len)
+            return buf;
+
+          frame->mb_code -= offsetsFromUTF8[frame->mb_len-1];
+
+          vt_append (frame, buf, frame->mb_code);
+          frame->mb_buf[0] = '\0';
+          frame->mb_curlen = frame->mb_len = frame->mb_code = 0;
+          return buf;
+        } else {
+          frame->mb_code = c;
+          frame->mb_len = ({
+            uchar uc = 0;
+            if ((c & 0xe0) is 0xc0)
+              uc = 2;
+            else if ((c & 0xf0) is 0xe0)
+              uc = 3;
+            else if ((c & 0xf8) is 0xf0)
+              uc = 4;
+            else
+              uc = -1;
+
+            uc;
+            });
+          frame->mb_buf[0] = c;
+          frame->mb_curlen = 1;
+          return buf;
+        }
+      } else
+        vt_append (frame, buf, c);
+  }
+
+  return buf;
+}
+
+/* Fills the screen from the tail of the log, wrapping the logical lines at
+ * the current width, and truncates the log where the screen starts; that
+ * might be in the middle of a line, which then continues on the first row. */
+static void vt_video_add_log_lines (vwm_frame *this) {
+  struct stat st;
+  if (-1 is this->logfd or -1 is fstat (this->logfd, &st) or 0 is st.st_size)
+    return;
+
+  char *mbuf = mmap (0, st.st_size, PROT_READ, MAP_SHARED, this->logfd, 0);
+
+  if (MAP_FAILED is mbuf) return;
+
+  int lines = this->num_rows;
+  int cols = this->num_cols;
+
+  for (int i = 0; i < lines; i++) {
+    this->wrapped[i] = 0;
+    for (int j = 0; j < cols; j++)
+      this->videomem[i][j] = 0;
+  }
+
+  long size = st.st_size;
+  long popped = 0;
+
+  while (lines isnot 0 and size) {
+    long end = size;
+    int has_nl = ('\n' is mbuf[end - 1]);
+    if (has_nl) end--;
+
+    long start = end;
+    while (start and mbuf[start - 1] isnot '\n') start--;
+
+    int len = (int) (end - start);
+    char *bytes = Alloc ((size_t) len + 1);
+    memcpy (bytes, mbuf + start, len);
+
+    int *cells = Alloc (sizeof (int) * ((size_t) len + 1));
+    int *offsets = Alloc (sizeof (int) * ((size_t) len + 1));
+    int num_cells = 0;
+
+    int idx = 0;
+    while (idx < len) {
+      ifnot (bytes[idx]) {
+        idx++;
+        continue;
+      }
+
+      offsets[num_cells] = idx;
+      cells[num_cells++] = (int) ustring_to_code (bytes, &idx);
+    }
+
+    int nrows = (num_cells + cols - 1) / cols;
+    ifnot (nrows) nrows = 1;
+
+    /* the rows that do not fit, stay in the log */
+    int skip = (nrows > lines ? nrows - lines : 0);
+    int row = lines - (nrows - skip);
+
+    for (int k = skip; k < nrows; k++, row++) {
+      for (int j = 0; j < cols and k * cols + j < num_cells; j++)
+        this->videomem[row][j] = cells[k * cols + j];
+
+      this->wrapped[row] = (k < nrows - 1);
+    }
+
+    lines -= nrows - skip;
+    size = start + (skip ? offsets[skip * cols] : 0);
+    popped += has_nl;
+
+    Free (bytes);
+    Free (cells);
+    Free (offsets);
+  }
+
+  ftruncate (this->logfd, size);
+  lseek (this->logfd, size, SEEK_SET);
+  munmap (mbuf, st.st_size);
+
+  logts_pop (&this->logts, popped);
+  this->log_size = size;
+  this->log_lines -= (popped > this->log_lines ? this->log_lines : popped);
+}
+
+static int frame_row_len (vwm_frame *this, int row) {
+  int len = this->num_cols;
+  while (len and 0 is this->videomem[row][len - 1]) len--;
+  return len;
+}
+
+/* Re-wraps the logical lines of the screen at the new width, keeping the
+ * cursor at the same place in its line. The rows that do not fit, are the
+ * oldest and go to the log, as if they had scrolled. The history in the log
+ * is kept as logical lines, so it is re-wrapped only when it is read back. */
+static void frame_reflow (vwm_frame *this, int rows, int cols, int **videomem,
+                                                   int **colors, uchar *wrapped) {
+  int used = this->num_rows;
+  while (used > this->row_pos and 0 is frame_row_len (this, used - 1)) used--;
+
+  int total = 0, cur_row = 0, cur_col = 1;
+
+  for (int r = 0; r < used; r++) {
+    int first = r;
+    while (r < used - 1 and this->wrapped[r]) r++;
+
+    int len = (r - first) * this->num_cols + frame_row_len (this, r);
+    int nrows = (len + cols - 1) / cols;
+    ifnot (nrows) nrows = 1;
+
+    if (this->row_pos - 1 >= first and this->row_pos - 1 <= r) {
+      int off = (this->row_pos - 1 - first) * this->num_cols + this->col_pos - 1;
+      int crow = off / cols;
+      cur_col = off % cols + 1;
+
+      if (crow >= nrows) {
+        if (1 is cur_col and crow is nrows) { /* pending wrap */
+          crow--;
+          cur_col = cols + 1;
+        } else
+          nrows = crow + 1;
+      }
+
+      cur_row = total + crow;
+    }
+
+    total += nrows;
+  }
+
+  /* drop from the top, but never the cursor */
+  int drop = total - rows;
+  if (drop < 0) drop = 0;
+  if (drop > cur_row) drop = cur_row;
+
+  int line[cols];
+  int g = 0;
+
+  for (int r = 0; r < used and g - drop < rows; r++) {
+    int first = r;
+    while (r < used - 1 and this->wrapped[r]) r++;
+
+    int len = (r - first) * this->num_cols + frame_row_len (this, r);
+    int nrows = (len + cols - 1) / cols;
+    ifnot (nrows) nrows = 1;
+    if (this->row_pos - 1 >= first and this->row_pos - 1 <= r and cur_row - g >= nrows)
+      nrows = cur_row - g + 1;
+
+    for (int k = 0; k < nrows and g - drop < rows; k++, g++) {
+      int *vrow = (g < drop ? line : videomem[g - drop]);
+
+      for (int j = 0; j < cols; j++) {
+        int off = k * cols + j;
+        int orow = first + off / this->num_cols;
+        int ocol = off % this->num_cols;
+
+        if (off >= len) {
+          vrow[j] = 0;
+          continue;
+        }
+
+        vrow[j] = this->videomem[orow][ocol];
+        if (g >= drop)
+          colors[g - drop][j] = this->colors[orow][ocol];
+      }
+
+      if (g < drop) {
+        ifnot (NULL is this->logfile)
+          frame_log_row (this, line, cols, k < nrows - 1);
+      } else
+        wrapped[g - drop] = (k < nrows - 1);
+    }
+  }
+
+  this->row_pos = cur_row - drop + 1;
+  this->col_pos = cur_col;
+}
+
+static void frame_on_resize (vwm_frame *this, int rows, int cols) {
+  TRACE_EVENT (VWM_TRACE_RESIZE, this->id, rows, cols, 0);
+
+  int **videomem = vwm_alloc_ints (rows, cols, 0);
+  int **colors = vwm_alloc_ints (rows, cols, COLOR_FG_NORMAL);
+  uchar *wrapped = Alloc ((size_t) rows);
+  int row_pos = 0;
+  int i, j, nj, ni;
+
+  /* full screen applications redraw themselves */
+  if (cols isnot this->num_cols and 0 is this->alt_screen and
+      this->scroll_first_row is 1 and this->last_row is this->num_rows) {
+    frame_reflow (this, rows, cols, videomem, colors, wrapped);
+    goto theend;
+  }
+
+  int last_row = this->num_rows;
+  if (rows < last_row)
+    while (last_row > rows and 0 is this->videomem[last_row-1][0])
+      last_row--;
+
+  for (i = last_row, ni = rows; i and ni; i--, ni--) {
+    if (this->row_pos is i)
+      if ((row_pos = i + (this->num_rows - last_row) + rows - this->num_rows) < 1)
+        row_pos = 1;
+
+    for (j = 0, nj = 0; (j < this->num_cols) and (nj < cols); j++, nj++) {
+      videomem[ni-1][nj] = this->videomem[i-1][j];
+      colors[ni-1][nj] = this->colors[i-1][j];
+    }
+
+    wrapped[ni-1] = (cols is this->num_cols ? this->wrapped[i-1] : 0);
+  }
+
+  ifnot (row_pos) /* We never reached the old cursor */
+    row_pos = 1;
+
+  this->row_pos = row_pos;
+  this->col_pos = (this->col_pos > cols ? cols : this->col_pos);
+
+theend:
+  for (i = 0; i < this->num_rows; i++)
+    Free (this->videomem[i]);
+  Free (this->videomem);
+
+  for (i = 0; i < this->num_rows; i++)
+    Free (this->colors[i]);
+  Free (this->colors);
+
+  Free (this->wrapped);
+
+  this->videomem = videomem;
+  this->colors = colors;
+  this->wrapped = wrapped;
+
+  if (cols isnot this->num_cols) {
+    Free (this->tabstops);
+    this->tabstops = Alloc (sizeof (int) * cols);
+    for (i = 0; i < cols; i++)
+      this->tabstops[i] = (0 is i % TABWIDTH);
+  }
+
+  this->num_rows = rows;
+  this->num_cols = cols;
+  this->pending_rows = 0;
+
+  /* the recorder announces the new geometry with the next output */
+  this->rec_gen = 0;
+}
+
+/* the frames of the windows in the background, are resized when they are
+ * about to be drawn or they have output */
+static void frame_resize_pending (vwm_frame *this) {
+  ifnot (this->pending_rows) return;
+
+  frame_on_resize (this, this->pending_rows, this->pending_cols);
+  this->last_row = this->num_rows;
+}
+
+/* the size the frame takes, when it is next fed or drawn */
+static void frame_set_size (vwm_frame *this, int rows, int cols) {
+  if (rows <= 0 or cols <= 0) return;
+
+  if (rows is this->num_rows and cols is this->num_cols) {
+    this->pending_rows = 0;
+    return;
+  }
+
+  this->pending_rows = rows;
+  this->pending_cols = cols;
+}
+
+static void win_set_frame (vwm_win *this, vwm_frame *frame) {
+  ifnot (this->parent->prop->render) return;
+
+  string_clear (frame->render);
+
+  vt_setscroll (frame->render, frame->scroll_first_row + frame->first_row - 1,
+      frame->last_row + frame->first_row - 1);
+
+  if (this->draw_separators) {
+    this->draw_separators = 0;
+    string_append_with_len (frame->render, this->separators_buf->bytes, this->separators_buf->num_bytes);
+  }
+
+  vt_goto (frame->render, frame->row_pos + frame->first_row - 1, frame->col_pos);
+
+  ifnot (NULL is this->last_frame) {
+    ifnot (frame->key_state is this->last_frame->key_state)
+      vt_keystate_print (frame->render, frame->key_state);
+
+    ifnot (frame->textattr is this->last_frame->textattr)
+      vt_attr_set (frame->render, frame->textattr);
+
+    for (int i = 0; i < NCHARSETS; i++)
+      if (frame->charset[i] isnot this->last_frame->charset[i])
+        vt_altcharset (frame->render, i, frame->charset[i]);
+  }
+
+  vt_write (frame->root, frame->render);
+}
+
+static void frame_process_output (vwm_frame *this, char *buf, int len) {
+  frame_resize_pending (this);
+
+  /* one clock read per read() batch; it stamps the lines that scroll */
+  long ns = vt_clock_ns ();
+  this->batch_ms = ns / 1000000;
+
+  this->stats.bytes_read += len;
+  this->stats.last_activity = this->batch_ms;
+  TRACE_EVENT (VWM_TRACE_READ, this->id, len, 0, 0);
+
+  vwm_recorder *rec = (NULL is this->root ? NULL : this->root->prop->recorder);
+  if (NULL isnot rec)
+    frame_record_output (this, rec, buf, len);
+
+  if (NULL isnot this->root and 0 is this->root->prop->render)
+    frame_feed_output (this, (const uchar *) buf, len);
+  else {
+    this->process_output_cb (this, buf, len);
+    long present_ns = vt_clock_ns ();
+    this->stats.bytes_rendered += this->render->num_bytes;
+    this->stats.render_ns += present_ns - ns;
+
+    if (this->lat_input_ns)
+      frame_latency_record (this, ns, present_ns);
+
+    TRACE_EVENT (VWM_TRACE_RENDER, this->id, len, this->render->num_bytes,
+        (present_ns - ns) / 1000);
+  }
+
+  /* keyframes are taken only between sequences */
+  if (NULL isnot rec and this->process_char_cb is vt_esc_scan and
+      (this->rec_bytes >= REC_KEYFRAME_BYTES or
+       this->batch_ms - this->rec_keyframe_ms >= REC_KEYFRAME_MS))
+    frame_record_keyframe (this, rec);
+}
+
+/* the state a sequence ended in, for the trace */
+static int vt_trace_state (FrameProcessChar_cb cb) {
+  if (cb is vt_esc_e)       return VWM_TRACE_STATE_ESC;
+  if (cb is vt_esc_brace)   return VWM_TRACE_STATE_CSI;
+  if (cb is vt_esc_brace_q) return VWM_TRACE_STATE_CSI_PRIVATE;
+  if (cb is vt_esc_lparen)  return VWM_TRACE_STATE_G0;
+  if (cb is vt_esc_rparen)  return VWM_TRACE_STATE_G1;
+  if (cb is vt_esc_pound)   return VWM_TRACE_STATE_POUND;
+  return VWM_TRACE_STATE_TEXT;
+}
+
+/* as the parser does, but it traces the sequences, as they end */
+static void vt_process_char_traced (vwm_frame *frame, string_t *buf, int c) {
+  FrameProcessChar_cb cb = frame->process_char_cb;
+  int param = frame->esc_param[0];
+
+  cb (frame, buf, c);
+
+  if (cb isnot vt_esc_scan and frame->process_char_cb is vt_esc_scan)
+    trace_event (VWM_TRACE_SEQUENCE, frame->id, c, param, vt_trace_state (cb));
+}
+
+static void frame_process_output_cb (vwm_frame *this, char *buf, int len) {
+  string_clear (this->render);
+
+  if (TRACE_ON)
+    while (len--)
+      vt_process_char_traced (this, this->render, (uchar) *buf++);
+  else
+    while (len--)
+      this->process_char_cb (this, this->render, (uchar) *buf++);
+
+  if (this->lat_input_ns) this->lat_parsed_ns = vt_clock_ns ();
+
+  vt_write (this->root, this->render);
+}
+
+static void argv_release (char **argv, int *argc) {
+  for (int i = 0; i <= *argc; i++) Free (argv[i]);
+  Free (argv);
+  *argc = 0;
+  argv = NULL;
+}
+
+static void frame_release_argv (vwm_frame *this) {
+  if (NULL is this->argv) return;
+  argv_release (this->argv, &this->argc);
+}
+
+static char **parse_command (char *command, int *argc) {
+  char *sp = command;
+  char *tokbeg;
+  size_t len;
+
+  *argc = 0;
+  char **argv = Alloc (sizeof (char *));
+
+  while (*sp) {
+    while (*sp and *sp is ' ') sp++;
+    ifnot (*sp) break;
+
+    tokbeg = sp;
+
+    if (*sp is '"') {
+      sp++;
+      tokbeg++;
+
+parse_quoted:
+      while (*sp and *sp isnot '"') sp++;
+      ifnot (*sp) goto theerror;
+      if (*(sp - 1) is '\\') goto parse_quoted;
+      len = (size_t) (sp - tokbeg);
+      sp++;
+      goto add_arg;
+    }
+
+    while (*sp and *sp isnot ' ') sp++;
+
+    len = (size_t) (sp - tokbeg);
+
+add_arg:
+    *argc += 1;
+    argv = Realloc (argv, sizeof (char *) * ((*argc) + 1));
+    argv[*argc - 1] = Alloc (len + 1);
+    cstring_cp (argv[*argc - 1], len + 1, tokbeg, len);
+
+    ifnot (*sp) break;
+    sp++;
+  }
+
+  argv[*argc] = (char *) NULL;
+
+  return argv;
+
+theerror:
+  argv_release (argv, argc);
+  return NULL;
+}
+
+static void frame_set_command (vwm_frame *this, char *command) {
+  if (NULL is command or 0 is bytelen (command))
+    return;
+
+  self(release_argv);
+  this->argv = parse_command (command, &this->argc);
+}
+
+static void frame_set_visibility (vwm_frame *this, int visibility) {
+  if (this->is_visible) {
+    ifnot (visibility) {
+      this->parent->num_visible_frames--;
+      this->parent->num_separators--;
+    }
+  } else {
+    if (visibility) {
+      this->parent->num_visible_frames++;
+      this->parent->num_separators++;
+    }
+  }
+
+  this->is_visible = (0 isnot visibility);
+}
+
+static void frame_set_argv (vwm_frame *this, int argc, char **argv) {
+  if (argc <= 0) return;
+
+  self(release_argv);
+
+  this->argv = Alloc (sizeof (char *) * (argc + 1));
+  for (int i = 0; i < argc; i++) {
+    size_t len = bytelen (argv[i]);
+    this->argv[i] = Alloc (len + 1);
+    cstring_cp (this->argv[i], len + 1, argv[i], len);
+  }
+
+  this->argv[argc] = NULL;
+  this->argc = argc;
+}
+
+static void frame_set_fd (vwm_frame *this, int fd) {
+  this->fd = fd;
+}
+
+static int frame_get_fd (vwm_frame *this) {
+  return this->fd;
+}
+
+static pid_t frame_get_pid (vwm_frame *this) {
+  return this->pid;
+}
+
+static int frame_get_visibility (vwm_frame *this) {
+  return this->is_visible;
+}
+
+static int frame_get_remove_log (vwm_frame *this) {
+  return this->remove_log;
+}
+
+static int frame_get_argc (vwm_frame *this) {
+  return this->argc;
+}
+
+static char **frame_get_argv (vwm_frame *this) {
+  return this->argv;
+}
+
+static vwm_win *frame_get_parent (vwm_frame *this) {
+  return this->parent;
+}
+
+static vwm_t *frame_get_root (vwm_frame *this) {
+  return this->root;
+}
+
+static int frame_get_num_rows (vwm_frame *this) {
+  return this->num_rows;
+}
+
+static int frame_get_logfd (vwm_frame *this) {
+  return this->logfd;
+}
+
+static char *frame_get_logfile (vwm_frame *this) {
+  if (NULL is this->logfile) return NULL;
+  return this->logfile->bytes;
+}
+
+static void frame_clear (vwm_frame *this, int state) {
+  if (NULL is this) return;
+
+  string_t *render = this->render;
+
+  string_clear (render);
+  vt_goto (render, this->first_row, 1);
+
+  for (int i = 0; i < this->num_rows; i++) {
+    if (state & VFRAME_CLEAR_VIDEO_MEM)
+      this->wrapped[i] = 0;
+
+    for (int j = 0; j < this->num_cols; j++) {
+      if (state & VFRAME_CLEAR_VIDEO_MEM) {
+        this->videomem[i][j] = ' ';
+        this->colors[i][j] = COLOR_FG_NORMAL;
+      }
+
+      string_append_byte (render, ' ');
+    }
+
+    string_append (render, "\r\n");
+  }
+
+  // clear the last newline, otherwise it scrolls one line more
+  string_clear_at (render, -1); // this is visible when there is one frame
+
+  if (state & VFRAME_CLEAR_LOG)
+    if (this->logfd isnot -1) {
+      ftruncate (this->logfd, 0);
+      lseek (this->logfd, 0, SEEK_SET);
+      logts_release (&this->logts);
+      frame_log_release_segments (this, 1);
+      this->log_size = 0;
+      this->log_lines = 0;
+    }
+
+  vt_write (this->root, render);
+}
+
+static int frame_check_pid (vwm_frame *this) {
+  if (NULL is this or -1 is this->pid) return -1;
+
+  ifnot (0 is waitpid (this->pid, &this->status, WNOHANG)) {
+    this->pid = -1;
+    this->fd = -1;
+    int state = (VFRAME_CLEAR_VIDEO_MEM|
+      (this->logfd isnot -1 ?
+        (this->remove_log ? VFRAME_CLEAR_LOG : 0) :
+        0));
+    self(clear, state);
+    return 0;
+  }
+
+  return this->pid;
+}
+
+static int frame_kill_proc (vwm_frame *this) {
+  if (this is NULL or this->pid is -1) return -1;
+
+  int state = (VFRAME_CLEAR_VIDEO_MEM|
+    (this->logfd isnot -1 ?
+      (this->remove_log ? VFRAME_CLEAR_LOG : 0) :
+      0));
+  self(clear, state);
+
+  kill (this->pid, SIGHUP);
+  waitpid (this->pid, NULL, 0);
+  this->pid = -1;
+  this->fd = -1;
+  return 0;
+}
+
+static FrameProcessOutput_cb frame_set_process_output_cb (vwm_frame *this, FrameProcessOutput_cb cb) {
+  FrameProcessOutput_cb prev = this->process_output_cb;
+  this->process_output_cb = cb;
+  return prev;
+}
+
+static FrameAtFork_cb frame_set_at_fork_cb (vwm_frame *this, FrameAtFork_cb cb) {
+  FrameAtFork_cb prev = this->at_fork_cb;
+  this->at_fork_cb = cb;
+  return prev;
+}
+
+static void frame_set_unimplemented_cb (vwm_frame *this, FrameUnimplemented_cb cb) {
+  this->unimplemented_cb = cb;
+}
+
+static int frame_set_log (vwm_frame *this, char *fname, int remove_log) {
+  self(release_log);
+
+  if (NULL is fname or fname[0] is '\0') {
+    tmpname_t t = tmpfname (this->root->prop->tmpdir->bytes, "libvwm");
+    if (-1 is t.fd)
+      return NOTOK;
+
+    this->logfd = t.fd;
+    this->logfile = t.fname;
+    this->remove_log = remove_log;
+
+    return this->logfd;
+  }
+
+  this->logfd = open (fname, O_CREAT|O_RDWR, S_IRUSR|S_IWUSR);
+
+  if (this->logfd is NOTOK) return NOTOK;
+
+  if (-1 is fchmod (this->logfd, 0600)) return NOTOK;
+
+  this->logfile = string_new_with (fname);
+  this->remove_log = remove_log;
+  return this->logfd;
+}
+
+/* max_size bounds the log and its sealed segments; without a segment_size,
+ * the log rotates at a quarter of it; compress seals them through the log
+ * worker thread */
+static int frame_set_log_policy (vwm_frame *this, long max_size, long segment_size, int compress) {
+  if (0 > max_size or 0 > segment_size) return NOTOK;
+
+  if (0 is segment_size and max_size) {
+    segment_size = max_size / 4;
+    if (segment_size < LOG_MIN_SEGMENT_SIZE)
+      segment_size = LOG_MIN_SEGMENT_SIZE;
+  }
+
+  this->log_max_size = max_size;
+  this->log_segment_size = segment_size;
+  this->log_compress = (compress isnot 0);
+
+  if (NULL isnot this->logfile) {
+    if (this->log_segment_size and this->log_size >= this->log_segment_size)
+      frame_log_rotate (this);
+    else
+      frame_log_trim (this);
+  }
+
+  return OK;
+}
+
+static int frame_at_fork_default_cb (vwm_frame *this, vwm_t *root, vwm_win *parent) {
+  (void) this; (void) parent; (void) root;
+  return 1;
+}
+
+/* the sequence is already counted; the file is rewritten at most once in
+ * UNIMPLEMENTED_DUMP_MS, and not for every sequence */
+static void frame_unimplemented_default_cb (vwm_frame *this, const char *fun, int c, int param) {
+  (void) fun; (void) c; (void) param;
+  vwm_t *vwm = this->root;
+
+  if (NULL is vwm->prop->unimplemented_fp or 0 is vwm->prop->unimplemented_dirty)
+    return;
+
+  if (vt_clock_ms () - vwm->prop->unimplemented_dump_ms < UNIMPLEMENTED_DUMP_MS)
+    return;
+
+  vwm_write_unimplemented (vwm);
+}
+
+static int win_insert_frame_at (vwm_win *this, vwm_frame *frame, int idx) {
+  return DListInsertAt (this, frame, idx);
+}
+
+static int win_append_frame (vwm_win *this, vwm_frame *frame) {
+  return DListAppend (this, frame);
+}
+
+static vwm_frame *win_init_frame (vwm_win *this, frame_opts opts) {
+  vwm_frame *frame = Alloc (sizeof (vwm_frame));
+
+  frame->parent = (opts.parent isnot NULL ? opts.parent : this);
+
+  if (frame->parent isnot NULL) {
+    frame->root = frame->parent->parent;
+    frame->win =  frame->parent->self;
+    frame->self = frame->parent->frame;
+  }
+
+  frame->pid = opts.pid;
+  frame->fd = opts.fd;
+  frame->id = (NULL is frame->root ? 0 : ++frame->root->prop->frame_id_gen);
+  frame->at_frame = opts.at_frame;
+  frame->logfile = NULL;
+  frame->remove_log = opts.remove_log;
+  frame->is_visible = opts.is_visible;
+  frame->num_rows = opts.num_rows;
+  frame->first_row = opts.first_row;
 
-        if (frame->esc_param[1] > frame->num_rows)
-          frame->last_row = frame->num_rows;
-        else
-           frame->last_row = frame->esc_param[1];
+  frame->num_cols = (opts.num_cols isnot -1 ? opts.num_cols :
+    (NULL is this ? 78 : this->num_cols));
+  frame->first_col = (opts.first_col isnot -1 ? opts.first_col :
+    (NULL is this ? 1 : this->first_col));
 
-        if (frame->scroll_first_row > frame->last_row) {
-          /* Reset scroll region */
-          frame->scroll_first_row = 1;
-          frame->last_row = frame->num_rows;
-        }
-      }
+  ifnot (NULL is opts.argv)
+    Vframe.set.argv (frame, opts.argc, opts.argv);
+  else
+    if (NULL isnot opts.command)
+      Vframe.set.command (frame, opts.command);
 
-      frame->row_pos = 1;
-      frame->col_pos = 1;
+  frame->logfd = -1;
 
-      vt_setscroll (buf, frame->scroll_first_row + frame->first_row - 1,
-        frame->last_row + frame->first_row - 1);
-      vt_goto (buf, frame->row_pos + frame->first_row - 1, 1);
-      break;
+  Vframe.set.log_policy (frame, opts.log_max_size, opts.log_segment_size, opts.log_compress);
 
-    case 'A': /* Cursor UP */
-      if (frame->row_pos is frame->first_row)
-        break;
+  if (opts.enable_log)
+    Vframe.set.log (frame, opts.logfile, frame->remove_log);
 
-      ifnot (frame->esc_param[0])
-        frame->esc_param[0] = 1;
+  frame->mb_buf[0] = '\0';
+  frame->mb_curlen = frame->mb_len = frame->mb_code = 0;
+  frame->render = string_new (2048);
+  frame->state = 0;
 
-      newx = (frame->row_pos - frame->esc_param[0]);
+  frame->process_output_cb = (NULL is opts.process_output_cb ?
+      frame_process_output_cb : opts.process_output_cb);
 
-      if (newx > frame->scroll_first_row) {
-        frame->row_pos = newx;
-        vt_up (buf, frame->esc_param[0]);
-      } else {
-        frame->row_pos = frame->scroll_first_row;
-        vt_goto (buf, frame->row_pos + frame->first_row - 1,
-          frame->col_pos);
-      }
-      break;
+  frame->at_fork_cb = (NULL is opts.at_fork_cb ?
+      frame_at_fork_default_cb : opts.at_fork_cb);
 
-    case 'B': /* Cursor DOWN */
-      if (frame->row_pos is frame->last_row)
-        break;
+  frame->unimplemented_cb = frame_unimplemented_default_cb;
 
-      ifnot (frame->esc_param[0])
-        frame->esc_param[0] = 1;
+  frame->videomem = vwm_alloc_ints (frame->num_rows, frame->num_cols, 0);
+  frame->colors = vwm_alloc_ints (frame->num_rows, frame->num_cols, COLOR_FG_NORMAL);
+  frame->wrapped = Alloc ((size_t) frame->num_rows);
+  frame->esc_param = Alloc (sizeof (int) * MAX_PARAMS);
+  for (int i = 0; i < MAX_PARAMS; i++) frame->esc_param[i] = 0;
+  frame->tabstops = Alloc (sizeof (int) * frame->num_cols);
+  for (int i = 0; i < frame->num_cols; i++) {
+    ifnot ((int) i % TABWIDTH)
+      frame->tabstops[i] = 1;
+    else
+      frame->tabstops[i] = 0;
+  }
 
-      newx = frame->row_pos + frame->esc_param[0];
+  Vframe.reset (frame);
 
-      if (newx <= frame->last_row) {
-        frame->row_pos = newx;
-        vt_down (buf, frame->esc_param[0]);
-      } else {
-        frame->row_pos = frame->last_row;
-        vt_goto (buf, frame->row_pos + frame->first_row - 1,
-          frame->col_pos);
-      }
-      break;
+  if (opts.create_fd)
+    Vframe.create_fd (frame);
 
-    case 'C': /* Cursor RIGHT */
-      if (frame->col_pos is frame->num_cols)
-        break;
+  if (opts.fork and frame->argc)
+    Vframe.fork (frame);
 
-      ifnot (frame->esc_param[0])
-        frame->esc_param[0] = 1;
+  return frame;
+}
 
-      newy = (frame->col_pos + frame->esc_param[0]);
+static vwm_frame *win_new_frame (vwm_win *this, frame_opts opts) {
+  vwm_frame *frame = self(init_frame, opts);
 
-      if (newy < frame->num_cols) {
-        frame->col_pos = newy;
+  if (frame->at_frame < 0 or frame->at_frame > this->length)
+    self(append_frame, frame);
+  else
+    self(insert_frame_at, frame, frame->at_frame - 1);
 
-        vt_right (buf, frame->esc_param[0]);
-      } else {
-        frame->col_pos = frame->num_cols;
-        vt_goto (buf, frame->row_pos + frame->first_row - 1,
-          frame->col_pos);
-      }
-      break;
+  if (frame->is_visible) {
+    this->num_visible_frames++;
+    this->num_separators++;
 
-    case 'D': /* Cursor LEFT */
-      if (frame->col_pos is 1)
-        break;
+    int at = 1;
+    vwm_frame *it = this->head;
+    while (it) {
+      if (it is frame) break;
+      at += (it->is_visible isnot 0);
+      it = it->next;
+    }
 
-      ifnot (frame->esc_param[0])
-        frame->esc_param[0] = 1;
+    frame->at_frame = at;
 
-      newy = (frame->col_pos - frame->esc_param[0]);
+  }
 
-      if (newy > 1) {
-        frame->col_pos = newy;
-        vt_left (buf, frame->esc_param[0]);
-      } else {
-        frame->col_pos = 1;
-        string_append (buf, "\r");
-      }
+  return frame;
+}
 
-      break;
+static vwm_frame *win_pop_frame_at (vwm_win *this, int idx) {
+  return DListPopAt (this, vwm_frame, idx);
+}
 
-    case 'G': { /* (hpa - horizontal) (ADDITION) */
-      int col = frame->esc_param[0];
-      int row = frame->esc_param[1];
-      if (row <= 1) row = frame->row_pos;
-      frame->esc_param[0] = row;
-      frame->esc_param[1] = col;
-    }
+static vwm_frame *win_add_frame (vwm_win *this, int argc, char **argv, int draw) {
+  int num_frames = self(get.num_visible_frames);
 
-    case 'd': /* (vpa - HVP) (ADDITION) */
-      frame->unimplemented_cb (frame, "ADDI param[0]", c, frame->esc_param[0]);
-      frame->unimplemented_cb (frame, "ADDI param[1]", c, frame->esc_param[1]);
-      frame->unimplemented_cb (frame, "ADDI row_pos", c, frame->row_pos);
-      frame->unimplemented_cb (frame, "ADDI col_pos", c, frame->col_pos);
+  if (num_frames is this->max_frames) return NULL;
 
-    case 'f':
-    case 'H': /* Move cursor to coordinates */
-      ifnot (frame->esc_param[0])
-        frame->esc_param[0] = 1;
+  int frame_rows = 0;
+  int mod = self(frame_rows, num_frames + 1, &frame_rows);
+  int
+    num_rows = frame_rows + mod,
+    first_row = this->first_row;
 
-      ifnot (frame->esc_param[1])
-        frame->esc_param[1] = 1;
+  vwm_frame *frame = this->head;
+  while (frame) {
+    ifnot (frame->is_visible) goto next_frame;
 
-      if ((frame->row_pos = frame->esc_param[0]) >
-          frame->num_rows)
-        frame->row_pos = frame->num_rows;
+    frame->new_rows = num_rows;
+    first_row += num_rows + 1;
+    num_rows = frame_rows;
 
-      if ((frame->col_pos = frame->esc_param[1]) >
-          frame->num_cols)
-        frame->col_pos = frame->num_cols;
+    next_frame: frame = frame->next;
+  }
 
-      vt_goto (buf, frame->row_pos + frame->first_row - 1,
-        frame->col_pos);
-      break;
+  frame = self(new_frame, FrameOpts (
+      .num_rows = num_rows,
+      .first_row = first_row,
+      .argc = argc,
+      .argv = argv));
 
-    case 'g': /* Clear tabstops */
-      switch (frame->esc_param[0]) {
-        case 0: /* Clear a tabstop */
-          frame->tabstops[frame->col_pos-1] = 0;
-          break;
+  frame->new_rows = num_rows;
 
-        case 3: /* Clear all tabstops */
-          for (newy = 0; newy < frame->num_cols; ++newy)
-            frame->tabstops[newy] = 0;
-          break;
+  self(set.current_at, this->length - 1);
+  self(on_resize, draw);
+  return frame;
+}
 
-        default:
-          frame->unimplemented_cb (frame, __func__, c, frame->esc_param[0]);
-          break;
-      }
-      break;
+static int win_frame_rows (vwm_win *this, int num_frames, int *frame_rows) {
+  int avail_rows = this->num_rows - (num_frames - 1);
+  *frame_rows = avail_rows / num_frames;
+  return avail_rows % num_frames;
+}
 
-    case 'm': /* Set terminal attributes */
-      vt_process_m (frame, buf, frame->esc_param[0]);
-      for (i = 1; frame->esc_param[i] and i < MAX_PARAMS; i++)
-        vt_process_m (frame, buf, frame->esc_param[i]);
-      break;
+static int win_delete_frame (vwm_win *this, vwm_frame *frame, int draw) {
+  ifnot (this->length)
+    return OK;
 
-    case 'J': /* Clear screen */
-      switch (frame->esc_param[0]) {
-        case 0: /* Clear from cursor down */
-          vt_video_erase (frame, frame->row_pos,
-            frame->num_rows, 1, frame->num_cols);
+  if (1 is this->length) {
+    Vframe.kill_proc (frame);;
+    self(release_frame_at, 0);
+  } else if (0 is frame->is_visible) {
+    int idx = self(get.frame_idx, frame);
+    Vframe.kill_proc (frame);
+    self(release_frame_at, idx);
+  } else {
+    int is_last_frame = this->last_frame is frame;
+    int idx = self(get.frame_idx, frame);
+    Vframe.kill_proc (frame);
+    self(release_frame_at, idx);
 
-          newx = frame->row_pos;
-          vt_savecursor (buf);
-          string_append (buf, "\r");
+    int num_frames = self(get.num_visible_frames);
+    ifnot (num_frames) return OK;
 
-          while (newx++ < frame->num_rows) {
-            vt_clreol (buf);
-            string_append (buf, "\n");
-          }
+    int frame_rows = 0;
+    int mod = self(frame_rows, num_frames, &frame_rows);
+    int
+      num_rows = frame_rows + mod,
+      first_row = this->first_row;
 
-          vt_clreol (buf);
-          vt_restcursor (buf);
-          break;
+    frame = this->head;
+    while (frame) {
+      ifnot (frame->is_visible) goto next_frame;
 
-        case 1: /* Clear from cursor up */
-          vt_video_erase (frame, 1, frame->row_pos,
-            1, frame->num_cols);
+      frame->new_rows = num_rows;
+      first_row += num_rows + 1;
+      num_rows = frame_rows;
 
-          newx = frame->row_pos;
-          vt_savecursor (buf);
-          string_append (buf, "\r");
+      next_frame: frame = frame->next;
+    }
 
-          while (--newx > 0) {
-            vt_clreol (buf);
-            vt_up (buf, 1);
+    if (is_last_frame or this->current is this->last_frame) {
+      if (1 is num_frames)
+        this->last_frame = this->current;
+      else {
+        frame = this->head;
+        while (frame) {
+          if (frame isnot this->current) {
+            this->last_frame = frame;
+            break;
           }
 
-          vt_clreol (buf);
-          vt_restcursor (buf);
-          break;
+          frame = frame->next;
+        }
+      }
+    }
 
-        case 2: /* Clear whole screen */
-          vt_video_erase (frame, 1, frame->num_rows,
-            1, frame->num_cols);
 
-          vt_goto (buf, frame->first_row + 1 - 1, 1);
-          frame->row_pos = 1;
-          frame->col_pos = 1;
-          newx = frame->row_pos;
-          vt_savecursor (buf);
-          string_append (buf, "\r");
+    self(on_resize, draw);
+  }
 
-          while (newx++ < frame->num_rows) {
-            vt_clreol (buf);
-            string_append (buf, "\n");
-          }
+  return OK;
+}
 
-          vt_clreol (buf);
-          vt_restcursor (buf);
-          break;
+static void frame_release_log (vwm_frame *this) {
+  if (NULL is this->logfile) return;
 
-        default:
-          frame->unimplemented_cb (frame, __func__, c, frame->esc_param[0]);
-          break;
-      }
-      break;
+  if (this->remove_log)
+    unlink (this->logfile->bytes);
 
-    case 'K': /* Clear line */
-      switch (frame->esc_param[0]) {
-        case 0: /* Clear to end of line */
-          vt_video_erase (frame, frame->row_pos,
-            frame->row_pos, frame->col_pos, frame->num_cols);
+  string_free (this->logfile);
+  this->logfile = NULL;
 
-          vt_clreol (buf);
-        break;
+  close (this->logfd);
+  this->logfd = -1;
 
-        case 1: /* Clear to beginning of line */
-          vt_video_erase (frame, frame->row_pos,
-            frame->row_pos, 1, frame->col_pos);
+  logts_release (&this->logts);
+  frame_log_release_segments (this, this->remove_log);
+  this->log_size = 0;
+  this->log_lines = 0;
+}
 
-          vt_clrbgl (buf);
-          break;
+static void win_release_frame_at (vwm_win *this, int idx) {
+  vwm_frame *frame = self(pop_frame_at, idx);
 
-        case 2: /* Clear whole line */
-          vt_video_erase (frame, frame->row_pos,
-            frame->row_pos, 1, frame->num_cols);
+  if (NULL is frame) return;
 
-          vt_clrline (buf);
-          break;
-        }
-      break;
+  if (frame->is_visible) {
+    this->num_separators--;
+    this->num_visible_frames--;
 
-    case 'P': /* Delete under cursor */
-      vt_video_erase (frame, frame->row_pos,
-        frame->row_pos, frame->col_pos, frame->col_pos);
+    vwm_frame *it = this->head;
+    while (it) {
+      if (it->is_visible)
+        if (frame->at_frame < it->at_frame)
+          it->at_frame--;
 
-      vt_delunder (buf, frame->esc_param[0]);
-      break;
+      it = it->next;
+    }
+  }
 
-    case 'M': /* Delete lines */
-      vt_frame_video_scroll_back (frame, 1);
-      vt_delline (buf, frame->esc_param[0]);
-      break;
+  vwm_prop *vwm = this->parent->prop;
+  if (vwm->send_frame is frame) {
+    vwm->send_frame = NULL;
+    vwm->send_len = vwm->send_off = 0;
+  }
 
-    case 'L': /* Insert lines */
-      vt_insline (buf, frame->esc_param[0]);
-      break;
+  Vframe.release_log (frame);
 
-    case '@': /* Insert characters */
-      ifnot (frame->esc_param[0])
-        frame->esc_param[0] = 1;
+  for (int i = 0; i < frame->num_rows; i++)
+    Free (frame->videomem[i]);
+  Free (frame->videomem);
 
-      vt_insertchar (buf, frame->esc_param[0]);
-      vt_frame_video_rshift (frame, frame->esc_param[0]);
-      break;
+  for (int i = 0; i < frame->num_rows; i++)
+    Free (frame->colors[i]);
+  Free (frame->colors);
 
-    case 'i': /* Printing */
-      frame->unimplemented_cb (frame, __func__, c, frame->esc_param[0]);
-      break;
+  Free (frame->wrapped);
+  Free (frame->tabstops);
+  Free (frame->esc_param);
 
-    case 'n': /* Device status request */
-      switch (frame->esc_param[0]) {
-        case 5: /* Status report request */
-          /* Say we're just fine. */
-          write (frame->fd, "\033[0n", 4);
-          break;
+  Vframe.release_argv (frame);
+  string_release (frame->render);
+  Free (frame->latency);
 
-        case 6: /* Cursor position request */
-          sprintf (reply, "\033[%d;%dR", frame->row_pos,
-              frame->col_pos);
+  ifnot (-1 is frame->pid) {
+    kill (frame->pid, SIGHUP);
+    waitpid (frame->pid, NULL, 0);
+  }
 
-          write (frame->fd, reply, bytelen (reply));
-          break;
-        }
-        break;
+  Free (frame);
+}
 
-    case 'c': /* Request terminal identification string_t */
-      /* Respond with "I am a vt102" */
-      write (frame->fd, "\033[?6c", 5);
-      break;
+static void vwm_make_separator (string_t *render, char *color, int cells, int row, int col) {
+  vt_goto (render, row, col);
+  string_append (render, color);
+  for (int i = 0; i < cells; i++)
+    string_append_with_len (render, "—", 3);
 
-    case 'X': /* (ECH) Erase param chars (ADDITION) */
-      vt_frame_ech (frame, buf, frame->esc_param[0]);
-      break;
+  vt_attr_reset (render);
+}
 
-    //case 'G':
-       /* (CHA) Cursor to column param (ADDITION) */
-     // vt_frame_cha (frame, buf, frame->esc_param[0]);
-     // break;
+static int win_set_separators (vwm_win *this, int draw) {
+  string_clear (this->separators_buf);
 
-    default:
-      frame->unimplemented_cb (frame, __func__, c, frame->esc_param[0]);
-      break;
+  ifnot (this->num_separators) return NOTOK;
+
+  vwm_frame *prev = this->head;
+  vwm_frame *frame = this->head->next;
+  while (prev->is_visible is 0) {
+    prev = frame;
+    frame = frame->next;
   }
 
-  vt_frame_esc_set (frame);
-  return buf;
-}
+  int num = 0;
 
-static string_t *vt_esc_e (vwm_frame *frame, string_t *buf, int c) {
-  /* Return inside the switch to prevent reset_esc() */
-  switch (c) {
-    case '\030': /* Processed as escape cancel */
-    case '\032':
-      break;
+  while (num < this->num_separators) {
+    ifnot (frame->is_visible) goto next_frame;
 
-    case '[':
-      frame->process_char_cb = vt_esc_brace;
-      return buf;
+    num++;
+    vwm_make_separator (this->separators_buf,
+       (prev is this->current ? COLOR_FOCUS : COLOR_UNFOCUS),
+        frame->num_cols, prev->first_row + prev->last_row, frame->first_col);
 
-    case '(':
-      frame->process_char_cb = vt_esc_lparen;
-      return buf;
+    prev = frame;
+    next_frame: frame = frame->next;
+  }
 
-    case ')':
-      frame->process_char_cb = vt_esc_rparen;
-      return buf;
+  if (DRAW is draw)
+    vt_write (this->parent, this->separators_buf);
 
-    case '#':
-      frame->process_char_cb = vt_esc_pound;
-      return buf;
+  return OK;
+}
 
-    case 'D': /* Cursor down with scroll up at margin */
-      if (frame->row_pos < frame->last_row)
-        frame->row_pos++;
-      else
-        vt_frame_video_scroll (frame, 1);
+static vwm_frame *win_set_current_at (vwm_win *this, int idx) {
+  DListSetCurrent (this, idx);
+  return this->current;
+}
 
-      string_append (buf, "\n");
-      break;
+static vwm_frame *win_set_frame_as_current (vwm_win *this, vwm_frame *frame) {
+  int idx = DListGetIdx (this, vwm_frame, frame);
+  return win_set_current_at (this, idx);
+}
 
-    case 'M': /* Reverse scroll (move up; scroll at top) */
-      if (frame->row_pos > frame->scroll_first_row)
-        --frame->row_pos;
-      else
-        vt_frame_video_scroll_back (frame, 1);
+/* appends the rows of the frame to render, from the cursor position on */
+static void frame_render_rows (vwm_frame *frame, string_t *render, int *oldattr, int *oldclr, uchar *on) {
+  char buf[8];
+  int len = 0;
 
-      vt_revscroll (buf);
-      break;
+  for (int i = 0; i < frame->num_rows; i++) {
+    for (int j = 0; j < frame->num_cols; j++) {
+      utf8 chr = frame->videomem[i][j];
+      int clr = frame->colors[i][j];
 
-    case 'E': /* Next line (CR-LF) */
-      if (frame->row_pos < frame->last_row)
-        frame->row_pos++;
-      else
-        vt_frame_video_scroll (frame, 1);
+      ifnot (clr is *oldclr) {
+        vt_setfg (render, clr);
+        *oldclr = clr;
+      }
 
-      frame->col_pos = 1;
-      string_append (buf, "\r\n");
-      break;
+      if (chr & 0xFF) {
+        vt_attr_check (render, chr & 0xFF, *oldattr, on);
+        *oldattr = (chr & 0xFF);
 
-    case '7': /* Save cursor and attribute */
-      frame->saved_row_pos = frame->row_pos;
-      frame->saved_col_pos = frame->col_pos;
-      frame->saved_textattr = frame->textattr;
-      break;
+        if (*oldattr >= 0x80) {
+          ustring_character (chr, buf, &len);
+          string_append_with_len (render, buf, len);
+        } else
+          string_append_byte (render, chr & 0xFF);
+      } else {
+        *oldattr = 0;
 
-    case '8': /* Restore saved cursor and attribute */
-      frame->row_pos = frame->saved_row_pos;
-      frame->col_pos = frame->col_pos;
-      if (frame->row_pos > frame->num_rows)
-        frame->row_pos = frame->num_rows;
+        ifnot (*on is NORMAL) {
+          vt_attr_reset (render);
+          *on = NORMAL;
+        }
 
-      if (frame->col_pos > frame->num_cols)
-        frame->col_pos = frame->num_cols;
+        string_append_byte (render, ' ');
+      }
+    }
+
+    string_append (render, "\r\n");
+  }
+}
+
+static void win_draw (vwm_win *this) {
+  ifnot (this->parent->prop->render) return;
 
-      vt_goto (buf, frame->row_pos + frame->first_row - 1,
-        frame->col_pos);
+  int
+    oldattr = 0,
+    oldclr = COLOR_FG_NORM;
 
-      frame->textattr = frame->saved_textattr;
-      vt_frame_attr_set (frame, buf);
-      break;
+  uchar on = NORMAL;
 
-    case '=': /* Set application keypad mode */
-      frame->key_state = appl;
-      vt_keystate_print (buf, frame->key_state);
-      break;
+  string_t *render = this->render;
+  string_clear (render);
+  string_append (render, TERM_SCREEN_CLEAR);
+  vt_setscroll (render, 0, 0);
+  vt_attr_reset (render);
+  vt_setbg (render, COLOR_BG_NORM);
+  vt_setfg (render, COLOR_FG_NORM);
+  vwm_frame *frame = this->head;
+  while (frame) {
+    ifnot (frame->is_visible) goto next_frame;
 
-    case '>': /* Set numeric keypad mode */
-      frame->key_state = norm;
-      vt_keystate_print (buf, frame->key_state);
-      break;
+    frame_resize_pending (frame);
 
-    case 'N': /* Select charset G2 for one character */
-    case 'O': /* Select charset G3 for one character */
-      frame->unimplemented_cb (frame, __func__, c, frame->esc_param[0]);
-      break;
+    vt_goto (render, frame->first_row, 1);
 
-    case 'H': /* Set horizontal tab */
-      frame->tabstops[frame->col_pos - 1] = 1;
-      break;
+    frame_render_rows (frame, render, &oldattr, &oldclr, &on);
 
-    case 'Z': /* Request terminal identification string_t */
-      /* Respond with "I am a vt102" */
-      write (frame->fd, "\033[?6c", 5);
-      break;
+    // clear the last newline, otherwise it scrolls one line more
+    string_clear_at (render, -1); // this is visible when there is one frame
 
-    case 'c': /* Terminal reset */
-      frame_reset (frame);
-      break;
+    /*  un-needed?
+    vt_setscroll (render, frame->scroll_first_row + frame->first_row - 1,
+        frame->last_row + frame->first_row - 1);
+    vt_goto (render, frame->row_pos + frame->first_row - 1, frame->col_pos);
+    */
 
-    default:
-      frame->unimplemented_cb (frame, __func__, c, frame->esc_param[0]);
-      break;
+    next_frame: frame = frame->next;
   }
 
-  vt_frame_esc_set (frame);
-  return buf;
+  self(set.separators, DONOT_DRAW);
+  string_append_with_len (render, this->separators_buf->bytes, this->separators_buf->num_bytes);
+
+  frame = this->current;
+  vt_goto (render, frame->row_pos + frame->first_row - 1, frame->col_pos);
+
+  vt_write (this->parent, render);
 }
 
-static string_t *vt_esc_scan (vwm_frame *frame, string_t *buf, int c) {
-  switch (c) {
-    case '\000': /* NULL (fill character) */
-      break;
+static void win_on_resize (vwm_win *this, int draw) {
+  int frow = 1;
+  vwm_frame *frame = this->head;
+  while (frame) {
+    ifnot (frame->is_visible) goto next_frame;
 
-    case '\003': /* EXT  (half duplex turnaround) */
-    case '\004': /* EOT  (can be disconnect char) */
-    case '\005': /* ENQ  (generate answerback) */
-      string_append_byte (buf, c);
-      break;
+    Vframe.on_resize (frame, frame->new_rows, frame->num_cols);
+    frame->num_rows = frame->new_rows;
+    frame->last_row = frame->num_rows;
+    frame->first_row = frow;
+    frow += frame->num_rows + 1;
+    if (frame->argv and frame->pid isnot -1) {
+      struct winsize ws = {.ws_row = frame->num_rows, .ws_col = frame->num_cols};
+      ioctl (frame->fd, TIOCSWINSZ, &ws);
+      kill (frame->pid, SIGWINCH);
+    }
 
-    case '\007': /* BEL  (sound terminal bell) */
-      vt_bell (buf);
-      break;
+    next_frame: frame = frame->next;
+  }
 
-    case '\b': /* Backspace; move left one character */
-      ifnot (1 is frame->col_pos) {
-        --frame->col_pos;
-        vt_left (buf, frame->esc_param[0]);
-      }
-      break;
+  if (draw)
+    self(draw);
+}
 
-    case '\t': /* Tab.  Handle with direct motion (Buggy) */
-      {
-        int i = frame->col_pos;
-        do {
-          ++frame->col_pos;
-        } while (0 is frame->tabstops[frame->col_pos - 1]
-            and (frame->col_pos < frame->num_cols));
+static int win_min_rows (vwm_win *this) {
+  int num_frames = self(get.num_visible_frames);
+  return this->num_rows - num_frames -
+      this->num_separators - (num_frames * 2);
+}
 
-        vt_right (buf, frame->col_pos - i);
-      }
-      break;
+static void win_frame_increase_size (vwm_win *this, vwm_frame *frame, int param, int draw) {
+  if (this->length is 1)
+    return;
 
-    case '\013': /* Processed as linefeeds */
-    case '\014': /* Don't let the cursor move below winow or scrolling region */
-    case '\n':
-      if (frame->row_pos < frame->last_row)
-        frame->row_pos++;
-      else
-        vt_frame_video_scroll (frame, 1);
+  int min_rows = win_min_rows (this);
 
-      string_append (buf, "\n");
-      break;
+  ifnot (param) param = 1;
+  if (param > min_rows) param = min_rows;
 
-    case '\r': /* Move cursor to left margin */
-      frame->col_pos = 1;
-      string_append (buf, "\r");
-      break;
+  int num_lines;
+  int mod;
+  int num_frames = self(get.num_visible_frames);
 
-    case '\016': /* S0 (selects G1 charset) */
-    case '\017': /* S1 (selects G0 charset) */
-    case '\021': /* XON (continue transmission) */
-    case '\022': /* XOFF (stop transmission) */
-      string_append_byte (buf, c);
-      break;
+  if (param is 1 or param is num_frames - 1) {
+    num_lines = 1;
+    mod = 0;
+  } else if (param > num_frames - 1) {
+    num_lines = param / (num_frames - 1);
+    mod = param % (num_frames - 1);
+  } else {
+    num_lines = (num_frames - 1) / param;
+    mod = (num_frames - 1) % param;
+  }
 
-    case '\030': /* Processed as escape cancel */
-    case '\032':
-      vt_frame_esc_set (frame);
-      break;
+  int orig_param = param;
 
-    case '\033':
-      frame->process_char_cb = vt_esc_e;
-      return buf;
+  vwm_frame *fr = this->head;
+  while (fr) {
+    fr->new_rows = fr->num_rows;
+    fr = fr->next;
+  }
 
-    default:
-      if (c >= 0x80 or frame->mb_len) {
-        if (frame->mb_len > 0) {
-          frame->mb_buf[frame->mb_curlen++] = c;
-          frame->mb_code <<= 6;
-          frame->mb_code += c;
+  fr = this->head;
+  int iter = 1;
+  while (fr and param and iter++ < ((num_frames - 1) * 3)) {
+    if (frame is fr or frame->is_visible is 0)
+      goto next_frame;
 
-          if (frame->mb_curlen isnot frame->mb_len)
-            return buf;
+    int num = num_lines;
+    while (fr->new_rows > 2 and num--) {
+      fr->new_rows = fr->new_rows - 1;
+      param--;
+    }
 
-          frame->mb_code -= offsetsFromUTF8[frame->mb_len-1];
+    if (fr->new_rows is 2)
+      goto next_frame;
 
-          vt_append (frame, buf, frame->mb_code);
-          frame->mb_buf[0] = '\0';
-          frame->mb_curlen = frame->mb_len = frame->mb_code = 0;
-          return buf;
-        } else {
-          frame->mb_code = c;
-          frame->mb_len = ({
-            uchar uc = 0;
-            if ((c & 0xe0) is 0xc0)
-              uc = 2;
-            else if ((c & 0xf0) is 0xe0)
-              uc = 3;
-            else if ((c & 0xf8) is 0xf0)
-              uc = 4;
-            else
-              uc = -1;
+    if (mod) {
+      fr->new_rows--;
+      param--;
+      mod--;
+    }
 
-            uc;
-            });
-          frame->mb_buf[0] = c;
-          frame->mb_curlen = 1;
-          return buf;
-        }
-      } else
-        vt_append (frame, buf, c);
+    next_frame:
+      if (fr->next is NULL)
+        fr = this->head;
+      else
+        fr = fr->next;
   }
 
-  return buf;
+  frame->new_rows = frame->new_rows + (orig_param - param);
+
+  self(on_resize, draw);
 }
 
-static void vt_video_add_log_lines (vwm_frame *this) {
-  struct stat st;
-  if (-1 is this->logfd or -1 is fstat (this->logfd, &st))
+static void win_frame_decrease_size (vwm_win *this, vwm_frame *frame, int param, int draw) {
+  if (1 is this->length or frame->num_rows <= MIN_ROWS)
     return;
 
-  long size = st.st_size;
+  if (frame->num_rows - param <= 2)
+    param = frame->num_rows - 2;
 
-  char *mbuf = mmap (0, size, PROT_READ, MAP_SHARED, this->logfd, 0);
+  if (0 >= param)
+    param = 1;
+
+  int num_lines;
+  int mod;
+  int num_frames = self(get.num_visible_frames);
 
-  if (NULL is mbuf) return;
+  if (param is 1 or param is num_frames - 1) {
+    num_lines = 1;
+    mod = 0;
+  } else if (param > num_frames - 1) {
+    num_lines = param / (num_frames - 1);
+    mod = param % (num_frames - 1);
+  } else {
+    num_lines = (num_frames - 1) / param;
+    mod = (num_frames - 1) % param;
+  }
 
-  char *buf = mbuf + size - 1;
+  vwm_frame *fr = this->head;
+  while (fr) {
+    fr->new_rows = fr->num_rows;
+    fr = fr->next;
+  }
 
-  int lines = this->num_rows;
+  int orig_param = param;
 
-  for (int i = 0; i < lines; i++)
-    for (int j = 0; j < this->num_cols; j++)
-      this->videomem[i][j] = 0;
+  fr = this->head;
+  int iter = 1;
+  while (fr and param and iter++ < ((this->length - 1) * 3)) {
+    if (frame is fr or frame->is_visible is 0)
+      goto next_frame;
 
-  while (lines isnot 0 and size) {
-    char b[BUFSIZE];
-    char c;
-    int rbts = 0;
-    while (--size) {
-      c = *--buf;
+    fr->new_rows = fr->num_rows + num_lines;
 
-      if (c is '\n') break;
+    param -= num_lines;
 
-      ifnot (c) continue;
-      b[rbts++] = c;
+    if (mod) {
+      fr->new_rows++;
+      param--;
+      mod--;
     }
 
-    b[rbts] = '\0';
-
-    int blen = bytelen (b);
-
-    char nbuf[blen + 1];
-    for (int i = 0; i < blen; i++)
-      nbuf[i] = b[blen - i - 1];
-
-    nbuf[blen] = '\0';
+  next_frame:
+    if (fr->next is NULL)
+      fr = this->head;
+    else
+      fr = fr->next;
+  }
 
-    int idx = 0;
-    for (int i = 0; i < this->num_cols; i++) {
-      if (idx >= blen) break;
+  frame->new_rows = frame->new_rows - (orig_param - param);
 
-      this->videomem[lines-1][i] =
-         (int) ustring_to_code (nbuf, &idx);
-    }
+  self(on_resize, draw);
+}
 
-    lines--;
-  }
+static void win_frame_set_size (vwm_win *this, vwm_frame *frame, int param, int draw) {
+  if (param is frame->num_rows or 0 >= param)
+    return;
 
-  ftruncate (this->logfd, size);
-  lseek (this->logfd, size, SEEK_SET);
-  munmap (0, st.st_size);
+  if (param > frame->num_rows)
+    win_frame_increase_size (this, frame, param - frame->num_rows, draw);
+  else
+    win_frame_decrease_size (this, frame, frame->num_rows - param, draw);
 }
 
-static void frame_on_resize (vwm_frame *this, int rows, int cols) {
-  int **videomem = vwm_alloc_ints (rows, cols, 0);
-  int **colors = vwm_alloc_ints (rows, cols, COLOR_FG_NORMAL);
-  int row_pos = 0;
-  int i, j, nj, ni;
+static vwm_frame *win_frame_change (vwm_win *this, vwm_frame *frame, int dir, int draw) {
+  int num_frames = self(get.num_visible_frames);
+  if ((NULL is frame->next and NULL is frame->prev) or 1 is num_frames)
+    return frame;
 
-  int last_row = this->num_rows;
-  if (rows < last_row)
-    while (last_row > rows and 0 is this->videomem[last_row-1][0])
-      last_row--;
+  int idx = -1;
 
-  for (i = last_row, ni = rows; i and ni; i--, ni--) {
-    if (this->row_pos is i)
-      if ((row_pos = i + (this->num_rows - last_row) + rows - this->num_rows) < 1)
-        row_pos = 1;
+  vwm_frame *lframe = frame;
 
-    for (j = 0, nj = 0; (j < this->num_cols) and (nj < cols); j++, nj++) {
-      videomem[ni-1][nj] = this->videomem[i-1][j];
-      colors[ni-1][nj] = this->colors[i-1][j];
+again:
+  if (dir is DOWN_POS) {
+    if (NULL is lframe->next) {
+      idx = 0;
+      while (lframe) {
+        if (lframe->is_visible) break;
+        idx++;
+        lframe = lframe->next;
+      }
+    } else {
+      if (lframe->next->is_visible) {
+        idx = self(get.frame_idx, lframe->next);
+      } else {
+        lframe = lframe->next;
+        goto again;
+      }
+    }
+  } else {
+    if (NULL is lframe->prev) {
+      idx = this->length - 1;
+      while (lframe) {
+        if (lframe->is_visible) break;
+        idx--;
+        lframe = lframe->prev;
+      }
+    } else {
+      if (lframe->prev->is_visible) {
+        idx = self(get.frame_idx, lframe->prev);
+      } else {
+        lframe = lframe->prev;
+        goto again;
+      }
     }
   }
 
-  ifnot (row_pos) /* We never reached the old cursor */
-    row_pos = 1;
-
-  this->row_pos = row_pos;
-  this->col_pos = (this->col_pos > cols ? cols : this->col_pos);
+  this->last_frame = frame;
 
-  for (i = 0; i < this->num_rows; i++)
-    free (this->videomem[i]);
-  free (this->videomem);
+  self(set.current_at, idx);
 
-  for (i = 0; i < this->num_rows; i++)
-    free (this->colors[i]);
-  free (this->colors);
+  if (OK is self(set.separators, draw))
+    if (draw is DONOT_DRAW)
+      this->draw_separators = 1;
 
-  this->videomem = videomem;
-  this->colors = colors;
+  return this->current;
 }
 
-static void win_set_frame (vwm_win *this, vwm_frame *frame) {
-  string_clear (frame->render);
+static void vwm_change_win (vwm_t *this, vwm_win *win, int dir, int draw) {
+  if ($my(length) is 1)
+    return;
 
-  vt_setscroll (frame->render, frame->scroll_first_row + frame->first_row - 1,
-      frame->last_row + frame->first_row - 1);
+  int idx = -1;
+  switch (dir) {
+    case LAST_POS:
+      if ($my(last_win) is win)
+        return;
 
-  if (this->draw_separators) {
-    this->draw_separators = 0;
-    string_append_with_len (frame->render, this->separators_buf->bytes, this->separators_buf->num_bytes);
+      idx = self(get.win_idx, $my(last_win));
+      break;
+
+    case NEXT_POS:
+      ifnot (NULL is win->next)
+        idx = self(get.win_idx, win->next);
+      else
+        idx = 0;
+      break;
+
+    case PREV_POS:
+      ifnot (NULL is win->prev)
+        idx = self(get.win_idx, win->prev);
+      else
+        idx = $my(length) - 1;
+      break;
+
+    default:
+      idx = dir;
+      if (idx >= $my(length) or idx < 0) return;
+      break;
   }
 
-  vt_goto (frame->render, frame->row_pos + frame->first_row - 1, frame->col_pos);
+  $my(last_win) = win;
 
-  ifnot (NULL is this->last_frame) {
-    ifnot (frame->key_state is this->last_frame->key_state)
-      vt_keystate_print (frame->render, frame->key_state);
+  win = self(set.current_at, idx);
 
-    ifnot (frame->textattr is this->last_frame->textattr)
-      vt_attr_set (frame->render, frame->textattr);
+  Vterm.screen.clear ($my(term));
 
-    for (int i = 0; i < NCHARSETS; i++)
-      if (frame->charset[i] isnot this->last_frame->charset[i])
-        vt_altcharset (frame->render, i, frame->charset[i]);
+  ifnot (win->is_initialized) {
+    vwm_frame *frame = win->head;
+    while (frame) {
+      if (frame->argv is NULL)
+        Vframe.set.command (frame, $my(default_app)->bytes);
+
+      Vframe.fork (frame);
+
+      frame = frame->next;
+    }
   }
 
-  vt_write (frame->render->bytes, stdout);
-}
+  if (draw) {
+    if (win->is_initialized)
+      Vwin.draw (win);
+    else
+      Vwin.set.separators (win, DRAW);
+  } else
+    Vwin.set.separators (win, DONOT_DRAW);
 
-static void frame_process_output (vwm_frame *this, char *buf, int len) {
-  this->process_output_cb (this, buf, len);
+  win->is_initialized = 1;
 }
 
-#ifndef DEBUG
-static void frame_process_output_cb (vwm_frame *this, char *buf, int len) {
-  string_clear (this->render);
-
-  while (len--)
-    this->process_char_cb (this, this->render, (uchar) *buf++);
+static int vwm_default_edit_file_cb (vwm_t *this, vwm_frame *frame, char *file, void *object) {
+  (void) object; (void) frame;
 
-  vt_write (this->render->bytes, stdout);
+  size_t len = $my(editor)->num_bytes + bytelen (file);
+  char command[len + 2];
+  snprintf (command, len + 2, "%s %s", $my(editor)->bytes, file);
+  int argc = 0;
+  char **argv = parse_command (command, &argc);
+  int retval = self(spawn, argv);
+  argv_release (argv, &argc);
+  return retval;
 }
-#else
-static void frame_process_output_cb (vwm_frame *this, char *buf, int len) {
-  string_clear (this->render);
 
-  FILE *fout = this->root->prop->sequences_fp;
+static void frame_reopen_log (vwm_frame *this) {
+  if (this->logfile is NULL or 0 is this->logfile->num_bytes)
+    return;
 
-  fprintf (fout, "\n%s\n\n", buf);
+  if (-1 isnot this->logfd) close (this->logfd);
 
-  char seq_buf[MAX_SEQ_LEN + 1];
-  int seq_idx = 1;
-  seq_buf[0] = '\0';
+  this->logfd = open (this->logfile->bytes, O_RDWR|O_CREAT, S_IRUSR|S_IWUSR);
+  this->log_size = 0;
+}
 
-  while (len--) {
+static int frame_edit_log (vwm_frame *frame) {
+  if (frame->logfile is NULL)
+    return NOTOK;
 
-    if (this->process_char_cb is vt_esc_scan) {
-      ifnot (seq_idx) goto proceed;
+  vwm_win *win = frame->parent;
+  vwm_t *this = win->parent;
 
-      fprintf (fout, "ESC %s\n", seq_buf);
+  int len;
+  long now = vt_clock_ms ();
 
-      seq_idx = 0;
-      memset (seq_buf, 0, MAX_SEQ_LEN+1);
-    } else
-      seq_buf[seq_idx++] = *buf;
+  for (int i = 0; i < frame->num_rows; i++) {
+    char buf[(frame->num_cols * 4) + 2];
+    int wrapped = (i < frame->num_rows - 1 and frame->wrapped[i]);
+    len = vt_video_line_to_str (frame->videomem[i], buf, frame->num_cols) - wrapped;
+    write (frame->logfd, buf, len);
+    frame->log_size += len;
 
-proceed:
-    this->process_char_cb (this, this->render, (uchar) *buf++);
-  }
+    if (wrapped) continue;
 
-  if (seq_idx)
-    fprintf (fout, "ESC %s\n", seq_buf);
+    logts_push (&frame->logts, now);
+    frame->log_lines++;
+  }
 
-  fflush (fout);
+  /* the viewer gets a copy with the lines prefixed by their timestamp */
+  char *fname = frame->logfile->bytes;
+  tmpname_t t = tmpfname ($my(tmpdir)->bytes, "vwm_log");
+  if (-1 isnot t.fd) {
+    close (t.fd);
+    if (OK is Vframe.export_log (frame, t.fname->bytes))
+      fname = t.fname->bytes;
+  }
 
-  vt_write (this->render->bytes, stdout);
-}
-#endif /* DEBUG */
+  $my(edit_file_cb) (this, frame, fname, $my(objects)[VWMED_OBJECT]);
 
-static void argv_release (char **argv, int *argc) {
-  for (int i = 0; i <= *argc; i++) free (argv[i]);
-  free (argv);
-  *argc = 0;
-  argv = NULL;
-}
+  if (NULL isnot t.fname) {
+    unlink (t.fname->bytes);
+    string_free (t.fname);
+  }
 
-static void frame_release_argv (vwm_frame *this) {
-  if (NULL is this->argv) return;
-  argv_release (this->argv, &this->argc);
+  vt_video_add_log_lines (frame);
+  Vwin.draw (win);
+  return OK;
 }
 
-static char **parse_command (char *command, int *argc) {
-  char *sp = command;
-  char *tokbeg;
-  size_t len;
-
-  *argc = 0;
-  char **argv = Alloc (sizeof (char *));
-
-  while (*sp) {
-    while (*sp and *sp is ' ') sp++;
-    ifnot (*sp) break;
-
-    tokbeg = sp;
+typedef struct log_export {
+  FILE *fp;
 
-    if (*sp is '"') {
-      sp++;
-      tokbeg++;
+  int
+    idx,
+    at_bol;
 
-parse_quoted:
-      while (*sp and *sp isnot '"') sp++;
-      ifnot (*sp) goto theerror;
-      if (*(sp - 1) is '\\') goto parse_quoted;
-      len = (size_t) (sp - tokbeg);
-      sp++;
-      goto add_arg;
-    }
+  long
+    ms,
+    real_offset;
 
-    while (*sp and *sp isnot ' ') sp++;
+  logts_block *b;
+} log_export;
 
-    len = (size_t) (sp - tokbeg);
+static void log_export_chunk (log_export *x, const char *buf, size_t len) {
+  char tbuf[LOGTS_FMT_LEN + 1];
 
-add_arg:
-    *argc += 1;
-    argv = Realloc (argv, sizeof (char *) * ((*argc) + 1));
-    argv[*argc - 1] = Alloc (len + 1);
-    cstring_cp (argv[*argc - 1], len + 1, tokbeg, len);
+  while (len) {
+    if (x->at_bol) {
+      while (NULL isnot x->b and x->idx >= x->b->num_bytes) {
+        x->b = x->b->next;
+        x->idx = 0;
+        if (NULL isnot x->b) x->ms = x->b->base_ms;
+      }
 
-    ifnot (*sp) break;
-    sp++;
-  }
+      if (NULL isnot x->b and OK is logts_block_next (x->b, &x->idx, &x->ms))
+        logts_fmt (x->ms, x->real_offset, tbuf);
+      else {
+        memset (tbuf, ' ', LOGTS_FMT_LEN);
+        tbuf[LOGTS_FMT_LEN] = '\0';
+      }
 
-  argv[*argc] = (char *) NULL;
+      fprintf (x->fp, "%s  ", tbuf);
+      x->at_bol = 0;
+    }
 
-  return argv;
+    const char *nl = memchr (buf, '\n', len);
+    size_t n = (NULL is nl ? len : (size_t) (nl - buf) + 1);
+    fwrite (buf, 1, n, x->fp);
+    if (NULL isnot nl) x->at_bol = 1;
 
-theerror:
-  argv_release (argv, argc);
-  return NULL;
+    buf += n;
+    len -= n;
+  }
 }
 
-static void frame_set_command (vwm_frame *this, char *command) {
-  if (NULL is command or 0 is bytelen (command))
-    return;
+static void log_export_fd (log_export *x, int fd, off_t size) {
+  char buf[BUFSIZE];
+  off_t offset = 0;
 
-  self(release_argv);
-  this->argv = parse_command (command, &this->argc);
-}
+  while (size < 0 or offset < size) {
+    size_t len = BUFSIZE;
+    if (size >= 0 and (off_t) len > size - offset)
+      len = size - offset;
 
-static void frame_set_visibility (vwm_frame *this, int visibility) {
-  if (this->is_visible) {
-    ifnot (visibility) {
-      this->parent->num_visible_frames--;
-      this->parent->num_separators--;
-    }
-  } else {
-    if (visibility) {
-      this->parent->num_visible_frames++;
-      this->parent->num_separators++;
+    ssize_t bts = pread (fd, buf, len, offset);
+    if (0 >= bts) {
+      if (-1 is bts and errno is EINTR) continue;
+      break;
     }
-  }
 
-  this->is_visible = (0 isnot visibility);
+    log_export_chunk (x, buf, bts);
+    offset += bts;
+  }
 }
 
-static void frame_set_argv (vwm_frame *this, int argc, char **argv) {
-  if (argc <= 0) return;
+/* writes the logical log (the sealed segments and then the active log),
+ * with the lines prefixed by their timestamp */
+static int frame_export_log (vwm_frame *this, char *fname) {
+  if (NULL is this->logfile or NULL is fname)
+    return NOTOK;
 
-  self(release_argv);
+  int fd = open (fname, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR|S_IWUSR);
+  if (-1 is fd) return NOTOK;
 
-  this->argv = Alloc (sizeof (char *) * (argc + 1));
-  for (int i = 0; i < argc; i++) {
-    size_t len = bytelen (argv[i]);
-    this->argv[i] = Alloc (len + 1);
-    cstring_cp (this->argv[i], len + 1, argv[i], len);
+  FILE *fp = fdopen (fd, "w");
+  if (NULL is fp) {
+    close (fd);
+    return NOTOK;
   }
 
-  this->argv[argc] = NULL;
-  this->argc = argc;
-}
+  log_export x = {
+    .fp = fp,
+    .idx = 0,
+    .at_bol = 1,
+    .b = this->logts.head,
+    .ms = (NULL is this->logts.head ? 0 : this->logts.head->base_ms),
+    .real_offset = logts_real_offset ()
+  };
 
-static void frame_set_fd (vwm_frame *this, int fd) {
-  this->fd = fd;
-}
+  for (log_segment *seg = this->log_segments; seg; seg = seg->next) {
+    int compressed;
+    int sfd = log_segment_open (seg, &compressed);
+    if (-1 is sfd) continue;
+
+    if (compressed) {
+      size_t len;
+      char *buf = lz_decompress_file (sfd, &len);
+      if (NULL isnot buf) {
+        log_export_chunk (&x, buf, len);
+        Free (buf);
+      }
+    } else
+      log_export_fd (&x, sfd, -1);
 
-static int frame_get_fd (vwm_frame *this) {
-  return this->fd;
-}
+    close (sfd);
+  }
 
-static pid_t frame_get_pid (vwm_frame *this) {
-  return this->pid;
-}
+  log_export_fd (&x, this->logfd, this->log_size);
 
-static int frame_get_visibility (vwm_frame *this) {
-  return this->is_visible;
+  return (0 is fclose (fp) ? OK : NOTOK);
 }
 
-static int frame_get_remove_log (vwm_frame *this) {
-  return this->remove_log;
-}
+/* Session recording. The file starts with REC_MAGIC, followed by the
+ * records: [type][frame id][ms since the start][length] (as varints) and
+ * then the payload:
+ *   REC_FRAME:    rows, cols (when a frame is first seen or resized)
+ *   REC_OUTPUT:   the raw output of the frame, as it was read from the pty
+ *   REC_KEYFRAME: rows, cols, row_pos, col_pos, scroll_first_row, last_row,
+ *                 textattr, the number of cells, and the cells and their
+ *                 colors as a compressed block stream
+ * The keyframes are also indexed in "fname.idx" (REC_IDX_MAGIC and then
+ * 64bit ts, offset, frame id entries), so seeking means a binary search,
+ * one keyframe load and parsing at most one keyframe interval of output.
+ */
 
-static int frame_get_argc (vwm_frame *this) {
-  return this->argc;
-}
+static int rec_varint (char *buf, ulong v) {
+  int len = 0;
+  do {
+    char c = v & 0x7F;
+    v >>= 7;
+    if (v) c |= 0x80;
+    buf[len++] = c;
+  } while (v);
 
-static char **frame_get_argv (vwm_frame *this) {
-  return this->argv;
+  return len;
 }
 
-static vwm_win *frame_get_parent (vwm_frame *this) {
-  return this->parent;
+static void rec_put_varint (string_t *buf, ulong v) {
+  char b[10];
+  string_append_data (buf, b, rec_varint (b, v));
 }
 
-static vwm_t *frame_get_root (vwm_frame *this) {
-  return this->root;
-}
+static int rec_get_varint (const uchar *buf, size_t size, size_t *pos, ulong *v) {
+  int shift = 0;
+  uchar c;
+  *v = 0;
 
-static int frame_get_num_rows (vwm_frame *this) {
-  return this->num_rows;
-}
+  do {
+    if (*pos >= size or shift > 63) return NOTOK;
+    c = buf[(*pos)++];
+    *v |= (ulong) (c & 0x7F) << shift;
+    shift += 7;
+  } while (c & 0x80);
 
-static int frame_get_logfd (vwm_frame *this) {
-  return this->logfd;
+  return OK;
 }
 
-static char *frame_get_logfile (vwm_frame *this) {
-  if (NULL is this->logfile) return NULL;
-  return this->logfile->bytes;
+static void rec_put_u64 (string_t *buf, ulong v) {
+  for (int i = 0; i < 8; i++)
+    string_append_byte (buf, (v >> (i * 8)) & 0xFF);
 }
 
-static void frame_clear (vwm_frame *this, int state) {
-  if (NULL is this) return;
-
-  string_t *render = this->render;
-
-  string_clear (render);
-  vt_goto (render, this->first_row, 1);
+static ulong rec_get_u64 (const uchar *buf) {
+  ulong v = 0;
+  for (int i = 0; i < 8; i++)
+    v |= (ulong) buf[i] << (i * 8);
+  return v;
+}
 
-  for (int i = 0; i < this->num_rows; i++) {
-    for (int j = 0; j < this->num_cols; j++) {
-      if (state & VFRAME_CLEAR_VIDEO_MEM) {
-        this->videomem[i][j] = ' ';
-        this->colors[i][j] = COLOR_FG_NORMAL;
-      }
+static int rec_append (vwm_recorder *rec, int type, int frame_id, long ts,
+                                                  const char *payload, size_t len) {
+  char hdr[32];
+  int hdr_len = 0;
+  hdr[hdr_len++] = type;
+  hdr_len += rec_varint (hdr + hdr_len, frame_id);
+  hdr_len += rec_varint (hdr + hdr_len, (ulong) (ts < 0 ? 0 : ts));
+  hdr_len += rec_varint (hdr + hdr_len, len);
 
-      string_append_byte (render, ' ');
-    }
+  pthread_mutex_lock (&rec->mutex);
 
-    string_append (render, "\r\n");
+  if (rec->buf->num_bytes + hdr_len + len > REC_MAX_PENDING) {
+    /* the disk can not keep up; the frames resync with a keyframe */
+    rec->dropped++;
+    rec->gen++;
+    pthread_mutex_unlock (&rec->mutex);
+    return NOTOK;
   }
 
-  // clear the last newline, otherwise it scrolls one line more
-  string_clear_at (render, -1); // this is visible when there is one frame
+  if (type is REC_KEYFRAME) {
+    rec_put_u64 (rec->idx_buf, ts);
+    rec_put_u64 (rec->idx_buf, rec->offset);
+    rec_put_u64 (rec->idx_buf, frame_id);
+  }
 
-  if (state & VFRAME_CLEAR_LOG)
-    if (this->logfd isnot -1)
-      ftruncate (this->logfd, 0);
+  string_append_data (rec->buf, hdr, hdr_len);
+  string_append_data (rec->buf, payload, len);
+  rec->offset += hdr_len + len;
 
-  vt_write (render->bytes, stdout);
+  pthread_cond_signal (&rec->cond);
+  pthread_mutex_unlock (&rec->mutex);
+  return OK;
 }
 
-static int frame_check_pid (vwm_frame *this) {
-  if (NULL is this or -1 is this->pid) return -1;
+static void *rec_writer (void *arg) {
+  vwm_recorder *rec = (vwm_recorder *) arg;
+  string_t *buf = string_new (BUFSIZE);
+  string_t *idx_buf = string_new (BUFSIZE);
 
-  ifnot (0 is waitpid (this->pid, &this->status, WNOHANG)) {
-    this->pid = -1;
-    this->fd = -1;
-    int state = (VFRAME_CLEAR_VIDEO_MEM|
-      (this->logfd isnot -1 ?
-        (this->remove_log ? VFRAME_CLEAR_LOG : 0) :
-        0));
-    self(clear, state);
-    return 0;
-  }
+  pthread_mutex_lock (&rec->mutex);
 
-  return this->pid;
-}
+  for (;;) {
+    while (0 is rec->buf->num_bytes and 0 is rec->idx_buf->num_bytes and 0 is rec->quit)
+      pthread_cond_wait (&rec->cond, &rec->mutex);
 
-static int frame_kill_proc (vwm_frame *this) {
-  if (this is NULL or this->pid is -1) return -1;
+    if (0 is rec->buf->num_bytes and 0 is rec->idx_buf->num_bytes) break;
 
-  int state = (VFRAME_CLEAR_VIDEO_MEM|
-    (this->logfd isnot -1 ?
-      (this->remove_log ? VFRAME_CLEAR_LOG : 0) :
-      0));
-  self(clear, state);
+    string_t *tmp = rec->buf;
+    rec->buf = buf;
+    buf = tmp;
 
-  kill (this->pid, SIGHUP);
-  waitpid (this->pid, NULL, 0);
-  this->pid = -1;
-  this->fd = -1;
-  return 0;
-}
+    tmp = rec->idx_buf;
+    rec->idx_buf = idx_buf;
+    idx_buf = tmp;
 
-static FrameProcessOutput_cb frame_set_process_output_cb (vwm_frame *this, FrameProcessOutput_cb cb) {
-  FrameProcessOutput_cb prev = this->process_output_cb;
-  this->process_output_cb = cb;
-  return prev;
-}
+    pthread_mutex_unlock (&rec->mutex);
 
-static FrameAtFork_cb frame_set_at_fork_cb (vwm_frame *this, FrameAtFork_cb cb) {
-  FrameAtFork_cb prev = this->at_fork_cb;
-  this->at_fork_cb = cb;
-  return prev;
-}
+    fd_write (rec->fd, buf->bytes, buf->num_bytes);
+    if (idx_buf->num_bytes)
+      fd_write (rec->idx_fd, idx_buf->bytes, idx_buf->num_bytes);
 
-static void frame_set_unimplemented_cb (vwm_frame *this, FrameUnimplemented_cb cb) {
-  this->unimplemented_cb = cb;
-}
+    TRACE_EVENT (VWM_TRACE_REC_WRITE, 0, buf->num_bytes, idx_buf->num_bytes, 0);
 
-static int frame_set_log (vwm_frame *this, char *fname, int remove_log) {
-  self(release_log);
+    string_clear (buf);
+    string_clear (idx_buf);
 
-  if (NULL is fname or fname[0] is '\0') {
-    tmpname_t t = tmpfname (this->root->prop->tmpdir->bytes, "libvwm");
-    if (-1 is t.fd)
-      return NOTOK;
+    pthread_mutex_lock (&rec->mutex);
+  }
 
-    this->logfd = t.fd;
-    this->logfile = t.fname;
-    this->remove_log = remove_log;
+  pthread_mutex_unlock (&rec->mutex);
 
-    return this->logfd;
+  string_free (buf);
+  string_free (idx_buf);
+  return NULL;
+}
+
+static void frame_record_keyframe (vwm_frame *this, vwm_recorder *rec) {
+  size_t num_cells = (size_t) this->num_rows * this->num_cols;
+  int *cells = Alloc (sizeof (int) * num_cells * 2);
+  for (int i = 0; i < this->num_rows; i++) {
+    memcpy (cells + (size_t) i * this->num_cols, this->videomem[i], sizeof (int) * this->num_cols);
+    memcpy (cells + num_cells + (size_t) i * this->num_cols, this->colors[i], sizeof (int) * this->num_cols);
   }
 
-  this->logfd = open (fname, O_CREAT|O_RDWR, S_IRUSR|S_IWUSR);
+  string_t *payload = string_new (BUFSIZE);
+  rec_put_varint (payload, this->num_rows);
+  rec_put_varint (payload, this->num_cols);
+  rec_put_varint (payload, this->row_pos);
+  rec_put_varint (payload, this->col_pos);
+  rec_put_varint (payload, this->scroll_first_row);
+  rec_put_varint (payload, this->last_row);
+  rec_put_varint (payload, this->textattr);
+  rec_put_varint (payload, num_cells);
+  lz_blocks_compress ((uchar *) cells, sizeof (int) * num_cells * 2, payload);
 
-  if (this->logfd is NOTOK) return NOTOK;
+  rec_append (rec, REC_KEYFRAME, this->id, this->batch_ms - rec->start_ms,
+      payload->bytes, payload->num_bytes);
 
-  if (-1 is fchmod (this->logfd, 0600)) return NOTOK;
+  this->rec_bytes = 0;
+  this->rec_keyframe_ms = this->batch_ms;
 
-  this->logfile = string_new_with (fname);
-  this->remove_log = remove_log;
-  return this->logfd;
+  string_free (payload);
+  Free (cells);
 }
 
-static int frame_at_fork_default_cb (vwm_frame *this, vwm_t *root, vwm_win *parent) {
-  (void) this; (void) parent; (void) root;
-  return 1;
-}
+static void frame_record_output (vwm_frame *this, vwm_recorder *rec, char *buf, int len) {
+  if (this->rec_gen isnot rec->gen) {
+    char payload[20];
+    int plen = rec_varint (payload, this->num_rows);
+    plen += rec_varint (payload + plen, this->num_cols);
+    rec_append (rec, REC_FRAME, this->id, this->batch_ms - rec->start_ms, payload, plen);
 
-static void frame_unimplemented_default_cb (vwm_frame *this, const char *fun, int c, int param) {
-  if (this->root->prop->unimplemented_fp isnot NULL) {
-    fprintf (this->root->prop->unimplemented_fp, "|%s| %c %d| param: %d\n", fun, c, c, param);
-    fflush  (this->root->prop->unimplemented_fp);
+    frame_record_keyframe (this, rec);
+    this->rec_gen = rec->gen;
   }
-}
 
-static int win_insert_frame_at (vwm_win *this, vwm_frame *frame, int idx) {
-  return DListInsertAt (this, frame, idx);
-}
+  ifnot (len) return;
 
-static int win_append_frame (vwm_win *this, vwm_frame *frame) {
-  return DListAppend (this, frame);
+  if (OK is rec_append (rec, REC_OUTPUT, this->id, this->batch_ms - rec->start_ms, buf, len))
+    this->rec_bytes += len;
 }
 
-static vwm_frame *win_init_frame (vwm_win *this, frame_opts opts) {
-  vwm_frame *frame = Alloc (sizeof (vwm_frame));
-
-  frame->parent = (opts.parent isnot NULL ? opts.parent : this);
+static void vwm_unset_recorder (vwm_t *this) {
+  vwm_recorder *rec = $my(recorder);
+  if (NULL is rec) return;
 
-  if (frame->parent isnot NULL) {
-    frame->root = frame->parent->parent;
-    frame->win =  frame->parent->self;
-    frame->self = frame->parent->frame;
-  }
+  $my(recorder) = NULL;
+  /* the generation might have been bumped by a drop */
+  $my(rec_gen) = rec->gen;
 
-  frame->pid = opts.pid;
-  frame->fd = opts.fd;
-  frame->at_frame = opts.at_frame;
-  frame->logfile = NULL;
-  frame->remove_log = opts.remove_log;
-  frame->is_visible = opts.is_visible;
-  frame->num_rows = opts.num_rows;
-  frame->first_row = opts.first_row;
+  pthread_mutex_lock (&rec->mutex);
+  rec->quit = 1;
+  pthread_cond_signal (&rec->cond);
+  pthread_mutex_unlock (&rec->mutex);
 
-  frame->num_cols = (opts.num_cols isnot -1 ? opts.num_cols :
-    (NULL is this ? 78 : this->num_cols));
-  frame->first_col = (opts.first_col isnot -1 ? opts.first_col :
-    (NULL is this ? 1 : this->first_col));
+  pthread_join (rec->thread, NULL);
+  pthread_cond_destroy (&rec->cond);
+  pthread_mutex_destroy (&rec->mutex);
 
-  ifnot (NULL is opts.argv)
-    Vframe.set.argv (frame, opts.argc, opts.argv);
-  else
-    if (NULL isnot opts.command)
-      Vframe.set.command (frame, opts.command);
+  close (rec->fd);
+  close (rec->idx_fd);
+  string_free (rec->buf);
+  string_free (rec->idx_buf);
+  Free (rec);
+}
 
-  frame->logfd = -1;
+static int vwm_set_recorder (vwm_t *this, char *fname) {
+  self(unset.recorder);
 
-  if (opts.enable_log)
-    Vframe.set.log (frame, opts.logfile, frame->remove_log);
+  if (NULL is fname or '\0' is *fname) return NOTOK;
 
-  frame->mb_buf[0] = '\0';
-  frame->mb_curlen = frame->mb_len = frame->mb_code = 0;
-  frame->render = string_new (2048);
-  frame->state = 0;
+  size_t len = bytelen (fname);
+  char idx_fname[len + sizeof (REC_IDX_EXT)];
+  snprintf (idx_fname, sizeof (idx_fname), "%s" REC_IDX_EXT, fname);
 
-  frame->process_output_cb = (NULL is opts.process_output_cb ?
-      frame_process_output_cb : opts.process_output_cb);
+  vwm_recorder *rec = Alloc (sizeof (vwm_recorder));
+  rec->fd = open (fname, O_CREAT|O_WRONLY|O_TRUNC|O_CLOEXEC, S_IRUSR|S_IWUSR);
+  rec->idx_fd = open (idx_fname, O_CREAT|O_WRONLY|O_TRUNC|O_CLOEXEC, S_IRUSR|S_IWUSR);
 
-  frame->at_fork_cb = (NULL is opts.at_fork_cb ?
-      frame_at_fork_default_cb : opts.at_fork_cb);
+  if (-1 is rec->fd or -1 is rec->idx_fd or
+      REC_MAGIC_LEN isnot fd_write (rec->fd, REC_MAGIC, REC_MAGIC_LEN) or
+      REC_MAGIC_LEN isnot fd_write (rec->idx_fd, REC_IDX_MAGIC, REC_MAGIC_LEN))
+    goto theerror;
 
-  frame->unimplemented_cb = frame_unimplemented_default_cb;
+  rec->offset = REC_MAGIC_LEN;
+  rec->buf = string_new (1 << 16);
+  rec->idx_buf = string_new (BUFSIZE);
+  rec->start_ms = vt_clock_ms ();
+  rec->gen = ++$my(rec_gen);
+  pthread_mutex_init (&rec->mutex, NULL);
+  pthread_cond_init (&rec->cond, NULL);
 
-  frame->videomem = vwm_alloc_ints (frame->num_rows, frame->num_cols, 0);
-  frame->colors = vwm_alloc_ints (frame->num_rows, frame->num_cols, COLOR_FG_NORMAL);
-  frame->esc_param = Alloc (sizeof (int) * MAX_PARAMS);
-  for (int i = 0; i < MAX_PARAMS; i++) frame->esc_param[i] = 0;
-  frame->tabstops = Alloc (sizeof (int) * frame->num_cols);
-  for (int i = 0; i < frame->num_cols; i++) {
-    ifnot ((int) i % TABWIDTH)
-      frame->tabstops[i] = 1;
-    else
-      frame->tabstops[i] = 0;
+  if (0 isnot pthread_create (&rec->thread, NULL, rec_writer, rec)) {
+    pthread_cond_destroy (&rec->cond);
+    pthread_mutex_destroy (&rec->mutex);
+    string_free (rec->buf);
+    string_free (rec->idx_buf);
+    goto theerror;
   }
 
-  Vframe.reset (frame);
-
-  if (opts.create_fd)
-    Vframe.create_fd (frame);
-
-  if (opts.fork and frame->argc)
-    Vframe.fork (frame);
-
-  return frame;
-}
-
-static vwm_frame *win_new_frame (vwm_win *this, frame_opts opts) {
-  vwm_frame *frame = self(init_frame, opts);
+  $my(recorder) = rec;
 
-  if (frame->at_frame < 0 or frame->at_frame > this->length)
-    self(append_frame, frame);
-  else
-    self(insert_frame_at, frame, frame->at_frame - 1);
+  /* the initial state of every frame */
+  long now = vt_clock_ms ();
+  for (vwm_win *win = $my(head); win; win = win->next)
+    for (vwm_frame *frame = win->head; frame; frame = frame->next) {
+      frame->batch_ms = now;
+      frame_record_output (frame, rec, NULL, 0);
+    }
 
-  if (frame->is_visible) {
-    this->num_visible_frames++;
-    this->num_separators++;
+  return OK;
 
-    int at = 1;
-    vwm_frame *it = this->head;
-    while (it) {
-      if (it is frame) break;
-      at += (it->is_visible isnot 0);
-      it = it->next;
-    }
+theerror:
+  if (-1 isnot rec->fd) close (rec->fd);
+  if (-1 isnot rec->idx_fd) close (rec->idx_fd);
+  unlink (fname);
+  unlink (idx_fname);
+  Free (rec);
+  return NOTOK;
+}
 
-    frame->at_frame = at;
+static int rec_read (vwm_replay *rp, size_t *pos, int *type, int *frame_id,
+                                     long *ts, const uchar **payload, size_t *len) {
+  ulong v;
+  size_t p = *pos;
 
-  }
+  if (p >= rp->size) return NOTOK;
 
-  return frame;
-}
+  *type = rp->map[p++];
 
-static vwm_frame *win_pop_frame_at (vwm_win *this, int idx) {
-  return DListPopAt (this, vwm_frame, idx);
+  if (NOTOK is rec_get_varint (rp->map, rp->size, &p, &v)) return NOTOK;
+  *frame_id = (int) v;
+  if (NOTOK is rec_get_varint (rp->map, rp->size, &p, &v)) return NOTOK;
+  *ts = (long) v;
+  if (NOTOK is rec_get_varint (rp->map, rp->size, &p, &v)) return NOTOK;
+  *len = v;
+
+  if (*len > rp->size - p) return NOTOK;
+
+  *payload = rp->map + p;
+  *pos = p + *len;
+  return OK;
 }
 
-static vwm_frame *win_add_frame (vwm_win *this, int argc, char **argv, int draw) {
-  int num_frames = self(get.num_visible_frames);
+static void replay_add_idx (vwm_replay *rp, long ts, long offset, int frame_id) {
+  if (0 is (rp->num_idx % 1024))
+    rp->idx = Realloc (rp->idx, sizeof (rec_idx_entry) * (rp->num_idx + 1024));
 
-  if (num_frames is this->max_frames) return NULL;
+  rp->idx[rp->num_idx++] = (rec_idx_entry) {.ts = ts, .offset = offset, .frame_id = frame_id};
+}
 
-  int frame_rows = 0;
-  int mod = self(frame_rows, num_frames + 1, &frame_rows);
-  int
-    num_rows = frame_rows + mod,
-    first_row = this->first_row;
+static void replay_load_idx (vwm_replay *rp, char *fname) {
+  size_t len = bytelen (fname);
+  char idx_fname[len + sizeof (REC_IDX_EXT)];
+  snprintf (idx_fname, sizeof (idx_fname), "%s" REC_IDX_EXT, fname);
 
-  vwm_frame *frame = this->head;
-  while (frame) {
-    ifnot (frame->is_visible) goto next_frame;
+  int fd = open (idx_fname, O_RDONLY|O_CLOEXEC);
+  if (-1 isnot fd) {
+    struct stat st;
+    if (0 is fstat (fd, &st) and st.st_size >= REC_MAGIC_LEN) {
+      uchar *buf = Alloc ((size_t) st.st_size);
+      if (st.st_size is read (fd, buf, st.st_size) and
+          0 is memcmp (buf, REC_IDX_MAGIC, REC_MAGIC_LEN)) {
+        /* a trailing partial entry is from a recording that is still running */
+        for (off_t off = REC_MAGIC_LEN; off + REC_IDX_ENTRY_LEN <= st.st_size; off += REC_IDX_ENTRY_LEN) {
+          long offset = (long) rec_get_u64 (buf + off + 8);
+          if ((size_t) offset >= rp->size) break;
+          replay_add_idx (rp, (long) rec_get_u64 (buf + off), offset, (int) rec_get_u64 (buf + off + 16));
+        }
+      }
 
-    frame->new_rows = num_rows;
-    first_row += num_rows + 1;
-    num_rows = frame_rows;
+      Free (buf);
+    }
 
-    next_frame: frame = frame->next;
+    close (fd);
   }
 
-  frame = self(new_frame, FrameOpts (
-      .num_rows = num_rows,
-      .first_row = first_row,
-      .argc = argc,
-      .argv = argv));
+  if (rp->num_idx) return;
 
-  frame->new_rows = num_rows;
+  /* no index; rebuild it */
+  size_t pos = REC_MAGIC_LEN;
+  size_t rlen;
+  long ts;
+  int type, frame_id;
+  const uchar *payload;
 
-  self(set.current_at, this->length - 1);
-  self(on_resize, draw);
-  return frame;
+  size_t cur = pos;
+  while (OK is rec_read (rp, &pos, &type, &frame_id, &ts, &payload, &rlen)) {
+    if (type is REC_KEYFRAME)
+      replay_add_idx (rp, ts, (long) cur, frame_id);
+    cur = pos;
+  }
 }
 
-static int win_frame_rows (vwm_win *this, int num_frames, int *frame_rows) {
-  int avail_rows = this->num_rows - (num_frames - 1);
-  *frame_rows = avail_rows / num_frames;
-  return avail_rows % num_frames;
-}
+static vwm_replay *vwm_replay_open (vwm_t *this, char *fname) {
+  (void) this;
+  if (NULL is fname) return NULL;
 
-static int win_delete_frame (vwm_win *this, vwm_frame *frame, int draw) {
-  ifnot (this->length)
-    return OK;
+  int fd = open (fname, O_RDONLY|O_CLOEXEC);
+  if (-1 is fd) return NULL;
 
-  if (1 is this->length) {
-    Vframe.kill_proc (frame);;
-    self(release_frame_at, 0);
-  } else if (0 is frame->is_visible) {
-    int idx = self(get.frame_idx, frame);
-    Vframe.kill_proc (frame);
-    self(release_frame_at, idx);
-  } else {
-    int is_last_frame = this->last_frame is frame;
-    int idx = self(get.frame_idx, frame);
-    Vframe.kill_proc (frame);
-    self(release_frame_at, idx);
+  struct stat st;
+  if (-1 is fstat (fd, &st) or st.st_size < REC_MAGIC_LEN) {
+    close (fd);
+    return NULL;
+  }
 
-    int num_frames = self(get.num_visible_frames);
-    ifnot (num_frames) return OK;
+  uchar *map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
 
-    int frame_rows = 0;
-    int mod = self(frame_rows, num_frames, &frame_rows);
-    int
-      num_rows = frame_rows + mod,
-      first_row = this->first_row;
+  if (MAP_FAILED is map) return NULL;
 
-    frame = this->head;
-    while (frame) {
-      ifnot (frame->is_visible) goto next_frame;
+  if (memcmp (map, REC_MAGIC, REC_MAGIC_LEN)) {
+    munmap (map, st.st_size);
+    return NULL;
+  }
 
-      frame->new_rows = num_rows;
-      first_row += num_rows + 1;
-      num_rows = frame_rows;
+  vwm_replay *rp = Alloc (sizeof (vwm_replay));
+  rp->map = map;
+  rp->size = st.st_size;
+  rp->pos = REC_MAGIC_LEN;
+  rp->frame_id = -1;
 
-      next_frame: frame = frame->next;
-    }
+  replay_load_idx (rp, fname);
 
-    if (is_last_frame or this->current is this->last_frame) {
-      if (1 is num_frames)
-        this->last_frame = this->current;
-      else {
-        frame = this->head;
-        while (frame) {
-          if (frame isnot this->current) {
-            this->last_frame = frame;
-            break;
-          }
+  rp->info.num_keyframes = rp->num_idx;
 
-          frame = frame->next;
-        }
-      }
-    }
+  /* the frames, with their geometry from their first keyframe */
+  for (long i = 0; i < rp->num_idx; i++) {
+    int found = 0;
+    for (int j = 0; j < rp->info.num_frames; j++)
+      if ((found = (rp->info.frames[j].id is rp->idx[i].frame_id))) break;
 
+    if (found) continue;
 
-    self(on_resize, draw);
+    size_t pos = rp->idx[i].offset;
+    size_t len;
+    long ts;
+    int type, frame_id;
+    const uchar *payload;
+    ulong rows = 0, cols = 0;
+
+    if (OK is rec_read (rp, &pos, &type, &frame_id, &ts, &payload, &len)) {
+      size_t p = 0;
+      rec_get_varint (payload, len, &p, &rows);
+      rec_get_varint (payload, len, &p, &cols);
+    }
+
+    rp->info.frames = Realloc (rp->info.frames, sizeof (vwm_replay_frame) * (rp->info.num_frames + 1));
+    rp->info.frames[rp->info.num_frames++] = (vwm_replay_frame) {
+      .id = rp->idx[i].frame_id,
+      .num_rows = (int) rows,
+      .num_cols = (int) cols,
+      .first_ms = rp->idx[i].ts
+    };
   }
 
-  return OK;
+  /* the duration, from the records that follow the last keyframe */
+  size_t pos = (rp->num_idx ? (size_t) rp->idx[rp->num_idx - 1].offset : REC_MAGIC_LEN);
+  size_t len;
+  long ts;
+  int type, frame_id;
+  const uchar *payload;
+  while (OK is rec_read (rp, &pos, &type, &frame_id, &ts, &payload, &len))
+    if (ts > rp->info.duration_ms) rp->info.duration_ms = ts;
+
+  return rp;
 }
 
-static void frame_release_log (vwm_frame *this) {
-  if (NULL is this->logfile) return;
+static vwm_replay_info *vwm_replay_info_get (vwm_t *this, vwm_replay *rp) {
+  (void) this;
+  return (NULL is rp ? NULL : &rp->info);
+}
 
-  if (this->remove_log)
-    unlink (this->logfile->bytes);
+static void vwm_replay_close (vwm_t *this, vwm_replay **rpp) {
+  (void) this;
+  if (NULL is *rpp) return;
 
-  string_free (this->logfile);
-  this->logfile = NULL;
+  vwm_replay *rp = *rpp;
+  munmap (rp->map, rp->size);
+  Free (rp->idx);
+  Free (rp->info.frames);
+  Free (rp);
+  *rpp = NULL;
+}
 
-  close (this->logfd);
-  this->logfd = -1;
+static void frame_set_grid_size (vwm_frame *this, int rows, int cols) {
+  if (rows is this->num_rows and cols is this->num_cols) return;
+
+  frame_on_resize (this, rows, cols);
+  this->last_row = rows;
+  this->scroll_first_row = 1;
 }
 
-static void win_release_frame_at (vwm_win *this, int idx) {
-  vwm_frame *frame = self(pop_frame_at, idx);
+static int frame_load_keyframe (vwm_frame *this, const uchar *payload, size_t len) {
+  ulong v[8];
+  size_t p = 0;
 
-  if (NULL is frame) return;
+  for (int i = 0; i < 8; i++)
+    if (NOTOK is rec_get_varint (payload, len, &p, &v[i])) return NOTOK;
 
-  if (frame->is_visible) {
-    this->num_separators--;
-    this->num_visible_frames--;
+  int rows = (int) v[0], cols = (int) v[1];
+  if (0 >= rows or 0 >= cols or v[7] isnot (ulong) rows * cols) return NOTOK;
 
-    vwm_frame *it = this->head;
-    while (it) {
-      if (it->is_visible)
-        if (frame->at_frame < it->at_frame)
-          it->at_frame--;
+  size_t clen;
+  int *cells = (int *) lz_blocks_decompress (payload + p, len - p, &clen);
+  if (NULL is cells) return NOTOK;
 
-      it = it->next;
-    }
+  if (clen isnot sizeof (int) * v[7] * 2) {
+    Free (cells);
+    return NOTOK;
   }
 
-  Vframe.release_log (frame);
+  frame_set_grid_size (this, rows, cols);
 
-  for (int i = 0; i < frame->num_rows; i++)
-    free (frame->videomem[i]);
-  free (frame->videomem);
+  for (int i = 0; i < rows; i++) {
+    memcpy (this->videomem[i], cells + (size_t) i * cols, sizeof (int) * cols);
+    memcpy (this->colors[i], cells + v[7] + (size_t) i * cols, sizeof (int) * cols);
+  }
 
-  for (int i = 0; i < frame->num_rows; i++)
-    free (frame->colors[i]);
-  free (frame->colors);
+  this->row_pos = (int) v[2];
+  this->col_pos = (int) v[3];
+  this->scroll_first_row = (int) v[4];
+  this->last_row = (int) v[5];
+  this->textattr = (uchar) v[6];
+  vt_frame_esc_set (this);
 
-  free (frame->tabstops);
-  free (frame->esc_param);
+  Free (cells);
+  return OK;
+}
 
-  Vframe.release_argv (frame);
-  string_release (frame->render);
+/* parse the output, without rendering it */
+static void frame_feed_output (vwm_frame *this, const uchar *buf, size_t len) {
+  string_clear (this->render);
 
-  ifnot (-1 is frame->pid) {
-    kill (frame->pid, SIGHUP);
-    waitpid (frame->pid, NULL, 0);
-  }
+  int traced = TRACE_ON;
 
-  free (frame);
-}
+  while (len--) {
+    if (traced)
+      vt_process_char_traced (this, this->render, *buf++);
+    else
+      this->process_char_cb (this, this->render, *buf++);
 
-static void vwm_make_separator (string_t *render, char *color, int cells, int row, int col) {
-  vt_goto (render, row, col);
-  string_append (render, color);
-  for (int i = 0; i < cells; i++)
-    string_append_with_len (render, "—", 3);
+    if (this->render->num_bytes > BUFSIZE)
+      string_clear (this->render);
+  }
 
-  vt_attr_reset (render);
+  string_clear (this->render);
 }
 
-static int win_set_separators (vwm_win *this, int draw) {
-  string_clear (this->separators_buf);
+/* reconstructs in frame, the state of the recorded frame at ms */
+static int vwm_replay_seek (vwm_t *this, vwm_replay *rp, vwm_frame *frame, int frame_id, long ms) {
+  (void) this;
+  if (NULL is rp or NULL is frame) return NOTOK;
+
+  /* the last keyframe at or before ms */
+  long lo = 0, hi = rp->num_idx;
+  while (lo < hi) {
+    long mid = lo + (hi - lo) / 2;
+    if (rp->idx[mid].ts <= ms)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
 
-  ifnot (this->num_separators) return NOTOK;
+  long kf = lo - 1;
+  while (kf >= 0 and rp->idx[kf].frame_id isnot frame_id) kf--;
 
-  vwm_frame *prev = this->head;
-  vwm_frame *frame = this->head->next;
-  while (prev->is_visible is 0) {
-    prev = frame;
-    frame = frame->next;
+  if (kf < 0) { /* before its first keyframe, start with that */
+    for (kf = 0; kf < rp->num_idx; kf++)
+      if (rp->idx[kf].frame_id is frame_id) break;
+
+    if (kf is rp->num_idx) return NOTOK;
   }
 
-  int num = 0;
+  size_t pos = rp->idx[kf].offset;
+  size_t len;
+  long ts;
+  int type, id;
+  const uchar *payload;
 
-  while (num < this->num_separators) {
-    ifnot (frame->is_visible) goto next_frame;
+  if (NOTOK is rec_read (rp, &pos, &type, &id, &ts, &payload, &len) or
+      NOTOK is frame_load_keyframe (frame, payload, len))
+    return NOTOK;
 
-    num++;
-    vwm_make_separator (this->separators_buf,
-       (prev is this->current ? COLOR_FOCUS : COLOR_UNFOCUS),
-        frame->num_cols, prev->first_row + prev->last_row, frame->first_col);
+  size_t cur = pos;
+  while (OK is rec_read (rp, &pos, &type, &id, &ts, &payload, &len)) {
+    if (ts > ms) break;
 
-    prev = frame;
-    next_frame: frame = frame->next;
-  }
+    cur = pos;
 
-  if (DRAW is draw)
-    vt_write (this->separators_buf->bytes, stdout);
+    if (id isnot frame_id) continue;
+
+    if (type is REC_OUTPUT)
+      frame_feed_output (frame, payload, len);
+    else if (type is REC_KEYFRAME)
+      frame_load_keyframe (frame, payload, len);
+  }
 
+  rp->pos = cur;
+  rp->frame_id = frame_id;
   return OK;
 }
 
-static vwm_frame *win_set_current_at (vwm_win *this, int idx) {
-  DListSetCurrent (this, idx);
-  return this->current;
-}
+/* the next output of the frame of the last seek */
+static int vwm_replay_next (vwm_t *this, vwm_replay *rp, long *ts, char **buf, int *len) {
+  (void) this;
+  if (NULL is rp or -1 is rp->frame_id) return NOTOK;
 
-static vwm_frame *win_set_frame_as_current (vwm_win *this, vwm_frame *frame) {
-  int idx = DListGetIdx (this, vwm_frame, frame);
-  return win_set_current_at (this, idx);
+  size_t rlen;
+  int type, id;
+  const uchar *payload;
+
+  while (OK is rec_read (rp, &rp->pos, &type, &id, ts, &payload, &rlen)) {
+    if (id isnot rp->frame_id or type isnot REC_OUTPUT) continue;
+
+    *buf = (char *) payload;
+    *len = (int) rlen;
+    return OK;
+  }
+
+  return NOTOK;
 }
 
-static void win_draw (vwm_win *this) {
-  char buf[8];
+/* parses output into the model of the frame, without rendering it */
+static void frame_feed (vwm_frame *this, char *buf, int len) {
+  frame_resize_pending (this);
+  this->batch_ms = vt_clock_ms ();
+  this->stats.bytes_read += len;
+  this->stats.last_activity = this->batch_ms;
+  TRACE_EVENT (VWM_TRACE_READ, this->id, len, 0, 0);
+  frame_feed_output (this, (const uchar *) buf, len);
+}
 
+/* The sequences that repaint the frame on a terminal of its size, from
+ * its model: the rows, the scroll region, the keypad and character sets,
+ * the cursor and the current attributes. The buffer belongs to the frame
+ * and is valid until its next output. */
+static char *frame_repaint (vwm_frame *this, size_t *len) {
   int
-    len = 0,
     oldattr = 0,
-    oldclr = COLOR_FG_NORM,
-    clr = COLOR_FG_NORM;
+    oldclr = COLOR_FG_NORM;
 
   uchar on = NORMAL;
-  utf8 chr = 0;
+
+  frame_resize_pending (this);
 
   string_t *render = this->render;
   string_clear (render);
@@ -3531,391 +6808,467 @@ static void win_draw (vwm_win *this) {
   vt_attr_reset (render);
   vt_setbg (render, COLOR_BG_NORM);
   vt_setfg (render, COLOR_FG_NORM);
-  vwm_frame *frame = this->head;
-  while (frame) {
-    ifnot (frame->is_visible) goto next_frame;
+  vt_goto (render, 1, 1);
 
-    vt_goto (render, frame->first_row, 1);
+  frame_render_rows (this, render, &oldattr, &oldclr, &on);
+  string_clear_at (render, -1);
+  string_clear_at (render, -1);
+  vt_attr_reset (render);
 
-    for (int i = 0; i < frame->num_rows; i++) {
-      for (int j = 0; j < frame->num_cols; j++) {
-        chr = frame->videomem[i][j];
-        clr = frame->colors[i][j];
+  if (this->scroll_first_row isnot 1 or this->last_row isnot this->num_rows)
+    vt_setscroll (render, this->scroll_first_row, this->last_row);
 
-        ifnot (clr is oldclr) {
-          vt_setfg (render, clr);
-          oldclr = clr;
-        }
+  vt_keystate_print (render, this->key_state);
 
-        if (chr & 0xFF) {
-          vt_attr_check (render, chr & 0xFF, oldattr, &on);
-          oldattr = (chr & 0xFF);
+  for (int i = 0; i < NCHARSETS; i++)
+    if (this->charset[i] isnot US_CHARSET)
+      vt_altcharset (render, i, this->charset[i]);
 
-          if (oldattr >= 0x80) {
-            ustring_character (chr, buf, &len);
-            string_append_with_len (render, buf, len);
-          } else
-            string_append_byte (render, chr & 0xFF);
-        } else {
-          oldattr = 0;
+  vt_goto (render, this->row_pos, this->col_pos);
+  vt_frame_attr_set (this, render);
 
-          ifnot (on is NORMAL) {
-            vt_attr_reset (render);
-            on = NORMAL;
-          }
+  *len = render->num_bytes;
+  return render->bytes;
+}
 
-          string_append_byte (render, ' ');
-        }
-      }
+/* writes the screen of the frame as text */
+static int frame_dump (vwm_frame *this, int fd) {
+  char buf[(this->num_cols * 4) + 2];
 
-      string_append (render, "\r\n");
-    }
+  for (int i = 0; i < this->num_rows; i++) {
+    int len = vt_video_line_to_str (this->videomem[i], buf, this->num_cols);
+    if (NOTOK is fd_write (fd, buf, len)) return NOTOK;
+  }
 
-    // clear the last newline, otherwise it scrolls one line more
-    string_clear_at (render, -1); // this is visible when there is one frame
+  return OK;
+}
 
-    /*  un-needed?
-    vt_setscroll (render, frame->scroll_first_row + frame->first_row - 1,
-        frame->last_row + frame->first_row - 1);
-    vt_goto (render, frame->row_pos + frame->first_row - 1, frame->col_pos);
-    */
+/* Search runs on a snapshot: the screen rows are copied and the log size
+ * is recorded on the main thread, then the workers scan those (the logs
+ * with pread(), as the main loop might truncate them while we read), while
+ * the main loop goes on; the last worker wakes it through a pipe.
+ */
 
-    next_frame: frame = frame->next;
+static const char *search_match (const char *line, size_t len, const char *pat, size_t pat_len) {
+  if (pat_len > len) return NULL;
+
+  const char *sp = line;
+  const char *end = line + len - pat_len;
+
+  while (sp <= end) {
+    ifnull (sp = memchr (sp, *pat, end - sp + 1))
+      return NULL;
+
+    if (0 is memcmp (sp, pat, pat_len))
+      return sp;
+
+    sp++;
   }
 
-  self(set.separators, DONOT_DRAW);
-  string_append_with_len (render, this->separators_buf->bytes, this->separators_buf->num_bytes);
+  return NULL;
+}
 
-  frame = this->current;
-  vt_goto (render, frame->row_pos + frame->first_row - 1, frame->col_pos);
+static void search_job_add_hit (search_job *job, const char *line, size_t len,
+                                                       int line_nr, int is_history) {
+  vwm_search_hit *hit;
+
+  if (job->num_hits < job->max_hits)
+    hit = &job->hits[job->num_hits++];
+  else { /* keep the most recent ones */
+    hit = &job->hits[job->hits_idx];
+    job->hits_idx = (job->hits_idx + 1) % job->max_hits;
+    Free (hit->line);
+  }
+
+  while (len and (line[len - 1] is ' ' or line[len - 1] is '\r'))
+    len--;
 
-  vt_write (render->bytes, stdout);
+  if (len > VWM_SEARCH_MAX_LINE_LEN) len = VWM_SEARCH_MAX_LINE_LEN;
+
+  hit->line = Alloc (len + 1);
+  memcpy (hit->line, line, len);
+  hit->line[len] = '\0';
+  hit->line_nr = line_nr;
+  hit->is_history = is_history;
+  hit->win_idx = job->win_idx;
+  hit->frame_idx = job->frame_idx;
 }
 
-static void win_on_resize (vwm_win *this, int draw) {
-  int frow = 1;
-  vwm_frame *frame = this->head;
-  while (frame) {
-    ifnot (frame->is_visible) goto next_frame;
+/* scans the complete lines in buf, returns the number of consumed bytes */
+static size_t search_job_scan (search_ctx *ctx, search_job *job, char *buf, size_t len) {
+  char *sp = buf;
+  char *end = buf + len;
+  char *nl;
 
-    Vframe.on_resize (frame, frame->new_rows, frame->num_cols);
-    frame->num_rows = frame->new_rows;
-    frame->last_row = frame->num_rows;
-    frame->first_row = frow;
-    frow += frame->num_rows + 1;
-    if (frame->argv and frame->pid isnot -1) {
-      struct winsize ws = {.ws_row = frame->num_rows, .ws_col = frame->num_cols};
-      ioctl (frame->fd, TIOCSWINSZ, &ws);
-      kill (frame->pid, SIGWINCH);
-    }
+  while (NULL isnot (nl = memchr (sp, '\n', end - sp))) {
+    job->log_lines++;
+    if (search_match (sp, nl - sp, ctx->pattern, ctx->pattern_len))
+      search_job_add_hit (job, sp, nl - sp, job->log_lines, 1);
 
-    next_frame: frame = frame->next;
+    sp = nl + 1;
   }
 
-  if (draw)
-    self(draw);
+  return sp - buf;
 }
 
-static int win_min_rows (vwm_win *this) {
-  int num_frames = self(get.num_visible_frames);
-  return this->num_rows - num_frames -
-      this->num_separators - (num_frames * 2);
+static void search_job_scan_tail (search_ctx *ctx, search_job *job, char *buf, size_t len) {
+  ifnot (len) return;
+
+  job->log_lines++;
+  if (search_match (buf, len, ctx->pattern, ctx->pattern_len))
+    search_job_add_hit (job, buf, len, job->log_lines, 1);
 }
 
-static void win_frame_increase_size (vwm_win *this, vwm_frame *frame, int param, int draw) {
-  if (this->length is 1)
-    return;
+static void search_job_log (search_ctx *ctx, search_job *job, int fd, off_t size) {
+  char *buf = Alloc (VWM_SEARCH_CHUNK_SIZE);
+  size_t carry = 0;
+  off_t offset = 0;
 
-  int min_rows = win_min_rows (this);
+  while (offset < size) {
+    if (__atomic_load_n (&ctx->is_cancelled, __ATOMIC_RELAXED)) break;
 
-  ifnot (param) param = 1;
-  if (param > min_rows) param = min_rows;
+    size_t len = VWM_SEARCH_CHUNK_SIZE - carry;
+    if ((off_t) len > size - offset)
+      len = size - offset;
 
-  int num_lines;
-  int mod;
-  int num_frames = self(get.num_visible_frames);
+    ssize_t bts = pread (fd, buf + carry, len, offset);
+    if (0 >= bts) {
+      if (-1 is bts and errno is EINTR) continue;
+      break;
+    }
 
-  if (param is 1 or param is num_frames - 1) {
-    num_lines = 1;
-    mod = 0;
-  } else if (param > num_frames - 1) {
-    num_lines = param / (num_frames - 1);
-    mod = param % (num_frames - 1);
-  } else {
-    num_lines = (num_frames - 1) / param;
-    mod = (num_frames - 1) % param;
-  }
+    offset += bts;
 
-  int orig_param = param;
+    size_t n = carry + bts;
+    size_t consumed = search_job_scan (ctx, job, buf, n);
+    carry = n - consumed;
 
-  vwm_frame *fr = this->head;
-  while (fr) {
-    fr->new_rows = fr->num_rows;
-    fr = fr->next;
+    if (carry is VWM_SEARCH_CHUNK_SIZE) { /* an endless line, treat the chunk as one */
+      search_job_scan_tail (ctx, job, buf, carry);
+      carry = 0;
+    } else
+      memmove (buf, buf + consumed, carry);
   }
 
-  fr = this->head;
-  int iter = 1;
-  while (fr and param and iter++ < ((num_frames - 1) * 3)) {
-    if (frame is fr or frame->is_visible is 0)
-      goto next_frame;
+  search_job_scan_tail (ctx, job, buf, carry);
 
-    int num = num_lines;
-    while (fr->new_rows > 2 and num--) {
-      fr->new_rows = fr->new_rows - 1;
-      param--;
-    }
+  Free (buf);
+}
 
-    if (fr->new_rows is 2)
-      goto next_frame;
+static void search_job_logs (search_ctx *ctx, search_job *job) {
+  for (int i = 0; i < job->num_logs; i++) {
+    if (-1 is job->log_fds[i]) continue;
 
-    if (mod) {
-      fr->new_rows--;
-      param--;
-      mod--;
+    ifnot (job->log_compressed[i]) {
+      search_job_log (ctx, job, job->log_fds[i], job->log_sizes[i]);
+      continue;
     }
 
-    next_frame:
-      if (fr->next is NULL)
-        fr = this->head;
-      else
-        fr = fr->next;
-  }
-
-  frame->new_rows = frame->new_rows + (orig_param - param);
+    size_t len;
+    char *buf = lz_decompress_file (job->log_fds[i], &len);
+    if (NULL is buf) continue;
 
-  self(on_resize, draw);
+    size_t consumed = search_job_scan (ctx, job, buf, len);
+    search_job_scan_tail (ctx, job, buf + consumed, len - consumed);
+    Free (buf);
+  }
 }
 
-static void win_frame_decrease_size (vwm_win *this, vwm_frame *frame, int param, int draw) {
-  if (1 is this->length or frame->num_rows <= MIN_ROWS)
-    return;
+static void *search_worker (void *arg) {
+  search_ctx *ctx = (search_ctx *) arg;
+  int idx;
 
-  if (frame->num_rows - param <= 2)
-    param = frame->num_rows - 2;
+  while ((idx = __atomic_fetch_add (&ctx->next_job, 1, __ATOMIC_RELAXED)) < ctx->num_jobs) {
+    if (__atomic_load_n (&ctx->is_cancelled, __ATOMIC_RELAXED)) break;
 
-  if (0 >= param)
-    param = 1;
+    search_job *job = &ctx->jobs[idx];
 
-  int num_lines;
-  int mod;
-  int num_frames = self(get.num_visible_frames);
+    /* history first, so when a job overflows, the screen hits survive */
+    if (job->num_logs)
+      search_job_logs (ctx, job);
 
-  if (param is 1 or param is num_frames - 1) {
-    num_lines = 1;
-    mod = 0;
-  } else if (param > num_frames - 1) {
-    num_lines = param / (num_frames - 1);
-    mod = param % (num_frames - 1);
-  } else {
-    num_lines = (num_frames - 1) / param;
-    mod = (num_frames - 1) % param;
-  }
+    for (int i = 0; i < job->num_rows; i++) {
+      size_t len = bytelen (job->rows[i]);
+      if (search_match (job->rows[i], len, ctx->pattern, ctx->pattern_len))
+        search_job_add_hit (job, job->rows[i], len, i + 1, 0);
+    }
 
-  vwm_frame *fr = this->head;
-  while (fr) {
-    fr->new_rows = fr->num_rows;
-    fr = fr->next;
+    if (__atomic_add_fetch (&ctx->jobs_done, 1, __ATOMIC_ACQ_REL) is ctx->num_jobs)
+      while (-1 is write (ctx->notify[1], "\n", 1) and errno is EINTR);
   }
 
-  int orig_param = param;
+  return NULL;
+}
 
-  fr = this->head;
-  int iter = 1;
-  while (fr and param and iter++ < ((this->length - 1) * 3)) {
-    if (frame is fr or frame->is_visible is 0)
-      goto next_frame;
+static int search_hit_cmp (const void *a, const void *b) {
+  const vwm_search_hit *ha = (const vwm_search_hit *) a;
+  const vwm_search_hit *hb = (const vwm_search_hit *) b;
 
-    fr->new_rows = fr->num_rows + num_lines;
+  if (ha->is_history isnot hb->is_history)
+    return ha->is_history - hb->is_history;
 
-    param -= num_lines;
+  if (ha->age isnot hb->age)
+    return ha->age - hb->age;
 
-    if (mod) {
-      fr->new_rows++;
-      param--;
-      mod--;
-    }
+  if (ha->win_idx isnot hb->win_idx)
+    return ha->win_idx - hb->win_idx;
 
-  next_frame:
-    if (fr->next is NULL)
-      fr = this->head;
-    else
-      fr = fr->next;
-  }
+  return ha->frame_idx - hb->frame_idx;
+}
 
-  frame->new_rows = frame->new_rows - (orig_param - param);
+static void vwm_search_release (vwm_t *this, vwm_search_result **resp) {
+  (void) this;
+  if (NULL is *resp) return;
 
-  self(on_resize, draw);
-}
+  vwm_search_result *res = *resp;
 
-static void win_frame_set_size (vwm_win *this, vwm_frame *frame, int param, int draw) {
-  if (param is frame->num_rows or 0 >= param)
-    return;
+  for (int i = 0; i < res->num_hits; i++) {
+    Free (res->hits[i].line);
+    Free (res->hits[i].win_name);
+  }
 
-  if (param > frame->num_rows)
-    win_frame_increase_size (this, frame, param - frame->num_rows, draw);
-  else
-    win_frame_decrease_size (this, frame, frame->num_rows - param, draw);
+  Free (res->hits);
+  Free (res->pattern);
+  Free (res);
+  *resp = NULL;
 }
 
-static vwm_frame *win_frame_change (vwm_win *this, vwm_frame *frame, int dir, int draw) {
-  int num_frames = self(get.num_visible_frames);
-  if ((NULL is frame->next and NULL is frame->prev) or 1 is num_frames)
-    return frame;
+/* joins the workers and collects their hits; the ctx is gone after it */
+static vwm_search_result *search_finish (vwm_t *this) {
+  search_ctx *ctx = $my(search);
+  $my(search) = NULL;
 
-  int idx = -1;
+  for (int i = 0; i < ctx->num_threads; i++)
+    pthread_join (ctx->threads[i], NULL);
 
-  vwm_frame *lframe = frame;
+  if (-1 isnot ctx->notify[0]) {
+    close (ctx->notify[0]);
+    close (ctx->notify[1]);
+  }
 
-again:
-  if (dir is DOWN_POS) {
-    if (NULL is lframe->next) {
-      idx = 0;
-      while (lframe) {
-        if (lframe->is_visible) break;
-        idx++;
-        lframe = lframe->next;
-      }
-    } else {
-      if (lframe->next->is_visible) {
-        idx = self(get.frame_idx, lframe->next);
-      } else {
-        lframe = lframe->next;
-        goto again;
-      }
-    }
-  } else {
-    if (NULL is lframe->prev) {
-      idx = this->length - 1;
-      while (lframe) {
-        if (lframe->is_visible) break;
-        idx--;
-        lframe = lframe->prev;
-      }
-    } else {
-      if (lframe->prev->is_visible) {
-        idx = self(get.frame_idx, lframe->prev);
-      } else {
-        lframe = lframe->prev;
-        goto again;
-      }
+  vwm_search_result *res = Alloc (sizeof (vwm_search_result));
+  res->pattern = ctx->pattern;
+  res->num_frames = ctx->num_jobs;
+  res->num_threads = (ctx->num_threads ? ctx->num_threads : 1);
+
+  int num_hits = 0;
+  for (int i = 0; i < ctx->num_jobs; i++)
+    num_hits += ctx->jobs[i].num_hits;
+
+  res->hits = Alloc (sizeof (vwm_search_hit) * (num_hits ? num_hits : 1));
+
+  int idx = 0;
+  for (int i = 0; i < ctx->num_jobs; i++) {
+    search_job *job = &ctx->jobs[i];
+
+    for (int j = 0; j < job->num_hits; j++) {
+      vwm_search_hit *hit = &res->hits[idx++];
+      *hit = job->hits[j];
+      /* distance in lines from the bottom of the frame's output */
+      hit->age = (hit->is_history ?
+          job->num_rows + job->log_lines - hit->line_nr :
+          job->num_rows - hit->line_nr);
+
+      size_t len = bytelen (job->win_name);
+      hit->win_name = Alloc (len + 1);
+      memcpy (hit->win_name, job->win_name, len + 1);
     }
+
+    for (int j = 0; j < job->num_rows; j++)
+      Free (job->rows[j]);
+
+    for (int j = 0; j < job->num_logs; j++)
+      if (-1 isnot job->log_fds[j])
+        close (job->log_fds[j]);
+
+    Free (job->rows);
+    Free (job->hits);
+    Free (job->win_name);
+    Free (job->log_fds);
+    Free (job->log_sizes);
+    Free (job->log_compressed);
   }
 
-  this->last_frame = frame;
+  qsort (res->hits, num_hits, sizeof (vwm_search_hit), search_hit_cmp);
 
-  self(set.current_at, idx);
+  for (int i = ctx->max_hits; i < num_hits; i++) {
+    Free (res->hits[i].line);
+    Free (res->hits[i].win_name);
+  }
 
-  if (OK is self(set.separators, draw))
-    if (draw is DONOT_DRAW)
-      this->draw_separators = 1;
+  res->num_hits = (num_hits > ctx->max_hits ? ctx->max_hits : num_hits);
 
-  return this->current;
+  struct timespec ts_end;
+  clock_gettime (CLOCK_MONOTONIC, &ts_end);
+  res->elapsed_usec = (ts_end.tv_sec - ctx->ts_beg.tv_sec) * 1000000L +
+      (ts_end.tv_nsec - ctx->ts_beg.tv_nsec) / 1000;
+
+  Free (ctx->jobs);
+  Free (ctx);
+  return res;
 }
 
-static void vwm_change_win (vwm_t *this, vwm_win *win, int dir, int draw) {
-  if ($my(length) is 1)
+/* the result goes to the search callback, that owns it from then on */
+static void search_done (vwm_t *this) {
+  vwm_search_result *res = search_finish (this);
+
+  if (NULL is $my(search_cb)) {
+    vwm_search_release (this, &res);
     return;
+  }
 
-  int idx = -1;
-  switch (dir) {
-    case LAST_POS:
-      if ($my(last_win) is win)
-        return;
+  $my(search_cb) (this, res, $my(objects)[VWMED_OBJECT]);
+}
 
-      idx = self(get.win_idx, $my(last_win));
-      break;
+static void vwm_search_cancel (vwm_t *this) {
+  if (NULL is $my(search)) return;
 
-    case NEXT_POS:
-      ifnot (NULL is win->next)
-        idx = self(get.win_idx, win->next);
-      else
-        idx = 0;
-      break;
+  __atomic_store_n (&$my(search)->is_cancelled, 1, __ATOMIC_RELAXED);
 
-    case PREV_POS:
-      ifnot (NULL is win->prev)
-        idx = self(get.win_idx, win->prev);
-      else
-        idx = $my(length) - 1;
-      break;
+  vwm_search_result *res = search_finish (this);
+  vwm_search_release (this, &res);
+}
 
-    default:
-      idx = dir;
-      if (idx >= $my(length) or idx < 0) return;
-      break;
+/* Starts a search and returns without waiting for it; the main loop
+ * watches for its end (see vwm_prepare()), and hands the result to the
+ * search callback. A search that is still running, is cancelled. */
+static int vwm_search_run (vwm_t *this, char *pattern, int max_hits) {
+  if (NULL is pattern or '\0' is *pattern) return NOTOK;
+
+  vwm_search_cancel (this);
+
+  if (0 >= max_hits) max_hits = VWM_SEARCH_MAX_HITS;
+
+  int num_jobs = 0;
+  vwm_win *win = $my(head);
+  while (win) {
+    num_jobs += win->length;
+    win = win->next;
   }
 
-  $my(last_win) = win;
+  ifnot (num_jobs) return NOTOK;
 
-  win = self(set.current_at, idx);
+  search_ctx *ctx = Alloc (sizeof (search_ctx));
+  clock_gettime (CLOCK_MONOTONIC, &ctx->ts_beg);
 
-  Vterm.screen.clear ($my(term));
+  ctx->pattern_len = bytelen (pattern);
+  ctx->pattern = Alloc (ctx->pattern_len + 1);
+  memcpy (ctx->pattern, pattern, ctx->pattern_len + 1);
+  ctx->max_hits = max_hits;
+  ctx->num_jobs = num_jobs;
+  ctx->jobs = Alloc (sizeof (search_job) * num_jobs);
 
-  ifnot (win->is_initialized) {
+  int idx = 0;
+  int widx = 0;
+  win = $my(head);
+  while (win) {
+    /* the name is taken now, as the window might be gone at the end */
+    size_t name_len = bytelen (win->name);
+
+    int fidx = 0;
     vwm_frame *frame = win->head;
     while (frame) {
-      if (frame->argv is NULL)
-        Vframe.set.command (frame, $my(default_app)->bytes);
+      search_job *job = &ctx->jobs[idx++];
+      job->win_idx = widx;
+      job->frame_idx = fidx++;
+      job->win_name = Alloc (name_len + 1);
+      memcpy (job->win_name, win->name, name_len + 1);
+      job->max_hits = max_hits;
+      job->hits = Alloc (sizeof (vwm_search_hit) * max_hits);
+      job->num_rows = frame->num_rows;
+      job->rows = Alloc (sizeof (char *) * frame->num_rows);
+
+      for (int i = 0; i < frame->num_rows; i++) {
+        char buf[(frame->num_cols * 4) + 2];
+        int len = vt_video_line_to_str (frame->videomem[i], buf, frame->num_cols);
+        buf[len - 1] = '\0';
+        job->rows[i] = Alloc ((size_t) len);
+        memcpy (job->rows[i], buf, len);
+      }
 
-      Vframe.fork (frame);
+      /* the logs are opened here, so a rotation or a trim that happens
+       * while the workers run, can not pull them out from under us */
+      if (NULL isnot frame->logfile and -1 isnot frame->logfd) {
+        int num = 1;
+        for (log_segment *seg = frame->log_segments; seg; seg = seg->next)
+          num++;
+
+        job->log_fds = Alloc (sizeof (int) * num);
+        job->log_sizes = Alloc (sizeof (off_t) * num);
+        job->log_compressed = Alloc (sizeof (int) * num);
+
+        struct stat st;
+        for (log_segment *seg = frame->log_segments; seg; seg = seg->next) {
+          int n = job->num_logs++;
+          job->log_fds[n] = log_segment_open (seg, &job->log_compressed[n]);
+          job->log_sizes[n] = (-1 isnot job->log_fds[n] and
+              0 is fstat (job->log_fds[n], &st) ? st.st_size : 0);
+        }
+
+        int n = job->num_logs++;
+        job->log_fds[n] = open (frame->logfile->bytes, O_RDONLY|O_CLOEXEC);
+        job->log_sizes[n] = frame->log_size;
+        job->log_compressed[n] = 0;
+      }
 
       frame = frame->next;
     }
-  }
-
-  if (draw) {
-    if (win->is_initialized)
-      Vwin.draw (win);
-    else
-      Vwin.set.separators (win, DRAW);
-  } else
-    Vwin.set.separators (win, DONOT_DRAW);
 
-  win->is_initialized = 1;
-}
+    win = win->next;
+    widx++;
+  }
 
-static int vwm_default_edit_file_cb (vwm_t *this, vwm_frame *frame, char *file, void *object) {
-  (void) object; (void) frame;
+  $my(search) = ctx;
 
-  size_t len = $my(editor)->num_bytes + bytelen (file);
-  char command[len + 2];
-  snprintf (command, len + 2, "%s %s", $my(editor)->bytes, file);
-  int argc = 0;
-  char **argv = parse_command (command, &argc);
-  int retval = self(spawn, argv);
-  argv_release (argv, &argc);
-  return retval;
-}
+  if (-1 is pipe (ctx->notify)) {
+    ctx->notify[0] = ctx->notify[1] = -1;
+    search_worker (ctx); /* nothing to wait on, do it in place */
+    search_done (this);
+    return OK;
+  }
 
-static void frame_reopen_log (vwm_frame *this) {
-  if (this->logfile is NULL or 0 is this->logfile->num_bytes)
-    return;
+  long ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+  int num_threads = (0 >= ncpu ? 1 : (int) ncpu);
+  if (num_threads > num_jobs) num_threads = num_jobs;
+  if (num_threads > VWM_SEARCH_MAX_THREADS) num_threads = VWM_SEARCH_MAX_THREADS;
 
-  if (-1 isnot this->logfd) close (this->logfd);
+  for (; ctx->num_threads < num_threads; ctx->num_threads++)
+    if (0 isnot pthread_create (&ctx->threads[ctx->num_threads], NULL, search_worker, ctx))
+      break;
 
-  this->logfd = open (this->logfile->bytes, O_RDWR|O_CREAT, S_IRUSR|S_IWUSR);
+  /* no threads, do it in place; the end is still taken by the main loop */
+  ifnot (ctx->num_threads)
+    search_worker (ctx);
+
+  return OK;
 }
 
-static int frame_edit_log (vwm_frame *frame) {
-  if (frame->logfile is NULL)
+static int vwm_search_jump (vwm_t *this, vwm_search_result *res, int idx) {
+  if (NULL is res or idx < 0 or idx >= res->num_hits)
     return NOTOK;
 
-  vwm_win *win = frame->parent;
-  vwm_t *this = win->parent;
+  vwm_search_hit *hit = &res->hits[idx];
 
-  int len;
+  /* the layout might have been changed since the search */
+  vwm_win *win = self(get.win_at, hit->win_idx);
+  if (NULL is win or 0 is cstring_eq (win->name, hit->win_name))
+    return NOTOK;
 
-  for (int i = 0; i < frame->num_rows; i++) {
-    char buf[(frame->num_cols * 3) + 2];
-    len = vt_video_line_to_str (frame->videomem[i], buf, frame->num_cols);
-    write (frame->logfd, buf, len);
+  vwm_frame *frame = Vwin.get.frame_at (win, hit->frame_idx);
+  if (NULL is frame) return NOTOK;
+
+  if (win isnot $my(current))
+    self(change_win, $my(current), hit->win_idx, DRAW);
+
+  if (frame->is_visible and frame isnot win->current) {
+    win->last_frame = win->current;
+    Vwin.set.frame_as_current (win, frame);
+    Vwin.set.separators (win, DRAW);
   }
 
-  $my(edit_file_cb) (this, frame, frame->logfile->bytes, $my(objects)[VWMED_OBJECT]);
+  if (hit->is_history)
+    return Vframe.edit_log (frame);
 
-  vt_video_add_log_lines (frame);
-  Vwin.draw (win);
   return OK;
 }
 
@@ -4079,8 +7432,8 @@ static void vwm_release_win (vwm_t *this, vwm_win *win) {
     }
   }
 
-  free (w->name);
-  free (w);
+  Free (w->name);
+  Free (w);
 }
 
 static int vwm_spawn (vwm_t *this, char **argv) {
@@ -4152,7 +7505,8 @@ static pid_t frame_fork (vwm_frame *frame) {
 
   vwm_t *this = frame->parent->parent;
 
-  signal (SIGWINCH, SIG_IGN);
+  ifnot ($my(term)->headless)
+    signal (SIGWINCH, SIG_IGN);
 
   frame->pid = -1;
 
@@ -4244,14 +7598,24 @@ theerror:
   ifnot (-1 is fd) close (fd);
 
 theend:
-  signal (SIGWINCH, vwm_sigwinch_handler);
+  ifnot ($my(term)->headless)
+    signal (SIGWINCH, vwm_sigwinch_handler);
   return frame->pid;
 }
 
+static int vwm_handle_signal (vwm_t *, int);
+
 static void vwm_sigwinch_handler (int sig) {
   signal (sig, vwm_sigwinch_handler);
-  vwm_t *this = VWM;
-  $my(need_resize) = 1;
+  vwm_handle_signal (VWM, sig);
+}
+
+/* Under vtach, SIGUSR1 says that no client is attached, and SIGUSR2 that
+ * one is again. Meanwhile the output is parsed, but not drawn, and once
+ * there is somebody to see it, the window is drawn in full. */
+static void vwm_sigrender_handler (int sig) {
+  signal (sig, vwm_sigrender_handler);
+  vwm_handle_signal (VWM, sig);
 }
 
 static void vwm_handle_sigwinch (vwm_t *this) {
@@ -4275,14 +7639,18 @@ static void vwm_handle_sigwinch (vwm_t *this) {
 
     vwm_frame *frame = win->head;
     while (frame) {
-      Vframe.on_resize (frame, num_rows, win->num_cols);
-
       frame->first_row = first_row;
-      frame->num_rows = num_rows;
-      frame->last_row = frame->num_rows;
+
+      if (win is $my(current)) {
+        Vframe.on_resize (frame, num_rows, win->num_cols);
+        frame->last_row = frame->num_rows;
+      } else {
+        frame->pending_rows = num_rows;
+        frame->pending_cols = win->num_cols;
+      }
 
       if (frame->argv and frame->pid isnot -1) {
-        struct winsize ws = {.ws_row = frame->num_rows, .ws_col = frame->num_cols};
+        struct winsize ws = {.ws_row = num_rows, .ws_col = win->num_cols};
         ioctl (frame->fd, TIOCSWINSZ, &ws);
         kill (frame->pid, SIGWINCH);
       }
@@ -4303,13 +7671,264 @@ static void vwm_handle_sigwinch (vwm_t *this) {
   $my(need_resize) = 0;
 }
 
+/* takes at once, what has gathered on the frame */
+static void frame_drain_output (vwm_frame *frame, char *buf) {
+  struct timeval tv = {.tv_sec = 0, .tv_usec = 0};
+  fd_set read_mask;
+  int len;
+
+  do {
+    FD_ZERO (&read_mask);
+    FD_SET (frame->fd, &read_mask);
+    if (1 isnot select (frame->fd + 1, &read_mask, NULL, NULL, &tv))
+      return;
+
+    if (0 >= (len = read (frame->fd, buf, BUFSIZE)))
+      return;
+
+    frame_process_output (frame, buf, len);
+  } while (len is BUFSIZE);
+}
+
+/* Input that is sent to a frame, rather than typed (see Vtach.sock.send_input()),
+ * comes on the standard input as:
+ *
+ *   MODE_KEY ESC _ vwm-send;window;frame;length ESC \ data
+ *
+ * The window is an index or a name, and the frame an index or the name of its
+ * command; an empty field is the current one. The data is written to the frame
+ * as the frame can take it, and the standard input isn't read meanwhile, which
+ * is what holds the sender back. The data for a frame that doesn't exist, is
+ * read and discarded. */
+
+#define SEND_HEADER      "vwm-send;"
+#define SEND_HEADER_LEN  9
+#define SEND_MAX_HEADER  256
+
+static void vwm_ungetbyte (vwm_t *this, char c) {
+  if ($my(num_unread) < (int) sizeof ($my(unread)))
+    $my(unread)[$my(num_unread)++] = c;
+}
+
+static int cstring_is_index (const char *s) {
+  ifnot (*s) return 0;
+  while (*s)
+    if (*s < '0' or *s++ > '9') return 0;
+  return 1;
+}
+
+static vwm_win *vwm_send_win (vwm_t *this, const char *name) {
+  ifnot (*name) return $my(current);
+
+  if (cstring_is_index (name))
+    return vwm_get_win_at (this, atoi (name));
+
+  vwm_win *win = $my(head);
+  while (win) {
+    if (cstring_eq (win->name, name)) return win;
+    win = win->next;
+  }
+
+  return NULL;
+}
+
+static vwm_frame *vwm_send_frame (vwm_win *win, const char *name) {
+  if (NULL is win) return NULL;
+
+  ifnot (*name) return win->current;
+
+  if (cstring_is_index (name))
+    return win_get_frame_at (win, atoi (name));
+
+  vwm_frame *frame = win->head;
+  while (frame) {
+    if (frame->argv and frame->argv[0]) {
+      char *sp = strrchr (frame->argv[0], '/');
+      if (cstring_eq ((sp ? sp + 1 : frame->argv[0]), name))
+        return frame;
+    }
+
+    frame = frame->next;
+  }
+
+  return NULL;
+}
+
+/* after the mode key, returns 1 when what follows is input to send */
+static int vwm_input_send (vwm_t *this) {
+  char c;
+  if (0 >= vwm_getbyte (this, STDIN_FILENO, &c)) return 0;
+
+  if (c isnot ESCAPE_KEY) {
+    vwm_ungetbyte (this, c);
+    return 0;
+  }
+
+  if (0 >= vwm_getbyte (this, STDIN_FILENO, &c)) {
+    vwm_ungetbyte (this, ESCAPE_KEY);
+    return 0;
+  }
+
+  if (c isnot '_') {
+    vwm_ungetbyte (this, c);
+    vwm_ungetbyte (this, ESCAPE_KEY);
+    return 0;
+  }
+
+  char hdr[SEND_MAX_HEADER];
+  int len = 0;
+
+  /* anything else than the header, was typed, and it is put back */
+  while (len < SEND_HEADER_LEN) {
+    int n = vwm_getbyte (this, STDIN_FILENO, &c);
+    if (0 >= n or c isnot SEND_HEADER[len]) {
+      if (0 < n) vwm_ungetbyte (this, c);
+      while (len) vwm_ungetbyte (this, hdr[--len]);
+      vwm_ungetbyte (this, '_');
+      vwm_ungetbyte (this, ESCAPE_KEY);
+      return 0;
+    }
+
+    hdr[len++] = c;
+  }
+
+  while (1) {
+    if (0 >= vwm_getbyte (this, STDIN_FILENO, &c)) return 1;
+
+    if (c is ESCAPE_KEY) {
+      if (0 >= vwm_getbyte (this, STDIN_FILENO, &c)) return 1;
+      if (c is '\\') break;
+    }
+
+    if (len is SEND_MAX_HEADER - 1) return 1;
+    hdr[len++] = c;
+  }
+
+  hdr[len] = '\0';
+
+  if (strncmp (hdr, SEND_HEADER, SEND_HEADER_LEN)) return 1;
+
+  char *win = hdr + SEND_HEADER_LEN;
+  char *frame = strchr (win, ';');
+  if (NULL is frame) return 1;
+  *frame++ = '\0';
+
+  char *sp = strchr (frame, ';');
+  if (NULL is sp) return 1;
+  *sp++ = '\0';
+
+  $my(send_frame) = vwm_send_frame (vwm_send_win (this, win), frame);
+  $my(send_left) = strtoul (sp, NULL, 10);
+  $my(send_len) = $my(send_off) = 0;
+
+  if ($my(send_frame) and $my(send_frame)->fd is -1)
+    $my(send_frame) = NULL;
+
+  return 1;
+}
+
+/* writes what the frame can take now */
+static void vwm_send_write (vwm_t *this) {
+  vwm_frame *frame = $my(send_frame);
+
+  if (NULL is frame) {
+    $my(send_len) = $my(send_off) = 0;
+    return;
+  }
+
+  int flags = fcntl (frame->fd, F_GETFL);
+  fcntl (frame->fd, F_SETFL, flags | O_NONBLOCK);
+
+  ssize_t n = write (frame->fd, $my(send_buf) + $my(send_off),
+      $my(send_len) - $my(send_off));
+
+  fcntl (frame->fd, F_SETFL, flags);
+
+  if (0 > n) {
+    if (errno is EAGAIN or errno is EINTR) return;
+    $my(send_frame) = NULL;
+    $my(send_len) = $my(send_off) = 0;
+    return;
+  }
+
+  TRACE_EVENT (VWM_TRACE_WRITE, frame->id, n, 0, 0);
+
+  $my(send_off) += n;
+  if ($my(send_off) is $my(send_len))
+    $my(send_len) = $my(send_off) = 0;
+}
+
+static void vwm_send_read (vwm_t *this) {
+  size_t len = ($my(send_left) < BUFSIZE ? $my(send_left) : BUFSIZE);
+
+  ssize_t n = read (STDIN_FILENO, $my(send_buf), len);
+  if (0 >= n) {
+    if (0 > n and (errno is EAGAIN or errno is EINTR)) return;
+    $my(send_left) = 0;
+    return;
+  }
+
+  $my(send_left) -= n;
+
+  if (NULL is $my(send_frame)) return;
+
+  $my(send_len) = n;
+  $my(send_off) = 0;
+  vwm_send_write (this);
+}
+
 static void vwm_exit_signal (int sig) {
+  /* the accounting takes a lock, that might be held */
+  AllocAccount = NULL;
+
+  /* the trace is written first, as the rest might crash again */
+  if ((sig is SIGSEGV or sig is SIGBUS) and TRACE_ON and NULL isnot VWM and
+      NULL isnot VWM->prop->sequences_fname) {
+    int fd = open (VWM->prop->sequences_fname->bytes, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR|S_IWUSR);
+    if (-1 isnot fd) {
+      trace_write (fd);
+      close (fd);
+      TRACE_DUMPED = 1;
+    }
+  }
+
   __deinit_vwm__ (&VWM);
   exit (sig);
 }
 
-static int vwm_main (vwm_t *this) {
-  ifnot ($my(length)) return OK;
+_Static_assert (sizeof (vwm_pollfd) is sizeof (struct pollfd) and
+    offsetof (vwm_pollfd, revents) is offsetof (struct pollfd, revents) and
+    VWM_POLLIN is POLLIN and VWM_POLLOUT is POLLOUT and VWM_POLLERR is POLLERR and
+    VWM_POLLHUP is POLLHUP and VWM_POLLNVAL is POLLNVAL,
+    "a vwm_pollfd is a struct pollfd");
+
+static void vwm_poll_add (vwm_t *this, int fd, short events) {
+  vwm_poll *p = &$my(poll_set);
+
+  if (p->num_fds is $my(poll_size)) {
+    $my(poll_size) += 8;
+    p->fds = Realloc (p->fds, sizeof (vwm_pollfd) * $my(poll_size));
+  }
+
+  p->fds[p->num_fds++] = (vwm_pollfd) {.fd = fd, .events = events, .revents = 0};
+}
+
+/* an error or a hangup is ready too, as select() says */
+static int vwm_poll_ready (vwm_t *this, int fd, short events) {
+  vwm_poll *p = &$my(poll_set);
+
+  for (int i = 0; i < p->num_fds; i++)
+    if (p->fds[i].fd is fd and (p->fds[i].events & events))
+      return (p->fds[i].revents & (events|VWM_POLLERR|VWM_POLLHUP|VWM_POLLNVAL));
+
+  return 0;
+}
+
+static void vwm_start (vwm_t *this) {
+  if ($my(is_started)) return;
+  ifnot ($my(length)) return;
+
+  $my(is_started) = 1;
 
   if (NULL is $my(current)) {
     $my(current) = $my(head);
@@ -4325,27 +7944,6 @@ static int vwm_main (vwm_t *this) {
 
   setbuf (stdin, NULL);
 
-  signal (SIGHUP,   vwm_exit_signal);
-  signal (SIGINT,   vwm_exit_signal);
-  signal (SIGQUIT,  vwm_exit_signal);
-  signal (SIGTERM,  vwm_exit_signal);
-  signal (SIGSEGV,  vwm_exit_signal);
-  signal (SIGBUS,   vwm_exit_signal);
-  signal (SIGWINCH, vwm_sigwinch_handler);
-
-  fd_set read_mask;
-  struct timeval *tv = NULL;
-
-  char
-    input_buf[MAX_CHAR_LEN],
-    output_buf[BUFSIZE];
-
-  int
-    maxfd,
-    numready,
-    output_len,
-    retval = NOTOK;
-
   vwm_win *win = $my(current);
 
   Vwin.set.separators (win, DRAW);
@@ -4361,20 +7959,27 @@ static int vwm_main (vwm_t *this) {
   }
 
   win->is_initialized = 1;
+}
 
-#define forever for (;;)
+/* a turn of vwm_main() up to the wait (see vwm_poll in libvwm.h); the
+ * struct belongs to the vwm, and it is valid until the next call */
+static vwm_poll *vwm_prepare (vwm_t *this) {
+  vwm_start (this);
 
-  forever {
+  vwm_poll *p = &$my(poll_set);
+  p->num_fds = 0;
+  p->timeout = -1;
+
+  vwm_win *win;
+  vwm_frame *frame;
+
+  for (;;) {
     win = $my(current);
-    if (NULL is win) {
-      retval = OK;
-      break;
-    }
+    if (NULL is win) return NULL;
 
     check_length:
 
     ifnot (Vwin.get.num_visible_frames (win)) { // at_no_length_cb
-      retval = OK;
       if (1 isnot $my(length))
         self(change_win, win, PREV_POS, DRAW);
 
@@ -4385,12 +7990,19 @@ static int vwm_main (vwm_t *this) {
     if ($my(need_resize))
       vwm_handle_sigwinch (this);
 
+    if ($my(need_draw)) {
+      $my(need_draw) = 0;
+      Vwin.draw (win);
+    }
+
     Vwin.set.frame (win, win->current);
 
-    maxfd = 1;
+    p->num_fds = 0;
 
-    FD_ZERO (&read_mask);
-    FD_SET (STDIN_FILENO, &read_mask);
+    if ($my(send_len))
+      vwm_poll_add (this, $my(send_frame)->fd, VWM_POLLOUT);
+    else ifnot ($my(term)->headless)
+      vwm_poll_add (this, STDIN_FILENO, VWM_POLLIN);
 
     frame = win->head;
     int num_frames = 0;
@@ -4407,11 +8019,8 @@ static int vwm_main (vwm_t *this) {
       }
 
       if (frame->fd isnot -1) {
-        FD_SET (frame->fd, &read_mask);
+        vwm_poll_add (this, frame->fd, VWM_POLLIN);
         num_frames++;
-
-        if (maxfd <= frame->fd)
-          maxfd = frame->fd + 1;
       }
 
 frame_next:
@@ -4420,71 +8029,187 @@ frame_next:
 
     ifnot (num_frames) goto check_length;
 
-    if (0 >= (numready = select (maxfd, &read_mask, NULL, NULL, tv))) {
-      switch (errno) {
-        case EIO:
-        case EINTR:
-        default:
-          break;
-      }
+    break;
+  }
 
-      continue;
+  /* the output of a hidden frame that is sent to, is taken too, as
+   * otherwise its echo would fill the pty and stop the input */
+  vwm_frame *hidden = $my(send_frame);
+  if (hidden and (hidden->parent isnot win or 0 is hidden->is_visible))
+    vwm_poll_add (this, hidden->fd, VWM_POLLIN);
+
+  if ($my(search))
+    vwm_poll_add (this, $my(search)->notify[0], VWM_POLLIN);
+
+  if ($my(metrics) and -1 isnot $my(metrics_wake))
+    vwm_poll_add (this, $my(metrics_wake), VWM_POLLIN);
+
+  /* the metrics are published when they are asked for; a request that
+   * came too soon after the last one, is answered when its time comes */
+  p->timeout = vwm_publish_metrics (this);
+
+  return p;
+}
+
+/* What is ready, after vwm_prepare(); it does not wait, but for the keys
+ * that follow the mode key. It returns VWM_QUIT when the input says so,
+ * VWM_DONE when there is nothing left to run, otherwise OK. */
+static int vwm_dispatch (vwm_t *this) {
+  vwm_win *win = $my(current);
+  if (NULL is win) return VWM_DONE;
+
+  char
+    input_buf[MAX_CHAR_LEN],
+    output_buf[BUFSIZE];
+
+  int output_len;
+
+  if ($my(send_len) and vwm_poll_ready (this, $my(send_frame)->fd, VWM_POLLOUT))
+    vwm_send_write (this);
+
+  vwm_frame *hidden = $my(send_frame);
+  if (hidden and (hidden->parent isnot win or 0 is hidden->is_visible) and
+      vwm_poll_ready (this, hidden->fd, VWM_POLLIN)) {
+    if (0 < (output_len = read (hidden->fd, output_buf, BUFSIZE)))
+      frame_feed (hidden, output_buf, output_len);
+    else if (0 is output_len or errno isnot EINTR) {
+      /* it has gone; the rest of the input is discarded */
+      $my(send_frame) = NULL;
+      $my(send_len) = $my(send_off) = 0;
     }
+  }
+
+  /* the request itself is taken by vwm_prepare(), on the next turn */
+  if ($my(metrics) and -1 isnot $my(metrics_wake) and
+      vwm_poll_ready (this, $my(metrics_wake), VWM_POLLIN)) {
+    uint64_t val;
+    if (0 is read ($my(metrics_wake), &val, sizeof (val)))
+      $my(metrics_wake) = -1; /* a pipe whose writer has gone */
+  }
 
-    frame = win->current;
+  /* the callback might change the layout, the rest waits for the next turn */
+  if ($my(search) and vwm_poll_ready (this, $my(search)->notify[0], VWM_POLLIN)) {
+    search_done (this);
+    return OK;
+  }
 
-    for (int i = 0; i < MAX_CHAR_LEN; i++) input_buf[i] = '\0';
+  vwm_frame *frame = win->current;
 
-    if (FD_ISSET (STDIN_FILENO, &read_mask)) {
-      if (0 < fd_read (STDIN_FILENO, input_buf, 1)) {
-        if (VWM_QUIT is self(process_input, win, frame, input_buf)) {
-          retval = OK;
-          break;
-        }
-      }
+  for (int i = 0; i < MAX_CHAR_LEN; i++) input_buf[i] = '\0';
+
+  if (0 is $my(term)->headless and vwm_poll_ready (this, STDIN_FILENO, VWM_POLLIN)) {
+    if ($my(send_left))
+      vwm_send_read (this);
+    else if (0 < fd_read (STDIN_FILENO, input_buf, 1)) {
+      if (VWM_QUIT is self(process_input, win, frame, input_buf))
+        return VWM_QUIT;
     }
+  }
 
-    win = $my(current);
+  win = $my(current);
+  if (NULL is win) return VWM_DONE;
 
-    frame = win->head;
-    while (frame) {
-      if (frame->fd is -1 or 0 is frame->is_visible)
-        goto next_frame;
-
-      if (FD_ISSET (frame->fd, &read_mask)) {
-        output_buf[0] = '\0';
-        if (0 > (output_len = read (frame->fd, output_buf, BUFSIZE))) {
-          switch (errno) {
-            case EIO:
-            default:
-              if (-1 isnot frame->pid) {
-                if (0 is Vframe.check_pid (frame)) {
-                  Vwin.delete_frame (win, frame, DRAW);
-                  goto check_length;
-                }
+  frame = win->head;
+  while (frame) {
+    if (frame->fd is -1 or 0 is frame->is_visible)
+      goto next_frame;
+
+    if (vwm_poll_ready (this, frame->fd, VWM_POLLIN)) {
+      output_buf[0] = '\0';
+      if (0 > (output_len = read (frame->fd, output_buf, BUFSIZE))) {
+        switch (errno) {
+          case EIO:
+          default:
+            if (-1 isnot frame->pid) {
+              if (0 is Vframe.check_pid (frame)) {
+                Vwin.delete_frame (win, frame, DRAW);
+                return OK;
               }
+            }
 
-              goto next_frame;
-          }
+            goto next_frame;
         }
+      }
 
-        output_buf[output_len] = '\0';
+      output_buf[output_len] = '\0';
 
-        Vwin.set.frame (win, frame);
+      Vwin.set.frame (win, frame);
 
-        frame->process_output_cb (frame, output_buf, output_len);
-      }
+      frame_process_output (frame, output_buf, output_len);
 
-      next_frame:
-        frame = frame->next;
+      if (0 is $my(render) and output_len is BUFSIZE)
+        frame_drain_output (frame, output_buf);
     }
+
+    next_frame:
+      frame = frame->next;
   }
 
-  if (retval is 1 or retval is OK or retval is VWM_QUIT) return OK;
+  return OK;
+}
+
+/* a turn of the loop, that waits at most timeout milliseconds (-1 for
+ * ever); the return values are those of vwm_dispatch() */
+static int vwm_step (vwm_t *this, int timeout) {
+  vwm_poll *p = vwm_prepare (this);
+  if (NULL is p) return VWM_DONE;
+
+  if (p->timeout isnot -1 and (timeout is -1 or p->timeout < timeout))
+    timeout = p->timeout;
+
+  if (0 >= poll ((struct pollfd *) p->fds, p->num_fds, timeout))
+    return OK;
+
+  return vwm_dispatch (this);
+}
+
+/* What the handlers of vwm_main() do, for a host that catches the signals
+ * itself, as the step functions install none. */
+static int vwm_handle_signal (vwm_t *this, int sig) {
+  switch (sig) {
+    case SIGWINCH:
+      $my(need_resize) = 1;
+      return OK;
+
+    case SIGUSR1:
+    case SIGUSR2:
+      $my(render) = (sig is SIGUSR2);
+      if ($my(render)) $my(need_draw) = 1;
+      return OK;
+  }
 
   return NOTOK;
 }
 
+static int vwm_main (vwm_t *this) {
+  ifnot ($my(length)) return OK;
+
+  /* the handlers act on this instance */
+  VWM = this;
+
+  signal (SIGHUP,   vwm_exit_signal);
+  signal (SIGINT,   vwm_exit_signal);
+  signal (SIGQUIT,  vwm_exit_signal);
+  signal (SIGTERM,  vwm_exit_signal);
+  signal (SIGSEGV,  vwm_exit_signal);
+  signal (SIGBUS,   vwm_exit_signal);
+  ifnot ($my(term)->headless)
+    signal (SIGWINCH, vwm_sigwinch_handler);
+  signal (SIGUSR1,  vwm_sigrender_handler);
+  signal (SIGUSR2,  vwm_sigrender_handler);
+
+#define forever for (;;)
+
+  forever {
+    int retval = vwm_step (this, -1);
+    if (retval is VWM_DONE or retval is VWM_QUIT) break;
+
+    ifnot ($my(render)) usleep (UNDRAWN_READ_DELAY_US);
+  }
+
+  return OK;
+}
+
 static int vwm_default_on_tab_cb (vwm_t *this, vwm_win *win, vwm_frame *frame, void *object) {
   (void) this; (void) win; (void) frame; (void) object;
   return OK;
@@ -4497,11 +8222,19 @@ static int vwm_default_rline_cb (vwm_t *this, vwm_win *win, vwm_frame *frame, vo
 
 static int vwm_process_input (vwm_t *this, vwm_win *win, vwm_frame *frame, char *input_buf) {
   if (input_buf[0] isnot $my(mode_key)) {
-    if (-1 isnot frame->fd)
+    if (-1 isnot frame->fd) {
+      /* the first keystroke that has not been answered, is timed */
+      if (0 is frame->lat_input_ns)
+        frame->lat_input_ns = vt_clock_ns ();
+
+      TRACE_EVENT (VWM_TRACE_WRITE, frame->id, 1, 0, 0);
       fd_write (frame->fd, input_buf, 1);
+    }
     return OK;
   }
 
+  if (vwm_input_send (this)) return OK;
+
   int param = 0;
 
   utf8 c;
@@ -4724,7 +8457,14 @@ public vwm_t *__init_vwm__ (void) {
   *this =  (vwm_t) {
     .self = (vwm_self) {
       .main = vwm_main,
+      .step = vwm_step,
       .spawn = vwm_spawn,
+      .prepare = vwm_prepare,
+      .dispatch = vwm_dispatch,
+      .handle_signal = vwm_handle_signal,
+      .dump_trace = vwm_dump_trace,
+      .dump_latency = vwm_dump_latency,
+      .dump_allocations = vwm_dump_allocations,
       .getkey = vwm_getkey,
       .pop_win_at = vwm_pop_win_at,
       .change_win = vwm_change_win,
@@ -4735,6 +8475,7 @@ public vwm_t *__init_vwm__ (void) {
       .get = (vwm_get_self) {
         .term = vwm_get_term,
         .info = vwm_get_info,
+        .metrics = vwm_get_metrics,
         .shell = vwm_get_shell,
         .state = vwm_get_state,
         .lines = vwm_get_lines,
@@ -4744,6 +8485,7 @@ public vwm_t *__init_vwm__ (void) {
         .win_at = vwm_get_win_at,
         .win_idx = vwm_get_win_idx,
         .columns = vwm_get_columns,
+        .headless = vwm_get_headless,
         .num_wins = vwm_get_num_wins,
         .mode_key = vwm_get_mode_key,
         .current_win = vwm_get_current_win,
@@ -4758,30 +8500,52 @@ public vwm_t *__init_vwm__ (void) {
         .shell =  vwm_set_shell,
         .editor = vwm_set_editor,
         .tmpdir = vwm_set_tmpdir,
+        .recorder = vwm_set_recorder,
         .mode_key = vwm_set_mode_key,
         .object = vwm_set_object,
         .current_at = vwm_set_current_at,
+        .headless = vwm_set_headless,
+        .output_fd = vwm_set_output_fd,
+        .output_cb = vwm_set_output_cb,
         .default_app = vwm_set_default_app,
         .rline_cb = vwm_set_rline_cb,
         .on_tab_cb = vwm_set_on_tab_cb,
         .at_exit_cb = vwm_set_at_exit_cb,
         .edit_file_cb = vwm_set_edit_file_cb,
+        .search_cb = vwm_set_search_cb,
+        .metrics = vwm_set_metrics,
         .process_input_cb = vwm_set_process_input_cb,
         .debug = (vwm_set_debug_self) {
           .sequences = vwm_set_debug_sequences,
+          .allocations = vwm_set_debug_allocations,
           .unimplemented = vwm_set_debug_unimplemented
         },
       },
       .unset = (vwm_unset_self) {
         .tmpdir = vwm_unset_tmpdir,
+        .recorder = vwm_unset_recorder,
         .debug = (vwm_unset_debug_self) {
           .sequences = vwm_unset_debug_sequences,
+          .allocations = vwm_unset_debug_allocations,
           .unimplemented = vwm_unset_debug_unimplemented
         }
       },
       .new = (vwm_new_self) {
         .win = vwm_new_win,
         .term = vwm_new_term
+      },
+      .replay = (vwm_replay_self) {
+        .open = vwm_replay_open,
+        .info = vwm_replay_info_get,
+        .seek = vwm_replay_seek,
+        .next = vwm_replay_next,
+        .close = vwm_replay_close
+      },
+      .search = (vwm_search_self) {
+        .run = vwm_search_run,
+        .jump = vwm_search_jump,
+        .cancel = vwm_search_cancel,
+        .release = vwm_search_release
       }
     },
     .term = (vwm_term_self) {
@@ -4837,7 +8601,9 @@ public vwm_t *__init_vwm__ (void) {
       .fork = frame_fork,
       .clear = frame_clear,
       .reset = frame_reset,
+      .dump = frame_dump,
       .edit_log = frame_edit_log,
+      .export_log = frame_export_log,
       .check_pid = frame_check_pid,
       .create_fd = frame_create_fd,
       .on_resize = frame_on_resize,
@@ -4846,6 +8612,8 @@ public vwm_t *__init_vwm__ (void) {
       .release_log = frame_release_log,
       .release_argv = frame_release_argv,
       .release_info = frame_release_info,
+      .feed = frame_feed,
+      .repaint = frame_repaint,
       .process_output = frame_process_output,
       .get = (vwm_frame_get_self) {
         .fd = frame_get_fd,
@@ -4864,7 +8632,9 @@ public vwm_t *__init_vwm__ (void) {
       .set = (vwm_frame_set_self) {
         .fd = frame_set_fd,
         .log = frame_set_log,
+        .log_policy = frame_set_log_policy,
         .argv = frame_set_argv,
+        .size = frame_set_size,
         .command = frame_set_command,
         .visibility = frame_set_visibility,
         .at_fork_cb = frame_set_at_fork_cb,
@@ -4890,6 +8660,16 @@ public vwm_t *__init_vwm__ (void) {
   $my(process_input_cbs) = 0;
   $my(objects)[VWMED_OBJECT] = NULL;
 
+  $my(rec_gen) = 0;
+  $my(recorder) = NULL;
+  $my(frame_id_gen) = 0;
+  $my(log_jobs) = NULL;
+  $my(log_worker_state) = LOG_WORKER_NONE;
+  pthread_mutex_init (&$my(log_mutex), NULL);
+  pthread_cond_init (&$my(log_cond), NULL);
+
+  trace_acquire ();
+
   self(new.term);
 
   self(set.rline_cb, vwm_default_rline_cb);
@@ -4897,7 +8677,20 @@ public vwm_t *__init_vwm__ (void) {
   self(set.edit_file_cb, vwm_default_edit_file_cb);
   self(set.tmpdir, NULL, 0);
 
-  $my(sequences_fp) = NULL;
+  $my(render) = 1;
+  $my(need_draw) = 0;
+  $my(num_unread) = 0;
+  $my(send_frame) = NULL;
+  $my(send_left) = $my(send_len) = $my(send_off) = 0;
+
+  $my(output_cb) = NULL;
+  $my(output_object) = NULL;
+  $my(output_fd) = -1;
+
+  $my(is_started) = 0;
+  $my(poll_size) = 0;
+  $my(poll_set) = (vwm_poll) {.num_fds = 0, .timeout = -1, .fds = NULL};
+
   $my(sequences_fname) = NULL;
   $my(unimplemented_fp) = NULL;
   $my(unimplemented_fname) = NULL;
@@ -4916,6 +8709,9 @@ public void __deinit_vwm__ (vwm_t **thisp) {
 
   vwm_t *this = *thisp;
 
+  self(unset.recorder);
+  self(search.cancel);
+
   Vterm.orig_mode ($my(term));
   Vterm.release (&$my(term));
 
@@ -4926,24 +8722,35 @@ public void __deinit_vwm__ (vwm_t **thisp) {
     win = tmp;
   }
 
+  vwm_log_worker_stop (this);
+  pthread_cond_destroy (&$my(log_cond));
+  pthread_mutex_destroy (&$my(log_mutex));
+
   for (int i = 0; i < $my(num_at_exit_cbs); i++)
     $my(at_exit_cbs)[i] (this);
 
   if ($my(num_at_exit_cbs))
-    free ($my(at_exit_cbs));
+    Free ($my(at_exit_cbs));
 
   if ($my(num_process_input_cbs))
-    free ($my(process_input_cbs));
+    Free ($my(process_input_cbs));
 
   self(unset.debug.sequences);
   self(unset.debug.unimplemented);
+  self(unset.debug.allocations);
   self(unset.tmpdir);
+  trace_release ();
 
   string_release ($my(editor));
   string_release ($my(shell));
   string_release ($my(default_app));
 
-  free (this->prop);
-  free (this);
+  if ($my(poll_size))
+    Free ($my(poll_set).fds);
+
+  if (VWM is this) VWM = NULL;
+
+  Free (this->prop);
+  Free (this);
   *thisp = NULL;
 }
@@ -135,14 +135,18 @@ typedef struct vwm_prop vwm_prop;
 typedef struct vwm_term vwm_term;
 typedef struct vwm_win vwm_win;
 typedef struct vwm_frame vwm_frame;
+typedef struct vwm_replay vwm_replay;
+typedef struct vwm_search_result vwm_search_result;
 typedef struct vwm_t vwm_t;
 
 typedef void (*FrameProcessOutput_cb) (vwm_frame *, char *, int);
 typedef void (*FrameUnimplemented_cb) (vwm_frame *, const char *, int, int);
 typedef void (*VwmAtExit_cb) (vwm_t *);
+typedef void (*VwmOutput_cb) (vwm_t *, const char *, size_t, void *);
 typedef int  (*VwmOnTab_cb) (vwm_t *, vwm_win *, vwm_frame *, void *);
 typedef int  (*VwmRLine_cb) (vwm_t *, vwm_win *, vwm_frame *, void *);
 typedef int  (*VwmEditFile_cb) (vwm_t *, vwm_frame *, char *, void *);
+typedef void (*VwmSearch_cb) (vwm_t *, vwm_search_result *, void *);
 typedef int  (*FrameAtFork_cb) (vwm_frame *, vwm_t *, vwm_win *);
 typedef int  (*ProcessInput_cb) (vwm_t *, vwm_win *, vwm_frame *, utf8);
 
@@ -158,6 +162,7 @@ struct vwm_term {
   int
     lines,
     columns,
+    headless,
     out_fd,
     in_fd;
 };
@@ -180,7 +185,12 @@ typedef struct frame_opts {
     create_fd,
     enable_log,
     remove_log,
-    is_visible;
+    is_visible,
+    log_compress;
+
+  long
+    log_max_size,
+    log_segment_size;
 
   pid_t pid;
 
@@ -207,6 +217,9 @@ typedef struct frame_opts {
   .enable_log = 0,                    \
   .remove_log = 1,                    \
   .is_visible = 1,                    \
+  .log_compress = 0,                  \
+  .log_max_size = 0,                  \
+  .log_segment_size = 0,              \
   .process_output_cb = NULL,          \
   .at_fork_cb = NULL,                 \
   .parent = NULL,                     \
@@ -243,19 +256,224 @@ typedef struct win_opts {
   .frame_opts[5] = FrameOpts(),    \
   __VA_ARGS__ }
 
+/* The counters of a frame, as it processes its output; of a window, the
+ * sums of its frames (and the latest activity). last_activity is in
+ * milliseconds since the epoch (0 if there was none yet), and the
+ * backlogs, the input that waits for the program and the output that
+ * waits for the frame, are taken when the info is. */
+typedef struct vframe_stats {
+  long
+    bytes_read,
+    bytes_rendered,
+    sequences,
+    unimplemented,
+    scrolls,
+    render_ns,
+    write_backlog,
+    read_backlog,
+    last_activity;
+} vframe_stats;
+
+/* An escape sequence that is not implemented, as the vwm counts it: fun
+ * is the handler, c the final byte and param the first parameter. The
+ * frames are ids, and the times are milliseconds since the epoch. */
+typedef struct vwm_unimplemented {
+  const char *fun;
+
+  int
+    c,
+    param,
+    first_frame,
+    last_frame;
+
+  long
+    count,
+    first_seen,
+    last_seen;
+} vwm_unimplemented;
+
+/* The memory that is allocated through Alloc() and Realloc(), and released
+ * with Free(), while Vwm.set.debug.allocations() is on: by the function
+ * that allocated it (site is NULL for the rest, when the table is full),
+ * and for the whole process. */
+typedef struct vwm_alloc_site {
+  const char *site;
+
+  long
+    live_bytes,
+    peak_bytes,
+    live_allocs,
+    allocs;
+} vwm_alloc_site;
+
+typedef struct vwm_alloc_stats {
+  long
+    live_bytes,
+    peak_bytes,
+    live_allocs,
+    allocs;
+
+  /* the most live bytes first */
+  int num_sites;
+  vwm_alloc_site *sites;
+} vwm_alloc_stats;
+
+/* The latency of the input of a frame, in microseconds: from a keystroke
+ * until the pty has output for it, from then until it is parsed, and from
+ * then until it is written to the terminal. */
+enum {
+  LATENCY_INPUT_PTY = 0,
+  LATENCY_PTY_PARSE,
+  LATENCY_PARSE_PRESENT,
+  NUM_LATENCIES
+};
+
+typedef struct vframe_latency {
+  long
+    count,
+    min,
+    p50,
+    p90,
+    p99,
+    max;
+} vframe_latency;
+
+/* The metrics of a vwm (Vwm.get.metrics()), in the text exposition format
+ * that Prometheus reads. Vwm.set.metrics() makes the main loop publish them
+ * in a shared memory, so another process (the master of a vtach session)
+ * reads them at any time, without waiting: the reader asks for a new
+ * document by changing req, and wakes the loop through the descriptor that
+ * was given with the memory (an eventfd or the read end of a pipe, -1 for
+ * none, when the request waits for a turn that comes anyway); the vwm
+ * publishes it on that turn, at most once in VWM_METRICS_MS. seq is odd
+ * while the document is written, and ms is the time (of the monotonic
+ * clock) that it was taken. */
+#define VWM_METRICS_SIZE (48 << 10)
+#define VWM_METRICS_MS   1000
+
+typedef struct vwm_metrics {
+  uint
+    seq,
+    req,
+    len;
+
+  long ms;
+  char doc[];
+} vwm_metrics;
+
+/* The descriptors that a vwm waits on, when the loop of a host runs it
+ * instead of Vwm.main(): Vwm.prepare() fills them (it returns NULL when
+ * there is nothing left to run), the host waits on them, at most timeout
+ * milliseconds (-1 for ever), sets their revents and calls Vwm.dispatch().
+ * A vwm_pollfd is laid out as a struct pollfd, and the flags have the same
+ * values, so they can be given to poll(2) as they are; Vwm.step() does just
+ * that. The step functions install no signal handlers; a host that catches
+ * SIGWINCH, SIGUSR1 or SIGUSR2 passes them to Vwm.handle_signal(). */
+#define VWM_POLLIN   0x001
+#define VWM_POLLOUT  0x004
+#define VWM_POLLERR  0x008
+#define VWM_POLLHUP  0x010
+#define VWM_POLLNVAL 0x020
+
+typedef struct vwm_pollfd {
+  int fd;
+  short
+    events,
+    revents;
+} vwm_pollfd;
+
+typedef struct vwm_poll {
+  int
+    num_fds,
+    timeout;
+
+  vwm_pollfd *fds;
+} vwm_poll;
+
+/* The trace, that Vwm.set.debug.sequences() switches on: every thread
+ * keeps its last events in a ring, and a dump (see Vwm.dump_trace(), and
+ * the vwm_trace decoder) is a vwm_trace_header and for every ring, a
+ * vwm_trace_ring_header followed by its events, the oldest first. The
+ * times are of the monotonic clock, and frame is the id of the frame (0
+ * for none). */
+#define VWM_TRACE_MAGIC   "VWMTRACE"
+#define VWM_TRACE_VERSION 1
+
+enum {
+  VWM_TRACE_READ = 1,       /* a: the bytes of output */
+  VWM_TRACE_WRITE,          /* a: the bytes of input */
+  VWM_TRACE_SEQUENCE,       /* a: the final byte, b: the first parameter, c: the state */
+  VWM_TRACE_UNIMPLEMENTED,  /* as a sequence */
+  VWM_TRACE_RENDER,         /* a: the bytes in, b: the bytes out, c: microseconds */
+  VWM_TRACE_RESIZE,         /* a: rows, b: columns */
+  VWM_TRACE_LOG_COMPRESS,   /* a: 1 if it succeeded */
+  VWM_TRACE_REC_WRITE       /* a: the bytes of records, b: of the index */
+};
+
+/* the parser states, that a sequence ends in */
+enum {
+  VWM_TRACE_STATE_TEXT = 0,
+  VWM_TRACE_STATE_ESC,
+  VWM_TRACE_STATE_CSI,
+  VWM_TRACE_STATE_CSI_PRIVATE,
+  VWM_TRACE_STATE_G0,
+  VWM_TRACE_STATE_G1,
+  VWM_TRACE_STATE_POUND
+};
+
+typedef struct vwm_trace_event {
+  long long ns;
+
+  unsigned short
+    type,
+    frame;
+
+  uint a, b, c;
+} vwm_trace_event;
+
+typedef struct vwm_trace_header {
+  char magic[8];
+
+  uint
+    version,
+    event_size,
+    num_rings,
+    reserved;
+} vwm_trace_header;
+
+typedef struct vwm_trace_ring_header {
+  uint
+    thread,
+    reserved;
+
+  long long
+    num_events,  /* in the dump */
+    total;       /* that were recorded; the rest were overwritten */
+} vwm_trace_ring_header;
+
 typedef struct vframe_info {
   char *logfile;
 
   int
+    id,
     at_frame,
     num_rows,
     last_row,
     first_row,
     is_current,
-    is_visible;
+    is_visible,
+    log_compress,
+    num_log_segments;
+
+  long
+    log_max_size,
+    log_segment_size;
 
   pid_t pid;
 
+  vframe_stats stats;
+  vframe_latency latency[NUM_LATENCIES];
+
   char *argv[MAX_ARGS];
 } vframe_info;
 
@@ -270,6 +488,8 @@ typedef struct vwin_info {
     cur_frame_idx,
     num_visible_frames;
 
+  vframe_stats stats;
+
   vframe_info **frames;
 } vwin_info;
 
@@ -284,8 +504,62 @@ typedef struct vwm_info {
 
   pid_t pid;
   vwin_info **wins;
+
+  /* the most frequent first, and how many were not counted, as there
+   * was no room for them */
+  int num_unimplemented;
+  long unimplemented_dropped;
+  vwm_unimplemented *unimplemented;
+
+  /* NULL if the allocations are not counted */
+  vwm_alloc_stats *allocations;
 } vwm_info;
 
+typedef struct vwm_search_hit {
+  char
+    *line,
+    *win_name;
+
+  int
+    age,
+    win_idx,
+    line_nr,
+    frame_idx,
+    is_history;
+} vwm_search_hit;
+
+struct vwm_search_result {
+  char *pattern;
+
+  int
+    num_hits,
+    num_frames,
+    num_threads;
+
+  long elapsed_usec;
+
+  vwm_search_hit *hits;
+};
+
+typedef struct vwm_replay_frame {
+  int
+    id,
+    num_rows,
+    num_cols;
+
+  long first_ms;
+} vwm_replay_frame;
+
+typedef struct vwm_replay_info {
+  int num_frames;
+
+  long
+    duration_ms,
+    num_keyframes;
+
+  vwm_replay_frame *frames;
+} vwm_replay_info;
+
 typedef struct vwm_term_screen_self {
   void
     (*save)    (vwm_term *),
@@ -332,11 +606,14 @@ typedef struct vwm_frame_set_self {
   void
     (*fd) (vwm_frame *, int),
     (*argv) (vwm_frame *, int, char **),
+    (*size) (vwm_frame *, int, int),
     (*command) (vwm_frame *, char *),
     (*visibility) (vwm_frame *, int),
     (*unimplemented_cb) (vwm_frame *, FrameUnimplemented_cb);
 
-  int (*log) (vwm_frame *, char *,  int);
+  int
+    (*log) (vwm_frame *, char *,  int),
+    (*log_policy) (vwm_frame *, long, long, int);
 
   FrameProcessOutput_cb (*process_output_cb) (vwm_frame *, FrameProcessOutput_cb);
   FrameAtFork_cb (*at_fork_cb) (vwm_frame *, FrameAtFork_cb);
@@ -355,10 +632,15 @@ typedef struct vwm_frame_self {
     (*release_log) (vwm_frame *),
     (*release_info) (vframe_info *),
     (*release_argv) (vwm_frame *),
+    (*feed) (vwm_frame *, char *, int),
     (*process_output) (vwm_frame *, char *, int);
 
+  char *(*repaint) (vwm_frame *, size_t *);
+
   int
+    (*dump) (vwm_frame *, int),
     (*edit_log) (vwm_frame *),
+    (*export_log) (vwm_frame *, char *),
     (*check_pid) (vwm_frame *),
     (*kill_proc) (vwm_frame *),
     (*create_fd) (vwm_frame *);
@@ -436,6 +718,8 @@ typedef struct vwm_get_self {
     (*state) (vwm_t *),
     (*lines) (vwm_t *),
     (*columns) (vwm_t *),
+    (*headless) (vwm_t *),
+    (*metrics) (vwm_t *, char *, size_t),
     (*win_idx) (vwm_t *, vwm_win *),
     (*num_wins) (vwm_t *),
     (*current_win_idx) (vwm_t *);
@@ -459,17 +743,21 @@ typedef struct vwm_get_self {
 typedef struct vwm_unset_debug_self {
   void
     (*sequences) (vwm_t *),
+    (*allocations) (vwm_t *),
     (*unimplemented) (vwm_t *);
 } vwm_unset_debug_self;
 
 typedef struct vwm_unset_self {
   vwm_unset_debug_self debug;
-  void (*tmpdir) (vwm_t *);
+  void
+    (*tmpdir) (vwm_t *),
+    (*recorder) (vwm_t *);
 } vwm_unset_self;
 
 typedef struct vwm_set_debug_self {
   void
     (*sequences) (vwm_t *, char *),
+    (*allocations) (vwm_t *),
     (*unimplemented) (vwm_t *, char *);
 } vwm_set_debug_self;
 
@@ -487,11 +775,18 @@ typedef struct vwm_set_self {
     (*rline_cb) (vwm_t *, VwmRLine_cb),
     (*on_tab_cb) (vwm_t *, VwmOnTab_cb),
     (*at_exit_cb) (vwm_t *, VwmAtExit_cb),
+    (*headless) (vwm_t *, int, int),
+    (*output_fd) (vwm_t *, int),
+    (*output_cb) (vwm_t *, VwmOutput_cb, void *),
     (*default_app) (vwm_t *, char *),
     (*edit_file_cb) (vwm_t *, VwmEditFile_cb),
+    (*search_cb) (vwm_t *, VwmSearch_cb),
+    (*metrics) (vwm_t *, vwm_metrics *, size_t, int),
     (*process_input_cb) (vwm_t *, ProcessInput_cb);
 
-  int (*tmpdir) (vwm_t *, char *, size_t);
+  int
+    (*tmpdir) (vwm_t *, char *, size_t),
+    (*recorder) (vwm_t *, char *);
 
   vwm_win *(*current_at) (vwm_t *, int);
 
@@ -502,11 +797,34 @@ typedef struct vwm_new_self {
   vwm_term *(*term) (vwm_t *);
 } vwm_new_self;
 
+typedef struct vwm_replay_self {
+  vwm_replay *(*open) (vwm_t *, char *);
+  vwm_replay_info *(*info) (vwm_t *, vwm_replay *);
+
+  int
+    (*seek) (vwm_t *, vwm_replay *, vwm_frame *, int, long),
+    (*next) (vwm_t *, vwm_replay *, long *, char **, int *);
+
+  void (*close) (vwm_t *, vwm_replay **);
+} vwm_replay_self;
+
+typedef struct vwm_search_self {
+  int
+    (*run) (vwm_t *, char *, int),
+    (*jump) (vwm_t *, vwm_search_result *, int);
+
+  void
+    (*cancel) (vwm_t *),
+    (*release) (vwm_t *, vwm_search_result **);
+} vwm_search_self;
+
 typedef struct vwm_self {
    vwm_new_self new;
    vwm_get_self get;
    vwm_set_self set;
    vwm_unset_self unset;
+   vwm_search_self search;
+   vwm_replay_self replay;
 
   void
     (*change_win) (vwm_t *, vwm_win *, int, int),
@@ -515,12 +833,19 @@ typedef struct vwm_self {
 
   int
     (*main) (vwm_t *),
+    (*step) (vwm_t *, int),
     (*spawn) (vwm_t *, char **),
+    (*dispatch) (vwm_t *),
+    (*handle_signal) (vwm_t *, int),
+    (*dump_trace) (vwm_t *, char *),
+    (*dump_latency) (vwm_t *, char *),
+    (*dump_allocations) (vwm_t *, char *),
     (*append_win) (vwm_t *, vwm_win *),
     (*process_input) (vwm_t *, vwm_win *, vwm_frame *, char *);
 
   utf8 (*getkey) (vwm_t *, int);
 
+  vwm_poll *(*prepare) (vwm_t *);
   vwm_win *(*pop_win_at) (vwm_t *, int);
 } vwm_self;
 
@@ -0,0 +1,618 @@
+/* Measures the output processing of a frame: the pty byte stream goes
+ * through Vframe.process_output() (parsed and rendered, with the output of
+ * the headless vwm going to a sink that counts it) and through Vframe.feed()
+ * (parsed only), in chunks of the size that the main loop reads.
+ *
+ * Usage: vwm_bench [--json] [--runs=n] [--size=MB] [--chunk=bytes] [--rows=n]
+ *                  [--cols=n] [--corpus=name] [--tag=str] [--memory] [file ...]
+ *
+ *   --json       print a JSON object per result, instead of a table
+ *   --runs=n     the runs of each corpus (default 3); the fastest counts
+ *   --size=MB    the size of the generated corpora (default 8)
+ *   --chunk=n    the bytes given at once (default 4096)
+ *   --rows=n     the size of the frame (default 50x160)
+ *   --cols=n
+ *   --corpus=c   only this of the generated corpora
+ *   --tag=str    a label for the results (a version, a commit)
+ *   --memory     count the memory of the frame (Vwm.set.debug.allocations()),
+ *                that makes the runs slower
+ *
+ * The generated corpora are plain logs (log), colored compiler output
+ * (ansi), full screen repaints as vim or htop do them (repaint), CJK text
+ * (cjk) and the cat of a binary (binary). A file is a recording of
+ * Vwm.set.recorder() (its first frame, in the chunks it was read), or a
+ * raw capture of a pty (as script(1) makes them).
+ *
+ * For each, it reports MB/s, ns per byte, the allocations, and the bytes
+ * that were rendered per input byte; with --memory, the peak of the bytes
+ * that were allocated during a run, and the bytes that the frame still holds
+ * at its end (-1 without it).
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <termios.h>
+
+#include <libv/libvwm.h>
+
+#define Vwm    this->self
+#define Vframe this->frame
+#define Vwin   this->win
+
+#define MODE_RENDER 0
+#define MODE_PARSE  1
+
+typedef struct bench_corpus {
+  char *name;
+  char *buf;
+  size_t len;
+
+  /* the chunks of a recording, else every --chunk bytes */
+  int *chunks;
+  int num_chunks;
+} bench_corpus;
+
+typedef struct bench_opts {
+  int
+    json,
+    memory,
+    runs,
+    rows,
+    cols,
+    chunk;
+
+  size_t size;
+  char *corpus;
+  char *tag;
+} bench_opts;
+
+/* The allocations are counted, as they are made through the C library. */
+#ifdef __GLIBC__
+extern void *__libc_malloc (size_t);
+extern void *__libc_calloc (size_t, size_t);
+extern void *__libc_realloc (void *, size_t);
+
+static long NUM_ALLOCS = 0;
+
+__attribute__((visibility ("default"))) void *malloc (size_t size) {
+  NUM_ALLOCS++;
+  return __libc_malloc (size);
+}
+
+__attribute__((visibility ("default"))) void *calloc (size_t nmemb, size_t size) {
+  NUM_ALLOCS++;
+  return __libc_calloc (nmemb, size);
+}
+
+__attribute__((visibility ("default"))) void *realloc (void *ptr, size_t size) {
+  NUM_ALLOCS++;
+  return __libc_realloc (ptr, size);
+}
+#else
+static long NUM_ALLOCS = -1;
+#endif
+
+/* the rendered output, that would go to the terminal */
+static size_t SINK_BYTES = 0;
+
+static void sink_write (vwm_t *this, const char *buf, size_t len, void *object) {
+  (void) this; (void) buf; (void) object;
+  SINK_BYTES += len;
+}
+
+static long clock_ns (void) {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (long) ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* xorshift; the corpora are the same on every run */
+static unsigned int RNG = 2463534242u;
+
+static unsigned int rnd (unsigned int n) {
+  RNG ^= RNG << 13;
+  RNG ^= RNG >> 17;
+  RNG ^= RNG << 5;
+  return RNG % n;
+}
+
+typedef struct gen_buf {
+  char *bytes;
+  size_t len;
+  size_t size;
+} gen_buf;
+
+static void gen_append (gen_buf *g, const char *s, size_t len) {
+  if (g->len + len > g->size) {
+    g->size = (g->len + len) * 2;
+    g->bytes = realloc (g->bytes, g->size);
+  }
+
+  memcpy (g->bytes + g->len, s, len);
+  g->len += len;
+}
+
+static void gen_printf (gen_buf *g, const char *fmt, ...) __attribute__((format (printf, 2, 3)));
+static void gen_printf (gen_buf *g, const char *fmt, ...) {
+  char buf[1024];
+  va_list ap;
+  va_start (ap, fmt);
+  int len = vsnprintf (buf, sizeof (buf), fmt, ap);
+  va_end (ap);
+  if (len > (int) sizeof (buf) - 1) len = sizeof (buf) - 1;
+  gen_append (g, buf, len);
+}
+
+static void gen_word (gen_buf *g) {
+  static const char *words[] = {
+    "request", "worker", "cache", "miss", "connection", "closed", "timeout",
+    "retry", "session", "user", "upstream", "latency", "queue", "flush", "ok"};
+
+  const char *w = words[rnd (sizeof (words) / sizeof (words[0]))];
+  gen_append (g, w, strlen (w));
+}
+
+static void gen_log (gen_buf *g, size_t size) {
+  static const char *levels[] = {"INFO", "DEBUG", "WARN", "ERROR"};
+
+  for (long n = 0; g->len < size; n++) {
+    gen_printf (g, "2024-03-%02d %02d:%02d:%02d.%03d %-5s [worker-%u] ",
+      1 + (int) (n / 86400000) % 28, (int) (n / 3600000) % 24, (int) (n / 60000) % 60,
+      (int) (n / 1000) % 60, (int) (n % 1000), levels[rnd (4)], rnd (16));
+
+    int words = 4 + rnd (12);
+    for (int i = 0; i < words; i++) {
+      gen_word (g);
+      gen_append (g, " ", 1);
+    }
+
+    gen_printf (g, "id=%u took=%ums\r\n", rnd (1000000), rnd (5000));
+  }
+}
+
+static void gen_ansi (gen_buf *g, size_t size) {
+  while (g->len < size) {
+    int line = 1 + rnd (2000), col = 1 + rnd (80);
+    int is_error = rnd (3) == 0;
+
+    gen_printf (g, "\033[1msrc/module%u/file%u.c:%d:%d: \033[1;%dm%s: \033[0m\033[1m",
+      rnd (20), rnd (100), line, col, (is_error ? 31 : 35), (is_error ? "error" : "warning"));
+
+    int words = 3 + rnd (8);
+    for (int i = 0; i < words; i++) {
+      gen_word (g);
+      gen_append (g, " ", 1);
+    }
+
+    gen_printf (g, "[\033[1;%dm-W%s\033[0m\033[1m]\033[0m\r\n",
+      (is_error ? 31 : 35), (is_error ? "error" : "unused-variable"));
+    gen_printf (g, " %4d |     int \033[1;32mvalue%u\033[0m = compute (arg%u, %u);\r\n",
+      line, rnd (100), rnd (10), rnd (1000));
+    gen_printf (g, "      |         \033[1;32m^~~~~~\033[0m\r\n");
+
+    if (rnd (10) == 0)
+      gen_printf (g, "\033[32m[%3u%%]\033[0m \033[32mBuilding C object src/obj%u.o\033[0m\r\n",
+        rnd (101), rnd (500));
+  }
+}
+
+/* a screen of an editor and of a process viewer, in turns, then updates
+ * of parts of them */
+static void gen_repaint (gen_buf *g, size_t size, int rows, int cols) {
+  while (g->len < size) {
+    int htop = rnd (2);
+
+    gen_append (g, "\033[?25l\033[H\033[2J", 14);
+
+    if (htop) {
+      for (int r = 1; r <= 4; r++) {
+        gen_printf (g, "\033[%d;1H\033[1m%3d\033[0m[\033[32m", r, r);
+        int bars = rnd (cols / 3);
+        for (int i = 0; i < bars; i++) gen_append (g, "|", 1);
+        gen_printf (g, "\033[0m\033[%d;%dH%4.1f%%]\033[K", r, cols / 2, rnd (1000) / 10.0);
+      }
+
+      gen_printf (g, "\033[6;1H\033[30;42m  PID USER      PRI  NI  VIRT   RES   SHR S CPU%% MEM%%   TIME+  Command\033[K\033[0m");
+
+      for (int r = 7; r < rows; r++)
+        gen_printf (g, "\033[%d;1H%5u root       20   0 %5uM %5uM %5uM %c %4.1f %4.1f %2u:%02u.%02u \033[1m/usr/bin/proc%u\033[0m\033[K",
+          r, rnd (99999), rnd (9999), rnd (999), rnd (99), "SRD"[rnd (3)],
+          rnd (1000) / 10.0, rnd (1000) / 10.0, rnd (60), rnd (60), rnd (100), rnd (50));
+
+      for (int u = 0; u < 20; u++) {
+        int r = 7 + rnd (rows - 8);
+        gen_printf (g, "\033[%d;1H\033[7m%5u\033[0m\033[%d;44H%4.1f", r, rnd (99999), r, rnd (1000) / 10.0);
+      }
+    } else {
+      gen_printf (g, "\033[1;%dr", rows - 2);
+
+      for (int r = 1; r <= rows - 2; r++) {
+        gen_printf (g, "\033[%d;1H\033[33m%4d \033[0m", r, r);
+        if (rnd (4) == 0)
+          gen_printf (g, "\033[34m/* a comment on line %d */\033[0m", r);
+        else
+          gen_printf (g, "  \033[32mstatic\033[0m \033[32mint\033[0m fun%u (\033[32mint\033[0m a) { \033[33mreturn\033[0m a + \033[31m%u\033[0m; }",
+            rnd (100), rnd (1000));
+      }
+
+      gen_printf (g, "\033[%d;1H\033[7m file.c [+]  %d,%d  All \033[K\033[0m", rows - 1, rnd (rows), rnd (cols));
+
+      for (int u = 0; u < 40; u++) {
+        gen_printf (g, "\033[%d;%dH\033[1m%c\033[0m", 1 + rnd (rows - 2), 6 + rnd (cols - 7), 'a' + rnd (26));
+
+        if (rnd (8) == 0)
+          gen_printf (g, "\033[%d;1H\033M", 1 + rnd (4));
+      }
+
+      gen_append (g, "\033[r", 3);
+    }
+
+    gen_printf (g, "\033[%d;%dH\033[?25h", 1 + rnd (rows), 1 + rnd (cols));
+  }
+}
+
+static void gen_utf8 (gen_buf *g, unsigned int c) {
+  char b[4];
+
+  if (c < 0x80) {
+    b[0] = c;
+    gen_append (g, b, 1);
+  } else if (c < 0x800) {
+    b[0] = 0xC0 | (c >> 6);
+    b[1] = 0x80 | (c & 0x3F);
+    gen_append (g, b, 2);
+  } else {
+    b[0] = 0xE0 | (c >> 12);
+    b[1] = 0x80 | ((c >> 6) & 0x3F);
+    b[2] = 0x80 | (c & 0x3F);
+    gen_append (g, b, 3);
+  }
+}
+
+static void gen_cjk (gen_buf *g, size_t size) {
+  while (g->len < size) {
+    int chars = 10 + rnd (60);
+
+    for (int i = 0; i < chars; i++) {
+      unsigned int r = rnd (10);
+
+      if (r < 6)
+        gen_utf8 (g, 0x4E00 + rnd (0x9FFF - 0x4E00));   /* ideographs */
+      else if (r < 8)
+        gen_utf8 (g, 0x3041 + rnd (0x3096 - 0x3041));   /* hiragana */
+      else if (r < 9)
+        gen_utf8 (g, 0xAC00 + rnd (0xD7A3 - 0xAC00));   /* hangul */
+      else
+        gen_utf8 (g, 'a' + rnd (26));
+    }
+
+    gen_append (g, (rnd (4) ? "\r\n" : "。\r\n"), (rnd (4) ? 2 : 5));
+  }
+}
+
+static void gen_binary (gen_buf *g, size_t size) {
+  char buf[4096];
+
+  while (g->len < size) {
+    for (size_t i = 0; i < sizeof (buf); i++)
+      buf[i] = rnd (256);
+
+    gen_append (g, buf, sizeof (buf));
+  }
+}
+
+static void corpus_chunk (bench_corpus *c, int chunk) {
+  c->num_chunks = (c->len + chunk - 1) / chunk;
+  c->chunks = malloc (sizeof (int) * (c->num_chunks ? c->num_chunks : 1));
+
+  size_t left = c->len;
+  for (int i = 0; i < c->num_chunks; i++) {
+    c->chunks[i] = (left < (size_t) chunk ? (int) left : chunk);
+    left -= c->chunks[i];
+  }
+}
+
+static int corpus_generate (bench_corpus *c, char *name, bench_opts *opts) {
+  gen_buf g = {.bytes = NULL, .len = 0, .size = 0};
+
+  RNG = 2463534242u;
+
+  if (0 == strcmp (name, "log"))
+    gen_log (&g, opts->size);
+  else if (0 == strcmp (name, "ansi"))
+    gen_ansi (&g, opts->size);
+  else if (0 == strcmp (name, "repaint"))
+    gen_repaint (&g, opts->size, opts->rows, opts->cols);
+  else if (0 == strcmp (name, "cjk"))
+    gen_cjk (&g, opts->size);
+  else if (0 == strcmp (name, "binary"))
+    gen_binary (&g, opts->size);
+  else
+    return -1;
+
+  c->name = name;
+  c->buf = g.bytes;
+  c->len = g.len;
+  corpus_chunk (c, opts->chunk);
+  return 0;
+}
+
+static int corpus_read (vwm_t *this, bench_corpus *c, char *fname, bench_opts *opts) {
+  char *sp = strrchr (fname, '/');
+  c->name = (sp ? sp + 1 : fname);
+
+  vwm_replay *rp = Vwm.replay.open (this, fname);
+
+  if (NULL != rp) {
+    vwm_replay_info *info = Vwm.replay.info (this, rp);
+
+    size_t size = 0;
+    int chunks_size = 0;
+    c->buf = NULL;
+    c->len = 0;
+    c->chunks = NULL;
+    c->num_chunks = 0;
+
+    if (0 == info->num_frames) {
+      Vwm.replay.close (this, &rp);
+      return -1;
+    }
+
+    /* the frame that the recording is played on, from its start */
+    win_opts w_opts = WinOpts (
+      .num_rows = info->frames[0].num_rows + 1,
+      .num_cols = info->frames[0].num_cols,
+      .num_frames = 1,
+      .max_frames = 1);
+
+    w_opts.frame_opts[0].fork = 0;
+
+    vwm_win *win = Vwm.new.win (this, "corpus", w_opts);
+    vwm_frame *frame = Vwin.get.frame_at (win, 0);
+
+    long ts;
+    char *buf;
+    int len;
+
+    if (-1 == Vwm.replay.seek (this, rp, frame, info->frames[0].id, 0)) {
+      Vwm.release_win (this, win);
+      Vwm.replay.close (this, &rp);
+      return -1;
+    }
+
+    while (0 == Vwm.replay.next (this, rp, &ts, &buf, &len)) {
+      if (c->len + len > size) {
+        size = (c->len + len) * 2;
+        c->buf = realloc (c->buf, size);
+      }
+
+      if (c->num_chunks == chunks_size) {
+        chunks_size = (chunks_size ? chunks_size * 2 : 1024);
+        c->chunks = realloc (c->chunks, sizeof (int) * chunks_size);
+      }
+
+      memcpy (c->buf + c->len, buf, len);
+      c->len += len;
+      c->chunks[c->num_chunks++] = len;
+    }
+
+    Vwm.release_win (this, win);
+    Vwm.replay.close (this, &rp);
+    return (c->len ? 0 : -1);
+  }
+
+  FILE *fp = fopen (fname, "r");
+  if (NULL == fp) return -1;
+
+  struct stat st;
+  if (-1 == fstat (fileno (fp), &st) || 0 == st.st_size) {
+    fclose (fp);
+    return -1;
+  }
+
+  c->buf = malloc (st.st_size);
+  c->len = fread (c->buf, 1, st.st_size, fp);
+  fclose (fp);
+
+  corpus_chunk (c, opts->chunk);
+  return 0;
+}
+
+typedef struct bench_result {
+  long
+    best_ns,
+    allocs,
+    mem_peak,
+    mem_live;
+
+  size_t out_bytes;
+} bench_result;
+
+static long bench_live_bytes (vwm_t *this, long *peak) {
+  vwm_info *info = Vwm.get.info (this);
+  long live = info->allocations->live_bytes;
+  if (peak) *peak = info->allocations->peak_bytes;
+  Vwm.release_info (this, &info);
+  return live;
+}
+
+static void bench_run (vwm_t *this, bench_corpus *c, int mode, bench_opts *opts, bench_result *res) {
+  res->best_ns = -1;
+  res->mem_peak = res->mem_live = -1;
+
+  for (int run = 0; run < opts->runs; run++) {
+    win_opts w_opts = WinOpts (
+      .num_rows = opts->rows,
+      .num_cols = opts->cols,
+      .num_frames = 1,
+      .max_frames = 1);
+
+    w_opts.frame_opts[0].fork = 0;
+
+    long mem = 0;
+    if (opts->memory) {
+      Vwm.set.debug.allocations (this);
+      mem = bench_live_bytes (this, NULL);
+    }
+
+    vwm_win *win = Vwm.new.win (this, "bench", w_opts);
+    vwm_frame *frame = Vwin.get.frame_at (win, 0);
+
+    char *buf = c->buf;
+
+    SINK_BYTES = 0;
+    long allocs = NUM_ALLOCS;
+    long t = clock_ns ();
+
+    for (int i = 0; i < c->num_chunks; i++) {
+      if (mode == MODE_RENDER) {
+        Vwin.set.frame (win, frame);
+        Vframe.process_output (frame, buf, c->chunks[i]);
+      } else
+        Vframe.feed (frame, buf, c->chunks[i]);
+
+      buf += c->chunks[i];
+    }
+
+    t = clock_ns () - t;
+
+    if (res->best_ns < 0 || t < res->best_ns)
+      res->best_ns = t;
+
+    res->allocs = (NUM_ALLOCS < 0 ? -1 : NUM_ALLOCS - allocs);
+    res->out_bytes = SINK_BYTES;
+
+    if (opts->memory) {
+      long peak;
+      res->mem_live = bench_live_bytes (this, &peak) - mem;
+      res->mem_peak = peak - mem;
+    }
+
+    Vwm.release_win (this, win);
+  }
+}
+
+static void bench_print (bench_corpus *c, int mode, bench_result *res, bench_opts *opts) {
+  double ns_per_byte = (double) res->best_ns / c->len;
+  double mb_per_s = (c->len / (1024.0 * 1024.0)) / (res->best_ns / 1e9);
+  double out_per_in = (double) res->out_bytes / c->len;
+  char *smode = (mode == MODE_RENDER ? "render" : "parse");
+
+  if (opts->json) {
+    fprintf (stdout,
+      "{\"tag\": \"%s\", \"corpus\": \"%s\", \"mode\": \"%s\", \"bytes\": %zd, "
+      "\"chunks\": %d, \"rows\": %d, \"cols\": %d, \"runs\": %d, \"ns\": %ld, "
+      "\"mb_per_s\": %.2f, \"ns_per_byte\": %.3f, \"allocs\": %ld, "
+      "\"render_bytes\": %zd, \"render_per_byte\": %.3f, "
+      "\"mem_peak\": %ld, \"mem_live\": %ld}\n",
+      (opts->tag ? opts->tag : ""), c->name, smode, c->len, c->num_chunks,
+      opts->rows, opts->cols, opts->runs, res->best_ns, mb_per_s, ns_per_byte,
+      res->allocs, res->out_bytes, out_per_in, res->mem_peak, res->mem_live);
+    return;
+  }
+
+  fprintf (stdout, "%-12s %-7s %10zd %9.2f %9.3f %10ld %9.3f %10ld %10ld\n",
+    c->name, smode, c->len, mb_per_s, ns_per_byte, res->allocs, out_per_in,
+    (res->mem_peak < 0 ? -1 : res->mem_peak / 1024),
+    (res->mem_live < 0 ? -1 : res->mem_live / 1024));
+}
+
+static int bench_usage (char *name) {
+  fprintf (stderr,
+    "usage: %s [--json] [--runs=n] [--size=MB] [--chunk=bytes] [--rows=n] [--cols=n]\n"
+    "       [--corpus=log|ansi|repaint|cjk|binary] [--tag=str] [--memory] [file ...]\n", name);
+  return 1;
+}
+
+int main (int argc, char **argv) {
+  static char *generated[] = {"log", "ansi", "repaint", "cjk", "binary"};
+  int num_generated = sizeof (generated) / sizeof (generated[0]);
+
+  bench_opts opts = {
+    .json = 0, .memory = 0, .runs = 3, .rows = 50, .cols = 160, .chunk = 4096,
+    .size = 8 << 20, .corpus = NULL, .tag = NULL};
+
+  char **files = malloc (sizeof (char *) * argc);
+  int num_files = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (0 == strcmp (argv[i], "--json"))
+      opts.json = 1;
+    else if (0 == strcmp (argv[i], "--memory"))
+      opts.memory = 1;
+    else if (0 == strncmp (argv[i], "--runs=", 7))
+      opts.runs = atoi (argv[i] + 7);
+    else if (0 == strncmp (argv[i], "--size=", 7))
+      opts.size = (size_t) (atof (argv[i] + 7) * (1 << 20));
+    else if (0 == strncmp (argv[i], "--chunk=", 8))
+      opts.chunk = atoi (argv[i] + 8);
+    else if (0 == strncmp (argv[i], "--rows=", 7))
+      opts.rows = atoi (argv[i] + 7);
+    else if (0 == strncmp (argv[i], "--cols=", 7))
+      opts.cols = atoi (argv[i] + 7);
+    else if (0 == strncmp (argv[i], "--corpus=", 9))
+      opts.corpus = argv[i] + 9;
+    else if (0 == strncmp (argv[i], "--tag=", 6))
+      opts.tag = argv[i] + 6;
+    else if (argv[i][0] == '-')
+      return bench_usage (argv[0]);
+    else
+      files[num_files++] = argv[i];
+  }
+
+  if (opts.runs <= 0 || opts.size == 0 || opts.chunk <= 0 ||
+      opts.rows < 10 || opts.cols < 40)
+    return bench_usage (argv[0]);
+
+  /* what would be drawn on the terminal */
+  vwm_t *this = __init_vwm__ ();
+  Vwm.set.output_cb (this, sink_write, NULL);
+  Vwm.set.headless (this, opts.rows, opts.cols);
+
+  if (0 == opts.json)
+    fprintf (stdout, "%-12s %-7s %10s %9s %9s %10s %9s %10s %10s\n",
+      "corpus", "mode", "bytes", "MB/s", "ns/byte", "allocs", "out/in",
+      "peak KB", "live KB");
+
+  int retval = 0;
+
+  for (int i = 0; i < num_generated + num_files; i++) {
+    bench_corpus c;
+
+    if (i < num_generated) {
+      if (num_files && NULL == opts.corpus) continue;
+      if (opts.corpus && strcmp (opts.corpus, generated[i])) continue;
+
+      corpus_generate (&c, generated[i], &opts);
+    } else if (-1 == corpus_read (this, &c, files[i - num_generated], &opts)) {
+      fprintf (stderr, "%s: can not be read\n", files[i - num_generated]);
+      retval = 1;
+      continue;
+    }
+
+    for (int mode = MODE_RENDER; mode <= MODE_PARSE; mode++) {
+      bench_result res;
+
+      bench_run (this, &c, mode, &opts, &res);
+
+      bench_print (&c, mode, &res, &opts);
+      fflush (stdout);
+    }
+
+    free (c.buf);
+    free (c.chunks);
+  }
+
+  __deinit_vwm__ (&this);
+
+  free (files);
+  return retval;
+}
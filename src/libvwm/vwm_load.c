@@ -0,0 +1,678 @@
+/* Loads a vwm with windows and frames that run synthetic workloads, and
+ * measures how it keeps up, as the number of windows grows.
+ *
+ * The vwm runs on a pty that this program holds as the terminal (so no
+ * display is needed), and every frame runs one of the generators below,
+ * in the process that the frame forks:
+ *
+ *   log      a steady writer of log lines
+ *   burst    writes as fast as it can for a while, then sleeps
+ *   repaint  repaints the whole frame with colors, as top(1) does
+ *   idle     an idle shell, that echoes what it is typed
+ *
+ * The first frame of every window is an idle one, and it is the current
+ * frame. A keystroke (a '#') is typed to the vwm, and its idle frame
+ * answers with a token; the time until the token is drawn on the terminal
+ * is the keystroke to echo latency.
+ *
+ * Usage: vwm_load [--json] [--wins=n,n,...] [--frames=n] [--mix=gen,...]
+ *                 [--seconds=n] [--keys=n] [--switch=ms] [--rows=n]
+ *                 [--cols=n] [--tag=str]
+ *
+ *   --json       print a JSON object per run, instead of a table
+ *   --wins=list  the windows of each run (default 1,2,4,8)
+ *   --frames=n   the frames of a window (default 3, at most 6)
+ *   --mix=list   the generators of the other frames, in turn
+ *                (default log,burst,repaint,idle)
+ *   --seconds=n  the duration of a run (default 5)
+ *   --keys=n     the keystrokes per second (default 20)
+ *   --switch=ms  change to the next window that often (default never)
+ *   --rows=n     the size of the terminal (default 50x160)
+ *   --cols=n
+ *   --tag=str    a label for the results (a version, a commit)
+ *
+ * For each run, it reports the latency percentiles, the bytes per second
+ * that the frames got through (in total and of the slowest frame), the
+ * bytes that were drawn on the terminal, and the CPU time (as a share of a
+ * core) and the resident memory of the vwm process.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pty.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+
+#include <libv/libvwm.h>
+
+#define Vwm    this->self
+#define Vframe this->frame
+#define Vwin   this->win
+#define Vterm  this->term
+
+#define MAX_SLOTS    (64 * WIN_OPTS_MAX_FRAMES)
+#define MAX_GENS     8
+#define PROBE_KEY    '#'
+#define MODE_KEY     ('\\' & 0x1f)
+#define WARMUP_MS    500
+#define PROBE_MAX_MS 1000
+#define READ_SIZE    65536
+
+typedef struct load_opts {
+  int
+    json,
+    frames,
+    seconds,
+    keys,
+    switch_ms,
+    rows,
+    cols,
+    num_wins,
+    num_mix;
+
+  int wins[32];
+  char *mix[MAX_GENS];
+  char *tag;
+} load_opts;
+
+/* what the generators share with this process; it is mapped before the
+ * fork of the vwm, so the frames (that do not exec) have it too */
+typedef struct load_shared {
+  volatile unsigned long probe_seq;
+  long bytes[MAX_SLOTS];
+} load_shared;
+
+static load_shared *SHARED = NULL;
+
+typedef struct load_result {
+  int
+    probes,
+    lost;
+
+  double
+    p50,
+    p90,
+    p99,
+    max,
+    in_mb_s,
+    min_kb_s,
+    out_mb_s,
+    cpu;
+
+  long
+    rss_kb,
+    hwm_kb;
+
+  double kb_s[MAX_SLOTS];
+  char *gen[MAX_SLOTS];
+} load_result;
+
+static long clock_ms (void) {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (long) ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+static double clock_msf (void) {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void sleep_ms (long ms) {
+  struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L};
+  while (-1 == nanosleep (&ts, &ts) && errno == EINTR);
+}
+
+/* the generators; they end when the pty of their frame goes away */
+
+static void gen_write (int slot, const char *buf, size_t len) {
+  while (len) {
+    ssize_t n = write (STDOUT_FILENO, buf, len);
+    if (n <= 0) {
+      if (n == -1 && errno == EINTR) continue;
+      _exit (0);
+    }
+
+    __atomic_fetch_add (&SHARED->bytes[slot], n, __ATOMIC_RELAXED);
+    buf += n;
+    len -= n;
+  }
+}
+
+static void gen_log (int slot) {
+  char line[160];
+  long num = 0;
+
+  for (;;) {
+    /* 2000 lines per second */
+    for (int i = 0; i < 20; i++, num++) {
+      int len = snprintf (line, sizeof (line),
+        "%08ld worker-%ld: processed request %ld in %ld us, status 200\n",
+        num, num % 7, num * 31, (num * 17) % 5000);
+      gen_write (slot, line, len);
+    }
+
+    sleep_ms (10);
+  }
+}
+
+static void gen_burst (int slot) {
+  char block[4096];
+
+  for (size_t i = 0; i < sizeof (block); i++)
+    block[i] = ((i + 1) % 80 == 0 ? '\n' : 'a' + (i % 26));
+
+  for (;;) {
+    long end = clock_ms () + 100;
+    while (clock_ms () < end)
+      gen_write (slot, block, sizeof (block));
+
+    sleep_ms (400);
+  }
+}
+
+static void gen_repaint (int slot) {
+  struct winsize ws;
+  if (-1 == ioctl (STDOUT_FILENO, TIOCGWINSZ, &ws) || ws.ws_row == 0)
+    ws.ws_row = 24, ws.ws_col = 80;
+
+  size_t size = (size_t) ws.ws_row * (ws.ws_col + 32) + 16;
+  char *buf = malloc (size);
+  long tick = 0;
+
+  for (;;) {
+    /* 30 times per second */
+    size_t len = 0;
+    len += snprintf (buf + len, size - len, "\033[H");
+
+    for (int r = 1; r <= ws.ws_row; r++) {
+      len += snprintf (buf + len, size - len, "\033[%d;1H\033[3%dm", r,
+          (int) ((r + tick) % 7) + 1);
+
+      for (int c = 0; c < ws.ws_col - 1; c++)
+        buf[len++] = 'a' + ((r * 7 + c + tick) % 26);
+
+      len += snprintf (buf + len, size - len, "\033[m");
+    }
+
+    gen_write (slot, buf, len);
+    tick++;
+    sleep_ms (33);
+  }
+}
+
+static void gen_idle (int slot) {
+  struct termios t;
+  if (0 == tcgetattr (STDIN_FILENO, &t)) {
+    cfmakeraw (&t);
+    tcsetattr (STDIN_FILENO, TCSANOW, &t);
+  }
+
+  char c;
+  char token[32];
+
+  for (;;) {
+    ssize_t n = read (STDIN_FILENO, &c, 1);
+    if (n <= 0) {
+      if (n == -1 && errno == EINTR) continue;
+      _exit (0);
+    }
+
+    if (c == PROBE_KEY) {
+      int len = snprintf (token, sizeof (token), "\r\n#%lu#", SHARED->probe_seq);
+      gen_write (slot, token, len);
+    } else
+      gen_write (slot, &c, 1);
+  }
+}
+
+/* runs instead of the exec of the frame: its argv is the generator and
+ * its slot */
+static int load_at_fork (vwm_frame *frame, vwm_t *this, vwm_win *win) {
+  (void) win;
+
+  int sigs[] = {SIGHUP, SIGINT, SIGQUIT, SIGTERM, SIGSEGV, SIGBUS, SIGWINCH,
+    SIGUSR1, SIGUSR2, SIGCHLD, SIGPIPE};
+
+  for (size_t i = 0; i < sizeof (sigs) / sizeof (sigs[0]); i++)
+    signal (sigs[i], SIG_DFL);
+
+  char **argv = Vframe.get.argv (frame);
+  int slot = atoi (argv[1]);
+
+  if (0 == strcmp (argv[0], "log"))
+    gen_log (slot);
+  else if (0 == strcmp (argv[0], "burst"))
+    gen_burst (slot);
+  else if (0 == strcmp (argv[0], "repaint"))
+    gen_repaint (slot);
+  else
+    gen_idle (slot);
+
+  _exit (0);
+}
+
+/* the vwm process; its terminal is the pty of the harness */
+static int load_vwm (load_opts *opts, int num_wins, load_result *res) {
+  if (NULL == getenv ("TERM"))
+    setenv ("TERM", "xterm", 1);
+
+  vwm_t *this = __init_vwm__ ();
+
+  vwm_term *term = Vwm.get.term (this);
+  Vterm.raw_mode (term);
+
+  int rows, cols;
+  Vterm.init_size (term, &rows, &cols);
+  Vwm.set.size (this, rows, cols, 1);
+
+  char slots[MAX_SLOTS][12];
+  char *argvs[MAX_SLOTS][3];
+  int slot = 0;
+
+  for (int w = 0; w < num_wins; w++) {
+    win_opts w_opts = WinOpts (
+      .num_rows = rows,
+      .num_cols = cols,
+      .num_frames = opts->frames,
+      .max_frames = opts->frames);
+
+    for (int f = 0; f < opts->frames; f++, slot++) {
+      snprintf (slots[slot], 12, "%d", slot);
+      argvs[slot][0] = res->gen[slot];
+      argvs[slot][1] = slots[slot];
+      argvs[slot][2] = NULL;
+
+      w_opts.frame_opts[f].argc = 2;
+      w_opts.frame_opts[f].argv = argvs[slot];
+      w_opts.frame_opts[f].at_fork_cb = load_at_fork;
+    }
+
+    char name[16]; snprintf (name, sizeof (name), "load%d", w);
+    vwm_win *win = Vwm.new.win (this, name, w_opts);
+    Vwin.set.current_at (win, 0);
+  }
+
+  Vterm.screen.save (term);
+  Vterm.screen.clear (term);
+
+  int retval = Vwm.main (this);
+
+  Vterm.screen.restore (term);
+
+  __deinit_vwm__ (&this);
+
+  return retval;
+}
+
+/* the CPU time of a process in milliseconds, and its memory */
+static long proc_cpu_ms (pid_t pid) {
+  char fname[64], buf[1024];
+  snprintf (fname, sizeof (fname), "/proc/%d/stat", pid);
+
+  FILE *fp = fopen (fname, "r");
+  if (NULL == fp) return -1;
+
+  size_t n = fread (buf, 1, sizeof (buf) - 1, fp);
+  fclose (fp);
+  buf[n] = '\0';
+
+  /* the fields after the name; utime and stime are the 14th and 15th */
+  char *sp = strrchr (buf, ')');
+  if (NULL == sp) return -1;
+
+  unsigned long utime, stime;
+  if (2 != sscanf (sp + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+      &utime, &stime))
+    return -1;
+
+  return (long) ((utime + stime) * 1000 / sysconf (_SC_CLK_TCK));
+}
+
+static long proc_status_kb (pid_t pid, char *field) {
+  char fname[64], line[256];
+  snprintf (fname, sizeof (fname), "/proc/%d/status", pid);
+
+  FILE *fp = fopen (fname, "r");
+  if (NULL == fp) return -1;
+
+  long kb = -1;
+  size_t len = strlen (field);
+
+  while (fgets (line, sizeof (line), fp))
+    if (0 == strncmp (line, field, len)) {
+      kb = atol (line + len);
+      break;
+    }
+
+  fclose (fp);
+  return kb;
+}
+
+static int cmp_double (const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+static double percentile (double *s, int num, double p) {
+  if (num == 0) return 0;
+  int idx = (int) (p * (num - 1) + 0.5);
+  return s[idx];
+}
+
+/* drains the terminal until the vwm exits, or kills it */
+static void load_quit (int fd, pid_t pid) {
+  char buf[READ_SIZE];
+  char quit[] = {MODE_KEY, 'q'};
+
+  if (-1 == write (fd, quit, sizeof (quit))) {}
+
+  long end = clock_ms () + 3000;
+  while (clock_ms () < end) {
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    if (0 < poll (&pfd, 1, 100)) {
+      if (0 >= read (fd, buf, sizeof (buf))) break;
+    }
+
+    if (pid == waitpid (pid, NULL, WNOHANG)) {
+      pid = -1;
+      break;
+    }
+  }
+
+  if (pid != -1) {
+    kill (pid, SIGKILL);
+    waitpid (pid, NULL, 0);
+  }
+
+  close (fd);
+}
+
+static int load_run (load_opts *opts, int num_wins, load_result *res) {
+  int num_slots = num_wins * opts->frames;
+  int mix = 0;
+
+  memset (SHARED, 0, sizeof (load_shared));
+
+  for (int i = 0; i < num_slots; i++)
+    res->gen[i] = (i % opts->frames == 0 ? "idle" : opts->mix[mix++ % opts->num_mix]);
+
+  struct winsize ws = {.ws_row = opts->rows, .ws_col = opts->cols};
+
+  int fd;
+  pid_t pid = forkpty (&fd, NULL, NULL, &ws);
+  if (-1 == pid) return -1;
+
+  if (0 == pid)
+    _exit (load_vwm (opts, num_wins, res));
+
+  int max_samples = opts->seconds * opts->keys + 16;
+  double *samples = malloc (sizeof (double) * max_samples);
+
+  long base[MAX_SLOTS];
+  long cpu = 0;
+  size_t out_bytes = 0;
+
+  char buf[READ_SIZE + 32];
+  char token[32];
+  int keep = 0;
+  int toklen = 0;
+
+  long now = clock_ms ();
+  long warm = now + WARMUP_MS;
+  long end = warm + opts->seconds * 1000L;
+  long next_probe = warm;
+  long next_switch = (opts->switch_ms > 0 ? warm + opts->switch_ms : -1);
+  int interval = (opts->keys > 0 ? 1000 / opts->keys : -1);
+  int is_warm = 0;
+  int pending = 0;
+  double sent = 0;
+
+  res->probes = res->lost = 0;
+
+  for (;;) {
+    now = clock_ms ();
+    if (now >= end) break;
+
+    if (0 == is_warm && now >= warm) {
+      is_warm = 1;
+      cpu = proc_cpu_ms (pid);
+      out_bytes = 0;
+      for (int i = 0; i < num_slots; i++)
+        base[i] = __atomic_load_n (&SHARED->bytes[i], __ATOMIC_RELAXED);
+    }
+
+    if (pending && clock_msf () - sent > PROBE_MAX_MS) {
+      res->lost++;
+      pending = 0;
+    }
+
+    if (is_warm && 0 == pending && interval > 0 && now >= next_probe &&
+        res->probes < max_samples) {
+      SHARED->probe_seq++;
+      toklen = snprintf (token, sizeof (token), "#%lu#", SHARED->probe_seq);
+      char c = PROBE_KEY;
+      sent = clock_msf ();
+      if (1 == write (fd, &c, 1))
+        pending = 1;
+      next_probe = now + interval;
+    }
+
+    if (is_warm && 0 == pending && next_switch != -1 && now >= next_switch) {
+      char key[] = {MODE_KEY, 'l'};
+      if (-1 == write (fd, key, sizeof (key))) {}
+      next_switch = now + opts->switch_ms;
+    }
+
+    long timeout = end - now;
+    if (0 == is_warm && warm - now < timeout) timeout = warm - now;
+    if (pending) timeout = 5;
+    else if (interval > 0 && is_warm && next_probe - now < timeout)
+      timeout = next_probe - now;
+    if (timeout < 0) timeout = 0;
+
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    if (0 >= poll (&pfd, 1, (int) timeout)) continue;
+
+    ssize_t n = read (fd, buf + keep, READ_SIZE);
+    if (n <= 0) {
+      if (n == -1 && errno == EINTR) continue;
+      fprintf (stderr, "vwm exited before the end of the run\n");
+      waitpid (pid, NULL, 0);
+      close (fd);
+      free (samples);
+      return -1;
+    }
+
+    out_bytes += n;
+
+    if (pending) {
+      if (memmem (buf, keep + n, token, toklen)) {
+        samples[res->probes++] = clock_msf () - sent;
+        pending = 0;
+        keep = 0;
+        continue;
+      }
+
+      /* the token might be split between two reads */
+      int len = keep + n;
+      keep = (len < toklen - 1 ? len : toklen - 1);
+      memmove (buf, buf + len - keep, keep);
+    } else
+      keep = 0;
+  }
+
+  double secs = opts->seconds;
+
+  res->cpu = (proc_cpu_ms (pid) - cpu) / (secs * 1000) * 100;
+  res->rss_kb = proc_status_kb (pid, "VmRSS:");
+  res->hwm_kb = proc_status_kb (pid, "VmHWM:");
+
+  double total = 0;
+  res->min_kb_s = -1;
+
+  for (int i = 0; i < num_slots; i++) {
+    long bytes = __atomic_load_n (&SHARED->bytes[i], __ATOMIC_RELAXED) - base[i];
+    res->kb_s[i] = bytes / 1024.0 / secs;
+    total += bytes;
+
+    /* an idle frame writes only the echo */
+    if (strcmp (res->gen[i], "idle") && (res->min_kb_s < 0 || res->kb_s[i] < res->min_kb_s))
+      res->min_kb_s = res->kb_s[i];
+  }
+
+  if (res->min_kb_s < 0) res->min_kb_s = 0;
+
+  res->in_mb_s = total / (1024.0 * 1024.0) / secs;
+  res->out_mb_s = out_bytes / (1024.0 * 1024.0) / secs;
+
+  qsort (samples, res->probes, sizeof (double), cmp_double);
+  res->p50 = percentile (samples, res->probes, 0.50);
+  res->p90 = percentile (samples, res->probes, 0.90);
+  res->p99 = percentile (samples, res->probes, 0.99);
+  res->max = (res->probes ? samples[res->probes - 1] : 0);
+
+  free (samples);
+
+  load_quit (fd, pid);
+  return 0;
+}
+
+static void load_print (load_opts *opts, int num_wins, load_result *res) {
+  int num_slots = num_wins * opts->frames;
+
+  if (opts->json) {
+    fprintf (stdout,
+      "{\"tag\": \"%s\", \"wins\": %d, \"frames\": %d, \"rows\": %d, \"cols\": %d, "
+      "\"seconds\": %d, \"keys\": %d, \"switch_ms\": %d, \"probes\": %d, \"lost\": %d, "
+      "\"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f, "
+      "\"in_mb_s\": %.3f, \"min_frame_kb_s\": %.3f, \"out_mb_s\": %.3f, "
+      "\"cpu\": %.1f, \"rss_kb\": %ld, \"hwm_kb\": %ld, \"frame_kb_s\": [",
+      (opts->tag ? opts->tag : ""), num_wins, opts->frames, opts->rows, opts->cols,
+      opts->seconds, opts->keys, opts->switch_ms, res->probes, res->lost,
+      res->p50, res->p90, res->p99, res->max, res->in_mb_s, res->min_kb_s,
+      res->out_mb_s, res->cpu, res->rss_kb, res->hwm_kb);
+
+    for (int i = 0; i < num_slots; i++)
+      fprintf (stdout, "%s{\"win\": %d, \"frame\": %d, \"gen\": \"%s\", \"kb_s\": %.3f}",
+        (i ? ", " : ""), i / opts->frames, i % opts->frames, res->gen[i], res->kb_s[i]);
+
+    fprintf (stdout, "]}\n");
+    return;
+  }
+
+  fprintf (stdout, "%5d %6d %7.2f %7.2f %7.2f %7.2f %5d %8.2f %9.2f %8.2f %6.1f %8ld\n",
+    num_wins, opts->frames, res->p50, res->p90, res->p99, res->max, res->lost,
+    res->in_mb_s, res->min_kb_s, res->out_mb_s, res->cpu, res->hwm_kb);
+}
+
+static int load_usage (char *name) {
+  fprintf (stderr,
+    "usage: %s [--json] [--wins=n,n,...] [--frames=n] [--mix=log,burst,repaint,idle]\n"
+    "       [--seconds=n] [--keys=n] [--switch=ms] [--rows=n] [--cols=n] [--tag=str]\n", name);
+  return 1;
+}
+
+static int parse_list (char *s, char **list, int max) {
+  int num = 0;
+  char *sp;
+  for (char *tok = strtok_r (s, ",", &sp); tok && num < max; tok = strtok_r (NULL, ",", &sp))
+    list[num++] = tok;
+  return num;
+}
+
+int main (int argc, char **argv) {
+  load_opts opts = {
+    .json = 0, .frames = 3, .seconds = 5, .keys = 20, .switch_ms = 0,
+    .rows = 50, .cols = 160, .num_wins = 0, .num_mix = 0, .tag = NULL};
+
+  char wins_default[] = "1,2,4,8";
+  char mix_default[] = "log,burst,repaint,idle";
+  char *wins = wins_default;
+  char *mix = mix_default;
+
+  for (int i = 1; i < argc; i++) {
+    if (0 == strcmp (argv[i], "--json"))
+      opts.json = 1;
+    else if (0 == strncmp (argv[i], "--wins=", 7))
+      wins = argv[i] + 7;
+    else if (0 == strncmp (argv[i], "--frames=", 9))
+      opts.frames = atoi (argv[i] + 9);
+    else if (0 == strncmp (argv[i], "--mix=", 6))
+      mix = argv[i] + 6;
+    else if (0 == strncmp (argv[i], "--seconds=", 10))
+      opts.seconds = atoi (argv[i] + 10);
+    else if (0 == strncmp (argv[i], "--keys=", 7))
+      opts.keys = atoi (argv[i] + 7);
+    else if (0 == strncmp (argv[i], "--switch=", 9))
+      opts.switch_ms = atoi (argv[i] + 9);
+    else if (0 == strncmp (argv[i], "--rows=", 7))
+      opts.rows = atoi (argv[i] + 7);
+    else if (0 == strncmp (argv[i], "--cols=", 7))
+      opts.cols = atoi (argv[i] + 7);
+    else if (0 == strncmp (argv[i], "--tag=", 6))
+      opts.tag = argv[i] + 6;
+    else
+      return load_usage (argv[0]);
+  }
+
+  char *list[32];
+  int num = parse_list (wins, list, 32);
+  for (int i = 0; i < num; i++) {
+    int n = atoi (list[i]);
+    if (n <= 0 || n * opts.frames > MAX_SLOTS) return load_usage (argv[0]);
+    opts.wins[opts.num_wins++] = n;
+  }
+
+  opts.num_mix = parse_list (mix, opts.mix, MAX_GENS);
+  for (int i = 0; i < opts.num_mix; i++)
+    if (strcmp (opts.mix[i], "log") && strcmp (opts.mix[i], "burst") &&
+        strcmp (opts.mix[i], "repaint") && strcmp (opts.mix[i], "idle"))
+      return load_usage (argv[0]);
+
+  if (opts.num_wins == 0 || opts.num_mix == 0 || opts.seconds <= 0 ||
+      opts.frames <= 0 || opts.frames > WIN_OPTS_MAX_FRAMES ||
+      opts.keys < 0 || opts.keys > 1000 || opts.rows < 10 || opts.cols < 40)
+    return load_usage (argv[0]);
+
+  SHARED = mmap (NULL, sizeof (load_shared), PROT_READ|PROT_WRITE,
+      MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if (MAP_FAILED == SHARED) return 1;
+
+  signal (SIGPIPE, SIG_IGN);
+
+  if (0 == opts.json)
+    fprintf (stdout, "%5s %6s %7s %7s %7s %7s %5s %8s %9s %8s %6s %8s\n",
+      "wins", "frames", "p50ms", "p90ms", "p99ms", "maxms", "lost",
+      "in MB/s", "min KB/s", "out MB/s", "cpu%", "rss KB");
+
+  int retval = 0;
+
+  for (int i = 0; i < opts.num_wins; i++) {
+    load_result res;
+
+    if (-1 == load_run (&opts, opts.wins[i], &res)) {
+      retval = 1;
+      continue;
+    }
+
+    load_print (&opts, opts.wins[i], &res);
+    fflush (stdout);
+  }
+
+  munmap (SHARED, sizeof (load_shared));
+  return retval;
+}
@@ -0,0 +1,186 @@
+/* Replays a session that has been recorded with Vwm.set.recorder().
+ *
+ * Usage: vwm_replay [--info] [--dump] [--frame=id] [--at=seconds] [--speed=n] file
+ *
+ *   --info       print the recorded frames and the duration
+ *   --dump       print the screen of the frame at --at (default at the end)
+ *   --frame=id   the recorded frame to replay (default the first one)
+ *   --at=sec     start (or dump) at this point in time
+ *   --speed=n    playback speed (default 1); idle time is capped to two seconds
+ *
+ * While playing, `q' quits.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/select.h>
+#include <sys/termios.h>
+
+#include <libv/libvwm.h>
+
+#define Vwm    this->self
+#define Vframe this->frame
+#define Vwin   this->win
+#define Vterm  this->term
+
+#define MAX_IDLE_MS 2000
+
+static int replay_usage (char *name) {
+  fprintf (stderr,
+    "usage: %s [--info] [--dump] [--frame=id] [--at=seconds] [--speed=n] file\n", name);
+  return 1;
+}
+
+static int replay_info (vwm_replay_info *info) {
+  fprintf (stdout, "duration  : %ld.%03ld sec\n", info->duration_ms / 1000, info->duration_ms % 1000);
+  fprintf (stdout, "keyframes : %ld\n", info->num_keyframes);
+
+  for (int i = 0; i < info->num_frames; i++)
+    fprintf (stdout, "frame %-4d: %dx%d, first seen at %ld.%03ld sec\n",
+        info->frames[i].id, info->frames[i].num_rows, info->frames[i].num_cols,
+        info->frames[i].first_ms / 1000, info->frames[i].first_ms % 1000);
+
+  return 0;
+}
+
+static int replay_play (vwm_t *this, vwm_replay *rp, vwm_replay_frame *rframe, long at_ms, double speed) {
+  vwm_term *term =  Vwm.get.term (this);
+
+  Vterm.raw_mode (term);
+
+  int rows, cols;
+  Vterm.init_size (term, &rows, &cols);
+
+  Vwm.set.size (this, rows, cols, 1);
+
+  win_opts w_opts = WinOpts (
+    .num_rows = rows,
+    .num_cols = cols,
+    .num_frames = 1,
+    .max_frames = 1);
+
+  w_opts.frame_opts[0].fork = 0;
+
+  vwm_win *win = Vwm.new.win (this, "replay", w_opts);
+  vwm_frame *frame = Vwin.get.frame_at (win, 0);
+
+  if (-1 == Vwm.replay.seek (this, rp, frame, rframe->id, at_ms))
+    return 1;
+
+  Vterm.screen.save (term);
+  Vterm.screen.clear (term);
+
+  Vwin.draw (win);
+
+  long prev = at_ms;
+  long ts;
+  char *buf;
+  int len;
+
+  while (0 == Vwm.replay.next (this, rp, &ts, &buf, &len)) {
+    long delay = (long) ((ts - prev) / speed);
+    if (delay > MAX_IDLE_MS) delay = MAX_IDLE_MS;
+
+    fd_set read_mask;
+    FD_ZERO (&read_mask);
+    FD_SET (STDIN_FILENO, &read_mask);
+    struct timeval tv = {.tv_sec = delay / 1000, .tv_usec = (delay % 1000) * 1000};
+
+    if (0 < select (STDIN_FILENO + 1, &read_mask, NULL, NULL, &tv)) {
+      char c;
+      if (1 == read (STDIN_FILENO, &c, 1) && c == 'q')
+        break;
+    }
+
+    Vwin.set.frame (win, frame);
+    Vframe.process_output (frame, buf, len);
+    prev = ts;
+  }
+
+  Vterm.screen.restore (term);
+  return 0;
+}
+
+int main (int argc, char **argv) {
+  char *fname = NULL;
+  int frame_id = -1, dump = 0, info = 0;
+  long at_ms = -1;
+  double speed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (0 == strcmp (argv[i], "--info"))
+      info = 1;
+    else if (0 == strcmp (argv[i], "--dump"))
+      dump = 1;
+    else if (0 == strncmp (argv[i], "--frame=", 8))
+      frame_id = atoi (argv[i] + 8);
+    else if (0 == strncmp (argv[i], "--at=", 5))
+      at_ms = (long) (atof (argv[i] + 5) * 1000);
+    else if (0 == strncmp (argv[i], "--speed=", 8))
+      speed = atof (argv[i] + 8);
+    else if (argv[i][0] == '-')
+      return replay_usage (argv[0]);
+    else
+      fname = argv[i];
+  }
+
+  if (NULL == fname || speed <= 0) return replay_usage (argv[0]);
+
+  vwm_t *this = __init_vwm__ ();
+
+  int retval = 1;
+
+  vwm_replay *rp = Vwm.replay.open (this, fname);
+  if (NULL == rp) {
+    fprintf (stderr, "%s: not a recording\n", fname);
+    goto theend;
+  }
+
+  vwm_replay_info *rinfo = Vwm.replay.info (this, rp);
+
+  if (info) {
+    retval = replay_info (rinfo);
+    goto theend;
+  }
+
+  vwm_replay_frame *rframe = NULL;
+  for (int i = 0; i < rinfo->num_frames; i++)
+    if (frame_id == -1 || rinfo->frames[i].id == frame_id) {
+      rframe = &rinfo->frames[i];
+      break;
+    }
+
+  if (NULL == rframe) {
+    fprintf (stderr, "%s: no such frame\n", fname);
+    goto theend;
+  }
+
+  if (dump) {
+    win_opts w_opts = WinOpts (
+      .num_rows = rframe->num_rows + 1,
+      .num_cols = rframe->num_cols,
+      .num_frames = 1,
+      .max_frames = 1);
+
+    w_opts.frame_opts[0].fork = 0;
+
+    vwm_win *win = Vwm.new.win (this, "replay", w_opts);
+    vwm_frame *frame = Vwin.get.frame_at (win, 0);
+
+    if (0 == Vwm.replay.seek (this, rp, frame, rframe->id,
+        (at_ms < 0 ? rinfo->duration_ms : at_ms)))
+      retval = (0 == Vframe.dump (frame, STDOUT_FILENO) ? 0 : 1);
+
+    goto theend;
+  }
+
+  retval = replay_play (this, rp, rframe, (at_ms < 0 ? 0 : at_ms), speed);
+
+theend:
+  Vwm.replay.close (this, &rp);
+  __deinit_vwm__ (&this);
+  return retval;
+}
@@ -0,0 +1,194 @@
+/* Decodes a trace that has been written by Vwm.dump_trace() (or by the
+ * vwm when the trace stops, or when it crashes).
+ *
+ * Usage: vwm_trace [--frame=id] [--type=name] [--last=n] file
+ *
+ *   --frame=id   only the events of this frame
+ *   --type=name  only the events of this type (read, write, sequence,
+ *                unimplemented, render, resize, log-compress, rec-write)
+ *   --last=n     only the last n events
+ *
+ * The events of all the threads are merged by their time, that is printed
+ * in seconds from the first event.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/termios.h>
+
+#include <libv/libvwm.h>
+
+typedef struct trace_entry {
+  vwm_trace_event ev;
+  uint thread;
+} trace_entry;
+
+static const char *TYPES[] = {
+  NULL, "read", "write", "sequence", "unimplemented", "render", "resize",
+  "log-compress", "rec-write"};
+
+#define NUM_TYPES (int) (sizeof (TYPES) / sizeof (TYPES[0]))
+
+static const char *STATES[] = {"", "ESC", "CSI", "CSI ?", "ESC (", "ESC )", "ESC #"};
+
+#define NUM_STATES (int) (sizeof (STATES) / sizeof (STATES[0]))
+
+static int trace_usage (char *name) {
+  fprintf (stderr, "usage: %s [--frame=id] [--type=name] [--last=n] file\n", name);
+  return 1;
+}
+
+static int cmp_entry (const void *a, const void *b) {
+  const trace_entry *x = a, *y = b;
+  return (x->ev.ns > y->ev.ns) - (x->ev.ns < y->ev.ns);
+}
+
+static void print_char (uint c) {
+  if (c >= 0x20 && c < 0x7f)
+    fprintf (stdout, "'%c'", (int) c);
+  else
+    fprintf (stdout, "0x%02x", c);
+}
+
+static void print_entry (trace_entry *e, long long first_ns) {
+  vwm_trace_event *ev = &e->ev;
+  long long ns = ev->ns - first_ns;
+
+  fprintf (stdout, "%6lld.%06lld  thread %-2u ", ns / 1000000000LL, (ns % 1000000000LL) / 1000,
+      e->thread);
+
+  if (ev->frame)
+    fprintf (stdout, "frame %-4u ", ev->frame);
+  else
+    fprintf (stdout, "%-10s ", "");
+
+  fprintf (stdout, "%-14s", (ev->type < NUM_TYPES && TYPES[ev->type] ? TYPES[ev->type] : "?"));
+
+  switch (ev->type) {
+    case VWM_TRACE_READ:
+    case VWM_TRACE_WRITE:
+      fprintf (stdout, "%u bytes", ev->a);
+      break;
+
+    case VWM_TRACE_SEQUENCE:
+    case VWM_TRACE_UNIMPLEMENTED:
+      fprintf (stdout, "%s ", ((int) ev->c < NUM_STATES ? STATES[ev->c] : "?"));
+      print_char (ev->a);
+      fprintf (stdout, " %d", (int) ev->b);
+      break;
+
+    case VWM_TRACE_RENDER:
+      fprintf (stdout, "%u bytes in, %u out, %u us", ev->a, ev->b, ev->c);
+      break;
+
+    case VWM_TRACE_RESIZE:
+      fprintf (stdout, "%ux%u", ev->a, ev->b);
+      break;
+
+    case VWM_TRACE_LOG_COMPRESS:
+      fprintf (stdout, "%s", (ev->a ? "done" : "failed"));
+      break;
+
+    case VWM_TRACE_REC_WRITE:
+      fprintf (stdout, "%u bytes, %u of index", ev->a, ev->b);
+      break;
+
+    default:
+      fprintf (stdout, "%u %u %u", ev->a, ev->b, ev->c);
+  }
+
+  fprintf (stdout, "\n");
+}
+
+int main (int argc, char **argv) {
+  char *fname = NULL;
+  int frame = -1;
+  int type = -1;
+  long last = -1;
+
+  for (int i = 1; i < argc; i++) {
+    if (0 == strncmp (argv[i], "--frame=", 8))
+      frame = atoi (argv[i] + 8);
+    else if (0 == strncmp (argv[i], "--type=", 7)) {
+      for (int t = 1; t < NUM_TYPES; t++)
+        if (0 == strcmp (argv[i] + 7, TYPES[t])) type = t;
+
+      if (-1 == type) return trace_usage (argv[0]);
+    } else if (0 == strncmp (argv[i], "--last=", 7))
+      last = atol (argv[i] + 7);
+    else if (argv[i][0] == '-')
+      return trace_usage (argv[0]);
+    else
+      fname = argv[i];
+  }
+
+  if (NULL == fname) return trace_usage (argv[0]);
+
+  FILE *fp = fopen (fname, "r");
+  if (NULL == fp) {
+    fprintf (stderr, "%s: can not be opened\n", fname);
+    return 1;
+  }
+
+  vwm_trace_header hdr;
+  if (1 != fread (&hdr, sizeof (hdr), 1, fp) ||
+      memcmp (hdr.magic, VWM_TRACE_MAGIC, sizeof (hdr.magic)) ||
+      hdr.version != VWM_TRACE_VERSION || hdr.event_size != sizeof (vwm_trace_event)) {
+    fprintf (stderr, "%s: is not a trace of this version\n", fname);
+    fclose (fp);
+    return 1;
+  }
+
+  trace_entry *entries = NULL;
+  long num = 0;
+  int retval = 0;
+
+  for (uint r = 0; r < hdr.num_rings; r++) {
+    vwm_trace_ring_header rhdr;
+    if (1 != fread (&rhdr, sizeof (rhdr), 1, fp)) {
+      fprintf (stderr, "%s: is truncated\n", fname);
+      retval = 1;
+      break;
+    }
+
+    if (rhdr.total > rhdr.num_events)
+      fprintf (stdout, "thread %u: the first %lld events have been overwritten\n",
+          rhdr.thread, rhdr.total - rhdr.num_events);
+
+    entries = realloc (entries, sizeof (trace_entry) * (num + rhdr.num_events));
+
+    for (long long i = 0; i < rhdr.num_events; i++) {
+      vwm_trace_event ev;
+      if (1 != fread (&ev, sizeof (ev), 1, fp)) {
+        fprintf (stderr, "%s: is truncated\n", fname);
+        retval = 1;
+        break;
+      }
+
+      if (frame != -1 && ev.frame != frame) continue;
+      if (type != -1 && ev.type != type) continue;
+
+      entries[num].ev = ev;
+      entries[num].thread = rhdr.thread;
+      num++;
+    }
+
+    if (retval) break;
+  }
+
+  fclose (fp);
+
+  qsort (entries, num, sizeof (trace_entry), cmp_entry);
+
+  long from = (last >= 0 && last < num ? num - last : 0);
+
+  for (long i = from; i < num; i++)
+    print_entry (&entries[i], entries[0].ev.ns);
+
+  free (entries);
+  return retval;
+}
@@ -13,6 +13,7 @@
 #include <sys/shm.h>
 #include <termios.h>
 #include <signal.h>
+#include <time.h>
 #include <errno.h>
 
 #include <libv/libvwm.h>
@@ -52,6 +53,9 @@ struct vwmed_prop {
 
   VwmEditFile_cb edit_file_cb;
 
+  vwm_search_result *search_result;
+  int search_jump;
+
   void *objects[NUM_OBJECTS];
 };
 
@@ -156,6 +160,72 @@ theend:
   return OK;
 }
 
+private void vwmed_print_stats (FILE *fp, vframe_stats *stats) {
+  fprintf (fp, "Bytes read         : %ld\n", stats->bytes_read);
+  fprintf (fp, "Bytes rendered     : %ld\n", stats->bytes_rendered);
+  fprintf (fp, "Sequences          : %ld\n", stats->sequences);
+  fprintf (fp, "Unimplemented      : %ld\n", stats->unimplemented);
+  fprintf (fp, "Scrolled lines     : %ld\n", stats->scrolls);
+  fprintf (fp, "Render time        : %.3f ms\n", stats->render_ns / 1e6);
+  fprintf (fp, "Write backlog      : %ld\n", stats->write_backlog);
+  fprintf (fp, "Read backlog       : %ld\n", stats->read_backlog);
+
+  ifnot (stats->last_activity) {
+    fprintf (fp, "Last activity      : None\n");
+    return;
+  }
+
+  time_t secs = stats->last_activity / 1000;
+  struct tm tm;
+  char buf[32];
+  strftime (buf, sizeof (buf), "%Y-%m-%d %H:%M:%S", localtime_r (&secs, &tm));
+  fprintf (fp, "Last activity      : %s.%03ld\n", buf, stats->last_activity % 1000);
+}
+
+private void vwmed_print_latency (FILE *fp, vframe_latency *lat) {
+  static const char *labels[NUM_LATENCIES] = {
+    "Input to pty       :",
+    "Pty to parse       :",
+    "Parse to present   :"};
+
+  for (int i = 0; i < NUM_LATENCIES; i++) {
+    ifnot (lat[i].count) continue;
+    fprintf (fp, "%s %ld keys, p50 %ld, p90 %ld, p99 %ld, max %ld (us)\n", labels[i],
+        lat[i].count, lat[i].p50, lat[i].p90, lat[i].p99, lat[i].max);
+  }
+}
+
+private void vwmed_print_unimplemented (FILE *fp, vwm_info *vinfo) {
+  ifnot (vinfo->num_unimplemented) return;
+
+  fprintf (fp, "\n--= unimplemented sequences --=\n");
+  for (int i = 0; i < vinfo->num_unimplemented; i++) {
+    vwm_unimplemented *u = &vinfo->unimplemented[i];
+    fprintf (fp, "%-19s: '%c' %d param %d, %ld times, frames %d..%d\n", u->fun,
+        (u->c >= ' ' and u->c < 0x7f ? u->c : '?'), u->c, u->param, u->count,
+        u->first_frame, u->last_frame);
+  }
+
+  if (vinfo->unimplemented_dropped)
+    fprintf (fp, "Not counted        : %ld\n", vinfo->unimplemented_dropped);
+}
+
+private void vwmed_print_allocations (FILE *fp, vwm_alloc_stats *stats) {
+  if (NULL is stats) return;
+
+  fprintf (fp, "\n--= allocations --=\n");
+  fprintf (fp, "Live bytes         : %ld in %ld allocations\n", stats->live_bytes, stats->live_allocs);
+  fprintf (fp, "Peak bytes         : %ld\n", stats->peak_bytes);
+  fprintf (fp, "Allocations        : %ld\n", stats->allocs);
+
+  for (int i = 0; i < stats->num_sites and i < 20; i++) {
+    vwm_alloc_site *site = &stats->sites[i];
+    fprintf (fp, "%-19s: %ld live (%ld), peak %ld, %ld allocations\n",
+        (NULL is site->site ? "other" : site->site), site->live_bytes,
+        site->live_allocs, site->peak_bytes, site->allocs);
+  }
+}
+
 private void vwmed_get_info (vwmed_t *this, vwm_t *vwm) {
   tmpfname_t *tmpn = File.tmpfname.new (Vwm.get.tmpdir (vwm), "vwmed_info");
   if (NULL is tmpn or -1 is tmpn->fd) return;
@@ -170,6 +240,8 @@ private void vwmed_get_info (vwmed_t *this, vwm_t *vwm) {
   fprintf (fp, "Unimplemented fname: %s\n", vinfo->unimplemented_fname);
   fprintf (fp, "Num windows        : %d\n", vinfo->num_win);
   fprintf (fp, "Current window idx : %d\n", vinfo->cur_win_idx);
+  vwmed_print_unimplemented (fp, vinfo);
+  vwmed_print_allocations (fp, vinfo->allocations);
 
   for (int widx = 0; widx < vinfo->num_win; widx++) {
     vwin_info *w_info = vinfo->wins[widx];
@@ -180,11 +252,13 @@ private void vwmed_get_info (vwmed_t *this, vwm_t *vwm) {
     fprintf (fp, "Num frames         : %d\n", w_info->num_frames);
     fprintf (fp, "Visible frames     : %d\n", w_info->num_visible_frames);
     fprintf (fp, "Current frame idx  : %d\n", w_info->cur_frame_idx);
+    vwmed_print_stats (fp, &w_info->stats);
 
     for (int fidx = 0; fidx < w_info->num_frames; fidx++) {
       vframe_info *f_info = w_info->frames[fidx];
       fprintf (fp, "\n--= %s frame [%d] =--\n", w_info->name, fidx);
       fprintf (fp, "At frame           : %d\n", f_info->at_frame);
+      fprintf (fp, "Frame id           : %d\n", f_info->id);
       fprintf (fp, "Frame pid          : %d\n", f_info->pid);
       fprintf (fp, "Frame num rows     : %d\n", f_info->num_rows);
       fprintf (fp, "Frame first row    : %d\n", f_info->first_row);
@@ -192,6 +266,12 @@ private void vwmed_get_info (vwmed_t *this, vwm_t *vwm) {
       fprintf (fp, "It is current      : %s\n", (f_info->is_current ? "Yes" : "No"));
       fprintf (fp, "Frame is visible   : %s\n", (f_info->is_visible ? "Yes" : "No"));
       fprintf (fp, "Frame logfile      : %s\n", (f_info->logfile[0] isnot 0 ? f_info->logfile : "Hasn't been set"));
+      fprintf (fp, "Log max size       : %ld\n", f_info->log_max_size);
+      fprintf (fp, "Log segment size   : %ld\n", f_info->log_segment_size);
+      fprintf (fp, "Log segments       : %d%s\n", f_info->num_log_segments,
+          (f_info->log_compress ? " (compressed)" : ""));
+      vwmed_print_stats (fp, &f_info->stats);
+      vwmed_print_latency (fp, f_info->latency);
       fprintf (fp, "Frame argv         :");
 
       int arg = 0;
@@ -215,6 +295,56 @@ private void vwmed_get_info (vwmed_t *this, vwm_t *vwm) {
   //File.tmpfname.free (tmpn);
 }
 
+private void vwmed_get_search_result (vwmed_t *this, vwm_t *vwm) {
+  vwm_search_result *res = $my(search_result);
+  if (NULL is res) return;
+
+  tmpfname_t *tmpn = File.tmpfname.new (Vwm.get.tmpdir (vwm), "vwmed_search");
+  if (NULL is tmpn or -1 is tmpn->fd) return;
+
+  FILE *fp = fdopen (tmpn->fd, "w+");
+
+  fprintf (fp, "==- Search -==\n");
+  fprintf (fp, "Pattern            : %s\n", res->pattern);
+  fprintf (fp, "Num hits           : %d\n", res->num_hits);
+  fprintf (fp, "Searched frames    : %d\n", res->num_frames);
+  fprintf (fp, "Num threads        : %d\n", res->num_threads);
+  fprintf (fp, "Elapsed            : %ld.%03ld ms\n\n",
+      res->elapsed_usec / 1000, res->elapsed_usec % 1000);
+
+  for (int i = 0; i < res->num_hits; i++) {
+    vwm_search_hit *hit = &res->hits[i];
+    fprintf (fp, "%4d  %s frame[%d] %s line %d | %s\n", i + 1,
+        hit->win_name, hit->frame_idx, (hit->is_history ? "history" : "screen "),
+        hit->line_nr, hit->line);
+  }
+
+  if (res->num_hits)
+    fprintf (fp, "\nuse: search --jump=N, to focus the frame of the Nth hit\n");
+
+  fflush (fp);
+
+  $my(state) |= (VWMED_BUF_IS_PAGER|VWMED_BUF_HASNOT_EMPTYLINE|
+                 VWMED_BUF_DONOT_SHOW_STATUSLINE|VWMED_BUF_DONOT_SHOW_TOPLINE);
+
+  $my(edit_file_cb) (vwm, Vwm.get.current_frame (vwm), tmpn->fname->bytes, this);
+}
+
+private void vwmed_search_cb (vwm_t *vwm, vwm_search_result *res, void *object) {
+  vwmed_t *this = (vwmed_t *) object;
+
+  Vwm.search.release (vwm, &$my(search_result));
+  $my(search_result) = res;
+
+  if ($my(search_jump)) {
+    Vwm.search.jump (vwm, res, $my(search_jump) - 1);
+    $my(search_jump) = 0;
+    return;
+  }
+
+  vwmed_get_search_result (this, vwm);
+}
+
 private int vwmed_process_rline (vwmed_t *this, rline_t *rl, vwm_t *vwm, vwm_win *win, vwm_frame *frame) {
   int retval;
   string_t *com = NULL;
@@ -339,20 +469,126 @@ private int vwmed_process_rline (vwmed_t *this, rline_t *rl, vwm_t *vwm, vwm_win
 
   } else if (Cstring.eq (com->bytes, "set")) {
     string_t *log_file = Rline.get.anytype_arg (rl, "log-file");
-    if (NULL is log_file)
+    string_t *log_max_size = Rline.get.anytype_arg (rl, "log-max-size");
+    string_t *log_segment_size = Rline.get.anytype_arg (rl, "log-segment-size");
+    string_t *log_compress = Rline.get.anytype_arg (rl, "log-compress");
+    string_t *trace = Rline.get.anytype_arg (rl, "trace");
+    string_t *allocations = Rline.get.anytype_arg (rl, "allocations");
+
+    if (NULL is log_file and NULL is log_max_size and
+        NULL is log_segment_size and NULL is log_compress and NULL is trace and
+        NULL is allocations)
+      goto theend;
+
+    if (NULL isnot allocations) {
+      if (atoi (allocations->bytes))
+        Vwm.set.debug.allocations (vwm);
+      else
+        Vwm.unset.debug.allocations (vwm);
+    }
+
+    if (NULL isnot trace) {
+      if (atoi (trace->bytes))
+        Vwm.set.debug.sequences (vwm, NULL);
+      else
+        Vwm.unset.debug.sequences (vwm);
+    }
+
+    if (NULL isnot log_file) {
+      int set_log = atoi (log_file->bytes);
+      if (set_log)
+        Vframe.set.log (frame, NULL, 1);
+      else
+        Vframe.release_log (frame);
+    }
+
+    if (NULL isnot log_max_size or NULL isnot log_segment_size or NULL isnot log_compress) {
+      vframe_info *finfo = Vframe.get.info (frame);
+
+      /* a new limit alone derives the segment size again */
+      long segment_size = (NULL isnot log_segment_size ? atol (log_segment_size->bytes) :
+          (NULL isnot log_max_size ? 0 : finfo->log_segment_size));
+
+      Vframe.set.log_policy (frame,
+          (NULL is log_max_size ? finfo->log_max_size : atol (log_max_size->bytes)),
+          segment_size,
+          (NULL is log_compress ? finfo->log_compress : atoi (log_compress->bytes)));
+
+      Vframe.release_info (finfo);
+    }
+
+    retval = OK;
+    goto theend;
+
+  } else if (Cstring.eq (com->bytes, "frame_export_log")) {
+    string_t *a_file = Rline.get.anytype_arg (rl, "file");
+    if (NULL is a_file)
       goto theend;
-    int set_log = atoi (log_file->bytes);
-    if (set_log)
-      Vframe.set.log (frame, NULL, 1);
-    else
-      Vframe.release_log (frame);
 
+    Vframe.export_log (frame, a_file->bytes);
     retval = OK;
     goto theend;
+
+  } else if (Cstring.eq (com->bytes, "record")) {
+    if (Rline.arg.exists (rl, "stop")) {
+      Vwm.unset.recorder (vwm);
+      retval = OK;
+      goto theend;
+    }
+
+    string_t *a_file = Rline.get.anytype_arg (rl, "file");
+    if (NULL is a_file)
+      goto theend;
+
+    retval = Vwm.set.recorder (vwm, a_file->bytes);
+    goto theend;
+
+  } else if (Cstring.eq (com->bytes, "trace_dump")) {
+    string_t *a_file = Rline.get.anytype_arg (rl, "file");
+    retval = Vwm.dump_trace (vwm, (NULL is a_file ? NULL : a_file->bytes));
+    goto theend;
+
+  } else if (Cstring.eq (com->bytes, "allocations")) {
+    string_t *a_file = Rline.get.anytype_arg (rl, "file");
+    if (NULL is a_file)
+      goto theend;
+
+    retval = Vwm.dump_allocations (vwm, a_file->bytes);
+    goto theend;
+
+  } else if (Cstring.eq (com->bytes, "latency")) {
+    string_t *a_file = Rline.get.anytype_arg (rl, "file");
+    if (NULL is a_file)
+      goto theend;
+
+    retval = Vwm.dump_latency (vwm, a_file->bytes);
+    goto theend;
+
   } else if (Cstring.eq (com->bytes, "info")) {
     vwmed_get_info (this, vwm);
     retval = OK;
     goto theend;
+
+  } else if (Cstring.eq (com->bytes, "search")) {
+    string_t *a_pat  = Rline.get.anytype_arg (rl, "pattern");
+    string_t *a_jump = Rline.get.anytype_arg (rl, "jump");
+    string_t *a_max  = Rline.get.anytype_arg (rl, "max-hits");
+
+    /* the result comes later, through vwmed_search_cb() */
+    if (NULL isnot a_pat) {
+      int max_hits = (NULL is a_max ? 0 : atoi (a_max->bytes));
+      $my(search_jump) = (NULL is a_jump ? 0 : atoi (a_jump->bytes));
+      retval = Vwm.search.run (vwm, a_pat->bytes, max_hits);
+      goto theend;
+    }
+
+    if (NULL is a_jump)
+      vwmed_get_search_result (this, vwm);
+    else if (NULL isnot $my(search_result))
+      Vwm.search.jump (vwm, $my(search_result), atoi (a_jump->bytes) - 1);
+
+    retval = OK;
+    goto theend;
   }
 
 theend:
@@ -749,6 +985,22 @@ private int vwmed_init_ved (vwmed_t *this) {
   Ed.append.command_arg   ($my(ed), "frame_clear", "--clear-log=", 12);
   Ed.append.command_arg   ($my(ed), "frame_clear", "--clear-video-mem=", 18);
 
+  Ed.append.rline_command ($my(ed), "frame_export_log", 0, 0);
+  Ed.append.command_arg   ($my(ed), "frame_export_log", "--file=", 7);
+
+  Ed.append.rline_command ($my(ed), "record", 0, 0);
+  Ed.append.command_arg   ($my(ed), "record", "--file=", 7);
+  Ed.append.command_arg   ($my(ed), "record", "--stop", 6);
+
+  Ed.append.rline_command ($my(ed), "trace_dump", 0, 0);
+  Ed.append.command_arg   ($my(ed), "trace_dump", "--file=", 7);
+
+  Ed.append.rline_command ($my(ed), "allocations", 0, 0);
+  Ed.append.command_arg   ($my(ed), "allocations", "--file=", 7);
+
+  Ed.append.rline_command ($my(ed), "latency", 0, 0);
+  Ed.append.command_arg   ($my(ed), "latency", "--file=", 7);
+
   Ed.append.rline_command ($my(ed), "split_and_fork", 0, 0);
   Ed.append.command_arg   ($my(ed), "split_and_fork", "--command={", 11);
 
@@ -760,9 +1012,19 @@ private int vwmed_init_ved (vwmed_t *this) {
 
   Ed.append.rline_command ($my(ed), "set", 0, 0);
   Ed.append.command_arg   ($my(ed), "set", "--log-file=", 11);
+  Ed.append.command_arg   ($my(ed), "set", "--log-compress=", 15);
+  Ed.append.command_arg   ($my(ed), "set", "--log-max-size=", 15);
+  Ed.append.command_arg   ($my(ed), "set", "--log-segment-size=", 19);
+  Ed.append.command_arg   ($my(ed), "set", "--trace=", 8);
+  Ed.append.command_arg   ($my(ed), "set", "--allocations=", 14);
 
   Ed.append.rline_command ($my(ed), "info", 0, 0);
 
+  Ed.append.rline_command ($my(ed), "search", 0, 0);
+  Ed.append.command_arg   ($my(ed), "search", "--jump=", 7);
+  Ed.append.command_arg   ($my(ed), "search", "--pattern=", 10);
+  Ed.append.command_arg   ($my(ed), "search", "--max-hits=", 11);
+
   Ed.append.rline_command ($my(ed), "ed", 0, 0);
   if (Cstring.eq_n ("veda", Vwm.get.editor (vwm), 4)) {
     Ed.append.command_arg ($my(ed), "ed", "--exit", 6);
@@ -808,6 +1070,7 @@ private int vwmed_init_ved (vwmed_t *this) {
   Vwm.set.rline_cb (vwm, vwmed_rline_cb);
   Vwm.set.on_tab_cb (vwm, vwmed_tab_cb);
   Vwm.set.edit_file_cb (vwm, vwmed_edit_file_cb);
+  Vwm.set.search_cb (vwm, vwmed_search_cb);
 
   return OK;
 }
@@ -862,6 +1125,8 @@ public vwmed_t *__init_vwmed__ (vwm_t *vwm) {
   $my(rline_command_cbs) = NULL;
   $my(num_info_cbs) = 0;
   $my(info_cbs) = NULL;
+  $my(search_result) = NULL;
+  $my(search_jump) = 0;
 
   if (NULL is vwm)
     vwm = __init_vwm__ ();
@@ -878,6 +1143,11 @@ public void __deinit_vwmed__ (vwmed_t **thisp) {
 
   vwmed_t *this = *thisp;
 
+  Vwm.search.cancel ($my(objects)[VWM_OBJECT]);
+
+  ifnot (NULL is $my(search_result))
+    Vwm.search.release ($my(objects)[VWM_OBJECT], &$my(search_result));
+
   __deinit_this__ (&$my(__This__));
 
   if ($my(num_rline_cbs))